@@ -0,0 +1,109 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2015 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#include <vector>
+using namespace std;
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool()
+	: job_( 0 ), step_( 0 ), numBusy_( 0 ), quit_( false )
+{;}
+
+WorkerPool::WorkerPool( const WorkerPool& other )
+	: job_( 0 ), step_( 0 ), numBusy_( 0 ), quit_( false )
+{;}
+
+WorkerPool& WorkerPool::operator=( const WorkerPool& other )
+{
+	if ( this != &other )
+		stop();
+	return *this;
+}
+
+WorkerPool::~WorkerPool()
+{
+	stop();
+}
+
+unsigned int WorkerPool::numThreads() const
+{
+	return threads_.size();
+}
+
+void WorkerPool::start( unsigned int num )
+{
+	stop();
+	quit_ = false;
+	for ( unsigned int i = 0; i < num; ++i )
+		threads_.push_back( 
+			std::thread( &WorkerPool::loop, this, i, step_ ) );
+}
+
+void WorkerPool::stop()
+{
+	if ( threads_.empty() )
+		return;
+	{
+		std::lock_guard< std::mutex > guard( lock_ );
+		quit_ = true;
+	}
+	start_.notify_all();
+	for ( unsigned int i = 0; i < threads_.size(); ++i )
+		threads_[i].join();
+	threads_.clear();
+}
+
+void WorkerPool::run( unsigned int numChunks, 
+				const std::function< void( unsigned int ) >& job )
+{
+	if ( numChunks == 0 )
+		return;
+	if ( threads_.size() != numChunks - 1 )
+		start( numChunks - 1 );
+	if ( numChunks > 1 ) {
+		{
+			std::lock_guard< std::mutex > guard( lock_ );
+			job_ = &job;
+			numBusy_ = threads_.size();
+			++step_;
+		}
+		start_.notify_all();
+	}
+	job( numChunks - 1 );
+	if ( numChunks > 1 ) {
+		std::unique_lock< std::mutex > guard( lock_ );
+		while ( numBusy_ > 0 )
+			done_.wait( guard );
+		job_ = 0;
+	}
+}
+
+/**
+ * Each thread is given the step count when it starts, so it waits for
+ * the next run rather than doing one that is already over.
+ */
+void WorkerPool::loop( unsigned int me, unsigned long seen )
+{
+	for ( ; ; ) {
+		const std::function< void( unsigned int ) >* job;
+		{
+			std::unique_lock< std::mutex > guard( lock_ );
+			while ( !quit_ && step_ == seen )
+				start_.wait( guard );
+			if ( quit_ )
+				return;
+			seen = step_;
+			job = job_;
+		}
+		(*job)( me );
+		std::lock_guard< std::mutex > guard( lock_ );
+		if ( --numBusy_ == 0 )
+			done_.notify_one();
+	}
+}
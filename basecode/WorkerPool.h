@@ -0,0 +1,64 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2015 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#ifndef _WORKER_POOL_H
+#define _WORKER_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/**
+ * Worker threads for solvers that split their process into chunks: the
+ * voxels of the Ksolve and Gsolve, the cells of the HSolvePool and the
+ * voxels of a SteadyState batch. The threads are started on the first
+ * run and then wait between runs, so a tick costs two handoffs rather
+ * than starting and joining threads. In each run, worker i does chunk i
+ * and the calling thread does the last chunk.
+ *
+ * A copy starts with no threads, so the solvers can still be copied.
+ */
+class WorkerPool
+{
+	public:
+		WorkerPool();
+		WorkerPool( const WorkerPool& other );
+		WorkerPool& operator=( const WorkerPool& other );
+		~WorkerPool();
+
+		/**
+		 * Calls job( i ) for each chunk i from 0 to numChunks - 1, and
+		 * returns when all are done. Starts numChunks - 1 threads if
+		 * there is not already that number.
+		 */
+		void run( unsigned int numChunks, 
+				const std::function< void( unsigned int ) >& job );
+
+		/// Stops and joins the threads.
+		void stop();
+
+		/// Number of threads running, not counting the calling thread.
+		unsigned int numThreads() const;
+
+	private:
+		void start( unsigned int num );
+		void loop( unsigned int me, unsigned long seen );
+
+		vector< std::thread > threads_;
+		std::mutex lock_;
+		std::condition_variable start_;
+		std::condition_variable done_;
+		const std::function< void( unsigned int ) >* job_;
+		unsigned long step_;
+		unsigned int numBusy_;
+		bool quit_;
+};
+
+#endif // _WORKER_POOL_H
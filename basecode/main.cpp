@@ -208,7 +208,7 @@ Id init( int argc, char** argv, bool& doUnitTests, bool& doRegressionTests,
 				break;
 			case 'h': // help
 			default:
-				cout << "Usage: moose -help -infiniteLoop -unit_tests -regression_tests -quit -n numNodes -benchmark [ee gsl gssa intFire hhNet msg_<msgType>_<size>]\n";
+				cout << "Usage: moose -help -infiniteLoop -unit_tests -regression_tests -quit -n numNodes -benchmark [ee gsl gssa intFire hines msg_<msgType>_<size>]\n";
 
 				exit( 1 );
 		}
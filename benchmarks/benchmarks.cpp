@@ -12,6 +12,7 @@ using namespace std;
 
 void runKineticsBenchmark1( const string& method );
 void testIntFireNetwork( unsigned int runsteps );
+void runHinesBatchBenchmark( unsigned int numCells, unsigned int numSteps );
 
 void mooseBenchmarks( unsigned int option )
 {
@@ -33,6 +34,10 @@ void mooseBenchmarks( unsigned int option )
 			cout << "intFire benchmark: 104576 synapses, pconnect = 0.1, 2e5 timesteps\n";
 			testIntFireNetwork( 200000 );
 			break;
+		case 5:
+			cout << "Hines benchmark: 64 branched cells, scalar vs batched matrix solve, 20000 timesteps\n";
+			runHinesBatchBenchmark( 64, 20000 );
+			break;
 		default:
 			cout << "Unknown benchmark specified, quitting\n";
 			break;
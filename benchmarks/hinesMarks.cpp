@@ -0,0 +1,131 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2014 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#include "header.h"
+#include <ctime>
+#include "../shell/Shell.h"
+#include "../hsolve/HSolveStruct.h"
+#include "../hsolve/HinesMatrix.h"
+#include "../hsolve/HSolvePassive.h"
+#include "../hsolve/HinesBatch.h"
+
+/**
+ * Builds a cell with a soma and 4 dendrites of 8 compartments, each of
+ * which forks into 2 branches of 8 compartments: 97 compartments in all.
+ * Returns the soma.
+ */
+static Id makeBranchedCell( Id parent, const string& name, double initVm )
+{
+    Shell* shell = reinterpret_cast< Shell* >( Id().eref().data() );
+    Id cell = shell->doCreate( "Neutral", parent, name, 1 );
+    unsigned int n = 0;
+    vector< Id > tips;
+    for ( unsigned int branch = 0; branch < 13; ++branch )
+    {
+        // The soma, then the 4 dendrites, then a pair of forks for each.
+        unsigned int length = ( branch == 0 ) ? 1 : 8;
+        Id prev;
+        if ( branch > 0 && branch <= 4 )
+            prev = tips[ 0 ];
+        else if ( branch > 4 )
+            prev = tips[ 1 + ( branch - 5 ) / 2 ];
+
+        for ( unsigned int i = 0; i < length; ++i )
+        {
+            ostringstream cname;
+            cname << "c" << n++;
+            Id c = shell->doCreate( "Compartment", cell, cname.str(), 1 );
+            Field< double >::set( c, "Ra", 1e7 );
+            Field< double >::set( c, "Rm", 1e9 );
+            Field< double >::set( c, "Cm", 1e-11 );
+            Field< double >::set( c, "Em", -0.065 );
+            Field< double >::set( c, "initVm", initVm );
+            if ( prev != Id() )
+                shell->doAddMsg( "Single", prev, "axial", c, "raxial" );
+            else
+                Field< double >::set( c, "inject", 1e-10 );
+            prev = c;
+        }
+        tips.push_back( prev );
+    }
+    return Id( cell.path() + "/c0" );
+}
+
+/**
+ * Times numSteps passive steps of numCells identical branched cells,
+ * first each cell on its own as HSolvePassive does it, then with the
+ * matrices solved in HinesBatches, gather and scatter included. The two
+ * runs must leave exactly the same Vm.
+ */
+void runHinesBatchBenchmark( unsigned int numCells, unsigned int numSteps )
+{
+    Shell* shell = reinterpret_cast< Shell* >( Id().eref().data() );
+    Id model = shell->doCreate( "Neutral", Id(), "hinesBench", 1 );
+    vector< HSolvePassive > cells( numCells );
+    for ( unsigned int i = 0; i < numCells; ++i )
+    {
+        ostringstream name;
+        name << "cell" << i;
+        Id soma = makeBranchedCell( model, name.str(), -0.065 + 1e-4 * i );
+        cells[ i ].setup( soma, 50e-6 );
+    }
+    shell->doDelete( model );
+
+    vector< HinesBatch > batch;
+    for ( unsigned int i = 0; i < numCells; i += HinesBatch::LANES )
+    {
+        vector< HSolvePassive* > lanes;
+        for ( unsigned int j = i; j < numCells && j < i + HinesBatch::LANES; ++j )
+            lanes.push_back( &cells[ j ] );
+        batch.push_back( HinesBatch() );
+        batch.back().setup( lanes );
+    }
+
+    vector< vector< double > > V0( numCells );
+    for ( unsigned int i = 0; i < numCells; ++i )
+        V0[ i ] = cells[ i ].V_;
+
+    clock_t t = clock();
+    for ( unsigned int step = 0; step < numSteps; ++step )
+        for ( unsigned int i = 0; i < numCells; ++i )
+        {
+            cells[ i ].updateMatrix();
+            cells[ i ].forwardEliminate();
+            cells[ i ].backwardSubstitute();
+        }
+    double scalarTime = double( clock() - t ) / CLOCKS_PER_SEC;
+
+    vector< vector< double > > scalarV( numCells );
+    for ( unsigned int i = 0; i < numCells; ++i )
+    {
+        scalarV[ i ] = cells[ i ].V_;
+        cells[ i ].V_ = V0[ i ];
+    }
+
+    t = clock();
+    for ( unsigned int step = 0; step < numSteps; ++step )
+    {
+        for ( unsigned int i = 0; i < numCells; ++i )
+            cells[ i ].updateMatrix();
+        for ( unsigned int b = 0; b < batch.size(); ++b )
+            batch[ b ].solve();
+    }
+    double batchTime = double( clock() - t ) / CLOCKS_PER_SEC;
+
+    bool same = true;
+    for ( unsigned int i = 0; i < numCells; ++i )
+        same = same && ( cells[ i ].V_ == scalarV[ i ] );
+
+    cout << numCells << " cells of " << cells[ 0 ].nCompt_
+         << " compartments, " << numSteps << " steps\n";
+    cout << "scalar:  " << scalarTime << " s\n";
+    cout << "batched: " << batchTime << " s, " << scalarTime / batchTime
+         << " times as fast\n";
+    cout << ( same ? "Vm identical\n" : "Vm differs!\n" );
+}
@@ -10,12 +10,23 @@
 #include "header.h"
 #include "../shell/Shell.h"
 
-/// Small model, long runtime.
+/**
+ * Small model, long runtime.
+ * The "ee" method is Exponential Euler in the Ksolve, so the model is
+ * loaded with a Ksolve and its method is set afterwards.
+ */
 void runKineticsBenchmark1( const string& method )
 {
 	Shell* s = reinterpret_cast< Shell* >( ObjId().data() );
-	Id mgr = s->doLoadModel( "../Demos/Genesis_files/OSC_Cspace.g", "/model", method );
+	bool isEE = ( method == "ee" );
+	Id mgr = s->doLoadModel( "../Demos/Genesis_files/OSC_Cspace.g", 
+			"/model", isEE ? "gsl" : method );
 	assert( mgr != Id() );
+	if ( isEE ) {
+		Id ksolve( "/model/kinetics/ksolve" );
+		assert( ksolve != Id() );
+		Field< string >::set( ksolve, "method", "ee" );
+	}
 	s->doReinit();
 	s->doStart( 10000.0 );
 }
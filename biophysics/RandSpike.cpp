@@ -9,6 +9,7 @@
 
 #include "header.h"
 #include "../randnum/randnum.h"
+#include "../randnum/Philox.h"
 #include "RandSpike.h"
 
 	///////////////////////////////////////////////////////
@@ -67,6 +68,15 @@ const Cinfo* RandSpike::initCinfo()
 		&RandSpike::setRefractT,
 		&RandSpike::getRefractT
 	);
+	static ValueFinfo< RandSpike, long > seed( "seed",
+		"Seed for the random number stream of this RandSpike. Each "
+		"RandSpike has its own counter-based stream, indexed by its Id "
+		"and data index, which is restarted on reinit. If zero, the "
+		"default, a seed is drawn from the global random number "
+		"generator on each reinit.",
+		&RandSpike::setSeed,
+		&RandSpike::getSeed
+	);
 	static ReadOnlyValueFinfo< RandSpike, bool > hasFired( "hasFired",
 		"True if RandSpike has just fired",
 		&RandSpike::getFired
@@ -79,6 +89,7 @@ const Cinfo* RandSpike::initCinfo()
 		&rate,		// Value
 		&refractT,	// Value
 		&absRefract,	// Value
+		&seed,		// Value
 		&hasFired,	// ReadOnlyValue
 	};
 
@@ -111,7 +122,8 @@ RandSpike::RandSpike()
       refractT_(0.0),
       lastEvent_(0.0),
 	  threshold_(0.0),
-	  fired_( 0 )
+	  fired_( 0 ),
+	  seed_( 0 )
 {;}
 
 //////////////////////////////////////////////////////////////////
@@ -144,6 +156,16 @@ double RandSpike::getRefractT() const
 	return refractT_;
 }
 
+void RandSpike::setSeed( long seed )
+{
+	seed_ = seed;
+}
+
+long RandSpike::getSeed() const
+{
+	return seed_;
+}
+
 bool RandSpike::getFired() const
 {
 	return fired_;
@@ -159,7 +181,7 @@ void RandSpike::process( const Eref& e, ProcPtr p )
 	if ( refractT_ > p->currTime - lastEvent_ )
 		return;
 	double prob = realRate_ * p->dt;
-	if ( prob >= 1.0 || prob >= mtrand() ) 
+	if ( prob >= 1.0 || prob >= rng_.uniform() ) 
 	{
 		lastEvent_ = p->currTime;
 		spikeOut()->send( e, p->currTime );
@@ -172,11 +194,17 @@ void RandSpike::process( const Eref& e, ProcPtr p )
 // Set it so that first spike is allowed.
 void RandSpike::reinit( const Eref& e, ProcPtr p )
 {
+	uint64_t seed = seed_;
+	if ( seed_ == 0 ) // Draw from the global generator, so mtseed applies.
+		seed = ( static_cast< uint64_t >( genrand_int32() ) << 32 ) | 
+				genrand_int32();
+	rng_.setSeed( seed, 
+		( static_cast< uint64_t >( e.id().value() ) << 32 ) | e.dataIndex() );
 	if ( rate_ <= 0.0 ) {
 		lastEvent_ = 0.0;
 		realRate_ = 0.0;
 	} else {
-		double prob = mtrand();
+		double prob = rng_.uniform();
 		double m = 1.0 / rate_;
 		lastEvent_ = m * log( prob );
 	}
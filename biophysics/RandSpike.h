@@ -26,6 +26,9 @@ class RandSpike
 
         bool getFired() const;
 
+		void setSeed( long seed );
+		long getSeed() const;
+
 	//////////////////////////////////////////////////////////////////
 	// Message dest functions.
 	//////////////////////////////////////////////////////////////////
@@ -42,6 +45,8 @@ class RandSpike
 		double lastEvent_;
 		double threshold_;
 		bool fired_;
+		long seed_;
+		Philox rng_;
 };
 
 #endif // _RANDSPIKE_H
@@ -0,0 +1,202 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2014 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#include <math.h>
+#include <vector>
+#include <cassert>
+#include <stdint.h>
+using namespace std;
+#include "../randnum/Philox.h"
+#include "BinomialDiff.h"
+
+BinomialDiff::BinomialDiff()
+	: lastDt_( -1.0 )
+{;}
+
+bool BinomialDiff::buildFromTree( const vector< unsigned int >& parentVoxel,
+		const vector< double >& volume,
+		const vector< double >& area,
+		const vector< double >& length,
+		double diffConst )
+{
+	unsigned int num = parentVoxel.size();
+	vector< vector< unsigned int > > nbr( num );
+	vector< vector< double > > rate( num );
+	// Too slow to matter.
+	if ( diffConst >= 1e-18 ) {
+		for ( unsigned int i = 0; i < num; ++i ) {
+			unsigned int p = parentVoxel[i];
+			if ( p >= num ) // The root has no parent.
+				continue;
+			// Same face conductance as FastMatrixElim::buildForDiffusion
+			double g = diffConst * ( area[i] + area[p] ) /
+					( length[i] + length[p] );
+			nbr[i].push_back( p );
+			rate[i].push_back( g / volume[i] );
+			nbr[p].push_back( i );
+			rate[p].push_back( g / volume[p] );
+		}
+	}
+	finish( nbr, rate );
+	return !empty();
+}
+
+bool BinomialDiff::buildFromCube( const vector< unsigned int >& s2m,
+		unsigned int numVoxels,
+		unsigned int nx, unsigned int ny, unsigned int nz,
+		double dx, double dy, double dz,
+		double diffConst )
+{
+	vector< vector< unsigned int > > nbr( numVoxels );
+	vector< vector< double > > rate( numVoxels );
+	assert( s2m.size() == nx * ny * nz );
+	if ( diffConst >= 1e-18 ) {
+		const unsigned int stride[] = { 1, nx, nx * ny };
+		const unsigned int len[] = { nx, ny, nz };
+		const double r[] = { diffConst / ( dx * dx ),
+				diffConst / ( dy * dy ), diffConst / ( dz * dz ) };
+		for ( unsigned int q = 0; q < s2m.size(); ++q ) {
+			unsigned int a = s2m[q];
+			if ( a >= numVoxels )
+				continue;
+			// Look only in the + direction, so each face is added once.
+			for ( unsigned int axis = 0; axis < 3; ++axis ) {
+				unsigned int s = stride[ axis ];
+				if ( ( q / s ) % len[ axis ] + 1 >= len[ axis ] )
+					continue;
+				unsigned int b = s2m[ q + s ];
+				if ( b >= numVoxels )
+					continue;
+				nbr[a].push_back( b );
+				rate[a].push_back( r[ axis ] );
+				nbr[b].push_back( a );
+				rate[b].push_back( r[ axis ] );
+			}
+		}
+	}
+	finish( nbr, rate );
+	return !empty();
+}
+
+void BinomialDiff::finish( const vector< vector< unsigned int > >& nbr,
+		const vector< vector< double > >& rate )
+{
+	rowStart_.clear();
+	neighbour_.clear();
+	rate_.clear();
+	totRate_.assign( nbr.size(), 0.0 );
+	for ( unsigned int i = 0; i < nbr.size(); ++i ) {
+		rowStart_.push_back( neighbour_.size() );
+		for ( unsigned int j = 0; j < nbr[i].size(); ++j ) {
+			neighbour_.push_back( nbr[i][j] );
+			rate_.push_back( rate[i][j] );
+			totRate_[i] += rate[i][j];
+		}
+	}
+	rowStart_.push_back( neighbour_.size() );
+	lastDt_ = -1.0;
+}
+
+bool BinomialDiff::empty() const
+{
+	return neighbour_.empty();
+}
+
+void BinomialDiff::advance( vector< double >& y, unsigned int numPools,
+		double dt, Philox& rng )
+{
+	unsigned int numVoxels = totRate_.size();
+	assert( y.size() == numVoxels * numPools );
+	if ( dt != lastDt_ ) {
+		leaveProb_.resize( numVoxels );
+		for ( unsigned int i = 0; i < numVoxels; ++i )
+			leaveProb_[i] = 1.0 - exp( -totRate_[i] * dt );
+		lastDt_ = dt;
+	}
+	delta_.assign( y.size(), 0.0 );
+	for ( unsigned int i = 0; i < y.size(); ++i )
+		y[i] = floor( y[i] + 0.5 );
+
+	for ( unsigned int i = 0; i < numVoxels; ++i ) {
+		unsigned int begin = rowStart_[i];
+		unsigned int end = rowStart_[i + 1];
+		if ( begin == end )
+			continue;
+		for ( unsigned int j = 0; j < numPools; ++j ) {
+			double n = y[ i * numPools + j ];
+			if ( n <= 0.0 )
+				continue;
+			double left = sample( n, leaveProb_[i], rng );
+			if ( left <= 0.0 )
+				continue;
+			delta_[ i * numPools + j ] -= left;
+			// Split those that left among the neighbours.
+			double restRate = totRate_[i];
+			for ( unsigned int k = begin; k + 1 < end && left > 0.0; ++k ){
+				double m = sample( left, rate_[k] / restRate, rng );
+				delta_[ neighbour_[k] * numPools + j ] += m;
+				left -= m;
+				restRate -= rate_[k];
+			}
+			if ( left > 0.0 )
+				delta_[ neighbour_[ end - 1 ] * numPools + j ] += left;
+		}
+	}
+	for ( unsigned int i = 0; i < y.size(); ++i )
+		y[i] += delta_[i];
+}
+
+double BinomialDiff::sample( double n, double p, Philox& rng )
+{
+	if ( n <= 0.0 || p <= 0.0 )
+		return 0.0;
+	if ( p >= 1.0 )
+		return n;
+	if ( p > 0.5 )
+		return n - sample( n, 1.0 - p, rng );
+
+	double q = 1.0 - p;
+	if ( n * p < 10.0 ) { // Inversion, searching up from zero.
+		double s = p / q;
+		double a = ( n + 1.0 ) * s;
+		double r = pow( q, n );
+		double u = rng.uniform();
+		double k = 0.0;
+		while ( u > r && k < n ) {
+			u -= r;
+			k += 1.0;
+			r *= a / k - s;
+		}
+		return k;
+	}
+
+	double spq = sqrt( n * p * q );
+	double b = 1.15 + 2.53 * spq;
+	double a = -0.0873 + 0.0248 * b + 0.01 * p;
+	double c = n * p + 0.5;
+	double vr = 0.92 - 4.2 / b;
+	double alpha = ( 2.83 + 5.1 / b ) * spq;
+	double lpq = log( p / q );
+	double m = floor( ( n + 1.0 ) * p );
+	double h = lgamma( m + 1.0 ) + lgamma( n - m + 1.0 );
+	while ( true ) {
+		double u = rng.uniform() - 0.5;
+		double v = rng.uniform();
+		double us = 0.5 - fabs( u );
+		double k = floor( ( 2.0 * a / us + b ) * u + c );
+		if ( k < 0.0 || k > n )
+			continue;
+		if ( us >= 0.07 && v <= vr )
+			return k;
+		v = log( v * alpha / ( a / ( us * us ) + b ) );
+		if ( v <= h - lgamma( k + 1.0 ) - lgamma( n - k + 1.0 ) +
+				( k - m ) * lpq )
+			return k;
+	}
+}
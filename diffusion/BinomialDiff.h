@@ -0,0 +1,93 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2014 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#ifndef _BINOMIAL_DIFF_H
+#define _BINOMIAL_DIFF_H
+
+/**
+ * BinomialDiff does discrete stochastic diffusion, so that molecule
+ * numbers stay integral. In each timestep, each molecule in voxel i
+ * leaves with probability 1 - exp( -R_i dt ), where R_i is the sum of
+ * the jump rates to its neighbours. So the number leaving is binomial,
+ * and those that leave are split among the neighbours by successive
+ * binomials in proportion to the jump rates. All voxels use the counts
+ * at the start of the step, so no count can go negative.
+ * Molecules move at most one voxel per step, so dt should be small
+ * compared to 1/R_i for accuracy, but any dt is stable.
+ * The cost is one or two binomial samples per voxel face per pool.
+ */
+class BinomialDiff
+{
+	public:
+		BinomialDiff();
+
+		/**
+		 * Sets up jump rates on a tree of voxels as used by
+		 * FastMatrixElim, so the mean matches the deterministic
+		 * diffusion. Returns false if nothing diffuses.
+		 */
+		bool buildFromTree( const vector< unsigned int >& parentVoxel,
+				const vector< double >& volume,
+				const vector< double >& area,
+				const vector< double >& length,
+				double diffConst );
+
+		/**
+		 * Sets up jump rates on a CubeMesh, where s2m is the
+		 * spaceToMesh lookup and entries of numVoxels or more are
+		 * not in the mesh. Returns false if nothing diffuses.
+		 */
+		bool buildFromCube( const vector< unsigned int >& s2m,
+				unsigned int numVoxels,
+				unsigned int nx, unsigned int ny, unsigned int nz,
+				double dx, double dy, double dz,
+				double diffConst );
+
+		/// True if there are no faces.
+		bool empty() const;
+
+		/**
+		 * Advances y by one step of dt. y is laid out as [voxel][pool]
+		 * for numPools pools which all have this diffConst. Entries
+		 * are rounded to whole numbers first.
+		 */
+		void advance( vector< double >& y, unsigned int numPools,
+				double dt, Philox& rng );
+
+		/**
+		 * Returns a sample from the binomial distribution of n trials
+		 * with probability p. Uses inversion when the mean is small
+		 * and the BTRS rejection method of Hormann (J Stat Comput
+		 * Simul 46:101, 1993) otherwise, so the cost does not grow
+		 * with n.
+		 */
+		static double sample( double n, double p, Philox& rng );
+
+	private:
+		/// Converts the neighbour lists into the compressed rows.
+		void finish( const vector< vector< unsigned int > >& nbr,
+				const vector< vector< double > >& rate );
+
+		/// Start of each voxel's entries in neighbour_ and rate_.
+		vector< unsigned int > rowStart_;
+		vector< unsigned int > neighbour_;
+		/// Jump rate per molecule to each neighbour, 1/sec.
+		vector< double > rate_;
+		/// Sum of jump rates out of each voxel.
+		vector< double > totRate_;
+
+		/// Probability of leaving each voxel, for lastDt_.
+		vector< double > leaveProb_;
+		double lastDt_;
+
+		/// Changes in n over the step, [voxel][pool].
+		vector< double > delta_;
+};
+
+#endif // _BINOMIAL_DIFF_H
@@ -0,0 +1,149 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2014 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#include <vector>
+#include <cassert>
+using namespace std;
+#include "CubeAdi.h"
+
+CubeAdi::CubeAdi()
+	: maxLineLength_( 0 )
+{
+	r_[0] = r_[1] = r_[2] = 0.0;
+}
+
+bool CubeAdi::build( const vector< unsigned int >& s2m,
+		unsigned int numVoxels,
+		unsigned int nx, unsigned int ny, unsigned int nz,
+		double dx, double dy, double dz,
+		double diffConst, double dt )
+{
+	clear();
+	// Too slow to matter.
+	if ( diffConst < 1e-18 )
+		return false;
+	assert( s2m.size() == nx * ny * nz );
+	r_[0] = diffConst * dt / ( dx * dx );
+	r_[1] = diffConst * dt / ( dy * dy );
+	r_[2] = diffConst * dt / ( dz * dz );
+	for ( unsigned int i = 0; i < 3; ++i )
+		buildAxis( i, s2m, numVoxels, nx, ny, nz, r_[i] );
+	return !empty();
+}
+
+bool CubeAdi::empty() const
+{
+	return ( index_[0].size() + index_[1].size() + index_[2].size() == 0 );
+}
+
+void CubeAdi::clear()
+{
+	for ( unsigned int i = 0; i < 3; ++i ) {
+		index_[i].clear();
+		lineStart_[i].clear();
+		inv_[i].clear();
+		up_[i].clear();
+		r_[i] = 0.0;
+	}
+	maxLineLength_ = 0;
+}
+
+void CubeAdi::buildAxis( unsigned int axis,
+		const vector< unsigned int >& s2m, unsigned int numVoxels,
+		unsigned int nx, unsigned int ny, unsigned int nz,
+		double r )
+{
+	const unsigned int stride[] = { 1, nx, nx * ny };
+	const unsigned int len[] = { nx, ny, nz };
+	unsigned int s = stride[ axis ];
+	unsigned int n = len[ axis ];
+
+	vector< unsigned int > line;
+	for ( unsigned int q = 0; q < s2m.size(); ++q ) {
+		if ( ( q / s ) % n != 0 ) // Only start from the face of the cube.
+			continue;
+		for ( unsigned int k = 0; k <= n; ++k ) {
+			unsigned int m = ( k < n ) ? s2m[ q + k * s ] : numVoxels;
+			if ( m < numVoxels ) {
+				line.push_back( m );
+				continue;
+			}
+			// Reached a gap or the end. A lone voxel has no flux here.
+			if ( line.size() > 1 ) {
+				lineStart_[ axis ].push_back( index_[ axis ].size() );
+				// Thomas algorithm on the tridiagonal matrix with
+				// -r off the diagonal and 1 + r per neighbour on it.
+				double prevUp = 0.0;
+				for ( unsigned int i = 0; i < line.size(); ++i ) {
+					double b = 1.0 + ( i > 0 ? r : 0.0 ) +
+							( i + 1 < line.size() ? r : 0.0 );
+					double inv = 1.0 / ( b - r * prevUp );
+					prevUp = r * inv;
+					index_[ axis ].push_back( line[i] );
+					inv_[ axis ].push_back( inv );
+					up_[ axis ].push_back( prevUp );
+				}
+				if ( maxLineLength_ < line.size() )
+					maxLineLength_ = line.size();
+			}
+			line.clear();
+		}
+	}
+	lineStart_[ axis ].push_back( index_[ axis ].size() );
+}
+
+void CubeAdi::advance( vector< double >& y, unsigned int numPools )
+{
+	if ( scratch_.size() < maxLineLength_ * numPools )
+		scratch_.resize( maxLineLength_ * numPools );
+	for ( unsigned int i = 0; i < 3; ++i )
+		sweepAxis( i, y, numPools );
+}
+
+void CubeAdi::sweepAxis( unsigned int axis,
+		vector< double >& y, unsigned int numPools )
+{
+	const vector< unsigned int >& index = index_[ axis ];
+	const vector< unsigned int >& lineStart = lineStart_[ axis ];
+	const vector< double >& inv = inv_[ axis ];
+	const vector< double >& up = up_[ axis ];
+	double r = r_[ axis ];
+
+	for ( unsigned int l = 0; l + 1 < lineStart.size(); ++l ) {
+		unsigned int begin = lineStart[l];
+		unsigned int end = lineStart[l + 1];
+
+		// Forward elimination into the scratch array.
+		double* w = &scratch_[0];
+		const double* yk = &y[ index[ begin ] * numPools ];
+		for ( unsigned int j = 0; j < numPools; ++j )
+			w[j] = yk[j] * inv[ begin ];
+		for ( unsigned int p = begin + 1; p < end; ++p ) {
+			yk = &y[ index[p] * numPools ];
+			const double* wPrev = w;
+			w += numPools;
+			double iv = inv[p];
+			for ( unsigned int j = 0; j < numPools; ++j )
+				w[j] = ( yk[j] + r * wPrev[j] ) * iv;
+		}
+
+		// Backward substitution back into y.
+		double* yNext = &y[ index[ end - 1 ] * numPools ];
+		for ( unsigned int j = 0; j < numPools; ++j )
+			yNext[j] = w[j];
+		for ( unsigned int p = end - 1; p > begin; --p ) {
+			w -= numPools;
+			double* yp = &y[ index[ p - 1 ] * numPools ];
+			double u = up[ p - 1 ];
+			for ( unsigned int j = 0; j < numPools; ++j )
+				yp[j] = w[j] + u * yNext[j];
+			yNext = yp;
+		}
+	}
+}
@@ -0,0 +1,87 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2014 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#ifndef _CUBE_ADI_H
+#define _CUBE_ADI_H
+
+/**
+ * CubeAdi does implicit diffusion on a CubeMesh by splitting the 3-D
+ * operator into x, y and z parts. Each timestep does a backward Euler
+ * step along x, then y, then z. Each of these is a set of independent
+ * tridiagonal solves, one for every line of occupied voxels along that
+ * axis. A line stops at EMPTY (or any other non-mesh) entries of the
+ * spaceToMesh lookup, so no flux goes into them.
+ * Each 1-D step is unconditionally stable, keeps n positive and
+ * conserves mass, so the whole step does too, for any dt.
+ * The Thomas algorithm coefficients depend only on the geometry,
+ * diffConst and dt, so they are worked out once in build.
+ */
+class CubeAdi
+{
+	public:
+		CubeAdi();
+
+		/**
+		 * Sets up the line sweeps for a CubeMesh. s2m is the
+		 * spaceToMesh lookup, indexed as ( z * ny + y ) * nx + x.
+		 * Entries of numVoxels or more are taken as not in the mesh.
+		 * Returns false if nothing diffuses.
+		 */
+		bool build( const vector< unsigned int >& s2m,
+				unsigned int numVoxels,
+				unsigned int nx, unsigned int ny, unsigned int nz,
+				double dx, double dy, double dz,
+				double diffConst, double dt );
+
+		/// True if there are no lines to sweep.
+		bool empty() const;
+
+		/// Clears out all the lines.
+		void clear();
+
+		/**
+		 * Advances y by one timestep. y is laid out as [voxel][pool]
+		 * for numPools pools which all have this diffConst.
+		 */
+		void advance( vector< double >& y, unsigned int numPools );
+
+	private:
+		/// Finds all lines along one axis and fills in their coeffs.
+		void buildAxis( unsigned int axis,
+				const vector< unsigned int >& s2m, unsigned int numVoxels,
+				unsigned int nx, unsigned int ny, unsigned int nz,
+				double r );
+
+		/// Does the tridiagonal solves for all lines along one axis.
+		void sweepAxis( unsigned int axis,
+				vector< double >& y, unsigned int numPools );
+
+		/// Mesh indices of the voxels on each line, line after line.
+		vector< unsigned int > index_[3];
+
+		/// Start of each line in index_, with an end entry.
+		vector< unsigned int > lineStart_[3];
+
+		/// 1/pivot for each entry in index_, from the forward pass.
+		vector< double > inv_[3];
+
+		/// r * inv_, used in the backward substitution.
+		vector< double > up_[3];
+
+		/// D.dt/dx^2 for each axis.
+		double r_[3];
+
+		/// Number of voxels on the longest line.
+		unsigned int maxLineLength_;
+
+		/// Holds the forward pass values of one line, for each pool.
+		vector< double > scratch_;
+};
+
+#endif // _CUBE_ADI_H
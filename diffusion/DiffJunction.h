@@ -22,8 +22,33 @@
 class DiffJunction
 {
 	public:
+		DiffJunction()
+			: otherDsolve( 0 ), dt( -1.0 )
+		{;}
+
 		unsigned int otherDsolve;
 		vector< unsigned int > myPools;
 		vector< unsigned int > otherPools;
 		vector< VoxelJunction > vj;
+
+		/**
+		 * The rest is set up by Dsolve::setupJunction from the above,
+		 * and redone whenever dt or a diffConst changes, and on reinit.
+		 * Each voxel appears just once in myVoxels and otherVoxels, even
+		 * if it is on many vj.
+		 * The diffusing pools of each voxel are gathered into the
+		 * blocks as [voxel][pool] for the calculations.
+		 */
+		double dt;
+		vector< double > diffConst; /// Of each of myPools, at setup.
+		vector< unsigned int > myDiffPools; /// myPools that diffuse.
+		vector< unsigned int > otherDiffPools; /// Matching otherPools.
+		vector< unsigned int > myVoxels;
+		vector< unsigned int > otherVoxels;
+		vector< unsigned int > myRow; /// Index in myVoxels, for each vj.
+		vector< unsigned int > otherRow; /// Same, into otherVoxels.
+		vector< double > eqFrac; /// My share of n at steady state, per vj
+		vector< double > decay; /// Decay factor over dt, [vj][pool]
+		vector< double > myBlock;
+		vector< double > otherBlock;
 };
@@ -0,0 +1,31 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2014 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+/**
+ * DiffPoolGroup holds a set of pools in a Dsolve which have the same
+ * diffConst and motorConst. Since all pools in a Dsolve share the mesh,
+ * such pools also have identical elimination ops, so they are built
+ * once and applied to all the pools together in a single sweep.
+ * The 'block' is scratch space laid out as [voxel][pool], so that the
+ * inner loop of the sweep runs over the pools of the group.
+ * On a CubeMesh the ops are empty and the adi does the sweep instead.
+ * In the binomial method neither is used and the binomial moves whole
+ * molecules instead.
+ */
+class DiffPoolGroup
+{
+	public:
+		vector< unsigned int > pools; /// Indices into Dsolve::pools_
+		vector< Triplet< double > > ops;
+		vector< double > diagVal;
+		CubeAdi adi;
+		BinomialDiff binomial;
+		vector< double > block;
+		vector< double > start; /// block before a trapezoidal step
+};
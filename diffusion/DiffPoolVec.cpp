@@ -71,6 +71,22 @@ void DiffPoolVec::setNvec( unsigned int start, unsigned int num,
 		*p++ = *q++;
 }
 
+void DiffPoolVec::getNblock( vector< double >& block, 
+				unsigned int offset, unsigned int stride ) const
+{
+	assert( block.size() >= n_.size() * stride );
+	for ( unsigned int i = 0; i < n_.size(); ++i )
+		block[ i * stride + offset ] = n_[i];
+}
+
+void DiffPoolVec::setNblock( const vector< double >& block, 
+				unsigned int offset, unsigned int stride )
+{
+	assert( block.size() >= n_.size() * stride );
+	for ( unsigned int i = 0; i < n_.size(); ++i )
+		n_[i] = block[ i * stride + offset ];
+}
+
 double DiffPoolVec::getDiffConst() const
 {
 	return diffConst_;
@@ -112,30 +128,18 @@ unsigned int DiffPoolVec::getId() const
 	return id_;
 }
 
-void DiffPoolVec::setOps(const vector< Triplet< double > >& ops,
+void DiffPoolVec::advance( const vector< Triplet< double > >& ops,
 	const vector< double >& diagVal )
 {
-	if ( ops.size() > 0 ) {
-		assert( diagVal.size() == n_.size() );
-		ops_ = ops;
-		diagVal_ = diagVal;
-	} else {
-		ops_.clear();
-		diagVal_.clear();
-	}
-}
-
-void DiffPoolVec::advance( double dt )
-{
-	if ( ops_.size() == 0 ) return;
+	if ( ops.size() == 0 ) return;
 	for ( vector< Triplet< double > >::const_iterator
-				i = ops_.begin(); i != ops_.end(); ++i )
+				i = ops.begin(); i != ops.end(); ++i )
 		n_[i->c_] -= n_[i->b_] * i->a_;
 
-	assert( n_.size() == diagVal_.size() );
+	assert( n_.size() == diagVal.size() );
 	vector< double >::iterator iy = n_.begin();
 	for ( vector< double >::const_iterator
-				i = diagVal_.begin(); i != diagVal_.end(); ++i )
+				i = diagVal.begin(); i != diagVal.end(); ++i )
 		*iy++ *= *i;
 }
 
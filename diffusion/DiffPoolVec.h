@@ -21,7 +21,9 @@ class DiffPoolVec
 		DiffPoolVec();
 		void process();
 		void reinit();
-		void advance( double dt );
+		/// Applies the elimination ops of the pool's group to 'n'.
+		void advance( const vector< Triplet< double > >& ops,
+				const vector< double >& diagVal );
 		double getNinit( unsigned int vox ) const;
 		void setNinit( unsigned int vox, double value );
 		double getN( unsigned int vox ) const;
@@ -46,8 +48,12 @@ class DiffPoolVec
 		void setNvec( const vector< double >& n ); 
 		void setNvec( unsigned int start, unsigned int num, 
 						vector< double >::const_iterator q ); 
-		void setOps( const vector< Triplet< double > >& ops_, 
-				const vector< double >& diagVal_ ); /// Assign operations.
+		/// Copies 'n' into a [voxel][pool] block, at the given column.
+		void getNblock( vector< double >& block, 
+						unsigned int offset, unsigned int stride ) const;
+		/// Copies 'n' back out of a [voxel][pool] block.
+		void setNblock( const vector< double >& block, 
+						unsigned int offset, unsigned int stride );
 
 		// static const Cinfo* initCinfo();
 	private:
@@ -56,8 +62,6 @@ class DiffPoolVec
 		vector< double > nInit_; /// Boundary condition: Initial 'n'.
 		double diffConst_; /// Diffusion const, assumed uniform
 		double motorConst_; /// Motor const, ie, transport rate.
-		vector< Triplet< double > > ops_;
-		vector< double > diagVal_;
 };
 
 #endif // _DIFF_POOL_VEC_H
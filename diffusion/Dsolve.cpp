@@ -17,19 +17,25 @@
 #include "ZombiePoolInterface.h"
 #include "DiffPoolVec.h"
 #include "FastMatrixElim.h"
+#include "CubeAdi.h"
+#include "../randnum/Philox.h"
+#include "BinomialDiff.h"
 #include "../mesh/VoxelJunction.h"
 #include "DiffJunction.h"
+#include "DiffPoolGroup.h"
 #include "Dsolve.h"
 #include "../mesh/Boundary.h"
 #include "../mesh/MeshEntry.h"
 #include "../mesh/ChemCompt.h"
 #include "../mesh/MeshCompt.h"
+#include "../mesh/CubeMesh.h"
 #include "../shell/Wildcard.h"
 #include "../kinetics/PoolBase.h"
 #include "../kinetics/Pool.h"
 #include "../kinetics/BufPool.h"
 #include "../ksolve/ZombiePool.h"
 #include "../ksolve/ZombieBufPool.h"
+#include "../randnum/randnum.h"
 
 const Cinfo* Dsolve::initCinfo()
 {
@@ -90,6 +96,28 @@ const Cinfo* Dsolve::initCinfo()
 			&Dsolve::getCompartment
 		);
 
+		static ValueFinfo< Dsolve, string > method (
+			"method",
+			"Diffusion method. 'implicit', the default, is the "
+			"deterministic backward Euler or x/y/z sweep scheme. "
+			"'binomial' moves whole molecules between voxels, each "
+			"leaving with probability set by the jump rates to its "
+			"neighbours. Use this with a Gsolve so that n stays "
+			"integral and the diffusion noise is kept. "
+			"Motor transport is not done in binomial mode.",
+			&Dsolve::setMethod,
+			&Dsolve::getMethod
+		);
+
+		static ValueFinfo< Dsolve, long > seed (
+			"seed",
+			"Seed for the random numbers used by the 'binomial' method. "
+			"The stream is restarted on reinit. If zero, the default, "
+			"a seed is drawn from the global random number generator "
+			"on each reinit.",
+			&Dsolve::setSeed,
+			&Dsolve::getSeed
+		);
 
 		///////////////////////////////////////////////////////
 		// DestFinfo definitions
@@ -127,6 +155,8 @@ const Cinfo* Dsolve::initCinfo()
 		&numAllVoxels,			// ReadOnlyValue
 		&nVec,				// LookupValue
 		&numPools,			// Value
+		&method,			// Value
+		&seed,				// Value
 		&buildNeuroMeshJunctions, 	// DestFinfo
 		&proc,				// SharedFinfo
 	};
@@ -151,10 +181,14 @@ static const Cinfo* dsolveCinfo = Dsolve::initCinfo();
 Dsolve::Dsolve()
 	: 
 		dt_( -1.0 ),
+		spareDt_( -1.0 ),
 		numTotPools_( 0 ),
 		numLocalPools_( 0 ),
 		poolStartIndex_( 0 ),
-		numVoxels_( 0 )
+		numVoxels_( 0 ),
+		sharedState_( Id() ),
+		isStochastic_( false ),
+		seed_( 0 )
 {;}
 
 Dsolve::~Dsolve()
@@ -169,6 +203,9 @@ void Dsolve::setNvec( unsigned int pool, vector< double > vec )
 	if ( pool < pools_.size() ) {
 		if ( vec.size() != pools_[pool].getNumVoxels() ) {
 			cout << "Warning: Dsolve::setNvec: pool index out of range\n";
+		} else if ( stateOwner() ) {
+			for ( unsigned int i = 0; i < vec.size(); ++i )
+				setPoolN( pool, i, vec[i] );
 		} else {
 			pools_[ pool ].setNvec( vec );
 		}
@@ -178,41 +215,143 @@ void Dsolve::setNvec( unsigned int pool, vector< double > vec )
 vector< double > Dsolve::getNvec( unsigned int pool ) const
 {
 	static vector< double > ret;
-	if ( pool <  pools_.size() )
-		return pools_[pool].getNvec();
+	if ( pool <  pools_.size() ) {
+		if ( !stateOwner() )
+			return pools_[pool].getNvec();
+		vector< double > n( numVoxels_ );
+		for ( unsigned int i = 0; i < numVoxels_; ++i )
+			n[i] = getPoolN( pool, i );
+		return n;
+	}
 
 	cout << "Warning: Dsolve::setNvec: pool index out of range\n";
 	return ret;
 }
 
+void Dsolve::setMethod( string method )
+{
+	if ( method == "implicit" ) {
+		isStochastic_ = false;
+	} else if ( method == "binomial" ) {
+		isStochastic_ = true;
+	} else {
+		cout << "Warning: Dsolve::setMethod: method '" << method <<
+				"' not known, using 'implicit'\n";
+		isStochastic_ = false;
+	}
+	dt_ = -1.0; // Force a rebuild.
+	spareDt_ = -1.0;
+}
+
+string Dsolve::getMethod() const
+{
+	return isStochastic_ ? "binomial" : "implicit";
+}
+
+void Dsolve::setSeed( long seed )
+{
+	seed_ = seed;
+}
+
+long Dsolve::getSeed() const
+{
+	return seed_;
+}
+
 //////////////////////////////////////////////////////////////
 // Process operations.
 //////////////////////////////////////////////////////////////
 
-static double integ( double myN, double rf, double rb, double dt )
+/**
+ * Sets up the cached values for the junction. Each vj is a pair of
+ * voxels exchanging molecules at rates kf = k/firstVol and 
+ * kb = k/secondVol. Over dt this has the exact solution
+ * myN' = eq + ( myN - eq ) * exp( -(kf + kb) * dt ), where
+ * eq = ( myN + otherN ) * firstVol / ( firstVol + secondVol ).
+ */
+void Dsolve::setupJunction( DiffJunction& jn, const Dsolve* other, 
+				double dt ) const
 {
-	const double EPSILON = 1e-12;
-	if ( myN > EPSILON && rf > EPSILON ) {
-		double C = exp( -rf * dt / myN );
-		myN *= C + ( rb / rf ) * ( 1.0 - C );
-	} else {
-		myN += ( rb - rf ) * dt;
+	const double EPSILON = 1e-15;
+	jn.dt = dt;
+	jn.myDiffPools.clear();
+	jn.otherDiffPools.clear();
+
+	// The volumes may have changed since the junction was built.
+	const ChemCompt* myCompt = reinterpret_cast< const ChemCompt* >( 
+					compartment_.eref().data() );
+	const ChemCompt* otherCompt = reinterpret_cast< const ChemCompt* >( 
+					other->compartment_.eref().data() );
+	vector< double > myVols = myCompt->getVoxelVolume();
+	vector< double > otherVols = otherCompt->getVoxelVolume();
+	for ( vector< VoxelJunction >::iterator 
+		i = jn.vj.begin(); i != jn.vj.end(); ++i ) {
+		i->firstVol = myVols[i->first];
+		i->secondVol = otherVols[i->second];
+	}
+
+	jn.diffConst.resize( jn.myPools.size() );
+	vector< double > diffConst;
+	for ( unsigned int i = 0; i < jn.myPools.size(); ++i ) {
+		double d = jn.diffConst[i] = pools_[ jn.myPools[i] ].getDiffConst();
+		if ( d < EPSILON )
+			continue;
+		jn.myDiffPools.push_back( jn.myPools[i] );
+		jn.otherDiffPools.push_back( jn.otherPools[i] );
+		diffConst.push_back( d );
+	}
+	unsigned int numPools = diffConst.size();
+
+	map< unsigned int, unsigned int > myRows;
+	map< unsigned int, unsigned int > otherRows;
+	jn.myVoxels.clear();
+	jn.otherVoxels.clear();
+	jn.myRow.resize( jn.vj.size() );
+	jn.otherRow.resize( jn.vj.size() );
+	jn.eqFrac.resize( jn.vj.size() );
+	jn.decay.resize( jn.vj.size() * numPools );
+	for ( unsigned int i = 0; i < jn.vj.size(); ++i ) {
+		const VoxelJunction& v = jn.vj[i];
+		if ( myRows.find( v.first ) == myRows.end() ) {
+			myRows[ v.first ] = jn.myVoxels.size();
+			jn.myVoxels.push_back( v.first );
+		}
+		if ( otherRows.find( v.second ) == otherRows.end() ) {
+			otherRows[ v.second ] = jn.otherVoxels.size();
+			jn.otherVoxels.push_back( v.second );
+		}
+		jn.myRow[i] = myRows[ v.first ];
+		jn.otherRow[i] = otherRows[ v.second ];
+		bool ok = ( v.firstVol > 0.0 && v.secondVol > 0.0 );
+		jn.eqFrac[i] = ok ? v.firstVol / ( v.firstVol + v.secondVol ) : 0;
+		for ( unsigned int j = 0; j < numPools; ++j ) {
+			double k = diffConst[j] * v.diffScale;
+			jn.decay[ i * numPools + j ] = ok ? 
+				exp( -k * ( 1.0 / v.firstVol + 1.0 / v.secondVol ) * dt ) :
+				1.0;
+		}
 	}
-	if ( myN < 0.0 )
-		return 0.0;
-	return myN;
+}
+
+bool Dsolve::isJunctionStale( const DiffJunction& jn, double dt ) const
+{
+	if ( !doubleEq( jn.dt, dt ) || jn.diffConst.size() != jn.myPools.size() )
+		return true;
+	for ( unsigned int i = 0; i < jn.myPools.size(); ++i )
+		if ( pools_[ jn.myPools[i] ].getDiffConst() != jn.diffConst[i] )
+			return true;
+	return false;
 }
 
 /**
- * Computes flux through a junction between diffusion solvers.
- * Most used at junctions on spines and PSDs, but can also be used
- * when a given diff solver is decomposed. At present the lookups
- * on the other diffusion solver assume that the data is on the local
- * node. Once this works well I can figure out how to do across nodes.
+ * Gathers the diffusing pools on both sides of the junction, does the
+ * exact two-voxel exchange for each vj in turn, and scatters back.
+ * Each exchange only moves the pair toward their shared steady state,
+ * so this is stable for any dt, keeps n positive and conserves mass.
+ * The inner loop over pools is contiguous.
  */
-void Dsolve::calcJunction( const DiffJunction& jn, double dt )
+void Dsolve::calcJunction( DiffJunction& jn, double dt )
 {
-	const double EPSILON = 1e-15;
 	Id oid( jn.otherDsolve );
 	assert ( oid != Id() );
 	assert ( oid.element()->cinfo()->isA( "Dsolve" ) );
@@ -220,51 +359,112 @@ void Dsolve::calcJunction( const DiffJunction& jn, double dt )
 	Dsolve* other = reinterpret_cast< Dsolve* >( oid.eref().data() );
 
 	assert( jn.otherPools.size() == jn.myPools.size() );
-	for ( unsigned int i = 0; i < jn.myPools.size(); ++i ) {
-		DiffPoolVec& myDv = pools_[ jn.myPools[i] ];
-		if ( myDv.getDiffConst() < EPSILON )
-			continue;
-		DiffPoolVec& otherDv = other->pools_[ jn.otherPools[i] ];
-		for ( vector< VoxelJunction >::const_iterator
-			j = jn.vj.begin(); j != jn.vj.end(); ++j ) {
-			double myN = myDv.getN( j->first );
-			double otherN = otherDv.getN( j->second );
-			// Here we do an exp Euler calculation
-			// rf is rate from self to other.
-			double k = myDv.getDiffConst() * j->diffScale; 
-			double lastN = myN;
-			myN = integ( myN, 
-				k * myN / j->firstVol, 
-				k * otherN / j->secondVol, 
-				dt 
-			);
-			otherN += lastN - myN; // Simple mass conservation
-			if ( otherN < 0.0 ) { // Avoid negatives
-				myN += otherN;
-				otherN = 0.0;
+	if ( isJunctionStale( jn, dt ) )
+		setupJunction( jn, other, dt );
+	unsigned int numPools = jn.myDiffPools.size();
+	if ( numPools == 0 )
+		return;
+
+	getPoolBlock( jn.myVoxels, jn.myDiffPools, jn.myBlock );
+	other->getPoolBlock( jn.otherVoxels, jn.otherDiffPools, jn.otherBlock );
+	for ( unsigned int i = 0; i < jn.vj.size(); ++i ) {
+		double* myN = &jn.myBlock[ jn.myRow[i] * numPools ];
+		double* otherN = &jn.otherBlock[ jn.otherRow[i] * numPools ];
+		const double* decay = &jn.decay[ i * numPools ];
+		double f = jn.eqFrac[i];
+		if ( isStochastic_ ) {
+			// Each molecule crosses with the exact probability of 
+			// being found on the other side after dt.
+			for ( unsigned int j = 0; j < numPools; ++j ) {
+				double out = BinomialDiff::sample( floor( myN[j] + 0.5 ),
+					( 1.0 - f ) * ( 1.0 - decay[j] ), rng_ );
+				double in = BinomialDiff::sample( floor( otherN[j] + 0.5 ),
+					f * ( 1.0 - decay[j] ), rng_ );
+				myN[j] = floor( myN[j] + 0.5 ) + in - out;
+				otherN[j] = floor( otherN[j] + 0.5 ) + out - in;
 			}
-			myDv.setN( j->first, myN );
-			otherDv.setN( j->second, otherN );
+			continue;
+		}
+		for ( unsigned int j = 0; j < numPools; ++j ) {
+			double tot = myN[j] + otherN[j];
+			double eq = f * tot;
+			myN[j] = eq + ( myN[j] - eq ) * decay[j];
+			otherN[j] = tot - myN[j];
 		}
 	}
+	setPoolBlock( jn.myVoxels, jn.myDiffPools, jn.myBlock );
+	other->setPoolBlock( jn.otherVoxels, jn.otherDiffPools, jn.otherBlock );
 }
 
 void Dsolve::process( const Eref& e, ProcPtr p )
 {
-	for ( vector< DiffPoolVec >::iterator 
-					i = pools_.begin(); i != pools_.end(); ++i ) {
-		i->advance( p->dt );
+	// Non-diffusing pools have no ops and are not in any group.
+	for ( vector< DiffPoolGroup >::iterator 
+					i = groups_.begin(); i != groups_.end(); ++i ) {
+		advanceGroup( *i, false );
 	}
 
-	for ( vector< DiffJunction >::const_iterator
+	for ( vector< DiffJunction >::iterator
 			i = junctions_.begin(); i != junctions_.end(); ++i ) {
 		calcJunction( *i, p->dt );
 	}
 }
 
+void Dsolve::diffuse( double dt )
+{
+	build( dt );
+	for ( vector< DiffPoolGroup >::iterator 
+					i = groups_.begin(); i != groups_.end(); ++i ) {
+		advanceGroup( *i, false );
+	}
+	for ( vector< DiffJunction >::iterator
+			i = junctions_.begin(); i != junctions_.end(); ++i ) {
+		calcJunction( *i, dt );
+	}
+}
+
+void Dsolve::diffuseTrapezoidal( double dt )
+{
+	if ( isStochastic_ ) {
+		diffuse( dt );
+		return;
+	}
+	build( dt / 2.0 );
+	for ( vector< DiffPoolGroup >::iterator 
+					i = groups_.begin(); i != groups_.end(); ++i ) {
+		if ( i->adi.empty() ) {
+			advanceGroup( *i, true );
+		} else {
+			advanceGroup( *i, false );
+			advanceGroup( *i, false );
+		}
+	}
+	for ( vector< DiffJunction >::iterator
+			i = junctions_.begin(); i != junctions_.end(); ++i ) {
+		calcJunction( *i, dt );
+	}
+}
+
+unsigned int Dsolve::getNumJunctions() const
+{
+	return junctions_.size();
+}
+
 void Dsolve::reinit( const Eref& e, ProcPtr p )
 {
 	build( p->dt );
+	// Picks up any change in voxel volumes.
+	for ( vector< DiffJunction >::iterator
+			i = junctions_.begin(); i != junctions_.end(); ++i ) {
+		i->dt = -1.0;
+	}
+	if ( isStochastic_ ) {
+		uint64_t seed = seed_;
+		if ( seed_ == 0 ) // Draw from the global generator, so mtseed applies.
+			seed = ( static_cast< uint64_t >( genrand_int32() ) << 32 ) | 
+					genrand_int32();
+		rng_.setSeed( seed, static_cast< uint64_t >( e.id().value() ) << 32 );
+	}
 	for ( vector< DiffPoolVec >::iterator 
 					i = pools_.begin(); i != pools_.end(); ++i ) {
 		i->reinit();
@@ -318,7 +518,8 @@ void Dsolve::setCompartment( Id id )
 {
 	const Cinfo* c = id.element()->cinfo();
 	if ( c->isA( "NeuroMesh" ) || c->isA( "SpineMesh" ) || 
-					c->isA( "PsdMesh" ) || c->isA( "CylMesh" ) ) {
+					c->isA( "PsdMesh" ) || c->isA( "CylMesh" ) ||
+					c->isA( "CubeMesh" ) ) {
 		compartment_ = id;
 		numVoxels_ = Field< unsigned int >::get( id, "numMesh" );
 		/*
@@ -328,7 +529,7 @@ void Dsolve::setCompartment( Id id )
 		*/
 	} else {
 		cout << "Warning: Dsolve::setCompartment:: compartment must be "
-				"NeuroMesh or CylMesh, you tried :" << c->name() << endl;
+				"NeuroMesh, CylMesh or CubeMesh, you tried :" << c->name() << endl;
 	}
 }
 
@@ -435,17 +636,40 @@ void Dsolve::build( double dt )
 {
 	if ( doubleEq( dt, dt_ ) )
 		return;
+	if ( doubleEq( dt, spareDt_ ) ) { // Switch back to the spare ops.
+		groups_.swap( spareGroups_ );
+		spareDt_ = dt_;
+		dt_ = dt;
+		return;
+	}
 	if ( compartment_ == Id() ) {
 		cout << "Dsolve::build: Warning: No compartment defined. \n"
 				"Did you forget to assign 'stoich.dsolve = this' ?\n";
 		return;
 	}
+	// Keep the current ops as the spare, and build new ones.
+	groups_.swap( spareGroups_ );
+	spareDt_ = dt_;
 	dt_ = dt;
 	const MeshCompt* m = reinterpret_cast< const MeshCompt* >( 
 						compartment_.eref().data() );
 	unsigned int numVoxels = m->getNumEntries();
 
+	if ( compartment_.element()->cinfo()->isA( "CubeMesh" ) ) {
+		buildCubeAdi( reinterpret_cast< const CubeMesh* >( m ), dt );
+		return;
+	}
+
+	groups_.clear();
 	for ( unsigned int i = 0; i < numLocalPools_; ++i ) {
+		// Pools with the same diffConst and motorConst share the ops,
+		// so they go into an existing group rather than rebuilding them.
+		unsigned int g = findGroup( pools_[i] );
+		if ( g < groups_.size() ) {
+			pools_[i].setNumVoxels( numVoxels_ );
+			groups_[g].pools.push_back( i );
+			continue;
+		}
 		bool debugFlag = false;
 		vector< unsigned int > diagIndex;
 		vector< double > diagVal;
@@ -468,10 +692,210 @@ void Dsolve::build( double dt )
 			if (debugFlag )
 				elim.print();
 		}
-		pools_[i].setOps( fops, diagVal );
+		if ( fops.size() > 0 ) {
+			groups_.push_back( DiffPoolGroup() );
+			groups_.back().pools.push_back( i );
+			groups_.back().ops = fops;
+			groups_.back().diagVal = diagVal;
+		}
+	}
+	for ( vector< DiffPoolGroup >::iterator 
+			i = groups_.begin(); i != groups_.end(); ++i ) {
+		i->block.resize( numVoxels_ * i->pools.size() );
+		if ( isStochastic_ )
+			i->binomial.buildFromTree( m->getParentVoxel(), 
+				m->getVoxelVolume(), m->getVoxelArea(), 
+				m->getVoxelLength(), 
+				pools_[ i->pools[0] ].getDiffConst() );
+	}
+}
+
+/**
+ * CubeMesh has no parent voxel tree, so the FastMatrixElim can't be used.
+ * Instead each group of pools with the same diffConst gets a CubeAdi 
+ * which does implicit sweeps along x, y and z.
+ * The motorConst is ignored here.
+ */
+void Dsolve::buildCubeAdi( const CubeMesh* cube, double dt )
+{
+	groups_.clear();
+	vector< unsigned int > s2m = cube->getSpaceToMesh();
+	for ( unsigned int i = 0; i < numLocalPools_; ++i ) {
+		pools_[i].setNumVoxels( numVoxels_ );
+		unsigned int g = findGroup( pools_[i] );
+		if ( g < groups_.size() ) {
+			groups_[g].pools.push_back( i );
+			continue;
+		}
+		CubeAdi adi;
+		if ( adi.build( s2m, numVoxels_, 
+			cube->getNx(), cube->getNy(), cube->getNz(),
+			cube->getDx(), cube->getDy(), cube->getDz(),
+			pools_[i].getDiffConst(), dt ) ) {
+			groups_.push_back( DiffPoolGroup() );
+			groups_.back().pools.push_back( i );
+			groups_.back().adi = adi;
+		}
+	}
+	for ( vector< DiffPoolGroup >::iterator 
+			i = groups_.begin(); i != groups_.end(); ++i ) {
+		i->block.resize( numVoxels_ * i->pools.size() );
+		if ( isStochastic_ )
+			i->binomial.buildFromCube( s2m, numVoxels_, 
+				cube->getNx(), cube->getNy(), cube->getNz(),
+				cube->getDx(), cube->getDy(), cube->getDz(),
+				pools_[ i->pools[0] ].getDiffConst() );
+	}
+}
+
+unsigned int Dsolve::findGroup( const DiffPoolVec& dv ) const
+{
+	for ( unsigned int i = 0; i < groups_.size(); ++i ) {
+		const DiffPoolVec& other = pools_[ groups_[i].pools[0] ];
+		if ( dv.getDiffConst() == other.getDiffConst() && 
+			dv.getMotorConst() == other.getMotorConst() )
+			return i;
+	}
+	return groups_.size();
+}
+
+/**
+ * Advances all pools in a group together. Gathers their 'n' into the
+ * [voxel][pool] block, does a single sweep through the shared ops, and
+ * scatters the result back. With a shared state store this is a strided
+ * pass over the store that touches only the pools of the group.
+ */
+void Dsolve::advanceGroup( DiffPoolGroup& g, bool isTrapezoidal )
+{
+	unsigned int numPools = g.pools.size();
+	bool isCube = !g.adi.empty();
+	unsigned int stride = 0;
+	double* n = sharedN( stride );
+	if ( n ) {
+		double* b = &g.block[0];
+		for ( unsigned int i = 0; i < numVoxels_; ++i ) {
+			const double* s = n + i * stride;
+			for ( unsigned int j = 0; j < numPools; ++j )
+				*b++ = s[ g.pools[j] ];
+		}
+	} else if ( numPools == 1 && !isCube && !isStochastic_ && 
+					!isTrapezoidal ) {
+		pools_[ g.pools[0] ].advance( g.ops, g.diagVal );
+		return;
+	} else {
+		for ( unsigned int j = 0; j < numPools; ++j )
+			pools_[ g.pools[j] ].getNblock( g.block, j, numPools );
+	}
+
+	if ( isTrapezoidal )
+		g.start = g.block;
+
+	if ( isStochastic_ )
+		g.binomial.advance( g.block, numPools, dt_, rng_ );
+	else if ( isCube )
+		g.adi.advance( g.block, numPools );
+	else
+		FastMatrixElim::advance( g.block, numPools, g.ops, g.diagVal );
+
+	if ( isTrapezoidal ) {
+		for ( unsigned int i = 0; i < g.block.size(); ++i )
+			g.block[i] = 2.0 * g.block[i] - g.start[i];
+	}
+
+	if ( n ) {
+		const double* b = &g.block[0];
+		for ( unsigned int i = 0; i < numVoxels_; ++i ) {
+			double* s = n + i * stride;
+			for ( unsigned int j = 0; j < numPools; ++j )
+				s[ g.pools[j] ] = *b++;
+		}
+	} else {
+		for ( unsigned int j = 0; j < numPools; ++j )
+			pools_[ g.pools[j] ].setNblock( g.block, j, numPools );
+	}
+}
+
+void Dsolve::setSharedState( Id owner )
+{
+	sharedState_ = owner;
+}
+
+ZombiePoolInterface* Dsolve::stateOwner() const
+{
+	if ( sharedState_ == Id() || !sharedState_.element() )
+		return 0;
+	return reinterpret_cast< ZombiePoolInterface* >( 
+					sharedState_.eref().data() );
+}
+
+double* Dsolve::sharedN( unsigned int& stride ) const
+{
+	ZombiePoolInterface* owner = stateOwner();
+	if ( !owner )
+		return 0;
+	assert( owner->getNumLocalVoxels() == numVoxels_ );
+	return owner->stateBlock( stride );
+}
+
+void Dsolve::getPoolBlock( const vector< unsigned int >& voxels,
+		const vector< unsigned int >& pools, vector< double >& block ) const
+{
+	unsigned int numPools = pools.size();
+	block.resize( voxels.size() * numPools );
+	unsigned int stride = 0;
+	const double* n = sharedN( stride );
+	for ( unsigned int i = 0; i < voxels.size(); ++i ) {
+		double* b = &block[ i * numPools ];
+		if ( n ) {
+			const double* s = n + voxels[i] * stride;
+			for ( unsigned int j = 0; j < numPools; ++j )
+				b[j] = s[ pools[j] ];
+		} else {
+			for ( unsigned int j = 0; j < numPools; ++j )
+				b[j] = pools_[ pools[j] ].getN( voxels[i] );
+		}
+	}
+}
+
+void Dsolve::setPoolBlock( const vector< unsigned int >& voxels,
+		const vector< unsigned int >& pools, const vector< double >& block )
+{
+	unsigned int numPools = pools.size();
+	assert( block.size() == voxels.size() * numPools );
+	unsigned int stride = 0;
+	double* n = sharedN( stride );
+	for ( unsigned int i = 0; i < voxels.size(); ++i ) {
+		const double* b = &block[ i * numPools ];
+		if ( n ) {
+			double* s = n + voxels[i] * stride;
+			for ( unsigned int j = 0; j < numPools; ++j )
+				s[ pools[j] ] = b[j];
+		} else {
+			for ( unsigned int j = 0; j < numPools; ++j )
+				pools_[ pools[j] ].setN( voxels[i], b[j] );
+		}
 	}
 }
 
+double Dsolve::getPoolN( unsigned int pool, unsigned int voxel ) const
+{
+	unsigned int stride = 0;
+	const double* n = sharedN( stride );
+	if ( n )
+		return n[ voxel * stride + pool ];
+	return pools_[ pool ].getN( voxel );
+}
+
+void Dsolve::setPoolN( unsigned int pool, unsigned int voxel, double v )
+{
+	unsigned int stride = 0;
+	double* n = sharedN( stride );
+	if ( n )
+		n[ voxel * stride + pool ] = v;
+	else
+		pools_[ pool ].setN( voxel, v );
+}
+
 /**
  * Should be called only from the Dsolve handling the NeuroMesh.
  */
@@ -587,7 +1011,7 @@ void Dsolve::setN( const Eref& e, double v )
 		return;
 	unsigned int vox = e.dataIndex();
 	if ( vox < numVoxels_ ) {
-		pools_[ pid ].setN( vox, v );
+		setPoolN( pid, vox, v );
 		return;
 	}
 	cout << "Warning: Dsolve::setN: Eref " << e << " out of range " <<
@@ -600,7 +1024,7 @@ double Dsolve::getN( const Eref& e ) const
 	if ( pid >= pools_.size() ) return 0.0; // ignore silently
 	unsigned int vox = e.dataIndex();
 	if ( vox <  numVoxels_ ) {
-		return pools_[ pid ].getN( vox );
+		return getPoolN( pid, vox );
 	}
 	cout << "Warning: Dsolve::setN: Eref " << e << " out of range " <<
 			pools_.size() << ", " << numVoxels_ << "\n";
@@ -664,6 +1088,10 @@ void Dsolve::setNumPools( unsigned int numPoolSpecies )
 	numTotPools_ = numPoolSpecies;
 	numLocalPools_ = numPoolSpecies;
 	poolStartIndex_ = 0;
+	groups_.clear(); // Pool indices may change, so force a rebuild.
+	spareGroups_.clear();
+	dt_ = -1.0;
+	spareDt_ = -1.0;
 
 	pools_.resize( numLocalPools_ );
 	for ( unsigned int i = 0 ; i < numLocalPools_; ++i ) {
@@ -691,14 +1119,13 @@ void Dsolve::getBlock( vector< double >& values ) const
 	assert( numPools + startPool <= numLocalPools_ );
 	values.resize( 4 );
 
+	// Goes through getPoolN, as the n may be in a shared state.
 	for ( unsigned int i = 0; i < numPools; ++i ) {
 		unsigned int j = i + startPool;
 		if ( j >= poolStartIndex_ && j < poolStartIndex_ + numLocalPools_ ){
-			vector< double >::const_iterator q =
-				pools_[ j - poolStartIndex_ ].getNvec().begin();
-				
-			values.insert( values.end(),
-				q + startVoxel, q + startVoxel + numVoxels );
+			for ( unsigned int k = 0; k < numVoxels; ++k )
+				values.push_back( 
+					getPoolN( j - poolStartIndex_, startVoxel + k ) );
 		}
 	}
 }
@@ -718,9 +1145,9 @@ void Dsolve::setBlock( const vector< double >& values )
 	for ( unsigned int i = 0; i < numPools; ++i ) {
 		unsigned int j = i + startPool;
 		if ( j >= poolStartIndex_ && j < poolStartIndex_ + numLocalPools_ ){
-			vector< double >::const_iterator 
-				q = values.begin() + 4 + i * numVoxels;
-			pools_[ j - poolStartIndex_ ].setNvec( startVoxel, numVoxels, q );
+			const double* q = &values[ 4 + i * numVoxels ];
+			for ( unsigned int k = 0; k < numVoxels; ++k )
+				setPoolN( j - poolStartIndex_, startVoxel + k, q[k] );
 		}
 	}
 }
@@ -10,6 +10,8 @@
 #ifndef _DSOLVE_H
 #define _DSOLVE_H
 
+class CubeMesh;
+
 /**
  * The Dsolve manages a large number of pools, each inhabiting a large
  * number of voxels that are shared for all the pools. 
@@ -53,6 +55,37 @@ class Dsolve: public ZombiePoolInterface
 		vector< double > getNvec( unsigned int pool ) const;
 		void setNvec( unsigned int pool, vector< double > vec );
 
+		/// Either "implicit" or "binomial".
+		void setMethod( string method );
+		string getMethod() const;
+		void setSeed( long seed );
+		long getSeed() const;
+
+		/// Inherited virtual. Diffuse the state store of owner in place.
+		void setSharedState( Id owner );
+
+		/**
+		 * Advances diffusion by dt, including the junctions. Rebuilds 
+		 * the ops first if dt differs from the last two builds. Used by
+		 * ReacDiff to take split steps.
+		 */
+		void diffuse( double dt );
+
+		/**
+		 * As diffuse, but a Crank-Nicolson step, second order in dt.
+		 * Uses the backward Euler ops for dt/2: if y is the backward
+		 * Euler step of dt/2 from n, the Crank-Nicolson step of dt is
+		 * 2y - n. This is stable at any dt, but large steps can ring
+		 * and take n below zero. Only the pools on a tree mesh get it:
+		 * CubeMesh pools take two backward Euler steps of dt/2, the
+		 * binomial method just does its usual step, and the junctions
+		 * are already exact.
+		 */
+		void diffuseTrapezoidal( double dt );
+
+		/// Number of junctions to other Dsolves.
+		unsigned int getNumJunctions() const;
+
 		//////////////////////////////////////////////////////////////////
 		// Dest Finfos
 		//////////////////////////////////////////////////////////////////
@@ -88,7 +121,17 @@ class Dsolve: public ZombiePoolInterface
 		 * local node. Once this works well I can figure out how to do
 		 * across nodes.
 		 */
-		void calcJunction( const DiffJunction& jn, double dt );
+		void calcJunction( DiffJunction& jn, double dt );
+
+		/**
+		 * Fills in the cached junction values used by calcJunction, 
+		 * using the current voxel volumes of both compartments.
+		 */
+		void setupJunction( DiffJunction& jn, const Dsolve* other,
+						double dt ) const;
+
+		/// True if the cached values of jn are out of date for dt.
+		bool isJunctionStale( const DiffJunction& jn, double dt ) const;
 		//////////////////////////////////////////////////////////////////
 		// Inherited virtual funcs from ZombiePoolInterface
 		//////////////////////////////////////////////////////////////////
@@ -142,6 +185,43 @@ class Dsolve: public ZombiePoolInterface
 		void build( double dt );
 		void rebuildPools();
 
+		/// Sets up the implicit x/y/z sweeps used in a CubeMesh.
+		void buildCubeAdi( const CubeMesh* cube, double dt );
+
+		/**
+		 * Returns index of the group whose pools have the same 
+		 * diffConst and motorConst as dv, or groups_.size() if none.
+		 */
+		unsigned int findGroup( const DiffPoolVec& dv ) const;
+
+		/**
+		 * Advances all the pools of a group in one sweep. With 
+		 * isTrapezoidal, does the 2y - n step of diffuseTrapezoidal.
+		 */
+		void advanceGroup( DiffPoolGroup& g, bool isTrapezoidal );
+
+		/// Returns the reac solver whose state we share, or 0 if none.
+		ZombiePoolInterface* stateOwner() const;
+
+		/**
+		 * Returns the shared state store of the reac solver, laid out
+		 * as n[ voxel * stride + pool ], or 0 if none.
+		 */
+		double* sharedN( unsigned int& stride ) const;
+
+		/// n of a pool in a voxel, from the shared state if there is one.
+		double getPoolN( unsigned int pool, unsigned int voxel ) const;
+		void setPoolN( unsigned int pool, unsigned int voxel, double v );
+
+		/// Gathers n of the pools in the voxels, as block[voxel][pool].
+		void getPoolBlock( const vector< unsigned int >& voxels,
+			const vector< unsigned int >& pools, 
+			vector< double >& block ) const;
+		/// Scatters the block back into the pools.
+		void setPoolBlock( const vector< unsigned int >& voxels,
+			const vector< unsigned int >& pools, 
+			const vector< double >& block );
+
 		/**
 		 * Utility func for debugging: Prints N_ matrix
 		 */
@@ -157,6 +237,9 @@ class Dsolve: public ZombiePoolInterface
 		/// Timestep used by diffusion calculations.
 		double dt_;
 
+		/// Timestep of spareGroups_. -1 if there are none.
+		double spareDt_;
+
 		unsigned int numTotPools_;
 		unsigned int numLocalPools_;
 		unsigned int poolStartIndex_;
@@ -165,6 +248,20 @@ class Dsolve: public ZombiePoolInterface
 		/// Internal vector, one for each pool species managed by Dsolve.
 		vector< DiffPoolVec > pools_;
 
+		/**
+		 * Groups of diffusing pools which share the same ops. Built
+		 * along with the ops, and used in process to advance all the
+		 * pools of each group together.
+		 */
+		vector< DiffPoolGroup > groups_;
+
+		/**
+		 * The groups from the build before last, kept for when dt
+		 * switches back. ReacDiff checking its error alternates between
+		 * two dts, which would otherwise rebuild the ops twice a step.
+		 */
+		vector< DiffPoolGroup > spareGroups_;
+
 		/// smallest Id value for poolMap_
 		unsigned int poolMapStart_;
 
@@ -177,6 +274,22 @@ class Dsolve: public ZombiePoolInterface
 		 * numerical integration for flux between the Dsolves.
 		 */
 		vector< DiffJunction > junctions_;
+
+		/**
+		 * The Ksolve or Gsolve whose state store holds the pool n.
+		 * When assigned, the Dsolve diffuses the store in place and its 
+		 * own DiffPoolVec n values are not used. Id() if not shared.
+		 */
+		Id sharedState_;
+
+		/// True for binomial stochastic diffusion, false for implicit.
+		bool isStochastic_;
+
+		/// Seed for rng_. 0 means draw one from the global generator.
+		long seed_;
+
+		/// Random numbers for binomial diffusion, restarted on reinit.
+		Philox rng_;
 };
 
 
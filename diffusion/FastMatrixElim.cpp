@@ -485,6 +485,30 @@ void FastMatrixElim::advance( vector< double >& y,
 		*iy++ *= *i;
 }
 
+// Static function.
+void FastMatrixElim::advance( vector< double >& y, unsigned int numPools,
+		const vector< Triplet< double > >& ops, // has both fops and bops.
+		const vector< double >& diagVal )
+{
+	assert( y.size() == diagVal.size() * numPools );
+	for ( vector< Triplet< double > >::const_iterator
+				i = ops.begin(); i != ops.end(); ++i ) {
+		double* c = &y[ i->c_ * numPools ];
+		const double* b = &y[ i->b_ * numPools ];
+		double a = i->a_;
+		for ( unsigned int j = 0; j < numPools; ++j )
+			c[j] -= b[j] * a;
+	}
+
+	double* py = &y[0];
+	for ( vector< double >::const_iterator
+				i = diagVal.begin(); i != diagVal.end(); ++i ) {
+		double d = *i;
+		for ( unsigned int j = 0; j < numPools; ++j )
+			*py++ *= d;
+	}
+}
+
 /**
  * static function. Reorders the ops and diagVal vectors so as to restore
  * the original indexing of the input vectors.
@@ -109,6 +109,17 @@ class FastMatrixElim: public SparseMatrix< double >
 		static void advance( vector< double >& y,
 			const vector< Triplet< double > >& ops, //has both fops and bops
 			const vector< double >& diagVal );
+
+		/**
+		 * Block version of advance. Here y is laid out as
+		 * [voxel][pool] for numPools pools which share the same ops
+		 * and diagVal. Each op is loaded once and applied across all
+		 * the pools, and the inner loop is contiguous so the compiler
+		 * can vectorize it.
+		 */
+		static void advance( vector< double >& y, unsigned int numPools,
+			const vector< Triplet< double > >& ops,
+			const vector< double >& diagVal );
 };
 
 void sortByColumn( 
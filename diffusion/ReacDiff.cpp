@@ -0,0 +1,330 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2014 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#include "header.h"
+#include "SparseMatrix.h"
+#include "KinSparseMatrix.h"
+#include "VoxelPoolsBase.h"
+#include "../mesh/VoxelJunction.h"
+#include "XferInfo.h"
+#include "ZombiePoolInterface.h"
+#include "DiffPoolVec.h"
+#include "FastMatrixElim.h"
+#include "CubeAdi.h"
+#include "../randnum/Philox.h"
+#include "BinomialDiff.h"
+#include "DiffJunction.h"
+#include "DiffPoolGroup.h"
+#include "Dsolve.h"
+#include "ReacDiff.h"
+
+const Cinfo* ReacDiff::initCinfo()
+{
+		///////////////////////////////////////////////////////
+		// Field definitions
+		///////////////////////////////////////////////////////
+
+		static ValueFinfo< ReacDiff, Id > ksolve (
+			"ksolve",
+			"Reaction solver, either a Ksolve or a Gsolve. Should not "
+			"be scheduled itself, as the ReacDiff advances it.",
+			&ReacDiff::setKsolve,
+			&ReacDiff::getKsolve
+		);
+
+		static ValueFinfo< ReacDiff, Id > dsolve (
+			"dsolve",
+			"Diffusion solver for the same reaction system. Should not "
+			"be scheduled itself, as the ReacDiff advances it.",
+			&ReacDiff::setDsolve,
+			&ReacDiff::getDsolve
+		);
+
+		static ValueFinfo< ReacDiff, string > splitting (
+			"splitting",
+			"Operator splitting between reaction and diffusion. "
+			"'lie': full diffusion step, then full reaction step. "
+			"First order in dt. "
+			"'strang': half diffusion step, full reaction step, then "
+			"half diffusion step. The half steps are Crank-Nicolson, "
+			"so with a second order reaction method the whole step is "
+			"second order in dt, and dt can be several times larger "
+			"for the same error. Pools on a CubeMesh and binomial "
+			"diffusion stay first order. Default.",
+			&ReacDiff::setSplitting,
+			&ReacDiff::getSplitting
+		);
+
+		static ValueFinfo< ReacDiff, unsigned int > errorCheckInterval (
+			"errorCheckInterval",
+			"Number of steps between estimates of the splitting error. "
+			"Each estimate redoes the step as two half steps, so "
+			"it costs about two more steps. 0 turns it off. Default 0. "
+			"Only done when the reaction solver is a Ksolve, as a Gsolve "
+			"cannot be rewound to redo the step, and when neither solver "
+			"talks to other compartments. Reinit warns if it is set "
+			"but cannot be done.",
+			&ReacDiff::setErrorCheckInterval,
+			&ReacDiff::getErrorCheckInterval
+		);
+
+		static ReadOnlyValueFinfo< ReacDiff, double > splittingError (
+			"splittingError",
+			"Latest estimate of the relative error of one step: the RMS "
+			"difference between a step of dt and two steps of dt/2, "
+			"divided by the RMS of n over all pools and voxels.",
+			&ReacDiff::getSplittingError
+		);
+
+		///////////////////////////////////////////////////////
+		// DestFinfo definitions
+		///////////////////////////////////////////////////////
+
+		static DestFinfo process( "process",
+			"Handles process call",
+			new ProcOpFunc< ReacDiff >( &ReacDiff::process ) );
+		static DestFinfo reinit( "reinit",
+			"Handles reinit call",
+			new ProcOpFunc< ReacDiff >( &ReacDiff::reinit ) );
+
+		///////////////////////////////////////////////////////
+		// Shared definitions
+		///////////////////////////////////////////////////////
+		static Finfo* procShared[] = {
+			&process, &reinit
+		};
+		static SharedFinfo proc( "proc",
+			"Shared message for process and reinit",
+			procShared, sizeof( procShared ) / sizeof( const Finfo* )
+		);
+
+	static Finfo* reacDiffFinfos[] =
+	{
+		&ksolve,			// Value
+		&dsolve,			// Value
+		&splitting,			// Value
+		&errorCheckInterval,	// Value
+		&splittingError,	// ReadOnlyValue
+		&proc,				// SharedFinfo
+	};
+
+	static Dinfo< ReacDiff > dinfo;
+	static  Cinfo reacDiffCinfo(
+		"ReacDiff",
+		Neutral::initCinfo(),
+		reacDiffFinfos,
+		sizeof(reacDiffFinfos)/sizeof(Finfo *),
+		&dinfo
+	);
+
+	return &reacDiffCinfo;
+}
+
+static const Cinfo* reacDiffCinfo = ReacDiff::initCinfo();
+
+//////////////////////////////////////////////////////////////
+// Class definitions
+//////////////////////////////////////////////////////////////
+ReacDiff::ReacDiff()
+	:
+		ksolve_( Id() ),
+		dsolve_( Id() ),
+		isStrang_( true ),
+		errorCheckInterval_( 0 ),
+		numSteps_( 0 ),
+		splittingError_( 0.0 )
+{;}
+
+//////////////////////////////////////////////////////////////
+// Field access functions
+//////////////////////////////////////////////////////////////
+
+void ReacDiff::setKsolve( Id ksolve )
+{
+	if ( ksolve == Id() || ksolve.element()->cinfo()->isA( "Ksolve" ) ||
+		ksolve.element()->cinfo()->isA( "Gsolve" ) ) {
+		ksolve_ = ksolve;
+	} else {
+		cout << "Warning: ReacDiff::setKsolve: Object '" << ksolve.path() <<
+				"' should be class Ksolve or Gsolve, is: " <<
+				ksolve.element()->cinfo()->name() << endl;
+	}
+}
+
+Id ReacDiff::getKsolve() const
+{
+	return ksolve_;
+}
+
+void ReacDiff::setDsolve( Id dsolve )
+{
+	if ( dsolve == Id() || dsolve.element()->cinfo()->isA( "Dsolve" ) ) {
+		dsolve_ = dsolve;
+	} else {
+		cout << "Warning: ReacDiff::setDsolve: Object '" << dsolve.path() <<
+				"' should be class Dsolve, is: " <<
+				dsolve.element()->cinfo()->name() << endl;
+	}
+}
+
+Id ReacDiff::getDsolve() const
+{
+	return dsolve_;
+}
+
+void ReacDiff::setSplitting( string method )
+{
+	if ( method == "strang" || method == "Strang" ) {
+		isStrang_ = true;
+	} else if ( method == "lie" || method == "Lie" ) {
+		isStrang_ = false;
+	} else {
+		cout << "Warning: ReacDiff::setSplitting: method '" << method <<
+				"' not known, using 'strang'\n";
+		isStrang_ = true;
+	}
+}
+
+string ReacDiff::getSplitting() const
+{
+	return isStrang_ ? "strang" : "lie";
+}
+
+void ReacDiff::setErrorCheckInterval( unsigned int v )
+{
+	errorCheckInterval_ = v;
+}
+
+unsigned int ReacDiff::getErrorCheckInterval() const
+{
+	return errorCheckInterval_;
+}
+
+double ReacDiff::getSplittingError() const
+{
+	return splittingError_;
+}
+
+ZombiePoolInterface* ReacDiff::ksolvePtr() const
+{
+	if ( ksolve_ == Id() || !ksolve_.element() )
+		return 0;
+	return reinterpret_cast< ZombiePoolInterface* >(
+					ksolve_.eref().data() );
+}
+
+Dsolve* ReacDiff::dsolvePtr() const
+{
+	if ( dsolve_ == Id() || !dsolve_.element() )
+		return 0;
+	return reinterpret_cast< Dsolve* >( dsolve_.eref().data() );
+}
+
+//////////////////////////////////////////////////////////////
+// Process operations.
+//////////////////////////////////////////////////////////////
+
+void ReacDiff::advance( ProcPtr p )
+{
+	ZombiePoolInterface* k = ksolvePtr();
+	Dsolve* d = dsolvePtr();
+	if ( isStrang_ ) {
+		d->diffuseTrapezoidal( p->dt / 2.0 );
+		k->process( ksolve_.eref(), p );
+		d->diffuseTrapezoidal( p->dt / 2.0 );
+	} else {
+		d->diffuse( p->dt );
+		k->process( ksolve_.eref(), p );
+	}
+}
+
+/**
+ * A Gsolve keeps propensities and random number state that setBlock
+ * does not rewind, so the check only works for a Ksolve. Redoing a step
+ * would also upset any other compartments the solvers talk to.
+ */
+bool ReacDiff::canCheckError() const
+{
+	ZombiePoolInterface* k = ksolvePtr();
+	Dsolve* d = dsolvePtr();
+	return ksolve_.element()->cinfo()->isA( "Ksolve" ) &&
+		k->getNumXfer() == 0 && d->getNumJunctions() == 0;
+}
+
+void ReacDiff::getState( vector< double >& values ) const
+{
+	ZombiePoolInterface* k = ksolvePtr();
+	values.resize( 4 );
+	values[0] = 0;
+	values[1] = k->getNumLocalVoxels();
+	values[2] = 0;
+	values[3] = k->getNumPools();
+	k->getBlock( values );
+}
+
+void ReacDiff::process( const Eref& e, ProcPtr p )
+{
+	ZombiePoolInterface* k = ksolvePtr();
+	Dsolve* d = dsolvePtr();
+	if ( !k || !d )
+		return;
+	++numSteps_;
+	if ( errorCheckInterval_ == 0 || numSteps_ % errorCheckInterval_ != 0 ||
+		!canCheckError() ) {
+		advance( p );
+		return;
+	}
+
+	// Do the step at dt, keep the answer, then redo it as two half steps
+	// from the same start. The half step answer is the one kept.
+	vector< double > start;
+	vector< double > full;
+	vector< double > half;
+	getState( start );
+	advance( p );
+	getState( full );
+	k->setBlock( start );
+
+	ProcInfo halfStep = *p;
+	halfStep.dt = p->dt / 2.0;
+	halfStep.currTime = p->currTime - halfStep.dt;
+	advance( &halfStep );
+	halfStep.currTime = p->currTime;
+	advance( &halfStep );
+	getState( half );
+
+	double diffSq = 0.0;
+	double nSq = 0.0;
+	for ( unsigned int i = 4; i < half.size(); ++i ) {
+		double x = full[i] - half[i];
+		diffSq += x * x;
+		nSq += half[i] * half[i];
+	}
+	splittingError_ = ( nSq > 0.0 ) ? sqrt( diffSq / nSq ) : 0.0;
+}
+
+void ReacDiff::reinit( const Eref& e, ProcPtr p )
+{
+	numSteps_ = 0;
+	splittingError_ = 0.0;
+	ZombiePoolInterface* k = ksolvePtr();
+	Dsolve* d = dsolvePtr();
+	if ( !k || !d ) {
+		cout << "Warning: ReacDiff::reinit: ksolve and dsolve must both "
+				"be assigned\n";
+		return;
+	}
+	d->reinit( dsolve_.eref(), p );
+	k->reinit( ksolve_.eref(), p );
+	if ( errorCheckInterval_ > 0 && !canCheckError() )
+		cout << "Warning: ReacDiff::reinit: " << e.id().path() << 
+			": errorCheckInterval is set, but the error cannot be checked "
+			"for a Gsolve, or when the solvers talk to other compartments. "
+			"splittingError will stay 0.\n";
+}
@@ -0,0 +1,94 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2014 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#ifndef _REAC_DIFF_H
+#define _REAC_DIFF_H
+
+/**
+ * ReacDiff drives a reaction solver (Ksolve or Gsolve) and its Dsolve
+ * through each timestep, so that the operator splitting between them
+ * can be chosen.
+ * With 'lie' splitting each step is a full diffusion step followed by
+ * a full reaction step, which is what separately scheduled solvers do.
+ * With 'strang' splitting each step is a half diffusion step, a full
+ * reaction step and another half diffusion step. The half steps are
+ * Crank-Nicolson (Dsolve::diffuseTrapezoidal), so given a second order
+ * reaction method the whole step is second order in dt.
+ * The ReacDiff must be the only one scheduled: the reac solver and
+ * Dsolve should not have clocks of their own.
+ *
+ * Every errorCheckInterval steps, the step is done twice: once at dt
+ * and once as two steps of dt/2. The RMS difference between the two,
+ * relative to the RMS of n, is reported as splittingError. This also
+ * includes the time error of the solvers themselves, which is fine
+ * when picking a dt. The check is skipped if either solver talks to
+ * other compartments, as redoing the step would then upset them, and
+ * for a Gsolve, whose stochastic state cannot be rewound. Reinit warns
+ * when that happens.
+ */
+class ReacDiff
+{
+	public:
+		ReacDiff();
+
+		//////////////////////////////////////////////////////////////////
+		// Field assignment stuff
+		//////////////////////////////////////////////////////////////////
+		void setKsolve( Id ksolve );
+		Id getKsolve() const;
+		void setDsolve( Id dsolve );
+		Id getDsolve() const;
+
+		/// Either "lie" or "strang".
+		void setSplitting( string method );
+		string getSplitting() const;
+
+		void setErrorCheckInterval( unsigned int v );
+		unsigned int getErrorCheckInterval() const;
+
+		double getSplittingError() const;
+
+		//////////////////////////////////////////////////////////////////
+		// Dest Finfos
+		//////////////////////////////////////////////////////////////////
+		void process( const Eref& e, ProcPtr p );
+		void reinit( const Eref& e, ProcPtr p );
+
+		//////////////////////////////////////////////////////////////////
+		static const Cinfo* initCinfo();
+	private:
+		/// Does one split step of p->dt, ending at p->currTime.
+		void advance( ProcPtr p );
+
+		/// True if the step can be redone to estimate the error.
+		bool canCheckError() const;
+
+		/// Copies out the n of all the pools in the reac solver.
+		void getState( vector< double >& values ) const;
+
+		ZombiePoolInterface* ksolvePtr() const;
+		Dsolve* dsolvePtr() const;
+
+		Id ksolve_;
+		Id dsolve_;
+
+		/// True for Strang splitting, false for Lie.
+		bool isStrang_;
+
+		/// Number of steps between error checks. 0 means never.
+		unsigned int errorCheckInterval_;
+
+		/// Steps since reinit.
+		unsigned int numSteps_;
+
+		/// Most recent error estimate.
+		double splittingError_;
+};
+
+#endif	// _REAC_DIFF_H
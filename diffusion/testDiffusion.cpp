@@ -22,6 +22,13 @@ using namespace std;
 #include "header.h"
 #include "../basecode/SparseMatrix.h"
 #include "FastMatrixElim.h"
+#include "CubeAdi.h"
+#include "../randnum/Philox.h"
+#include "BinomialDiff.h"
+#include "../ksolve/VoxelPoolsBase.h"
+#include "../mesh/VoxelJunction.h"
+#include "../ksolve/XferInfo.h"
+#include "../ksolve/ZombiePoolInterface.h"
 #include "../shell/Shell.h"
 
 
@@ -224,6 +231,23 @@ Linear cable, 12 segments.
 
 	assert(	checkAns( &alle[0], numCompts, &y[0], &ones[0] ) < 1e-25 );
 
+	// Block advance over several pools should match doing them singly.
+	const unsigned int numPools = 3;
+	vector< double > block( numCompts * numPools );
+	vector< vector< double > > single( numPools );
+	for ( unsigned int j = 0; j < numPools; ++j ) {
+		for ( unsigned int i = 0; i < numCompts; ++i ) {
+			double v = 1.0 + i + j * 0.5;
+			single[j].push_back( v );
+			block[ i * numPools + j ] = v;
+		}
+		FastMatrixElim::advance( single[j], fops, diagVal );
+	}
+	FastMatrixElim::advance( block, numPools, fops, diagVal );
+	for ( unsigned int j = 0; j < numPools; ++j )
+		for ( unsigned int i = 0; i < numCompts; ++i )
+			assert( doubleEq( block[ i * numPools + j ], single[j][i] ) );
+
 	/////////////////////////////////////////////////////////////////////
 	// Here we do the gsl test.
 	vector< double > temp( &test[0], &test[numCompts*numCompts] );
@@ -249,6 +273,113 @@ Linear cable, 12 segments.
 	cout << "." << flush;
 }
 
+/**
+ * Checks the CubeAdi on a line against the backward Euler equations,
+ * and then on a 3-D mesh with holes for mass conservation and for
+ * settling to uniform n.
+ */
+void testCubeAdi()
+{
+	const unsigned int nx = 5;
+	const double r = 0.7;
+	vector< unsigned int > s2m;
+	for ( unsigned int i = 0; i < nx; ++i )
+		s2m.push_back( i );
+	CubeAdi line;
+	assert( line.build( s2m, nx, nx, 1, 1, 1.0, 1.0, 1.0, r, 1.0 ) );
+	vector< double > y0;
+	for ( unsigned int i = 0; i < nx; ++i )
+		y0.push_back( i + 1.0 );
+	vector< double > y = y0;
+	line.advance( y, 1 );
+	for ( unsigned int i = 0; i < nx; ++i ) {
+		double lhs = y[i];
+		if ( i > 0 )
+			lhs += r * ( y[i] - y[i-1] );
+		if ( i < nx - 1 )
+			lhs += r * ( y[i] - y[i+1] );
+		assert( doubleEq( lhs, y0[i] ) );
+	}
+
+	// 4x3x2 cube with two EMPTY voxels, and two pools.
+	const unsigned int num = 4 * 3 * 2;
+	unsigned int numVoxels = 0;
+	s2m.resize( num );
+	for ( unsigned int i = 0; i < num; ++i )
+		s2m[i] = ( i == 5 || i == 14 ) ? ~0U : numVoxels++;
+	CubeAdi cube;
+	assert( cube.build( s2m, numVoxels, 4, 3, 2, 1.0, 1.0, 1.0, 3.0, 10.0 ));
+	vector< double > block( numVoxels * 2, 0.0 );
+	block[0] = 100.0;
+	block[ 2 * numVoxels - 1 ] = 50.0;
+	for ( unsigned int t = 0; t < 200; ++t )
+		cube.advance( block, 2 );
+	double tot0 = 0.0;
+	double tot1 = 0.0;
+	for ( unsigned int i = 0; i < numVoxels; ++i ) {
+		assert( doubleApprox( block[ 2 * i ], 100.0 / numVoxels ) );
+		tot0 += block[ 2 * i ];
+		tot1 += block[ 2 * i + 1 ];
+	}
+	assert( doubleEq( tot0, 100.0 ) );
+	assert( doubleEq( tot1, 50.0 ) );
+	cout << "." << flush;
+}
+
+void testBinomialDiff()
+{
+	Philox rng( 1234, 0 );
+	// Mean and variance of the sampler on both of its branches.
+	const double n[] = { 20.0, 1000.0 };
+	const double p[] = { 0.1, 0.3 };
+	const unsigned int numSamples = 20000;
+	for ( unsigned int k = 0; k < 2; ++k ) {
+		double sum = 0.0;
+		double sumSq = 0.0;
+		for ( unsigned int i = 0; i < numSamples; ++i ) {
+			double x = BinomialDiff::sample( n[k], p[k], rng );
+			assert( x >= 0.0 && x <= n[k] && x == floor( x ) );
+			sum += x;
+			sumSq += x * x;
+		}
+		double mean = sum / numSamples;
+		double var = sumSq / numSamples - mean * mean;
+		double npq = n[k] * p[k] * ( 1.0 - p[k] );
+		assert( fabs( mean - n[k] * p[k] ) < 4.0 * sqrt( npq / numSamples ) );
+		assert( fabs( var / npq - 1.0 ) < 0.05 );
+	}
+
+	// 3x3 square with the middle voxel empty, and two pools. The
+	// molecules stay whole, none are lost, and they spread out evenly.
+	vector< unsigned int > s2m( 9 );
+	unsigned int numVoxels = 0;
+	for ( unsigned int i = 0; i < 9; ++i )
+		s2m[i] = ( i == 4 ) ? ~0U : numVoxels++;
+	BinomialDiff bd;
+	assert( bd.buildFromCube( s2m, numVoxels, 3, 3, 1, 1.0, 1.0, 1.0, 1.0 ) );
+	vector< double > y( numVoxels * 2, 0.0 );
+	y[0] = 8000.0;
+	y[3] = 400.0;
+	vector< double > mean( numVoxels, 0.0 );
+	for ( unsigned int t = 0; t < 2000; ++t ) {
+		bd.advance( y, 2, 0.1, rng );
+		double tot0 = 0.0;
+		double tot1 = 0.0;
+		for ( unsigned int i = 0; i < numVoxels; ++i ) {
+			assert( y[ 2 * i ] >= 0.0 && y[ 2 * i ] == floor( y[ 2 * i ] ) );
+			tot0 += y[ 2 * i ];
+			tot1 += y[ 2 * i + 1 ];
+			if ( t >= 1000 )
+				mean[i] += y[ 2 * i ] / 1000.0;
+		}
+		assert( doubleEq( tot0, 8000.0 ) );
+		assert( doubleEq( tot1, 400.0 ) );
+	}
+	for ( unsigned int i = 0; i < numVoxels; ++i )
+		assert( fabs( mean[i] - 1000.0 ) < 20.0 );
+	cout << "." << flush;
+}
+
 void testSorting()
 {
 	static unsigned int k[] = {20,40,60,80,100,10,30,50,70,90};
@@ -760,6 +891,43 @@ void testCylDiffnWithStoich()
 	// cout << "analyticTot= " << analyticTot << ", myTot= " << myTot << endl;
 	assert( err < 1.0e-5 );
 
+	// The Dsolve shares the state of the Ksolve, so blocks of n go
+	// through to the Ksolve.
+	ZombiePoolInterface* zpi = 
+			reinterpret_cast< ZombiePoolInterface* >( dsolve.eref().data() );
+	vector< double > block( 4, 0.0 );
+	block[1] = ndc;
+	block[3] = 2;
+	zpi->getBlock( block );
+	assert( block.size() == 4 + 2 * ndc );
+	for ( unsigned int j = 0; j < 2; ++j ) {
+		nvec = LookupField< unsigned int, vector< double > >::get( 
+						dsolve, "nVec", j );
+		for ( unsigned int i = 0; i < ndc; ++i )
+			assert( doubleEq( block[ 4 + j * ndc + i ], nvec[i] ) );
+	}
+	block[4] = 0.5;
+	zpi->setBlock( block );
+	nvec = LookupField< unsigned int, vector< double > >::get( 
+						ksolve, "nVec", 0 );
+	assert( doubleEq( nvec[0], 0.5 ) );
+
+	// The voxels of the Ksolve live in one contiguous store, and the
+	// Dsolve writes straight into it.
+	ZombiePoolInterface* kzpi = 
+			reinterpret_cast< ZombiePoolInterface* >( ksolve.eref().data() );
+	unsigned int stride = 0;
+	const double* state = kzpi->stateBlock( stride );
+	assert( state != 0 );
+	assert( stride >= 2 );
+	for ( unsigned int i = 0; i < ndc; ++i )
+		assert( kzpi->pools( i )->S() == state + i * stride );
+	nvec = LookupField< unsigned int, vector< double > >::get( 
+						dsolve, "nVec", 1 );
+	nvec[ ndc - 1 ] = 0.25;
+	LookupField< unsigned int, vector< double > >::set( 
+						dsolve, "nVec", 1, nvec );
+	assert( doubleEq( state[ ( ndc - 1 ) * stride + 1 ], 0.25 ) );
 
 	s->doDelete( model );
 	cout << "." << flush;
@@ -821,32 +989,44 @@ void testBuildTree()
 }
 #endif
 
-void testCalcJunction()
+/**
+ * Makes a neuron with a dend and two spines on it, each with a PSD.
+ * The dend is a single voxel, so both spines join it there. The 
+ * head of the second spine is half the size, so the volumes differ.
+ * Puts a, b, c in dend, b, c, d in spine, c, d, e in psd. No reacs.
+ * Fills in the pools, and the Dsolves as dend, spine, psd.
+ */
+static Id makeJunctionTest( vector< Id >& pools, vector< Id >& solves )
 {
 	Shell* s = reinterpret_cast< Shell* >( Id().eref().data() );
-	// Make a neuron with same-size dend and spine. PSD is tiny.
-	// Put a, b, c in dend, b, c, d in spine, c, d, f in psd. No reacs.
-	// See settling of all concs by diffusion, pairwise.
 	Id model = s->doCreate( "Neutral", Id(), "model", 1 );
 	Id dend = s->doCreate( "Compartment", model, "dend", 1 );
-	Id neck = s->doCreate( "Compartment", model, "spine_neck", 1 );
-	Id head = s->doCreate( "Compartment", model, "spine_head", 1 );
 	Field< double >::set( dend, "x", 10e-6 );
 	Field< double >::set( dend, "diameter", 2e-6 );
 	Field< double >::set( dend, "length", 10e-6 );
-	Field< double >::set( neck, "x0", 9e-6 );
-	Field< double >::set( neck, "x", 9e-6 );
-	Field< double >::set( neck, "y", 1e-6 );
-	Field< double >::set( neck, "diameter", 0.5e-6 );
-	Field< double >::set( neck, "length", 1.0e-6 );
-	Field< double >::set( head, "x0", 9e-6 );
-	Field< double >::set( head, "x", 9e-6 );
-	Field< double >::set( head, "y0", 1e-6 );
-	Field< double >::set( head, "y", 11e-6 );
-	Field< double >::set( head, "diameter", 2e-6 );
-	Field< double >::set( head, "length", 10e-6 );
-	s->doAddMsg( "Single", ObjId( dend ), "raxial", ObjId( neck ), "axial");
-	s->doAddMsg( "Single", ObjId( neck ), "raxial", ObjId( head ), "axial");
+	for ( unsigned int i = 0; i < 2; ++i ) {
+		stringstream ss;
+		ss << i;
+		double x = 3e-6 + 5e-6 * i;
+		double headLength = 10e-6 / ( 1 + i );
+		Id neck = s->doCreate( "Compartment", model, 
+						"spine_neck" + ss.str(), 1 );
+		Id head = s->doCreate( "Compartment", model, 
+						"spine_head" + ss.str(), 1 );
+		Field< double >::set( neck, "x0", x );
+		Field< double >::set( neck, "x", x );
+		Field< double >::set( neck, "y", 1e-6 );
+		Field< double >::set( neck, "diameter", 0.5e-6 );
+		Field< double >::set( neck, "length", 1.0e-6 );
+		Field< double >::set( head, "x0", x );
+		Field< double >::set( head, "x", x );
+		Field< double >::set( head, "y0", 1e-6 );
+		Field< double >::set( head, "y", 1e-6 + headLength );
+		Field< double >::set( head, "diameter", 2e-6 );
+		Field< double >::set( head, "length", headLength );
+		s->doAddMsg( "Single", ObjId( dend ), "raxial", ObjId( neck ), "axial");
+		s->doAddMsg( "Single", ObjId( neck ), "raxial", ObjId( head ), "axial");
+	}
 
 	Id nm = s->doCreate( "NeuroMesh", model, "nm", 1 );
 	Field< double >::set( nm, "diffLength", 10e-6 );
@@ -858,22 +1038,18 @@ void testCalcJunction()
 	mid = s->doAddMsg( "Single", ObjId( nm ), "psdListOut", ObjId( pm ), "psdList" );
 	Field< Id >::set( nm, "cell", model );
 
-	vector< Id > pools( 9 );
+	pools.resize( 9 );
 	static string names[] = {"a", "b", "c", "b", "c", "d", "c", "d", "e" };
-	static Id parents[] = {nm, nm, nm, sm, sm, sm, pm, pm, pm};
+	Id parents[] = {nm, nm, nm, sm, sm, sm, pm, pm, pm};
 	for ( unsigned int i = 0; i < 9; ++i ) {
 		pools[i] = s->doCreate( "Pool", parents[i], names[i], 1 );
 		assert( pools[i] != Id() );
-		Field< double >::set( pools[i], "concInit", 1.0 + 1.0 * i );
 		Field< double >::set( pools[i], "diffConst", 1e-11 );
-		if ( i < 6 ) {
-			double vol = Field< double >::get( pools[i], "volume" );
-			assert( doubleEq( vol, 10e-6 * 1e-12 * PI ) );
-		}
 	}
-	Id dendsolve = s->doCreate( "Dsolve", model, "dendsolve", 1 );
-	Id spinesolve = s->doCreate( "Dsolve", model, "spinesolve", 1 );
-	Id psdsolve = s->doCreate( "Dsolve", model, "psdsolve", 1 );
+	solves.resize( 3 );
+	Id dendsolve = solves[0] = s->doCreate( "Dsolve", model, "dendsolve", 1 );
+	Id spinesolve = solves[1] = s->doCreate( "Dsolve", model, "spinesolve", 1 );
+	Id psdsolve = solves[2] = s->doCreate( "Dsolve", model, "psdsolve", 1 );
 	Field< Id >::set( dendsolve, "compartment", nm );
 	Field< Id >::set( spinesolve, "compartment", sm );
 	Field< Id >::set( psdsolve, "compartment", pm );
@@ -881,29 +1057,327 @@ void testCalcJunction()
 	Field< string >::set( spinesolve, "path", "/model/sm/#" );
 	Field< string >::set( psdsolve, "path", "/model/pm/#" );
 	assert( Field< unsigned int >::get( dendsolve, "numAllVoxels" ) == 1 );
-	assert( Field< unsigned int >::get( spinesolve, "numAllVoxels" ) == 1 );
-	assert( Field< unsigned int >::get( psdsolve, "numAllVoxels" ) == 1 );
+	assert( Field< unsigned int >::get( spinesolve, "numAllVoxels" ) == 2 );
+	assert( Field< unsigned int >::get( psdsolve, "numAllVoxels" ) == 2 );
 	assert( Field< unsigned int >::get( dendsolve, "numPools" ) == 3 );
 	assert( Field< unsigned int >::get( spinesolve, "numPools" ) == 3 );
 	assert( Field< unsigned int >::get( psdsolve, "numPools" ) == 3 );
 	SetGet2< Id, Id >::set( dendsolve, "buildNeuroMeshJunctions", 
 					spinesolve, psdsolve );
-	s->doSetClock( 0, 0.01 );
+	// Now that the pools span all voxels of their meshes.
+	for ( unsigned int i = 0; i < 9; ++i ) {
+		unsigned int num = pools[i].element()->numData();
+		Field< double >::setVec( pools[i], "concInit", 
+						vector< double >( num, 1.0 + 1.0 * i ) );
+	}
 	s->doUseClock( "/model/#solve", "process", 0 );
-	s->doReinit();
-	s->doStart( 100 );
+	return model;
+}
 
-	/*
+/**
+ * Returns which set of connected voxels the voxel of pool i in the
+ * junction test belongs to: 0 for b, 1 for c, and 2 or 3 for d in the
+ * first or second spine and its PSD. Returns 4 for a and e, which do
+ * not cross any junction.
+ */
+static unsigned int junctionSet( unsigned int i, unsigned int voxel )
+{
+	static unsigned int species[] = { 4, 0, 1, 0, 1, 2, 1, 2, 4 };
+	unsigned int j = species[i];
+	return ( j == 2 ) ? j + voxel : j;
+}
+
+/**
+ * Adds up n, and n / conc, over the voxels of each set of connected
+ * voxels in the junction test. Fills in the total n and the total
+ * volume, in arbitrary units, of each set.
+ */
+static void junctionTotals( const vector< Id >& pools, 
+				double* totN, double* totVol )
+{
+	for ( unsigned int j = 0; j < 4; ++j )
+		totN[j] = totVol[j] = 0.0;
+	for ( unsigned int i = 0; i < 9; ++i ) {
+		vector< double > n;
+		vector< double > conc;
+		Field< double >::getVec( pools[i], "n", n );
+		Field< double >::getVec( pools[i], "conc", conc );
+		for ( unsigned int k = 0; k < n.size(); ++k ) {
+			assert( n[k] >= 0.0 );
+			unsigned int j = junctionSet( i, k );
+			if ( j < 4 ) {
+				totN[j] += n[k];
+				totVol[j] += n[k] / conc[k];
+			}
+		}
+	}
+}
+
+/**
+ * Checks that every voxel of each set of connected voxels has the conc
+ * expected when the total n of the set is spread by volume.
+ */
+static void checkJunctionEquilibrium( const vector< Id >& pools,
+				const double* totN, const double* totVol, double tol )
+{
 	for ( unsigned int i = 0; i < 9; ++i ) {
-		double c = Field< double >::get( pools[i], "conc" );
-		double n = Field< double >::get( pools[i], "n" );
-		double v = Field< double >::get( pools[i], "volume" );
-		cout << pools[i].path() << ": " << c << ", " << n << ", " <<
-				n / v << ", " <<
-				v << endl;
+		vector< double > conc;
+		Field< double >::getVec( pools[i], "conc", conc );
+		for ( unsigned int k = 0; k < conc.size(); ++k ) {
+			unsigned int j = junctionSet( i, k );
+			if ( j < 4 ) {
+				double eq = totN[j] / totVol[j];
+				assert( fabs( conc[k] - eq ) < tol * eq );
+			}
+		}
 	}
-	*/
+}
+
+/**
+ * The junctions between the dend, spines and PSDs move each pool 
+ * present on both sides. Both spines join the one dend voxel. Checks 
+ * that mass is conserved, that the concs settle to those given by
+ * spreading the n by volume, that this holds at a dt far longer than
+ * the time constants, and that a change of diffConst after the 
+ * junctions have been set up is picked up.
+ */
+void testCalcJunction()
+{
+	Shell* s = reinterpret_cast< Shell* >( Id().eref().data() );
+	vector< Id > pools;
+	vector< Id > solves;
+	// The slowest mode takes a few hundred sec to settle.
+	double dts[] = { 0.1, 1000.0 };
+	double runtimes[] = { 2000.0, 10000.0 };
+	for ( unsigned int i = 0; i < 2; ++i ) {
+		Id model = makeJunctionTest( pools, solves );
+		s->doSetClock( 0, dts[i] );
+		s->doReinit();
+		double totN0[4];
+		double totVol[4];
+		junctionTotals( pools, totN0, totVol );
+		// The dend has a different conc from the spines to start.
+		vector< double > conc;
+		Field< double >::getVec( pools[4], "conc", conc );
+		assert( doubleEq( conc[0], 5.0 ) && doubleEq( conc[1], 5.0 ) );
+		assert( doubleEq( Field< double >::get( pools[2], "conc" ), 3.0 ) );
+
+		s->doStart( runtimes[i] );
+		double totN[4];
+		junctionTotals( pools, totN, totVol );
+		for ( unsigned int j = 0; j < 4; ++j )
+			assert( doubleEq( totN[j], totN0[j] ) );
+		checkJunctionEquilibrium( pools, totN, totVol, 1e-6 );
+		s->doDelete( model );
+	}
+
+	// Stop b crossing from the spines after the first step. The spine
+	// Dsolve owns the junction to the dend, so it uses the spine diffConst.
+	Id model = makeJunctionTest( pools, solves );
+	s->doSetClock( 0, 0.01 );
+	s->doReinit();
+	s->doStart( 0.01 );
+	Field< double >::set( pools[3], "diffConst", 0.0 );
+	vector< double > spineB;
+	Field< double >::getVec( pools[3], "n", spineB );
+	s->doStart( 10.0 );
+	vector< double > n;
+	Field< double >::getVec( pools[3], "n", n );
+	assert( n == spineB );
+	// c still crosses.
+	Field< double >::getVec( pools[4], "conc", n );
+	assert( n[0] < 4.9 );
+	s->doDelete( model );
+	cout << "." << flush;
+}
+
+/**
+ * Builds a 10 voxel cylinder with a <===> b, where only a diffuses and
+ * starts in voxel 0. Returns the model.
+ */
+static Id makeReacDiffTest( const string& solver )
+{
+	Shell* s = reinterpret_cast< Shell* >( Id().eref().data() );
+	Id model = s->doCreate( "Neutral", Id(), "model", 1 );
+	Id cyl = s->doCreate( "CylMesh", model, "cyl", 1 );
+	Field< double >::set( cyl, "r0", 1e-6 );
+	Field< double >::set( cyl, "r1", 1e-6 );
+	Field< double >::set( cyl, "x0", 0 );
+	Field< double >::set( cyl, "x1", 10e-6 );
+	Field< double >::set( cyl, "diffLength", 1e-6 );
+	Id a = s->doCreate( "Pool", cyl, "a", 1 );
+	Id b = s->doCreate( "Pool", cyl, "b", 1 );
+	Id r = s->doCreate( "Reac", cyl, "r", 1 );
+	s->doAddMsg( "Single", r, "sub", a, "reac" );
+	s->doAddMsg( "Single", r, "prd", b, "reac" );
+	Field< double >::set( r, "Kf", 2.0 );
+	Field< double >::set( r, "Kb", 0.5 );
+	Field< double >::set( a, "diffConst", 1e-12 );
+	Field< double >::set( b, "diffConst", 0.0 );
+
+	Id stoich = s->doCreate( "Stoich", model, "stoich", 1 );
+	Id ksolve = s->doCreate( solver, model, "ksolve", 1 );
+	Id dsolve = s->doCreate( "Dsolve", model, "dsolve", 1 );
+	Field< Id >::set( stoich, "compartment", cyl );
+	Field< Id >::set( stoich, "ksolve", ksolve );
+	Field< Id >::set( stoich, "dsolve", dsolve );
+	Field< string >::set( stoich, "path", "/model/cyl/#" );
+	Field< double >::set( ObjId( a, 0 ), "nInit", 1000.0 );
+	return model;
+}
+
+/**
+ * Runs the reac-diff test through a ReacDiff at dt and returns the
+ * RMS difference of n from ref, relative to the RMS of ref. If ref is
+ * empty, fills it in instead.
+ */
+static double reacDiffError( const string& splitting, double dt,
+	double runtime, vector< double >& ref )
+{
+	Shell* s = reinterpret_cast< Shell* >( Id().eref().data() );
+	Id model = makeReacDiffTest( "Ksolve" );
+	Id rd = s->doCreate( "ReacDiff", model, "rd", 1 );
+	Field< Id >::set( rd, "ksolve", Id( "/model/ksolve" ) );
+	Field< Id >::set( rd, "dsolve", Id( "/model/dsolve" ) );
+	// The ReacDiff advances both solvers, so they must not have clocks.
+	Field< int >::set( Id( "/model/ksolve" ), "tick", -1 );
+	Field< int >::set( Id( "/model/dsolve" ), "tick", -1 );
+	Field< string >::set( rd, "splitting", splitting );
+	s->doUseClock( "/model/rd", "process", 0 );
+	s->doSetClock( 0, dt );
+	s->doReinit();
+	s->doStart( runtime );
+	vector< double > n;
+	Field< double >::getVec( Id( "/model/cyl/a" ), "n", n );
+	if ( ref.size() == 0 )
+		ref = n;
+	assert( n.size() == ref.size() );
+	double diffSq = 0.0;
+	double refSq = 0.0;
+	for ( unsigned int i = 0; i < n.size(); ++i ) {
+		diffSq += ( n[i] - ref[i] ) * ( n[i] - ref[i] );
+		refSq += ref[i] * ref[i];
+	}
+	s->doDelete( model );
+	return sqrt( diffSq / refSq );
+}
+
+/**
+ * Checks ReacDiff splitting against the reac and diff solvers scheduled
+ * separately at a step small enough that the splitting does not matter.
+ * Strang splitting at a coarse dt should be close to this, and closer
+ * than Lie splitting at the same dt. Strang should also be second
+ * order, so that halving dt cuts its error about 4 times, where Lie
+ * only halves it. Also checks that the step doubling error estimate
+ * runs for a Ksolve and is skipped for a Gsolve.
+ */
+void testReacDiffSplitting()
+{
+	Shell* s = reinterpret_cast< Shell* >( Id().eref().data() );
+	double runtime = 2.0;
+	double coarseDt = 0.1;
+
+	Id model = makeReacDiffTest( "Ksolve" );
+	s->doUseClock( "/model/dsolve", "process", 0 );
+	s->doUseClock( "/model/ksolve", "process", 1 );
+	s->doSetClock( 0, 0.001 );
+	s->doSetClock( 1, 0.001 );
+	s->doReinit();
+	s->doStart( runtime );
+	vector< double > ref;
+	Field< double >::getVec( Id( "/model/cyl/a" ), "n", ref );
+	assert( ref.size() == 10 );
+	assert( ref[0] > ref[9] && ref[9] > 0.0 );
+	s->doDelete( model );
+
+	double strangErr = reacDiffError( "strang", coarseDt, runtime, ref );
+	double lieErr = reacDiffError( "lie", coarseDt, runtime, ref );
+	assert( strangErr < 0.005 );
+	assert( strangErr < 0.2 * lieErr );
+
+	// For the order, compare against a fine Strang run, as the
+	// separately scheduled run is itself only first order.
+	vector< double > fine;
+	reacDiffError( "strang", coarseDt / 64.0, runtime, fine );
+	double strang1 = reacDiffError( "strang", coarseDt, runtime, fine );
+	double strang2 = reacDiffError( "strang", coarseDt / 2.0, runtime, fine );
+	double lie1 = reacDiffError( "lie", coarseDt, runtime, fine );
+	double lie2 = reacDiffError( "lie", coarseDt / 2.0, runtime, fine );
+	assert( strang1 / strang2 > 3.5 && strang1 / strang2 < 4.5 );
+	assert( lie1 / lie2 > 1.7 && lie1 / lie2 < 2.3 );
+
+	// Step doubling for the Ksolve gives a small, nonzero estimate.
+	model = makeReacDiffTest( "Ksolve" );
+	Id rd = s->doCreate( "ReacDiff", model, "rd", 1 );
+	Field< Id >::set( rd, "ksolve", Id( "/model/ksolve" ) );
+	Field< Id >::set( rd, "dsolve", Id( "/model/dsolve" ) );
+	Field< int >::set( Id( "/model/ksolve" ), "tick", -1 );
+	Field< int >::set( Id( "/model/dsolve" ), "tick", -1 );
+	Field< unsigned int >::set( rd, "errorCheckInterval", 1 );
+	s->doUseClock( "/model/rd", "process", 0 );
+	s->doSetClock( 0, coarseDt );
+	s->doReinit();
+	s->doStart( 1.0 );
+	double err = Field< double >::get( rd, "splittingError" );
+	assert( err > 0.0 && err < 0.01 );
 	s->doDelete( model );
+
+	// The Gsolve cannot be rewound, so it is never checked.
+	model = makeReacDiffTest( "Gsolve" );
+	rd = s->doCreate( "ReacDiff", model, "rd", 1 );
+	Field< Id >::set( rd, "ksolve", Id( "/model/ksolve" ) );
+	Field< Id >::set( rd, "dsolve", Id( "/model/dsolve" ) );
+	Field< int >::set( Id( "/model/ksolve" ), "tick", -1 );
+	Field< int >::set( Id( "/model/dsolve" ), "tick", -1 );
+	Field< unsigned int >::set( rd, "errorCheckInterval", 1 );
+	s->doUseClock( "/model/rd", "process", 0 );
+	s->doReinit();
+	s->doStart( 1.0 );
+	assert( doubleEq( Field< double >::get( rd, "splittingError" ), 0.0 ) );
+	s->doDelete( model );
+	cout << "." << flush;
+}
+
+/**
+ * Runs the reac-diff test with a Gsolve and binomial diffusion. All of
+ * a starts in voxel 0, so the far voxels start stuck with no reactions
+ * possible, and must start reacting once a diffuses into them.
+ */
+void testGsolveWithDiffusion()
+{
+	Shell* s = reinterpret_cast< Shell* >( Id().eref().data() );
+	const char* methods[] = { "direct", "nextReaction" };
+	for ( unsigned int m = 0; m < 2; ++m ) {
+		Id model = makeReacDiffTest( "Gsolve" );
+		Id gsolve( "/model/ksolve" );
+		Id dsolve( "/model/dsolve" );
+		Field< string >::set( gsolve, "method", methods[m] );
+		Field< long >::set( gsolve, "seed", 1234 );
+		Field< string >::set( dsolve, "method", "binomial" );
+		Field< long >::set( dsolve, "seed", 5678 );
+		s->doUseClock( "/model/dsolve", "process", 0 );
+		s->doUseClock( "/model/ksolve", "process", 1 );
+		s->doSetClock( 0, 0.01 );
+		s->doSetClock( 1, 0.01 );
+		s->doReinit();
+		s->doStart( 10.0 );
+		vector< double > a;
+		vector< double > b;
+		Field< double >::getVec( Id( "/model/cyl/a" ), "n", a );
+		Field< double >::getVec( Id( "/model/cyl/b" ), "n", b );
+		assert( a.size() == 10 && b.size() == 10 );
+		double tot = 0.0;
+		for ( unsigned int i = 0; i < 10; ++i )
+			tot += a[i] + b[i];
+		assert( doubleEq( tot, 1000.0 ) );
+		// b does not diffuse, so it can only be made where a got to.
+		assert( b[1] > 100.0 );
+		double farB = 0.0;
+		for ( unsigned int i = 5; i < 10; ++i )
+			farB += b[i];
+		assert( farB > 10.0 );
+		s->doDelete( model );
+	}
 	cout << "." << flush;
 }
 
@@ -911,6 +1385,8 @@ void testDiffusion()
 {
 	testSorting();
 	testFastMatrixElim();
+	testCubeAdi();
+	testBinomialDiff();
 	testSetDiffusionAndTransport();
 	testCylDiffn();
 	testTaperingCylDiffn();
@@ -918,4 +1394,6 @@ void testDiffusion()
 	testCellDiffn();
 	testCylDiffnWithStoich();
 	testCalcJunction();
+	testReacDiffSplitting();
+	testGsolveWithDiffusion();
 }
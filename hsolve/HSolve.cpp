@@ -24,6 +24,9 @@
 #include "../biophysics/ChanCommon.h"
 #include "../biophysics/HHChannel.h"
 #include "ZombieHHChannel.h"
+#include "ZombieSynChan.h"
+#include "ZombieNMDAChan.h"
+#include "ZombieMgBlock.h"
 #include "../shell/Shell.h"
 
 const Cinfo* HSolve::initCinfo()
@@ -147,6 +150,41 @@ const Cinfo* HSolve::initCinfo()
         &HSolve::getCaMax
     );
 
+    static ValueFinfo< HSolve, int > lookupMode(
+        "lookupMode",
+        "How the lookup tables interpolate within a division. 0 (default) is "
+        "linear. 1 is a cubic through the rates and slopes at the ends of the "
+        "division. 2 is a cubic through the rates at the Chebyshev points of "
+        "the division. The cubic tables are sized automatically, to the "
+        "fewest divisions that meet lookupTolerance, and vDiv and caDiv are "
+        "set to the number chosen. Set before the path.",
+        &HSolve::setLookupMode,
+        &HSolve::getLookupMode
+    );
+
+    static ValueFinfo< HSolve, double > lookupTolerance(
+        "lookupTolerance",
+        "Largest error allowed in the cubic lookup tables, relative to the "
+        "largest rate of the gate. The error is measured against the gate's "
+        "own table. Default is 1e-5.",
+        &HSolve::setLookupTolerance,
+        &HSolve::getLookupTolerance
+    );
+
+    static ReadOnlyValueFinfo< HSolve, vector< Id > > lookupGates(
+        "lookupGates",
+        "Gates in the lookup tables: voltage-dependent gates, then "
+        "calcium-dependent gates.",
+        &HSolve::getLookupGates
+    );
+
+    static ReadOnlyValueFinfo< HSolve, vector< double > > lookupError(
+        "lookupError",
+        "Error of the lookup table for each gate in lookupGates, relative to "
+        "the largest rate of the gate.",
+        &HSolve::getLookupError
+    );
+
     static Finfo* hsolveFinfos[] =
     {
         &seed,              // Value
@@ -159,6 +197,10 @@ const Cinfo* HSolve::initCinfo()
         &caDiv,             // Value
         &caMin,             // Value
         &caMax,             // Value
+        &lookupMode,        // Value
+        &lookupTolerance,   // Value
+        &lookupGates,       // ReadOnlyValue
+        &lookupError,       // ReadOnlyValue
         &proc,              // Shared
     };
 
@@ -187,7 +229,7 @@ const Cinfo* HSolve::initCinfo()
 static const Cinfo* hsolveCinfo = HSolve::initCinfo();
 
 HSolve::HSolve()
-    : dt_( 50e-6 )
+    : dt_( 50e-6 ), pooled_( false )
 {
     ;
 }
@@ -199,10 +241,31 @@ HSolve::HSolve()
 
 void HSolve::process( const Eref& hsolve, ProcPtr p )
 {
+    if ( pooled_ )
+        return;
+
     this->HSolveActive::step( p );
 }
 
 void HSolve::reinit( const Eref& hsolve, ProcPtr p )
+{
+    if ( pooled_ )
+        return;
+
+    reinitSolver( p );
+}
+
+void HSolve::setPooled( bool pooled )
+{
+    pooled_ = pooled;
+}
+
+bool HSolve::isPooled() const
+{
+    return pooled_;
+}
+
+void HSolve::reinitSolver( ProcPtr p )
 {
     dt_ = p->dt;
     this->HSolveActive::reinit( p );
@@ -232,6 +295,20 @@ void HSolve::zombify( Eref hsolve ) const
     for ( i = channelId_.begin(); i != channelId_.end(); ++i )
         HHChannelBase::zombify( i->eref().element(),
 						ZombieHHChannel::initCinfo(), hsolve.id() );
+
+    vector< SynChanStruct >::const_iterator isyn;
+    for ( isyn = synchan_.begin(); isyn != synchan_.end(); ++isyn )
+    {
+        Element* syn = isyn->elm_.element();
+        if ( isyn->ghk_ )
+            ZombieSynChan::zombify( syn, ZombieNMDAChan::initCinfo(), hsolve.id() );
+        else
+            ZombieSynChan::zombify( syn, ZombieSynChan::initCinfo(), hsolve.id() );
+
+        if ( isyn->block_ != Id() )
+            ZombieMgBlock::zombify( isyn->block_.element(),
+                ZombieMgBlock::initCinfo(), hsolve.id() );
+    }
 }
 
 void HSolve::setup( Eref hsolve )
@@ -450,6 +527,50 @@ double HSolve::getCaMax() const
     return caMax_;
 }
 
+void HSolve::setLookupMode( int mode )
+{
+    if ( mode != LookupTable::LINEAR &&
+            mode != LookupTable::CUBIC &&
+            mode != LookupTable::CHEBYSHEV )
+    {
+        cerr << "Error: HSolve: lookupMode should be 0, 1 or 2.\n";
+        return;
+    }
+
+    lookupMode_ = mode;
+}
+
+int HSolve::getLookupMode() const
+{
+    return lookupMode_;
+}
+
+void HSolve::setLookupTolerance( double tolerance )
+{
+    if ( tolerance <= 0.0 )
+    {
+        cerr << "Error: HSolve: lookupTolerance should be positive.\n";
+        return;
+    }
+
+    lookupTolerance_ = tolerance;
+}
+
+double HSolve::getLookupTolerance() const
+{
+    return lookupTolerance_;
+}
+
+vector< Id > HSolve::getLookupGates() const
+{
+    return lookupGateId_;
+}
+
+vector< double > HSolve::getLookupError() const
+{
+    return lookupError_;
+}
+
 const set<string>& HSolve::handledClasses()
 {
     static set<string> classes;
@@ -21,6 +21,14 @@ public:
 	void process( const Eref& hsolve, ProcPtr p );
 	void reinit( const Eref& hsolve, ProcPtr p );
 	
+	/**
+	 * An HSolvePool that has taken this solver over does its process
+	 * and reinit, and the clock calls here are ignored.
+	 */
+	void setPooled( bool pooled );
+	bool isPooled() const;
+	void reinitSolver( ProcPtr p );
+	
 	void setSeed( Id seed );
 	Id getSeed() const; 		/**< For searching for compartments:
 								 *   seed is the starting compt.     */
@@ -53,6 +61,15 @@ public:
 	void setCaMax( double caMax );
 	double getCaMax() const;
 	
+	void setLookupMode( int mode );
+	int getLookupMode() const;
+	
+	void setLookupTolerance( double tolerance );
+	double getLookupTolerance() const;
+	
+	vector< Id > getLookupGates() const;
+	vector< double > getLookupError() const;
+	
 	// Interface functions defined in HSolveInterface.cpp
 	double getInitVm( Id id ) const;
 	void setInitVm( Id id, double value );
@@ -140,6 +157,9 @@ public:
 	double getCaFloor( Id id ) const;
 	void setCaFloor( Id id, double floor );
 	
+	/// Interface to SynChans, NMDAChans and MgBlocks
+	SynChanStruct* getSynChan( Id id );
+	
 	/// Interface to external channels
 	//~ const vector< vector< Id > >& getExternalChannels() const;
 	
@@ -167,6 +187,7 @@ private:
 	double dt_;
 	string path_;
 	Id seed_;
+	bool pooled_;
 };
 
 #endif // _HSOLVE_H
@@ -32,6 +32,9 @@ const int HSolveActive::INSTANT_Z = 4;
 HSolveActive::HSolveActive()
 {
     caAdvance_ = 1;
+    gatesDirty_ = true;
+    lookupMode_ = LookupTable::LINEAR;
+    lookupTolerance_ = 1.0e-5;
 
     // Default lookup table size
     //~ vDiv_ = 3000;    // for voltage
@@ -42,6 +45,26 @@ HSolveActive::HSolveActive()
 // Solving differential equations
 //////////////////////////////////////////////////////////////////////
 void HSolveActive::step( ProcPtr info )
+{
+    if ( nCompt_ <= 0 )
+        return;
+
+    advance( info );
+    sendOutputs( info );
+}
+
+void HSolveActive::advance( ProcPtr info )
+{
+    if ( nCompt_ <= 0 )
+        return;
+
+    prepareStep( info );
+    HSolvePassive::forwardEliminate();
+    HSolvePassive::backwardSubstitute();
+    finishStep( info );
+}
+
+void HSolveActive::prepareStep( ProcPtr info )
 {
     if ( nCompt_ <= 0 )
         return;
@@ -53,11 +76,22 @@ void HSolveActive::step( ProcPtr info )
 
     advanceChannels( info->dt );
     calculateChannelCurrents();
+    advanceSynChans( info );
     updateMatrix();
-    HSolvePassive::forwardEliminate();
-    HSolvePassive::backwardSubstitute();
+}
+
+void HSolveActive::finishStep( ProcPtr info )
+{
+    if ( nCompt_ <= 0 )
+        return;
+
     advanceCalcium();
-    advanceSynChans( info );
+}
+
+void HSolveActive::sendOutputs( ProcPtr info )
+{
+    if ( nCompt_ <= 0 )
+        return;
 
     sendValues( info );
     sendSpikes( info );
@@ -124,17 +158,13 @@ void HSolveActive::updateMatrix()
         value.injectVarying = 0.0;
     }
 
-    // Synapses are being handled as external channels.
-    //~ double Gk, Ek;
-    //~ vector< SynChanStruct >::iterator isyn;
-    //~ for ( isyn = synchan_.begin(); isyn != synchan_.end(); ++isyn ) {
-    //~ get< double >( isyn->elm_, synGkFinfo, Gk );
-    //~ get< double >( isyn->elm_, synEkFinfo, Ek );
-    //~
-    //~ unsigned int ic = isyn->compt_;
-    //~ HS_[ 4 * ic ] += Gk;
-    //~ HS_[ 4 * ic + 3 ] += Gk * Ek;
-    //~ }
+    vector< SynChanStruct >::iterator isyn;
+    for ( isyn = synchan_.begin(); isyn != synchan_.end(); ++isyn )
+    {
+        unsigned int ic = isyn->compt_;
+        HS_[ 4 * ic ] += isyn->Gk_;
+        HS_[ 4 * ic + 3 ] += isyn->Gk_ * isyn->Ek_;
+    }
 
     ihs = HS_.begin();
     vector< double >::iterator iec;
@@ -214,112 +244,96 @@ void HSolveActive::advanceCalcium()
     caActivation_.assign( caActivation_.size(), 0.0 );
 }
 
-void HSolveActive::advanceChannels( double dt )
+/**
+ * Finds the lookup rows for Vm in each compartment and Ca in each pool.
+ * Only tables that some gate reads are used.
+ */
+void HSolveActive::lookupRows()
 {
-    vector< double >::iterator iv;
-    vector< double >::iterator istate = state_.begin();
-    vector< int >::iterator ichannelcount = channelCount_.begin();
-    vector< ChannelStruct >::iterator ichan = channel_.begin();
-    vector< ChannelStruct >::iterator chanBoundary;
-    vector< unsigned int >::iterator icacount = caCount_.begin();
-    vector< double >::iterator ica = ca_.begin();
-    vector< double >::iterator caBoundary;
-    vector< LookupColumn >::iterator icolumn = column_.begin();
-    vector< LookupRow >::iterator icarowcompt;
-    vector< LookupRow* >::iterator icarow = caRow_.begin();
-
-    LookupRow vRow;
-    double C1, C2;
-    for ( iv = V_.begin(); iv != V_.end(); ++iv )
+    if ( gatesDirty_ )
+        groupGates();
+
+    if ( !vGate_.state.empty() || !vInstantGate_.state.empty() )
+        vTable_.rows( V_, vLookupRow_ );
+    if ( !caGate_.state.empty() || !caInstantGate_.state.empty() )
+        caTable_.rows( ca_, caLookupRow_ );
+}
+
+/// Advances each gate in the group by one step of size dt.
+static void advanceGates( LookupTable& table, const vector< LookupRow >& row,
+    GateGroup& g, double* state, double dt )
+{
+    table.lookup( g.column, g.row, row, g.C1, g.C2 );
+
+    unsigned int n = g.state.size();
+    const unsigned int* is = n ? &g.state[ 0 ] : 0;
+    const double* C1 = n ? &g.C1[ 0 ] : 0;
+    const double* C2 = n ? &g.C2[ 0 ] : 0;
+    for ( unsigned int i = 0; i < n; ++i )
     {
-        vTable_.row( *iv, vRow );
-        icarowcompt = caRowCompt_.begin();
-        caBoundary = ica + *icacount;
-        for ( ; ica < caBoundary; ++ica )
-        {
-            caTable_.row( *ica, *icarowcompt );
-            ++icarowcompt;
-        }
+        double temp = 1.0 + dt / 2.0 * C2[ i ];
+        state[ is[ i ] ] = ( state[ is[ i ] ] * ( 2.0 - temp ) + dt * C1[ i ] ) / temp;
+    }
+}
 
-        /*
-         * Optimize by moving "if ( instant )" outside the loop, because it is
-         * rarely used. May also be able to avoid "if ( power )".
-         *
-         * Or not: excellent branch predictors these days.
-         *
-         * Will be nice to test these optimizations.
-         */
-        chanBoundary = ichan + *ichannelcount;
-        for ( ; ichan < chanBoundary; ++ichan )
-        {
-            if ( ichan->Xpower_ > 0.0 )
-            {
-                vTable_.lookup( *icolumn, vRow, C1, C2 );
-                //~ *istate = *istate * C1 + C2;
-                //~ *istate = ( C1 + ( 2 - C2 ) * *istate ) / C2;
-                if ( ichan->instant_ & INSTANT_X )
-                    *istate = C1 / C2;
-                else
-                {
-                    double temp = 1.0 + dt / 2.0 * C2;
-                    *istate = ( *istate * ( 2.0 - temp ) + dt * C1 ) / temp;
-                }
+/// Sets each gate in the group to its steady state.
+static void settleGates( LookupTable& table, const vector< LookupRow >& row,
+    GateGroup& g, double* state )
+{
+    table.lookup( g.column, g.row, row, g.C1, g.C2 );
 
-                ++icolumn, ++istate;
-            }
+    unsigned int n = g.state.size();
+    for ( unsigned int i = 0; i < n; ++i )
+        state[ g.state[ i ] ] = g.C1[ i ] / g.C2[ i ];
+}
 
-            if ( ichan->Ypower_ > 0.0 )
-            {
-                vTable_.lookup( *icolumn, vRow, C1, C2 );
-                //~ *istate = *istate * C1 + C2;
-                //~ *istate = ( C1 + ( 2 - C2 ) * *istate ) / C2;
-                if ( ichan->instant_ & INSTANT_Y )
-                    *istate = C1 / C2;
-                else
-                {
-                    double temp = 1.0 + dt / 2.0 * C2;
-                    *istate = ( *istate * ( 2.0 - temp ) + dt * C1 ) / temp;
-                }
+void HSolveActive::advanceChannels( double dt )
+{
+    if ( state_.empty() )
+        return;
 
-                ++icolumn, ++istate;
-            }
+    lookupRows();
 
-            if ( ichan->Zpower_ > 0.0 )
-            {
-                LookupRow* caRow = *icarow;
-                if ( caRow )
-                {
-                    caTable_.lookup( *icolumn, *caRow, C1, C2 );
-                }
-                else
-                {
-                    vTable_.lookup( *icolumn, vRow, C1, C2 );
-                }
+    double* state = &state_[ 0 ];
+    advanceGates( vTable_, vLookupRow_, vGate_, state, dt );
+    advanceGates( caTable_, caLookupRow_, caGate_, state, dt );
+    settleGates( vTable_, vLookupRow_, vInstantGate_, state );
+    settleGates( caTable_, caLookupRow_, caInstantGate_, state );
+}
 
-                //~ *istate = *istate * C1 + C2;
-                //~ *istate = ( C1 + ( 2 - C2 ) * *istate ) / C2;
-                if ( ichan->instant_ & INSTANT_Z )
-                    *istate = C1 / C2;
-                else
-                {
-                    double temp = 1.0 + dt / 2.0 * C2;
-                    *istate = ( *istate * ( 2.0 - temp ) + dt * C1 ) / temp;
-                }
+void HSolveActive::settleChannels()
+{
+    if ( state_.empty() )
+        return;
 
-                ++icolumn, ++istate, ++icarow;
-            }
-        }
+    lookupRows();
 
-        ++ichannelcount, ++icacount;
-    }
+    double* state = &state_[ 0 ];
+    settleGates( vTable_, vLookupRow_, vGate_, state );
+    settleGates( caTable_, caLookupRow_, caGate_, state );
+    settleGates( vTable_, vLookupRow_, vInstantGate_, state );
+    settleGates( caTable_, caLookupRow_, caInstantGate_, state );
 }
 
 /**
- * SynChans are currently not under solver's control
+ * Advances the SynChans with the Vm at the start of the step, as their own
+ * process would have. The Ca current of NMDAChans goes into the pools
+ * before advanceCalcium.
  */
 void HSolveActive::advanceSynChans( ProcPtr info )
 {
-    return;
+    vector< SynChanStruct >::iterator isyn;
+    for ( isyn = synchan_.begin(); isyn != synchan_.end(); ++isyn )
+    {
+        if ( isyn->caPool_ != -1 )
+            isyn->Cin_ =
+                ca_[ isyn->caPool_ ] * isyn->intCaScale_ + isyn->intCaOffset_;
+
+        isyn->process( V_[ isyn->compt_ ] );
+
+        if ( isyn->caTarget_ != -1 )
+            caActivation_[ isyn->caTarget_ ] += isyn->ICa_;
+    }
 }
 
 void HSolveActive::sendSpikes( ProcPtr info )
@@ -352,3 +366,408 @@ void HSolveActive::sendValues( ProcPtr info )
             ca_[ *i ]
         );
 }
+
+#ifdef DO_UNIT_TESTS
+
+#include "../shell/Shell.h"
+
+static const double EREST = -0.07;
+
+/// Sets up a gate of the channel from the 13 parameters of setupAlpha.
+static void setupGate( Id chan, const string& gate, const double* parms )
+{
+    Id gateId( chan.path() + "/" + gate );
+    SetGet1< vector< double > >::set( gateId, "setupAlpha",
+        vector< double >( parms, parms + 13 ) );
+    Field< bool >::set( gateId, "useInterpolation", true );
+}
+
+static Id makeChannel( Id compt, const string& name, double Gbar, double Ek )
+{
+    Shell* shell = reinterpret_cast< Shell* >( Id().eref().data() );
+    Id chan = shell->doCreate( "HHChannel", compt, name, 1 );
+    shell->doAddMsg( "Single", compt, "channel", chan, "channel" );
+    Field< double >::set( chan, "Gbar", Gbar );
+    Field< double >::set( chan, "Ek", Ek );
+    return chan;
+}
+
+/**
+ * Builds a squid soma with a passive dendrite. The m gate of Na is
+ * instant. A Ca channel feeds a CaConc, which drives the Z gate of a
+ * Ca-dependent K channel.
+ */
+static Id makeActiveCell()
+{
+    Shell* shell = reinterpret_cast< Shell* >( Id().eref().data() );
+    Id cell = shell->doCreate( "Neutral", Id(), "activeCell", 1 );
+    Id soma = shell->doCreate( "Compartment", cell, "soma", 1 );
+    Field< double >::set( soma, "Cm", 0.007854e-6 );
+    Field< double >::set( soma, "Ra", 7639.44e3 );
+    Field< double >::set( soma, "Rm", 424.4e3 );
+    Field< double >::set( soma, "Em", EREST + 0.010613 );
+    Field< double >::set( soma, "inject", 0.1e-6 );
+    Field< double >::set( soma, "initVm", EREST );
+    Id dend = shell->doCreate( "Compartment", cell, "dend", 1 );
+    Field< double >::set( dend, "Cm", 0.007854e-6 );
+    Field< double >::set( dend, "Ra", 7639.44e3 );
+    Field< double >::set( dend, "Rm", 424.4e3 );
+    Field< double >::set( dend, "Em", EREST );
+    Field< double >::set( dend, "initVm", EREST );
+    shell->doAddMsg( "Single", soma, "axial", dend, "raxial" );
+
+    // A, B, C, D and F of alpha, then of beta, then divs, min and max.
+    const double naM[] = {
+        0.1e6 * ( EREST + 0.025 ), -0.1e6, -1.0, -( EREST + 0.025 ), -0.01,
+        4e3, 0.0, 0.0, -EREST, 0.018,
+        150, -0.1, 0.05 };
+    const double naH[] = {
+        70.0, 0.0, 0.0, -EREST, 0.02,
+        1e3, 0.0, 1.0, -( EREST + 0.03 ), -0.01,
+        150, -0.1, 0.05 };
+    const double kN[] = {
+        1e4 * ( 0.01 + EREST ), -1e4, -1.0, -( EREST + 0.01 ), -0.01,
+        0.125e3, 0.0, 0.0, -EREST, 0.08,
+        150, -0.1, 0.05 };
+    // Alpha rises linearly with Ca, beta is constant.
+    const double kcaZ[] = {
+        0.0, 1e5, 0.0, 0.0, 1e9,
+        50.0, 0.0, 0.0, 0.0, 1e9,
+        100, 0.0, 0.01 };
+
+    Id na = makeChannel( soma, "Na", 0.94248e-3, EREST + 0.115 );
+    Field< double >::set( na, "Xpower", 3.0 );
+    Field< double >::set( na, "Ypower", 1.0 );
+    Field< int >::set( na, "instant", 1 ); // m is instant.
+    setupGate( na, "gateX", naM );
+    setupGate( na, "gateY", naH );
+
+    Id k = makeChannel( soma, "K", 0.282743e-3, EREST - 0.012 );
+    Field< double >::set( k, "Xpower", 4.0 );
+    setupGate( k, "gateX", kN );
+
+    Id ca = makeChannel( soma, "Ca", 1e-5, 0.05 );
+    Field< double >::set( ca, "Xpower", 1.0 );
+    setupGate( ca, "gateX", kN );
+
+    Id conc = shell->doCreate( "CaConc", soma, "conc", 1 );
+    Field< double >::set( conc, "CaBasal", 1e-4 );
+    Field< double >::set( conc, "tau", 0.02 );
+    Field< double >::set( conc, "B", 1e6 );
+    shell->doAddMsg( "Single", ca, "IkOut", conc, "current" );
+
+    Id kca = makeChannel( soma, "KCa", 1e-4, EREST - 0.012 );
+    Field< double >::set( kca, "Zpower", 1.0 );
+    Field< int >::set( kca, "useConcentration", 1 );
+    setupGate( kca, "gateZ", kcaZ );
+    shell->doAddMsg( "Single", conc, "concOut", kca, "concen" );
+
+    return cell;
+}
+
+/// The fields sampled from the active cell, in the order they are stored.
+static const char* activeCellFields[][ 2 ] = {
+    { "/activeCell/soma", "Vm" },
+    { "/activeCell/dend", "Vm" },
+    { "/activeCell/soma/Na", "X" },
+    { "/activeCell/soma/Na", "Y" },
+    { "/activeCell/soma/K", "X" },
+    { "/activeCell/soma/Ca", "X" },
+    { "/activeCell/soma/KCa", "Z" },
+    { "/activeCell/soma/conc", "Ca" },
+    { "/activeCell/soma/KCa", "Gk" },
+};
+static const unsigned int numActiveCellFields = 9;
+
+/**
+ * Builds a cell and runs it for 20 ms, with or without an HSolve, sampling
+ * the given fields every 2 ms. Returns the cell, for the caller to delete.
+ */
+static Id runCell( Id ( *makeCell )(), const char* fields[][ 2 ],
+    unsigned int numFields, bool useSolver, vector< double >& values )
+{
+    Shell* shell = reinterpret_cast< Shell* >( Id().eref().data() );
+    double dt = 1e-6;
+    Id cell = makeCell();
+    if ( useSolver )
+    {
+        Id hsolve = shell->doCreate( "HSolve", cell, "solver", 1 );
+        Field< double >::set( hsolve, "dt", dt );
+        Field< string >::set( hsolve, "target", cell.path() + "/soma" );
+    }
+    for ( unsigned int i = 0; i < 10; ++i )
+        shell->doSetClock( i, dt );
+    // The unsolved channels only see the initial Vm on the second reinit.
+    shell->doReinit();
+    shell->doReinit();
+
+    values.clear();
+    for ( unsigned int t = 0; t < 10; ++t )
+    {
+        shell->doStart( 2e-3 );
+        for ( unsigned int i = 0; i < numFields; ++i )
+            values.push_back( Field< double >::get(
+                Id( fields[ i ][ 0 ] ), fields[ i ][ 1 ] ) );
+    }
+
+    return cell;
+}
+
+static void deleteCell( Id cell )
+{
+    Shell* shell = reinterpret_cast< Shell* >( Id().eref().data() );
+    shell->doDelete( cell );
+    shell->doReinit();
+}
+
+/*
+ * The fields of the active cell under HSolve, as sampled by runCell,
+ * from the solver as it was before the gates were grouped. Another
+ * compiler, optimization level or libm will differ in the last few
+ * digits, so they are only compared to within 1e-9.
+ */
+static const double savedActiveCell[] = {
+    -0.016675790936230638, -0.068301062600889639, 0.93598695802690213,
+    0.13393041966428207, 0.75492727686020378, 0.75492727686020378,
+    0.20315561363223825, 0.00059456994715121985, 2.0315561363223827e-05,
+    -0.071189096865635265, -0.069017614544861661, 0.045967762523103403,
+    0.20697231891187179, 0.63786661985531623, 0.63786661985531623,
+    0.3670377970005716, 0.0020890376863752572, 3.6703779700057161e-05,
+    -0.072362016997023965, -0.069520248515515554, 0.039929829959469351,
+    0.29956259803659396, 0.53326735604056374, 0.53326735604056374,
+    0.59357292354279012, 0.0032468776403552229, 5.9357292354279018e-05,
+    -0.073972537436423597, -0.06982655893215714, 0.032811347964141535,
+    0.38376246632044464, 0.45412418073531541, 0.45412418073531541,
+    0.75761582167040498, 0.0040993460065184622, 7.5761582167040495e-05,
+    -0.075062808462783681, -0.070021911551206351, 0.028684307509248896,
+    0.45945961526165913, 0.39347454382831898, 0.39347454382831898,
+    0.84653441551142561, 0.0047189331636856621, 8.4653441551142564e-05,
+    -0.075761847795819459, -0.070146781709311129, 0.026301619514499133,
+    0.52488029031421679, 0.34751842206862915, 0.34751842206862915,
+    0.88797515236536895, 0.0051603657934725898, 8.8797515236536904e-05,
+    -0.076234765321712167, -0.070226989445328097, 0.024794340446044495,
+    0.57995236703068831, 0.31298404271802233, 0.31298404271802233,
+    0.90627236866942262, 0.0054681601264471051, 9.0627236866942264e-05,
+    -0.076571969472358781, -0.07027926448895544, 0.023771378899453233,
+    0.62558562776104498, 0.2871530234182505, 0.2871530234182505,
+    0.91454794523943639, 0.0056772238492093473, 9.1454794523943648e-05,
+    -0.076819795882220765, -0.070314052579940084, 0.023042265077773533,
+    0.66302705277319918, 0.26785039507764086, 0.26785039507764086,
+    0.91857031997926863, 0.0058141410702041377, 9.1857031997926862e-05,
+    -0.077004254802302469, -0.070337732752696447, 0.022511732274952945,
+    0.6935399112220062, 0.25342263289679506, 0.25342263289679506,
+    0.92067292777720455, 0.0058988081035851814, 9.2067292777720455e-05
+};
+
+void testHSolveActive()
+{
+    vector< double > ee;
+    vector< double > hsolve;
+    deleteCell( runCell( makeActiveCell, activeCellFields,
+        numActiveCellFields, false, ee ) );
+    deleteCell( runCell( makeActiveCell, activeCellFields,
+        numActiveCellFields, true, hsolve ) );
+    unsigned int numSaved = sizeof( savedActiveCell ) / sizeof( double );
+    ASSERT( ee.size() == numSaved, "HSolveActive" );
+    ASSERT( hsolve.size() == numSaved, "HSolveActive" );
+
+    for ( unsigned int i = 0; i < numSaved; ++i )
+    {
+        // Grouping the gates must not change the answer beyond roundoff.
+        ASSERT( fabs( hsolve[ i ] - savedActiveCell[ i ] ) <=
+            1e-9 * fabs( savedActiveCell[ i ] ), "HSolveActive" );
+
+        // The unsolved objects integrate differently, so only come close.
+        double tol;
+        switch ( i % numActiveCellFields )
+        {
+            case 0: case 1:     // Vm
+                tol = 1e-6;
+                break;
+            case 7: case 8:     // Ca and Gk
+                tol = 2e-3 * fabs( ee[ i ] );
+                break;
+            default:            // Gate states
+                tol = 1e-4;
+        }
+        ASSERT( fabs( hsolve[ i ] - ee[ i ] ) < tol, "HSolveActive" );
+    }
+
+    cout << "." << flush;
+}
+
+/**
+ * Makes a synaptic channel of the given class on the parent, driven
+ * through a SimpleSynHandler by the spike source.
+ */
+static Id makeSynChan( const string& type, Id parent, const string& name,
+    double Gbar, double Ek, double tau1, double tau2, Id spikeGen,
+    double delay )
+{
+    Shell* shell = reinterpret_cast< Shell* >( Id().eref().data() );
+    Id chan = shell->doCreate( type, parent, name, 1 );
+    Field< double >::set( chan, "Gbar", Gbar );
+    Field< double >::set( chan, "Ek", Ek );
+    Field< double >::set( chan, "tau1", tau1 );
+    Field< double >::set( chan, "tau2", tau2 );
+
+    Id handler = shell->doCreate( "SimpleSynHandler", chan, "syns", 1 );
+    Field< unsigned int >::set( handler, "numSynapses", 1 );
+    Id synapse( handler.path() + "/synapse" );
+    Field< double >::set( ObjId( synapse, 0, 0 ), "weight", 1.0 );
+    Field< double >::set( ObjId( synapse, 0, 0 ), "delay", delay );
+    shell->doAddMsg( "Single", spikeGen, "spikeOut",
+        ObjId( synapse, 0, 0 ), "addSpike" );
+    shell->doAddMsg( "Single", handler, "activationOut", chan, "activation" );
+    return chan;
+}
+
+static Id makeCaPool( Id parent, const string& name )
+{
+    Shell* shell = reinterpret_cast< Shell* >( Id().eref().data() );
+    Id conc = shell->doCreate( "CaConc", parent, name, 1 );
+    Field< double >::set( conc, "CaBasal", 1e-4 );
+    Field< double >::set( conc, "tau", 0.02 );
+    Field< double >::set( conc, "B", 1e6 );
+    return conc;
+}
+
+/**
+ * Adds synaptic channels to the active cell, all driven by a SpikeGen
+ * that fires every 3 ms. Taken over by the solver are:
+ * - a SynChan on the soma
+ * - an NMDAChan on the soma, which reads Ca from and feeds the soma pool
+ * - a SynChan reaching the dendrite through an MgBlock
+ * Left to run on their own are:
+ * - a SynChan on the soma that sends IkOut to a pool of its own
+ * - an NMDAChan on the dendrite, whose ICaOut goes to a pool outside
+ *   the cell
+ * - an MgBlock on the dendrite, fed by two SynChans
+ */
+static Id makeSynapticCell()
+{
+    Shell* shell = reinterpret_cast< Shell* >( Id().eref().data() );
+    Id cell = makeActiveCell();
+    Id soma( "/activeCell/soma" );
+    Id dend( "/activeCell/dend" );
+    Id conc( "/activeCell/soma/conc" );
+
+    Id spikeGen = shell->doCreate( "SpikeGen", cell, "input", 1 );
+    Field< double >::set( spikeGen, "threshold", 0.0 );
+    Field< double >::set( spikeGen, "refractT", 3e-3 );
+    Field< bool >::set( spikeGen, "edgeTriggered", false );
+    SetGet1< double >::set( spikeGen, "Vm", 1.0 );
+
+    Id ampa = makeSynChan( "SynChan", soma, "ampa",
+        2e-8, 0.0, 1e-3, 2e-3, spikeGen, 1e-3 );
+    shell->doAddMsg( "Single", soma, "channel", ampa, "channel" );
+
+    Id nmda = makeSynChan( "NMDAChan", soma, "nmda",
+        2e-6, 0.0, 5e-3, 20e-3, spikeGen, 2e-3 );
+    Field< double >::set( nmda, "KMg_A", 0.28 );
+    Field< double >::set( nmda, "KMg_B", 0.016 );
+    Field< double >::set( nmda, "CMg", 1.2 );
+    Field< double >::set( nmda, "condFraction", 0.5 );
+    shell->doAddMsg( "Single", soma, "channel", nmda, "channel" );
+    shell->doAddMsg( "Single", nmda, "ICaOut", conc, "current" );
+    shell->doAddMsg( "Single", conc, "concOut", nmda, "assignIntCa" );
+
+    Id blocked = makeSynChan( "SynChan", dend, "blocked",
+        2e-6, 0.0, 2e-3, 10e-3, spikeGen, 1.5e-3 );
+    Id block = shell->doCreate( "MgBlock", dend, "block", 1 );
+    Field< double >::set( block, "KMg_A", 0.28 );
+    Field< double >::set( block, "KMg_B", 0.016 );
+    Field< double >::set( block, "CMg", 1.2 );
+    shell->doAddMsg( "Single", blocked, "channelOut", block, "origChannel" );
+    shell->doAddMsg( "Single", dend, "channel", block, "channel" );
+
+    Id ampaOut = makeSynChan( "SynChan", soma, "ampaOut",
+        2e-8, 0.0, 1e-3, 2e-3, spikeGen, 2.5e-3 );
+    shell->doAddMsg( "Single", soma, "channel", ampaOut, "channel" );
+    Id ampaPool = makeCaPool( cell, "ampaPool" );
+    shell->doAddMsg( "Single", ampaOut, "IkOut", ampaPool, "current" );
+
+    Id nmdaOut = makeSynChan( "NMDAChan", dend, "nmdaOut",
+        2e-6, 0.0, 5e-3, 20e-3, spikeGen, 0.5e-3 );
+    Field< double >::set( nmdaOut, "KMg_A", 0.28 );
+    Field< double >::set( nmdaOut, "KMg_B", 0.016 );
+    Field< double >::set( nmdaOut, "CMg", 1.2 );
+    Field< double >::set( nmdaOut, "condFraction", 0.5 );
+    shell->doAddMsg( "Single", dend, "channel", nmdaOut, "channel" );
+    Id nmdaPool = makeCaPool( cell, "nmdaPool" );
+    shell->doAddMsg( "Single", nmdaOut, "ICaOut", nmdaPool, "current" );
+    shell->doAddMsg( "Single", nmdaPool, "concOut", nmdaOut, "assignIntCa" );
+
+    Id shared = shell->doCreate( "MgBlock", dend, "shared", 1 );
+    Field< double >::set( shared, "KMg_A", 0.28 );
+    Field< double >::set( shared, "KMg_B", 0.016 );
+    Field< double >::set( shared, "CMg", 1.2 );
+    shell->doAddMsg( "Single", dend, "channel", shared, "channel" );
+    Id shared1 = makeSynChan( "SynChan", dend, "shared1",
+        1e-6, 0.0, 2e-3, 10e-3, spikeGen, 1e-3 );
+    Id shared2 = makeSynChan( "SynChan", dend, "shared2",
+        1e-6, 0.0, 1e-3, 5e-3, spikeGen, 2e-3 );
+    shell->doAddMsg( "Single", shared1, "channelOut", shared, "origChannel" );
+    shell->doAddMsg( "Single", shared2, "channelOut", shared, "origChannel" );
+
+    return cell;
+}
+
+/// The fields sampled from the synaptic cell, in the order they are stored.
+static const char* synapticCellFields[][ 2 ] = {
+    { "/activeCell/soma", "Vm" },
+    { "/activeCell/dend", "Vm" },
+    { "/activeCell/soma/conc", "Ca" },
+    { "/activeCell/ampaPool", "Ca" },
+    { "/activeCell/nmdaPool", "Ca" },
+    { "/activeCell/soma/ampa", "Gk" },
+    { "/activeCell/soma/nmda", "Gk" },
+    { "/activeCell/soma/nmda", "ICa" },
+    { "/activeCell/dend/block", "Gk" },
+    { "/activeCell/soma/ampaOut", "Gk" },
+    { "/activeCell/dend/nmdaOut", "Gk" },
+    { "/activeCell/dend/shared", "Gk" },
+};
+static const unsigned int numSynapticCellFields = 12;
+
+/// Synaptic channels and MgBlocks, with the class the solver leaves them.
+static const char* synapticCellClasses[][ 2 ] = {
+    { "/activeCell/soma/ampa", "ZombieSynChan" },
+    { "/activeCell/soma/nmda", "ZombieNMDAChan" },
+    { "/activeCell/dend/blocked", "ZombieSynChan" },
+    { "/activeCell/dend/block", "ZombieMgBlock" },
+    { "/activeCell/soma/ampaOut", "SynChan" },
+    { "/activeCell/dend/nmdaOut", "NMDAChan" },
+    { "/activeCell/dend/shared", "MgBlock" },
+    { "/activeCell/dend/shared1", "SynChan" },
+    { "/activeCell/dend/shared2", "SynChan" },
+};
+static const unsigned int numSynapticCellClasses = 9;
+
+void testHSolveSynChans()
+{
+    vector< double > ee;
+    vector< double > hsolve;
+    deleteCell( runCell( makeSynapticCell, synapticCellFields,
+        numSynapticCellFields, false, ee ) );
+    Id cell = runCell( makeSynapticCell, synapticCellFields,
+        numSynapticCellFields, true, hsolve );
+    for ( unsigned int i = 0; i < numSynapticCellClasses; ++i )
+        ASSERT( Id( synapticCellClasses[ i ][ 0 ] ).element()->cinfo()->name()
+            == synapticCellClasses[ i ][ 1 ], "HSolveSynChans" );
+    deleteCell( cell );
+
+    ASSERT( ee.size() == hsolve.size(), "HSolveSynChans" );
+    for ( unsigned int i = 0; i < ee.size(); ++i )
+    {
+        // Vm within 1 uV. Ca, Gk and ICa within 0.2%.
+        double tol = 2e-3 * fabs( ee[ i ] );
+        if ( i % numSynapticCellFields < 2 )
+            tol = 1e-6;
+        ASSERT( fabs( hsolve[ i ] - ee[ i ] ) <= tol, "HSolveSynChans" );
+    }
+
+    cout << "." << flush;
+}
+
+#endif // DO_UNIT_TESTS
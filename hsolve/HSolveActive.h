@@ -37,6 +37,22 @@ public:
     void step( ProcPtr info );			///< Equivalent to process
     void reinit( ProcPtr info );
 
+    /**
+     * step() in two parts. advance() only touches this solver's own
+     * arrays, so many cells can be advanced on different threads.
+     * sendOutputs() sends messages, and must be called from one thread.
+     */
+    void advance( ProcPtr info );
+    void sendOutputs( ProcPtr info );
+
+    /**
+     * advance() without the matrix solve: prepareStep() leaves HS_ and HJ_
+     * ready for elimination, and finishStep() carries on from the new
+     * VMid_ and V_. Used when the matrix is solved along with other cells.
+     */
+    void prepareStep( ProcPtr info );
+    void finishStep( ProcPtr info );
+
 protected:
     /**
      * Solver parameters: exposed as fields in MOOSE
@@ -67,6 +83,23 @@ protected:
     double                    caMax_;
     int                       caDiv_;
 
+    /**
+     * lookupMode_, lookupTolerance_:
+     *
+     * How the tables interpolate between divisions: LookupTable::LINEAR,
+     * CUBIC or CHEBYSHEV. A higher-order table is sized automatically, to
+     * the fewest divisions (doubling from a few) at which every gate is
+     * within lookupTolerance_ of its own table. 'div' is then set to the
+     * number chosen.
+     */
+    int                       lookupMode_;
+    double                    lookupTolerance_;
+    vector< Id >              lookupGateId_;	///< Voltage-dependent gates,
+    ///< then Ca-dependent gates.
+    vector< double >          lookupError_;		///< Error of each gate in
+    ///< lookupGateId_, relative to
+    ///< its largest rate.
+
     /**
      * Internal data structures. Will also be accessed in derived class HSolve.
      */
@@ -76,7 +109,9 @@ protected:
     vector< ChannelStruct >   channel_;			///< Vector of channels. Link
     ///< to compartment: chan2compt
     vector< SpikeGenStruct >  spikegen_;
-    vector< SynChanStruct >   synchan_;
+    vector< SynChanStruct >   synchan_;		///< SynChans, NMDAChans and
+    ///< MgBlocks taken over by the
+    ///< solver.
     vector< CaConcStruct >    caConc_;			///< Ca pool info
     vector< double >          ca_;				///< Ca conc in each pool
     vector< double >          caActivation_;	///< Ca current entering each
@@ -95,16 +130,30 @@ protected:
     vector< LookupColumn >    column_;			///< Which column in the table
     ///< to lookup for this species
     vector< LookupRow >       caRowCompt_;      /**< Lookup row buffer.
-		*   For each compartment, the lookup rows for calcium dependent
-		*   channels are loaded into this vector before being used. The vector
-		*   is then reused for the next compartment. This vector therefore has
-		*   a size equal to the maximum number of calcium pools across all
-		*   compartments. This is done in HSolveActive::advanceChannels */
+		*   Has a size equal to the maximum number of calcium pools across
+		*   all compartments, so that an entry stands for a pool within its
+		*   compartment. */
 
     vector< LookupRow* >      caRow_;			/**< Points into caRowCompt.
-		*   For each channel, points to the appropriate pool's LookupRow in the
-		*   caRowCompt vector. This value is then used by the channel. Also
-		*   happens in HSolveActive::advanceChannels */
+		*   For each channel with a Z gate, points to the entry of the pool
+		*   that the gate depends upon, or is 0 for a voltage gate. Used in
+		*   HSolveActive::groupGates to find the pool */
+
+    /**
+     * Gates grouped by how they are advanced, so that advanceChannels
+     * works through each group in one branch-free loop. Set up by
+     * groupGates.
+     */
+    GateGroup                 vGate_;			///< Voltage gates
+    GateGroup                 caGate_;			///< Calcium gates
+    GateGroup                 vInstantGate_;	///< Instant voltage gates
+    GateGroup                 caInstantGate_;	///< Instant calcium gates
+    bool                      gatesDirty_;		/**< Set when the gates need
+		*   to be grouped again, such as after a change in 'instant' */
+    vector< LookupRow >       vLookupRow_;		///< Lookup row of each
+    ///< compartment's Vm.
+    vector< LookupRow >       caLookupRow_;		///< Lookup row of each
+    ///< pool's Ca.
 
     vector< int >             channelCount_;	///< Number of channels in each
     ///< compartment
@@ -140,9 +189,11 @@ private:
     void readGates();
     void readCalcium();
     void readSynapses();
+    bool readSynChan( Id syn, Id block, unsigned int ic );
     void readExternalChannels();
     void createLookupTables();
     void manageOutgoingMessages();
+    void groupGates();
 
     void cleanup();
 
@@ -153,6 +204,7 @@ private:
     void reinitCompartments();
     void reinitCalcium();
     void reinitChannels();
+    void reinitSynChans( ProcPtr info );
 
     /**
      * Integration: Defined in HSolveActive.cpp
@@ -163,6 +215,8 @@ private:
     void backwardSubstitute();
     void advanceCalcium();
     void advanceChannels( double dt );
+    void settleChannels();				///< Gates to steady state
+    void lookupRows();
     void advanceSynChans( ProcPtr info );
     void sendSpikes( ProcPtr info );
     void sendValues( ProcPtr info );
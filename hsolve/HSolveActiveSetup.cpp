@@ -27,6 +27,7 @@ void HSolveActive::setup( Id seed, double dt )
     readSynapses(); // Reads SynChans, SpikeGens. Drops process msg for SpikeGens.
     readExternalChannels();
     manageOutgoingMessages(); // Manages messages going out from the cell's components.
+    gatesDirty_ = true;
 
     //~ reinit();
     cleanup();
@@ -48,6 +49,7 @@ void HSolveActive::reinit( ProcPtr info )
     reinitCompartments();
     reinitCalcium();
     reinitChannels();
+    reinitSynChans( info );
     sendValues( info );
 }
 
@@ -77,72 +79,80 @@ void HSolveActive::reinitCalcium()
 
 void HSolveActive::reinitChannels()
 {
-    vector< double >::iterator iv;
-    vector< double >::iterator istate = state_.begin();
-    vector< int >::iterator ichannelcount = channelCount_.begin();
-    vector< ChannelStruct >::iterator ichan = channel_.begin();
-    vector< ChannelStruct >::iterator chanBoundary;
-    vector< unsigned int >::iterator icacount = caCount_.begin();
-    vector< double >::iterator ica = ca_.begin();
-    vector< double >::iterator caBoundary;
+    // All gates start at steady state, instant or not.
+    settleChannels();
+}
+
+void HSolveActive::reinitSynChans( ProcPtr info )
+{
+    vector< SynChanStruct >::iterator isyn;
+    for ( isyn = synchan_.begin(); isyn != synchan_.end(); ++isyn )
+        isyn->reinit( info->dt );
+}
+
+/**
+ * Sorts the gates into the groups used by advanceChannels. Gates are met
+ * in the order of state_: by compartment, then channel, then X, Y, Z.
+ * A Z gate reads the calcium table if its channel has a pool in caRow_,
+ * else the voltage table.
+ */
+void HSolveActive::groupGates()
+{
+    vGate_.clear();
+    caGate_.clear();
+    vInstantGate_.clear();
+    caInstantGate_.clear();
+
+    unsigned int istate = 0;
     vector< LookupColumn >::iterator icolumn = column_.begin();
-    vector< LookupRow >::iterator icarowcompt;
     vector< LookupRow* >::iterator icarow = caRow_.begin();
-
-    LookupRow vRow;
-    double C1, C2;
-    for ( iv = V_.begin(); iv != V_.end(); ++iv )
+    vector< ChannelStruct >::iterator ichan = channel_.begin();
+    vector< ChannelStruct >::iterator chanBoundary;
+    unsigned int caStart = 0;    // First pool of this compartment in ca_
+    for ( unsigned int ic = 0; ic < nCompt_; ++ic )
     {
-        vTable_.row( *iv, vRow );
-        icarowcompt = caRowCompt_.begin();
-        caBoundary = ica + *icacount;
-        for ( ; ica < caBoundary; ++ica )
-        {
-            caTable_.row( *ica, *icarowcompt );
-            ++icarowcompt;
-        }
-
-        chanBoundary = ichan + *ichannelcount;
+        chanBoundary = ichan + channelCount_[ ic ];
         for ( ; ichan < chanBoundary; ++ichan )
         {
             if ( ichan->Xpower_ > 0.0 )
             {
-                vTable_.lookup( *icolumn, vRow, C1, C2 );
-
-                *istate = C1 / C2;
-
+                GateGroup& g = ( ichan->instant_ & INSTANT_X ) ?
+                    vInstantGate_ : vGate_;
+                g.add( istate, ic, icolumn->column );
                 ++icolumn, ++istate;
             }
 
             if ( ichan->Ypower_ > 0.0 )
             {
-                vTable_.lookup( *icolumn, vRow, C1, C2 );
-
-                *istate = C1 / C2;
-
+                GateGroup& g = ( ichan->instant_ & INSTANT_Y ) ?
+                    vInstantGate_ : vGate_;
+                g.add( istate, ic, icolumn->column );
                 ++icolumn, ++istate;
             }
 
             if ( ichan->Zpower_ > 0.0 )
             {
+                bool instant = ichan->instant_ & INSTANT_Z;
                 LookupRow* caRow = *icarow;
                 if ( caRow )
                 {
-                    caTable_.lookup( *icolumn, *caRow, C1, C2 );
+                    GateGroup& g = instant ? caInstantGate_ : caGate_;
+                    g.add( istate, caStart + ( caRow - &caRowCompt_[ 0 ] ),
+                        icolumn->column );
                 }
                 else
                 {
-                    vTable_.lookup( *icolumn, vRow, C1, C2 );
+                    GateGroup& g = instant ? vInstantGate_ : vGate_;
+                    g.add( istate, ic, icolumn->column );
                 }
-
-                *istate = C1 / C2;
-
                 ++icolumn, ++istate, ++icarow;
             }
         }
 
-        ++ichannelcount, ++icacount;
+        caStart += caCount_[ ic ];
     }
+
+    gatesDirty_ = false;
 }
 
 void HSolveActive::readHHChannels()
@@ -309,6 +319,56 @@ void HSolveActive::readCalcium()
     }
 }
 
+/**
+ * Builds a table for the gates whose rates A and B are sampled over divs
+ * divisions. A LINEAR table holds the samples as they are. A higher-order
+ * table starts with a few divisions, and doubles them until every gate is
+ * within tolerance of its samples, or until it has as many divisions as the
+ * samples. divs is set to the number chosen, and error to that of each gate.
+ */
+static void fitLookupTable(
+    LookupTable& table,
+    double min, double max, int& divs,
+    int mode, double tolerance,
+    const vector< vector< double > >& A,
+    const vector< vector< double > >& B,
+    vector< double >& error )
+{
+    const int minDivs = 8;
+    unsigned int nSpecies = A.size();
+
+    error.assign( nSpecies, 0.0 );
+    if ( mode == LookupTable::LINEAR || nSpecies == 0 || divs <= minDivs )
+    {
+        table = LookupTable( min, max, divs, nSpecies );
+        for ( unsigned int is = 0; is < nSpecies; ++is )
+            table.addColumns( is, A[ is ], B[ is ] );
+        return;
+    }
+
+    int fit = minDivs;
+    while ( 1 )
+    {
+        table = LookupTable( min, max, fit, nSpecies, mode );
+
+        double worst = 0.0;
+        for ( unsigned int is = 0; is < nSpecies; ++is )
+        {
+            table.addColumns( is, A[ is ], B[ is ] );
+            error[ is ] = table.error( is, A[ is ], B[ is ] );
+            if ( error[ is ] > worst )
+                worst = error[ is ];
+        }
+
+        if ( worst <= tolerance || fit == divs )
+            break;
+
+        fit = 2 * fit < divs ? 2 * fit : divs;
+    }
+
+    divs = fit;
+}
+
 void HSolveActive::createLookupTables()
 {
     std::set< Id > caSet;
@@ -383,9 +443,8 @@ void HSolveActive::createLookupTables()
     double vDiv = ( vMax_ - vMin_ ) / vDx;
     vDiv_ = static_cast< int >( vDiv + 0.5 ); // Round-off to nearest int.
 
-    caTable_ = LookupTable( caMin_, caMax_, caDiv_, caGate.size() );
-    vTable_ = LookupTable( vMin_, vMax_, vDiv_, vGate.size() );
-
+    vector< vector< double > > caA( caGate.size() ), caB( caGate.size() );
+    vector< vector< double > > vA( vGate.size() ), vB( vGate.size() );
     vector< double > A, B;
     vector< double >::iterator ia, ib;
     // double a, b;
@@ -424,7 +483,8 @@ void HSolveActive::createLookupTables()
         }
 
         //~ caTable_.addColumns( ig, A, B, interpolate );
-        caTable_.addColumns( ig, A, B );
+        caA[ ig ].swap( A );
+        caB[ ig ].swap( B );
     }
 
     // Voltage-dependent lookup tables
@@ -460,9 +520,22 @@ void HSolveActive::createLookupTables()
         }
 
         //~ vTable_.addColumns( ig, A, B, interpolate );
-        vTable_.addColumns( ig, A, B );
+        vA[ ig ].swap( A );
+        vB[ ig ].swap( B );
     }
 
+    vector< double > caError;
+    vector< double > vError;
+    fitLookupTable( caTable_, caMin_, caMax_, caDiv_,
+                    lookupMode_, lookupTolerance_, caA, caB, caError );
+    fitLookupTable( vTable_, vMin_, vMax_, vDiv_,
+                    lookupMode_, lookupTolerance_, vA, vB, vError );
+
+    lookupGateId_ = vGate;
+    lookupGateId_.insert( lookupGateId_.end(), caGate.begin(), caGate.end() );
+    lookupError_ = vError;
+    lookupError_.insert( lookupError_.end(), caError.begin(), caError.end() );
+
     column_.reserve( gateId_.size() );
     for ( unsigned int ig = 0; ig < gateId_.size(); ++ig )
     {
@@ -496,30 +569,52 @@ void HSolveActive::createLookupTables()
 /**
  * Reads in SynChans and SpikeGens.
  *
- * Unlike Compartments, HHChannels, etc., neither of these are zombified.
- * In other words, their fields are not managed by HSolve, and their "process"
- * functions are invoked to do their calculations. For SynChans, the process
- * calls are made by their respective clocks, and hence the process message is
- * not dropped. On the other hand, we drop the SpikeGen process messages here,
- * and explicitly call the SpikeGen process() from the HSolve via a pointer.
+ * SynChans and NMDAChans on a compartment, and SynChans that reach their
+ * compartment through an MgBlock, are taken over by the solver: their
+ * fields are read into synchan_ here, and they are zombified by HSolve.
+ * Those that talk to objects outside the solver, in ways the solver cannot
+ * stand in for, are left alone: they run their own process, and their
+ * current comes in as an external current.
+ *
+ * SpikeGens are not zombified, but we drop their process messages here, and
+ * explicitly call the SpikeGen process() from the HSolve via a pointer.
  */
 void HSolveActive::readSynapses()
 {
     vector< Id > spikeId;
     vector< Id > synId;
+    vector< Id > blockId;
+    vector< Id > source;
+    vector< Id > sink;
     vector< Id >::iterator syn;
+    vector< Id >::iterator block;
     vector< Id >::iterator spike;
-    SynChanStruct synchan;
 
     for ( unsigned int ic = 0; ic < nCompt_; ++ic )
     {
         synId.clear();
         HSolveUtils::synchans( compartmentId_[ ic ], synId );
         for ( syn = synId.begin(); syn != synId.end(); ++syn )
+            readSynChan( *syn, Id(), ic );
+
+        /*
+         * An MgBlock is taken over along with the SynChan that feeds it, if
+         * the SynChan feeds nothing else.
+         */
+        blockId.clear();
+        HSolveUtils::mgblocks( compartmentId_[ ic ], blockId );
+        for ( block = blockId.begin(); block != blockId.end(); ++block )
         {
-            synchan.compt_ = ic;
-            synchan.elm_ = *syn;
-            synchan_.push_back( synchan );
+            source.clear();
+            HSolveUtils::targets( *block, "origChannel", source );
+            if ( source.size() != 1 ||
+                    source[ 0 ].element()->cinfo()->name() != "SynChan" )
+                continue;
+
+            sink.clear();
+            HSolveUtils::targets( source[ 0 ], "channelOut", sink );
+            if ( sink.size() == 1 )
+                readSynChan( source[ 0 ], *block, ic );
         }
 
         static const Finfo* procDest = SpikeGen::initCinfo()->findFinfo( "process");
@@ -544,6 +639,91 @@ void HSolveActive::readSynapses()
     }
 }
 
+/**
+ * Adds a SynChan or NMDAChan to synchan_, with the MgBlock that it feeds,
+ * if any. Returns false if it has to be left out: if it or the MgBlock
+ * sends its Ik anywhere, or an NMDAChan sends its Ca current anywhere but to one of
+ * this cell's pools.
+ */
+bool HSolveActive::readSynChan( Id syn, Id block, unsigned int ic )
+{
+    vector< Id > target;
+    HSolveUtils::targets( syn, "IkOut", target );
+    if ( block != Id() )
+        HSolveUtils::targets( block, "IkOut", target );
+    if ( !target.empty() )
+        return false;
+
+    SynChanStruct synchan;
+    bool nmda = ( syn.element()->cinfo()->name() == "NMDAChan" );
+    if ( nmda )
+    {
+        target.clear();
+        HSolveUtils::targets( syn, "ICaOut", target );
+        if ( target.size() > 1 )
+            return false;
+
+        if ( target.size() == 1 )
+        {
+            vector< Id >::iterator pool =
+                find( caConcId_.begin(), caConcId_.end(), target[ 0 ] );
+            if ( pool == caConcId_.end() )
+                return false;
+
+            synchan.caTarget_ = pool - caConcId_.begin();
+        }
+
+        /*
+         * A pool of this cell that sets the internal Ca is read directly.
+         * Anything else can still set it through the assignIntCa message.
+         */
+        target.clear();
+        HSolveUtils::targets( syn, "assignIntCa", target );
+        if ( target.size() == 1 )
+        {
+            vector< Id >::iterator pool =
+                find( caConcId_.begin(), caConcId_.end(), target[ 0 ] );
+            if ( pool != caConcId_.end() )
+                synchan.caPool_ = pool - caConcId_.begin();
+        }
+    }
+
+    synchan.compt_ = ic;
+    synchan.elm_ = syn;
+    synchan.block_ = block;
+    synchan.dt_ = dt_;
+    synchan.Gbar_ = Field< double >::get( syn, "Gbar" );
+    synchan.Ek_ = Field< double >::get( syn, "Ek" );
+    synchan.modulation_ = Field< double >::get( syn, "modulation" );
+    synchan.normalizeWeights_ = Field< bool >::get( syn, "normalizeWeights" );
+    synchan.tau1_ = Field< double >::get( syn, "tau1" );
+    synchan.setTau1( synchan.tau1_ );
+    synchan.setTau2( Field< double >::get( syn, "tau2" ) );
+
+    Id mg = nmda ? syn : block;
+    if ( mg != Id() )
+    {
+        synchan.mgBlock_ = true;
+        synchan.KMg_A_ = Field< double >::get( mg, "KMg_A" );
+        synchan.KMg_B_ = Field< double >::get( mg, "KMg_B" );
+        synchan.CMg_ = Field< double >::get( mg, "CMg" );
+    }
+
+    if ( nmda )
+    {
+        synchan.ghk_ = true;
+        synchan.setTemperature( Field< double >::get( syn, "temperature" ) );
+        synchan.Cout_ = Field< double >::get( syn, "extCa" );
+        synchan.Cin_ = Field< double >::get( syn, "intCa" );
+        synchan.intCaScale_ = Field< double >::get( syn, "intCaScale" );
+        synchan.intCaOffset_ = Field< double >::get( syn, "intCaOffset" );
+        synchan.condFraction_ = Field< double >::get( syn, "condFraction" );
+    }
+
+    synchan_.push_back( synchan );
+    return true;
+}
+
 void HSolveActive::readExternalChannels()
 {
     vector< string > filter;
@@ -566,15 +746,33 @@ void HSolveActive::readExternalChannels()
 void HSolveActive::manageOutgoingMessages()
 {
     vector< Id > targets;
+    vector< Id >::iterator itarget;
     vector< string > filter;
 
+    /*
+     * SynChans and MgBlocks taken over by the solver read Vm directly, as do
+     * NMDAChans that read Ca from one of this cell's pools.
+     */
+    set< Id > readsVm;
+    set< Id > readsCa;
+    vector< SynChanStruct >::iterator isyn;
+    for ( isyn = synchan_.begin(); isyn != synchan_.end(); ++isyn )
+    {
+        readsVm.insert( isyn->elm_ );
+        if ( isyn->block_ != Id() )
+            readsVm.insert( isyn->block_ );
+        if ( isyn->caPool_ != -1 )
+            readsCa.insert( isyn->elm_ );
+    }
+
     /*
      * Going through all comparments, and finding out which ones have external
      * targets through the VmOut msg. External refers to objects that do not
      * belong the cell being managed by this HSolve. We find these by excluding
-     * any HHChannels and SpikeGens from the VmOut targets. These will then
-     * be used in HSolveActive::sendValues() to send out the messages behalf of
-     * the original objects.
+     * any HHChannels and SpikeGens from the VmOut targets, and any synaptic
+     * channels read above. These will then be used in
+     * HSolveActive::sendValues() to send out the messages behalf of the
+     * original objects.
      */
     filter.push_back( "HHChannel" );
     filter.push_back( "SpikeGen" );
@@ -582,15 +780,19 @@ void HSolveActive::manageOutgoingMessages()
     {
         targets.clear();
 
-        int nTargets = HSolveUtils::targets(
-                           compartmentId_[ ic ],
-                           "VmOut",
-                           targets,
-                           filter,
-                           false    // include = false. That is, use filter to exclude.
-                       );
+        HSolveUtils::targets(
+            compartmentId_[ ic ],
+            "VmOut",
+            targets,
+            filter,
+            false    // include = false. That is, use filter to exclude.
+        );
 
-        if ( nTargets )
+        for ( itarget = targets.begin(); itarget != targets.end(); ++itarget )
+            if ( readsVm.find( *itarget ) == readsVm.end() )
+                break;
+
+        if ( itarget != targets.end() )
             outVm_.push_back( ic );
     }
 
@@ -604,15 +806,19 @@ void HSolveActive::manageOutgoingMessages()
     {
         targets.clear();
 
-        int nTargets = HSolveUtils::targets(
-                           caConcId_[ ica ],
-                           "concOut",
-                           targets,
-                           filter,
-                           false    // include = false. That is, use filter to exclude.
-                       );
+        HSolveUtils::targets(
+            caConcId_[ ica ],
+            "concOut",
+            targets,
+            filter,
+            false    // include = false. That is, use filter to exclude.
+        );
+
+        for ( itarget = targets.begin(); itarget != targets.end(); ++itarget )
+            if ( readsCa.find( *itarget ) == readsCa.end() )
+                break;
 
-        if ( nTargets )
+        if ( itarget != targets.end() )
             outCa_.push_back( ica );
     }
 }
@@ -53,6 +53,14 @@ void HSolve::mapIds()
     mapIds( channelId_ );
     //~ mapIds( gateId_ );
 
+    // An MgBlock maps to the entry of the SynChan that feeds it.
+    for ( unsigned int i = 0; i < synchan_.size(); ++i )
+    {
+        localIndex_[ synchan_[ i ].elm_ ] = i;
+        if ( synchan_[ i ].block_ != Id() )
+            localIndex_[ synchan_[ i ].block_ ] = i;
+    }
+
     // Doesn't seem to be needed. Perhaps even the externalChannelId_ vector
     // is not needed.
     //~ for ( unsigned int ic = 0; ic < compartmentId_.size(); ++ic )
@@ -252,6 +260,7 @@ void HSolve::setPowers(
     unsigned int index = localIndex( id );
     assert( index < channel_.size() );
     channel_[ index ].setPowers( Xpower, Ypower, Zpower );
+    gatesDirty_ = true;
 }
 
 int HSolve::getInstant( Id id ) const
@@ -266,6 +275,7 @@ void HSolve::setInstant( Id id, int instant )
     unsigned int index = localIndex( id );
     assert( index < channel_.size() );
     channel_[ index ].instant_ = instant;
+    gatesDirty_ = true;
 }
 
 double HSolve::getHHChannelGbar( Id id ) const
@@ -515,3 +525,19 @@ void HSolve::setCaFloor( Id id, double floor )
 
     caConc_[ index ].floor_ = floor;
 }
+
+//////////////////////////////////////////////////////////////////////
+// SynChan interface.
+//////////////////////////////////////////////////////////////////////
+
+/**
+ * The zombie SynChans, NMDAChans and MgBlocks keep a pointer to their
+ * entry, so that fields and activation go straight into the solver.
+ * synchan_ is not resized after setup.
+ */
+SynChanStruct* HSolve::getSynChan( Id id )
+{
+    unsigned int index = localIndex( id );
+    assert( index < synchan_.size() );
+    return &synchan_[ index ];
+}
@@ -449,6 +449,7 @@ bool isClose( T a, T b, T tolerance )
 #include "../shell/Shell.h"
 #include "../basecode/global.h"
 #include "TestHSolve.h"
+#include "HinesBatch.h"
 void testHSolvePassive()
 {
 //    TEST_BEGIN;
@@ -674,6 +675,14 @@ void testHSolvePassive()
      */
     HSolvePassive HP;
 
+    /*
+     * Copies of the same cell, solved together by a HinesBatch. They
+     * should agree exactly with HP.
+     */
+    HSolvePassive HB[ 2 ];
+    vector< unsigned int > sig0;
+    vector< unsigned int > sig1;
+
     /*
      * This is the full reference matrix which will be compared to its sparse
      * implementation.
@@ -760,6 +769,18 @@ void testHSolvePassive()
         }
 
         HP.setup( c[ 0 ], dt );
+        HB[ 0 ].setup( c[ 0 ], dt );
+        HB[ 1 ].setup( c[ 0 ], dt );
+
+        HinesBatch::signature( HB[ 0 ], sig0 );
+        HinesBatch::signature( HB[ 1 ], sig1 );
+        ASSERT( sig0 == sig1, "Batch signature" );
+
+        vector< HSolvePassive* > lanes;
+        lanes.push_back( &HB[ 0 ] );
+        lanes.push_back( &HB[ 1 ] );
+        HinesBatch batch;
+        batch.setup( lanes );
 
         /*
          * Here we check if the cell was read in correctly by the solver.
@@ -860,6 +881,8 @@ void testHSolvePassive()
 
             // Do so in the solver..
             HP.updateMatrix();
+            HB[ 0 ].updateMatrix();
+            HB[ 1 ].updateMatrix();
 
             // ..locally..
             matrix.assign( matrixCopy.begin(), matrixCopy.end() );
@@ -937,6 +960,24 @@ void testHSolvePassive()
             // ..in solver..
             HP.backwardSubstitute();
 
+            // ..and in the batch, which should agree exactly..
+            batch.solve();
+            for ( i = 0; i < nCompt; ++i )
+            {
+                ostringstream error;
+                error << "Batch solve:"
+                      << " Pass " << pass
+                      << " Cell# " << cell + 1
+                      << " V(" << i << ")";
+                ASSERT (
+                    HB[ 0 ].getVMid( i ) == HP.getVMid( i ) &&
+                    HB[ 1 ].getVMid( i ) == HP.getVMid( i ) &&
+                    HB[ 0 ].getV( i ) == HP.getV( i ) &&
+                    HB[ 1 ].getV( i ) == HP.getV( i ),
+                    error.str()
+                );
+            }
+
             // ..and full back-sub on local matrix equation..
             for ( i = nCompt - 1; i >= 0; i-- )
             {
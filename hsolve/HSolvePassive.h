@@ -22,6 +22,9 @@ class HSolvePassive: public HinesMatrix
 #ifdef DO_UNIT_TESTS
 	friend void testHSolvePassive();
 #endif
+	friend class HinesBatch;
+	friend void runHinesBatchBenchmark(
+		unsigned int numCells, unsigned int numSteps );
 	
 public:
 	void setup( Id seed, double dt );
@@ -0,0 +1,593 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**   copyright (C) 2003-2007 Upinder S. Bhalla, Niraj Dudani and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#include "header.h"
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include "HSolveStruct.h"
+#include "HinesMatrix.h"
+#include "HSolvePassive.h"
+#include "RateLookup.h"
+#include "HSolveActive.h"
+#include "HSolve.h"
+#include "HinesBatch.h"
+#include "HSolvePool.h"
+
+const Cinfo* HSolvePool::initCinfo()
+{
+    static DestFinfo process(
+        "process",
+        "Handles 'process' call: advances all the cells by one time-step.",
+        new ProcOpFunc< HSolvePool >( &HSolvePool::process )
+    );
+
+    static DestFinfo reinit(
+        "reinit",
+        "Handles 'reinit' call: reinits all the cells, and deals them out "
+        "to the threads.",
+        new ProcOpFunc< HSolvePool >( &HSolvePool::reinit )
+    );
+
+    static Finfo* processShared[] =
+    {
+        &process,
+        &reinit
+    };
+
+    static SharedFinfo proc(
+        "proc",
+        "Handles 'reinit' and 'process' calls from a clock.",
+        processShared,
+        sizeof( processShared ) / sizeof( Finfo* )
+    );
+
+    static ValueFinfo< HSolvePool, vector< Id > > solvers(
+        "solvers",
+        "HSolve objects to be advanced by this pool. Each must already have "
+        "its target set up. Once in a pool, an HSolve ignores its own "
+        "process and reinit calls. An HSolve can only be in one pool.",
+        &HSolvePool::setSolvers,
+        &HSolvePool::getSolvers
+    );
+
+    static ValueFinfo< HSolvePool, unsigned int > numThreads(
+        "numThreads",
+        "Number of threads used to advance the cells. Cells are dealt out "
+        "to the threads by compartment count, and idle threads take cells "
+        "from busy ones. Results are identical to the single-threaded "
+        "calculation. Default is 1.",
+        &HSolvePool::setNumThreads,
+        &HSolvePool::getNumThreads
+    );
+
+    static ValueFinfo< HSolvePool, bool > interleave(
+        "interleave",
+        "When true, cells with the same tree, such as copies of one neuron, "
+        "have their matrices solved together, several cells at a time, "
+        "with the cells interleaved in memory. Each cell gets the same "
+        "result as on its own. Default is false.",
+        &HSolvePool::setInterleave,
+        &HSolvePool::getInterleave
+    );
+
+    static ReadOnlyValueFinfo< HSolvePool, unsigned int > numInterleaved(
+        "numInterleaved",
+        "Number of cells whose matrices are solved along with other cells "
+        "with the same tree.",
+        &HSolvePool::getNumInterleaved
+    );
+
+    static ReadOnlyValueFinfo< HSolvePool, unsigned int > numSteals(
+        "numSteals",
+        "Number of cells, or batches of interleaved cells, advanced by a "
+        "thread other than the one they were dealt to, since reinit. A "
+        "large number means the compartment counts are a poor guide to "
+        "the work in each cell.",
+        &HSolvePool::getNumSteals
+    );
+
+    static Finfo* hsolvePoolFinfos[] =
+    {
+        &solvers,           // Value
+        &numThreads,        // Value
+        &interleave,        // Value
+        &numInterleaved,    // ReadOnlyValue
+        &numSteals,         // ReadOnlyValue
+        &proc,              // Shared
+    };
+
+    static string doc[] =
+    {
+        "Name",             "HSolvePool",
+        "Author",           "Upinder S. Bhalla, Niraj Dudani, 2007, NCBS",
+        "Description",      "HSolvePool: Advances many HSolve cells together "
+        "on a set of threads.",
+    };
+
+    static Dinfo< HSolvePool > dinfo;
+    static Cinfo hsolvePoolCinfo(
+        "HSolvePool",
+        Neutral::initCinfo(),
+        hsolvePoolFinfos,
+        sizeof( hsolvePoolFinfos ) / sizeof( Finfo* ),
+        &dinfo,
+        doc,
+        sizeof(doc)/sizeof(string)
+    );
+
+    return &hsolvePoolCinfo;
+}
+
+static const Cinfo* hsolvePoolCinfo = HSolvePool::initCinfo();
+
+HSolvePool::HSolvePool()
+    : numThreads_( 1 ), interleave_( false ), numSteals_( 0 )
+{
+    ;
+}
+
+HSolvePool::HSolvePool( const HSolvePool& other )
+{
+    *this = other;
+}
+
+HSolvePool& HSolvePool::operator=( const HSolvePool& other )
+{
+    if ( this == &other )
+        return *this;
+    workers_.stop();
+    solverId_ = other.solverId_;
+    solver_ = other.solver_;
+    unit_ = other.unit_;
+    unitBatch_ = other.unitBatch_;
+    batch_ = other.batch_;
+    queue_ = other.queue_;
+    numThreads_ = other.numThreads_;
+    interleave_ = other.interleave_;
+    numSteals_ = other.numSteals_;
+    return *this;
+}
+
+HSolvePool::~HSolvePool()
+{
+    release();
+}
+
+///////////////////////////////////////////////////
+// Work stealing
+///////////////////////////////////////////////////
+
+/**
+ * Queues of units for one step. Each thread takes units from the front
+ * of its own queue, where the big ones are, and steals from the back of
+ * the others, where the small ones are.
+ */
+struct UnitQueues
+{
+    UnitQueues( const vector< vector< unsigned int > >& q,
+            HSolvePool* hp, ProcPtr proc )
+        : lock( q.size() ), pool( hp ), p( proc ), steals( 0 )
+    {
+        for ( unsigned int i = 0; i < q.size(); ++i )
+            queue.push_back( deque< unsigned int >( q[i].begin(), q[i].end() ) );
+    }
+
+    bool take( unsigned int q, bool front, unsigned int& unit )
+    {
+        std::lock_guard< std::mutex > guard( lock[q] );
+        if ( queue[q].empty() )
+            return false;
+        if ( front ) {
+            unit = queue[q].front();
+            queue[q].pop_front();
+        } else {
+            unit = queue[q].back();
+            queue[q].pop_back();
+        }
+        return true;
+    }
+
+    vector< deque< unsigned int > > queue;
+    vector< std::mutex > lock;
+    HSolvePool* pool;
+    ProcPtr p;
+    std::atomic< unsigned int > steals;
+};
+
+/// Advances units until all the queues are empty. Used by each thread.
+static void stepUnits( UnitQueues* w, unsigned int me )
+{
+    unsigned int n = w->queue.size();
+    unsigned int unit = 0;
+    for ( ; ; ) {
+        if ( !w->take( me, true, unit ) ) {
+            unsigned int k = 1;
+            for ( ; k < n; ++k )
+                if ( w->take( ( me + k ) % n, false, unit ) )
+                    break;
+            if ( k == n )
+                return;
+            ++w->steals;
+        }
+        w->pool->advanceUnit( unit, w->p );
+    }
+}
+
+///////////////////////////////////////////////////
+// Dest function definitions
+///////////////////////////////////////////////////
+
+void HSolvePool::process( const Eref& e, ProcPtr p )
+{
+    if ( queue_.size() <= 1 ) {
+        for ( unsigned int i = 0; i < unit_.size(); ++i )
+            advanceUnit( i, p );
+    } else {
+        // The calling thread works the last queue.
+        UnitQueues work( queue_, this, p );
+        std::function< void( unsigned int ) > job =
+            [&work]( unsigned int me ) { stepUnits( &work, me ); };
+        workers_.run( queue_.size(), job );
+        numSteals_ += work.steals;
+    }
+
+    // Messages go out in a fixed order, whichever thread did the cell.
+    for ( unsigned int i = 0; i < solver_.size(); ++i )
+        solver_[ i ]->sendOutputs( p );
+}
+
+void HSolvePool::advanceUnit( unsigned int unit, ProcPtr p )
+{
+    const vector< unsigned int >& cells = unit_[ unit ];
+    if ( unitBatch_[ unit ] < 0 ) {
+        solver_[ cells[ 0 ] ]->advance( p );
+        return;
+    }
+
+    for ( unsigned int i = 0; i < cells.size(); ++i )
+        solver_[ cells[ i ] ]->prepareStep( p );
+    batch_[ unitBatch_[ unit ] ].solve();
+    for ( unsigned int i = 0; i < cells.size(); ++i )
+        solver_[ cells[ i ] ]->finishStep( p );
+}
+
+void HSolvePool::reinit( const Eref& e, ProcPtr p )
+{
+    schedule();
+    numSteals_ = 0;
+    for ( unsigned int i = 0; i < solver_.size(); ++i )
+        solver_[ i ]->reinitSolver( p );
+}
+
+///////////////////////////////////////////////////
+// Field function definitions
+///////////////////////////////////////////////////
+
+void HSolvePool::setSolvers( vector< Id > solvers )
+{
+    release();
+    for ( vector< Id >::iterator i = solvers.begin(); i != solvers.end(); ++i )
+    {
+        if ( !i->element()->cinfo()->isA( "HSolve" ) )
+        {
+            cerr << "Error: HSolvePool::setSolvers(): '" << i->path()
+                 << "' is not an HSolve.\n";
+            continue;
+        }
+
+        HSolve* hsolve = reinterpret_cast< HSolve* >( i->eref().data() );
+        if ( hsolve->isPooled() )
+        {
+            cerr << "Error: HSolvePool::setSolvers(): '" << i->path()
+                 << "' is already in a pool.\n";
+            continue;
+        }
+
+        hsolve->setPooled( true );
+        solverId_.push_back( *i );
+    }
+    schedule();
+}
+
+vector< Id > HSolvePool::getSolvers() const
+{
+    return solverId_;
+}
+
+void HSolvePool::setNumThreads( unsigned int num )
+{
+    if ( num == 0 )
+        num = 1;
+    numThreads_ = num;
+    schedule();
+}
+
+unsigned int HSolvePool::getNumThreads() const
+{
+    return numThreads_;
+}
+
+void HSolvePool::setInterleave( bool interleave )
+{
+    interleave_ = interleave;
+    schedule();
+}
+
+bool HSolvePool::getInterleave() const
+{
+    return interleave_;
+}
+
+unsigned int HSolvePool::getNumInterleaved() const
+{
+    unsigned int num = 0;
+    for ( unsigned int i = 0; i < batch_.size(); ++i )
+        num += batch_[ i ].size();
+    return num;
+}
+
+unsigned int HSolvePool::getNumSteals() const
+{
+    return numSteals_;
+}
+
+///////////////////////////////////////////////////
+// Utility functions
+///////////////////////////////////////////////////
+
+void HSolvePool::release()
+{
+    workers_.stop();
+    for ( vector< Id >::iterator i = solverId_.begin(); i != solverId_.end(); ++i )
+        if ( Id::isValid( *i ) )
+            reinterpret_cast< HSolve* >( i->eref().data() )->setPooled( false );
+
+    solverId_.clear();
+    solver_.clear();
+    unit_.clear();
+    unitBatch_.clear();
+    batch_.clear();
+    queue_.clear();
+}
+
+void HSolvePool::schedule()
+{
+    workers_.stop();
+    solver_.clear();
+    unit_.clear();
+    unitBatch_.clear();
+    batch_.clear();
+
+    // Cells with the same tree, keyed by HinesBatch::signature.
+    map< vector< unsigned int >, vector< unsigned int > > shape;
+    vector< unsigned int > sig;
+    for ( unsigned int i = 0; i < solverId_.size(); ++i )
+    {
+        HSolve* hsolve = reinterpret_cast< HSolve* >( solverId_[ i ].eref().data() );
+        solver_.push_back( hsolve );
+
+        if ( interleave_ && hsolve->getSize() > 0 )
+        {
+            HinesBatch::signature( *hsolve, sig );
+            shape[ sig ].push_back( i );
+        }
+        else
+        {
+            unit_.push_back( vector< unsigned int >( 1, i ) );
+            unitBatch_.push_back( -1 );
+        }
+    }
+
+    map< vector< unsigned int >, vector< unsigned int > >::iterator s;
+    for ( s = shape.begin(); s != shape.end(); ++s )
+    {
+        const vector< unsigned int >& cells = s->second;
+        if ( cells.size() == 1 )
+        {
+            unit_.push_back( cells );
+            unitBatch_.push_back( -1 );
+            continue;
+        }
+
+        for ( unsigned int i = 0; i < cells.size(); i += HinesBatch::LANES )
+        {
+            unsigned int end = i + HinesBatch::LANES;
+            if ( end > cells.size() )
+                end = cells.size();
+
+            vector< HSolvePassive* > lanes;
+            for ( unsigned int j = i; j < end; ++j )
+                lanes.push_back( solver_[ cells[ j ] ] );
+
+            unit_.push_back( vector< unsigned int >( cells.begin() + i,
+                cells.begin() + end ) );
+            unitBatch_.push_back( batch_.size() );
+            batch_.push_back( HinesBatch() );
+            batch_.back().setup( lanes );
+        }
+    }
+
+    vector< unsigned int > load;
+    for ( unsigned int i = 0; i < unit_.size(); ++i )
+    {
+        unsigned int sum = 0;
+        for ( unsigned int j = 0; j < unit_[ i ].size(); ++j )
+            sum += solver_[ unit_[ i ][ j ] ]->getSize();
+        load.push_back( sum );
+    }
+
+    partition( load, numThreads_, queue_ );
+}
+
+
+static bool biggerLoad(
+    const pair< unsigned int, unsigned int >& a,
+    const pair< unsigned int, unsigned int >& b )
+{
+    return a.first > b.first;
+}
+
+void HSolvePool::partition(
+    const vector< unsigned int >& load,
+    unsigned int numThreads,
+    vector< vector< unsigned int > >& queue )
+{
+    unsigned int n = numThreads;
+    if ( n > load.size() )
+        n = load.size();
+    queue.assign( n, vector< unsigned int >() );
+    if ( n == 0 )
+        return;
+
+    vector< pair< unsigned int, unsigned int > > order;
+    for ( unsigned int i = 0; i < load.size(); ++i )
+        order.push_back( make_pair( load[ i ], i ) );
+    // Biggest first; equal loads keep their order.
+    stable_sort( order.begin(), order.end(), biggerLoad );
+
+    vector< unsigned long > total( n, 0 );
+    for ( unsigned int i = 0; i < order.size(); ++i )
+    {
+        unsigned int q = min_element( total.begin(), total.end() ) - total.begin();
+        queue[ q ].push_back( order[ i ].second );
+        total[ q ] += order[ i ].first;
+    }
+}
+
+///////////////////////////////////////////////////
+// Unit tests
+///////////////////////////////////////////////////
+
+#ifdef DO_UNIT_TESTS
+
+void testHSolvePool()
+{
+    unsigned int load[] = { 10, 1, 1, 1, 7, 3 };
+    vector< unsigned int > l( load, load + 6 );
+    vector< vector< unsigned int > > queue;
+
+    HSolvePool::partition( l, 2, queue );
+    ASSERT( queue.size() == 2, "Testing HSolvePool: number of queues" );
+    vector< unsigned int > seen( l.size(), 0 );
+    unsigned int total[ 2 ] = { 0, 0 };
+    for ( unsigned int q = 0; q < 2; ++q )
+        for ( unsigned int i = 0; i < queue[ q ].size(); ++i )
+        {
+            unsigned int c = queue[ q ][ i ];
+            ++seen[ c ];
+            total[ q ] += l[ c ];
+            if ( i > 0 )
+            {
+                ASSERT( l[ c ] <= l[ queue[ q ][ i - 1 ] ],
+                    "Testing HSolvePool: queue is biggest first" );
+            }
+        }
+    for ( unsigned int c = 0; c < l.size(); ++c )
+        ASSERT( seen[ c ] == 1, "Testing HSolvePool: each cell dealt once" );
+    ASSERT( total[ 0 ] == 12 && total[ 1 ] == 11,
+        "Testing HSolvePool: loads balanced" );
+
+    HSolvePool::partition( l, 10, queue );
+    ASSERT( queue.size() == l.size(), "Testing HSolvePool: no empty queues" );
+
+    HSolvePool::partition( vector< unsigned int >(), 4, queue );
+    ASSERT( queue.empty(), "Testing HSolvePool: no cells" );
+
+    cout << "." << flush;
+}
+
+#include "../shell/Shell.h"
+
+/**
+ * Runs cells of different lengths in an HSolvePool on numThreads
+ * threads, and returns the Vm of every compartment after each ms.
+ */
+static void runPoolCells( unsigned int numThreads, vector< double >& vm )
+{
+    Shell* shell = reinterpret_cast< Shell* >( Id().eref().data() );
+    const unsigned int numCells = 7;
+    const double dt = 50e-6;
+    Id model = shell->doCreate( "Neutral", Id(), "poolTest", 1 );
+    vector< Id > solvers;
+    vector< Id > compts;
+    for ( unsigned int i = 0; i < numCells; ++i )
+    {
+        ostringstream name;
+        name << "cell" << i;
+        Id cell = shell->doCreate( "Neutral", model, name.str(), 1 );
+        unsigned int nCompt = 2 + 3 * i;
+        Id prev;
+        for ( unsigned int j = 0; j < nCompt; ++j )
+        {
+            ostringstream cname;
+            cname << "c" << j;
+            Id c = shell->doCreate( "Compartment", cell, cname.str(), 1 );
+            Field< double >::set( c, "Ra", 1e7 );
+            Field< double >::set( c, "Rm", 1e9 );
+            Field< double >::set( c, "Cm", 1e-11 );
+            Field< double >::set( c, "Em", -0.065 );
+            Field< double >::set( c, "initVm", -0.065 + 0.002 * j );
+            if ( j == 0 )
+                Field< double >::set( c, "inject", 1e-10 * ( i + 1 ) );
+            else
+                shell->doAddMsg( "Single", prev, "axial", c, "raxial" );
+            prev = c;
+            compts.push_back( c );
+        }
+        Id hsolve = shell->doCreate( "HSolve", cell, "solver", 1 );
+        Field< double >::set( hsolve, "dt", dt );
+        Field< string >::set( hsolve, "target", cell.path() );
+        solvers.push_back( hsolve );
+    }
+    Id pool = shell->doCreate( "HSolvePool", model, "pool", 1 );
+    Field< vector< Id > >::set( pool, "solvers", solvers );
+    Field< unsigned int >::set( pool, "numThreads", numThreads );
+    shell->doUseClock( "/poolTest/pool", "process", 0 );
+    shell->doSetClock( 0, dt );
+    shell->doReinit();
+
+    vm.clear();
+    for ( unsigned int t = 0; t < 10; ++t )
+    {
+        shell->doStart( 1e-3 );
+        for ( unsigned int i = 0; i < compts.size(); ++i )
+            vm.push_back( Field< double >::get( compts[ i ], "Vm" ) );
+    }
+    shell->doDelete( pool );
+    shell->doDelete( model );
+    // Later tests expect the clock to start from zero.
+    shell->doReinit();
+}
+
+/**
+ * The cells are advanced on different threads, but each cell's arithmetic
+ * is the same, so the Vm traces must match the serial ones exactly.
+ */
+void testHSolvePoolThreads()
+{
+    vector< double > serial;
+    vector< double > threaded;
+    runPoolCells( 1, serial );
+    ASSERT( serial.size() > 0, "Testing HSolvePool threads: Vm recorded" );
+    ASSERT( serial[ 0 ] != serial[ serial.size() - 1 ],
+        "Testing HSolvePool threads: Vm changes" );
+    for ( unsigned int numThreads = 2; numThreads <= 4; numThreads += 2 )
+    {
+        runPoolCells( numThreads, threaded );
+        ASSERT( threaded == serial,
+            "Testing HSolvePool threads: Vm same as on one thread" );
+    }
+
+    cout << "." << flush;
+}
+
+#endif // DO_UNIT_TESTS
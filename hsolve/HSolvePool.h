@@ -0,0 +1,104 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**   copyright (C) 2003-2007 Upinder S. Bhalla, Niraj Dudani and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#ifndef _HSOLVE_POOL_H
+#define _HSOLVE_POOL_H
+
+#include "../basecode/WorkerPool.h"
+
+class HSolve;
+
+/**
+ * HSolvePool advances a population of cells, each set up by its own
+ * HSolve, on a set of worker threads. The cells are dealt out to the
+ * threads by compartment count, and a thread that runs out of cells
+ * takes the smallest ones left in the other threads' queues. Once all
+ * cells have been advanced, their Vm, Ca and spike messages are sent
+ * from the calling thread, in the order of the solvers list, so the
+ * result does not depend on the number of threads.
+ *
+ * With interleave on, cells with the same tree are grouped in batches
+ * of HinesBatch::LANES, whose matrices are solved together. A batch is
+ * dealt out and stolen as one piece of work.
+ *
+ * The worker threads, one for each queue but the last, come from a
+ * WorkerPool. They are started on the first step and wait between
+ * steps, and are stopped whenever the cells are dealt out again.
+ */
+class HSolvePool
+{
+public:
+    HSolvePool();
+    ~HSolvePool();
+
+    /// Copies the settings and solvers, but not the worker threads.
+    HSolvePool( const HSolvePool& other );
+    HSolvePool& operator=( const HSolvePool& other );
+
+    void process( const Eref& e, ProcPtr p );
+    void reinit( const Eref& e, ProcPtr p );
+
+    void setSolvers( vector< Id > solvers );
+    vector< Id > getSolvers() const;
+
+    void setNumThreads( unsigned int num );
+    unsigned int getNumThreads() const;
+
+    /// Solve cells with the same tree together in HinesBatches.
+    void setInterleave( bool interleave );
+    bool getInterleave() const;
+
+    /// Number of cells that are solved in HinesBatches.
+    unsigned int getNumInterleaved() const;
+
+    /**
+     * Cells or batches advanced by a thread other than the one they were
+     * dealt to.
+     */
+    unsigned int getNumSteals() const;
+
+    /// Advances one piece of work: a single cell, or a batch of cells.
+    void advanceUnit( unsigned int unit, ProcPtr p );
+
+    /**
+     * Deals out units of work with the given loads to numThreads
+     * queues, biggest first, each to the queue with the least load so
+     * far. Each queue is left biggest first. There are no more queues
+     * than units.
+     */
+    static void partition(
+        const vector< unsigned int >& load,
+        unsigned int numThreads,
+        vector< vector< unsigned int > >& queue );
+
+    static const Cinfo* initCinfo();
+
+private:
+    /// Hands the current solvers back to the clock.
+    void release();
+
+    /**
+     * Looks up the solvers, groups them into units of work, and deals the
+     * units out to the threads.
+     */
+    void schedule();
+
+    vector< Id >                        solverId_;
+    vector< HSolve* >                   solver_;
+    vector< vector< unsigned int > >    unit_;      ///< Cells in each unit
+    vector< int >                       unitBatch_; ///< Batch, or -1
+    vector< HinesBatch >                batch_;
+    vector< vector< unsigned int > >    queue_;     ///< Units per thread
+    unsigned int                        numThreads_;
+    bool                                interleave_;
+    unsigned int                        numSteals_;
+    WorkerPool                          workers_;
+};
+
+#endif // _HSOLVE_POOL_H
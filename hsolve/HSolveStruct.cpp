@@ -79,6 +79,147 @@ void SpikeGenStruct::send( ProcPtr info  )
 	spike->process( e_, info );
 }
 
+SynChanStruct::SynChanStruct()
+	:
+		compt_( 0 ),
+		Gbar_( 0.0 ),
+		Ek_( 0.0 ),
+		modulation_( 1.0 ),
+		Gk_( 0.0 ),
+		synGk_( 0.0 ),
+		Vm_( 0.0 ),
+		tau1_( 1.0e-3 ),
+		tau2_( 1.0e-3 ),
+		normalizeWeights_( 0 ),
+		xconst1_( 0.0 ),
+		yconst1_( 1.0 ),
+		xconst2_( 1.0 ),
+		yconst2_( 0.0 ),
+		norm_( 1.0 ),
+		activation_( 0.0 ),
+		X_( 0.0 ),
+		Y_( 0.0 ),
+		dt_( 25.0e-6 ),
+		mgBlock_( false ),
+		KMg_A_( 1.0 ),
+		KMg_B_( 1.0 ),
+		CMg_( 1.0 ),
+		ghk_( false ),
+		temperature_( 300 ),
+		Cout_( 1.5 ),
+		Cin_( 0.0008 ),
+		intCaScale_( 1.0 ),
+		intCaOffset_( 0.0 ),
+		condFraction_( 0.02 ),
+		ICa_( 0.0 ),
+		const_( FaradayConst * 2.0 / ( GasConst * 300 ) ),
+		caPool_( -1 ),
+		caTarget_( -1 )
+{ ; }
+
+void SynChanStruct::setTau1( double tau1 )
+{
+	tau1_ = tau1;
+	xconst1_ = tau1_ * ( 1.0 - exp( -dt_ / tau1_ ) );
+	xconst2_ = exp( -dt_ / tau1_ );
+	normalizeGbar();
+}
+
+void SynChanStruct::setTau2( double tau2 )
+{
+	tau2_ = tau2;
+	if ( doubleEq( tau2_, 0.0 ) ) {
+		yconst1_ = 1.0;
+		yconst2_ = 0.0;
+	} else {
+		yconst1_ = tau2_ * ( 1.0 - exp( -dt_ / tau2_ ) );
+		yconst2_ = exp( -dt_ / tau2_ );
+	}
+	normalizeGbar();
+}
+
+void SynChanStruct::setTemperature( double temperature )
+{
+	temperature_ = temperature;
+	const_ = ( FaradayConst / GasConst ) * 2.0 / temperature_; // Ca valency
+}
+
+/** As SynChan::normalizeGbar */
+void SynChanStruct::normalizeGbar()
+{
+	if ( doubleEq( tau2_, 0.0 ) ) {
+		norm_ = Gbar_;
+	} else if ( doubleEq( tau1_, tau2_ ) ) {
+		norm_ = Gbar_ * exp( 1.0 ) / tau1_;
+	} else {
+		double tpeak = tau1_ * tau2_ * log( tau1_ / tau2_ ) /
+			( tau1_ - tau2_ );
+		norm_ = Gbar_ * ( tau1_ - tau2_ ) /
+			( tau1_ * tau2_ *
+			( exp( -tpeak / tau1_ ) - exp( -tpeak / tau2_ ) ) );
+	}
+}
+
+void SynChanStruct::reinit( double dt )
+{
+	dt_ = dt;
+	activation_ = 0.0;
+	X_ = 0.0;
+	Y_ = 0.0;
+	Gk_ = 0.0;
+	synGk_ = 0.0;
+	ICa_ = 0.0;
+	setTau1( tau1_ );
+	setTau2( tau2_ );
+}
+
+void SynChanStruct::process( double Vm )
+{
+	X_ = modulation_ * activation_ * xconst1_ + X_ * xconst2_;
+	Y_ = X_ * yconst1_ + Y_ * yconst2_;
+	activation_ = 0.0;
+	synGk_ = Y_ * norm_;
+	Gk_ = synGk_;
+	Vm_ = Vm;
+
+	if ( mgBlock_ ) {
+		double KMg = KMg_A_ * exp( Vm / KMg_B_ );
+		Gk_ *= KMg / ( KMg + CMg_ );
+	}
+
+	if ( ghk_ ) {
+		// See NMDAChan::vProcess for the derivation.
+		double dV = log( Cout_ / Cin_ ) / const_;
+		double exponent = const_ * Vm;
+		double e2e = exp( -exponent );
+		if ( fabs( exponent ) < 0.00001 )
+			ICa_ = Gk_ * dV * exponent * ( Cin_ - Cout_ * e2e ) /
+				( ( Cin_ - Cout_ ) * ( 1 - 0.5 * exponent ) );
+		else
+			ICa_ = Gk_ * dV * exponent * ( Cin_ - Cout_ * e2e ) /
+				( ( Cin_ - Cout_ ) * ( 1 - e2e ) );
+		ICa_ *= condFraction_;
+	}
+}
+
+void GateGroup::clear()
+{
+	state.clear();
+	row.clear();
+	column.clear();
+	C1.clear();
+	C2.clear();
+}
+
+void GateGroup::add( unsigned int s, unsigned int r, unsigned int c )
+{
+	state.push_back( s );
+	row.push_back( r );
+	column.push_back( c );
+	C1.push_back( 0.0 );
+	C2.push_back( 0.0 );
+}
+
 CaConcStruct::CaConcStruct()
 	:
 		c_( 0.0 ),
@@ -127,11 +127,93 @@ struct SpikeGenStruct
 	void send( ProcPtr info );
 };
 
+/**
+ * A synaptic channel taken over by the solver: a SynChan or NMDAChan on a
+ * compartment, or a SynChan that reaches its compartment through an
+ * MgBlock. process() does the work of SynChan::calcGk, and of the Mg block
+ * and GHK calculations in NMDAChan::vProcess and MgBlock::vProcess.
+ */
 struct SynChanStruct
 {
-	// Index of parent compartment
-	unsigned int compt_;
-	Id elm_;
+	SynChanStruct();
+
+	unsigned int compt_;	///< Index of parent compartment
+	Id elm_;				///< The SynChan or NMDAChan
+	Id block_;				///< MgBlock between elm_ and the compartment,
+							///< if any.
+
+	double Gbar_;
+	double Ek_;
+	double modulation_;
+	double Gk_;				///< Conductance seen by the compartment
+	double synGk_;			///< Conductance before any Mg block
+	double Vm_;				///< Vm used in the last step
+
+	/// Alpha function terms, as in SynChan.
+	double tau1_;
+	double tau2_;
+	int normalizeWeights_;
+	double xconst1_;
+	double yconst1_;
+	double xconst2_;
+	double yconst2_;
+	double norm_;
+	double activation_;		///< Summed over a step from the SynHandlers
+	double X_;
+	double Y_;
+	double dt_;
+
+	/// Mg block, from the NMDAChan or the MgBlock.
+	bool mgBlock_;
+	double KMg_A_;
+	double KMg_B_;
+	double CMg_;
+
+	/// GHK calculation of the Ca current, for an NMDAChan.
+	bool ghk_;
+	double temperature_;
+	double Cout_;
+	double Cin_;
+	double intCaScale_;
+	double intCaOffset_;
+	double condFraction_;
+	double ICa_;
+	double const_;
+	int caPool_;			///< Pool whose Ca is read into Cin_, or -1
+	int caTarget_;			///< Pool fed by ICa_, or -1
+
+	void setTau1( double tau1 );
+	void setTau2( double tau2 );
+	void setTemperature( double temperature );
+	void normalizeGbar();
+
+	/** Clears the conductance, and computes the constants for dt. */
+	void reinit( double dt );
+
+	/**
+	 * Advances the alpha function by one step, using up the activation,
+	 * and finds Gk_ and ICa_ at the given Vm.
+	 */
+	void process( double Vm );
+};
+
+/**
+ * A group of gates that are all advanced the same way, stored as a
+ * structure of arrays for HSolveActive::advanceChannels. Gate i keeps its
+ * state at state[ i ] in the state vector, and looks up its rates in
+ * column[ i ] of lookup row row[ i ]: the row of a compartment's Vm for
+ * voltage gates, or of a pool's Ca for calcium gates.
+ */
+struct GateGroup
+{
+	vector< unsigned int > state;
+	vector< unsigned int > row;
+	vector< unsigned int > column;
+	vector< double > C1;		///< Rates looked up for each gate.
+	vector< double > C2;
+	
+	void clear();
+	void add( unsigned int s, unsigned int r, unsigned int c );
 };
 
 struct CaConcStruct
@@ -128,7 +128,15 @@ int HSolveUtils::synchans( Id compartment, vector< Id >& ret )
 {
 	// "channel" msgs lead to SynChans as well HHChannels, so request
 	// explicitly for former.
-	return targets( compartment, "channel", ret, "SynChan" );
+	vector< string > filter;
+	filter.push_back( "SynChan" );
+	filter.push_back( "NMDAChan" );
+	return targets( compartment, "channel", ret, filter );
+}
+
+int HSolveUtils::mgblocks( Id compartment, vector< Id >& ret )
+{
+	return targets( compartment, "channel", ret, "MgBlock" );
 }
 
 int HSolveUtils::leakageChannels( Id compartment, vector< Id >& ret )
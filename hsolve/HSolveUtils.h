@@ -35,6 +35,7 @@ public:
     static int gates( Id channel, vector< Id >& ret, bool getOriginals = true );
     static int spikegens( Id compartment, vector< Id >& ret );
     static int synchans( Id compartment, vector< Id >& ret );
+    static int mgblocks( Id compartment, vector< Id >& ret );
     static int leakageChannels( Id compartment, vector< Id >& ret );
     static int caTarget( Id channel, vector< Id >& ret );
     static int caDepend( Id channel, vector< Id >& ret );
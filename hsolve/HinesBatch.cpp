@@ -0,0 +1,346 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**   copyright (C) 2003-2007 Upinder S. Bhalla, Niraj Dudani and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#include "header.h"
+#include "HSolveStruct.h"
+#include "HinesMatrix.h"
+#include "HSolvePassive.h"
+#include "HinesBatch.h"
+
+const unsigned int HinesBatch::LANES;
+
+/*
+ * The lane loops work out their results into a local array before storing
+ * them. The compiler cannot tell that the rows of x_ they read and write
+ * are distinct, and would otherwise not vectorize them.
+ */
+
+/// t -= a / p * c, lane by lane. Same order of operations as HSolvePassive.
+static inline void subDivMul(
+    double* t, const double* a, const double* p, const double* c )
+{
+    double r[ HinesBatch::LANES ];
+    for ( unsigned int l = 0; l < HinesBatch::LANES; ++l )
+        r[ l ] = t[ l ] - a[ l ] / p[ l ] * c[ l ];
+    for ( unsigned int l = 0; l < HinesBatch::LANES; ++l )
+        t[ l ] = r[ l ];
+}
+
+/// vm = ( b - e * next ) / d, lane by lane.
+static inline void backSub(
+    double* vm, const double* b, const double* e, const double* next,
+    const double* d )
+{
+    double r[ HinesBatch::LANES ];
+    for ( unsigned int l = 0; l < HinesBatch::LANES; ++l )
+        r[ l ] = ( b[ l ] - e[ l ] * next[ l ] ) / d[ l ];
+    for ( unsigned int l = 0; l < HinesBatch::LANES; ++l )
+        vm[ l ] = r[ l ];
+}
+
+HinesBatch::HinesBatch()
+    : nCompt_( 0 ), nHJ_( 0 )
+{
+    ;
+}
+
+unsigned int HinesBatch::entry( const HSolvePassive& cell, const double* p )
+{
+    unsigned int nHS = cell.HS_.size();
+    unsigned int nHJ = cell.HJ_.size();
+
+    if ( nHS > 0 && p >= &cell.HS_[ 0 ] && p < &cell.HS_[ 0 ] + nHS )
+        return p - &cell.HS_[ 0 ];
+    if ( nHJ > 0 && p >= &cell.HJ_[ 0 ] && p < &cell.HJ_[ 0 ] + nHJ )
+        return nHS + ( p - &cell.HJ_[ 0 ] );
+
+    assert( p >= &cell.VMid_[ 0 ] && p < &cell.VMid_[ 0 ] + cell.VMid_.size() );
+    return nHS + nHJ + ( p - &cell.VMid_[ 0 ] );
+}
+
+void HinesBatch::signature( const HSolvePassive& cell,
+    vector< unsigned int >& sig )
+{
+    sig.clear();
+    sig.push_back( cell.nCompt_ );
+    sig.push_back( cell.HJ_.size() );
+
+    sig.push_back( cell.junction_.size() );
+    vector< JunctionStruct >::const_iterator junction;
+    for ( junction = cell.junction_.begin();
+            junction != cell.junction_.end();
+            ++junction )
+    {
+        sig.push_back( junction->index );
+        sig.push_back( junction->rank );
+    }
+
+    sig.push_back( cell.operand_.size() );
+    for ( unsigned int i = 0; i < cell.operand_.size(); ++i )
+        sig.push_back( entry( cell, &*cell.operand_[ i ] ) );
+
+    sig.push_back( cell.backOperand_.size() );
+    for ( unsigned int i = 0; i < cell.backOperand_.size(); ++i )
+        sig.push_back( entry( cell, &*cell.backOperand_[ i ] ) );
+}
+
+void HinesBatch::setup( const vector< HSolvePassive* >& cells )
+{
+    assert( cells.size() > 0 && cells.size() <= LANES );
+
+    cell_ = cells;
+    const HSolvePassive& first = *cells[ 0 ];
+    nCompt_ = first.nCompt_;
+    nHJ_ = first.HJ_.size();
+    junction_ = first.junction_;
+
+    op_.clear();
+    for ( unsigned int i = 0; i < first.operand_.size(); ++i )
+        op_.push_back( entry( first, &*first.operand_[ i ] ) );
+
+    backOp_.clear();
+    for ( unsigned int i = 0; i < first.backOperand_.size(); ++i )
+        backOp_.push_back( entry( first, &*first.backOperand_[ i ] ) );
+
+    x_.assign( ( 5 * nCompt_ + nHJ_ ) * LANES, 0.0 );
+    hjCopy_.assign( nHJ_ * LANES, 0.0 );
+
+    /*
+     * The off-diagonal terms of HS_ and the starting HJ_ do not change from
+     * step to step, so they are filled in here once. Spare lanes get a copy
+     * of the first cell, so that they do no harm.
+     */
+    for ( unsigned int l = 0; l < LANES; ++l )
+    {
+        const HSolvePassive& cell = *cell_[ l < cell_.size() ? l : 0 ];
+
+        for ( unsigned int i = 0; i < nCompt_; ++i )
+            x_[ ( 4 * i + 1 ) * LANES + l ] = cell.HS_[ 4 * i + 1 ];
+
+        for ( unsigned int i = 0; i < nHJ_; ++i )
+            hjCopy_[ i * LANES + l ] = cell.HJCopy_[ i ];
+    }
+}
+
+unsigned int HinesBatch::size() const
+{
+    return cell_.size();
+}
+
+double* HinesBatch::at( unsigned int entry )
+{
+    return &x_[ entry * LANES ];
+}
+
+void HinesBatch::solve()
+{
+    if ( nCompt_ == 0 )
+        return;
+
+    gather();
+    forwardEliminate();
+    backwardSubstitute();
+    scatter();
+}
+
+/**
+ * Copies the diagonal and right hand side of each cell's HS_ into its lane,
+ * and resets the junction terms. Nothing else in HS_ changes between steps.
+ */
+void HinesBatch::gather()
+{
+    for ( unsigned int l = 0; l < LANES; ++l )
+    {
+        const double* hs = &cell_[ l < cell_.size() ? l : 0 ]->HS_[ 0 ];
+        double* x = &x_[ l ];
+
+        for ( unsigned int i = 0; i < nCompt_; ++i )
+        {
+            x[ 4 * i * LANES ] = hs[ 4 * i ];
+            x[ ( 4 * i + 3 ) * LANES ] = hs[ 4 * i + 3 ];
+        }
+    }
+
+    if ( nHJ_ != 0 )
+        memcpy( at( 4 * nCompt_ ), &hjCopy_[ 0 ], sizeof( double ) * nHJ_ * LANES );
+}
+
+void HinesBatch::forwardEliminate()
+{
+    unsigned int ic = 0;
+    unsigned int iop = 0;
+    vector< JunctionStruct >::iterator junction;
+
+    for ( junction = junction_.begin();
+            junction != junction_.end();
+            junction++ )
+    {
+        unsigned int index = junction->index;
+        unsigned int rank = junction->rank;
+
+        while ( ic < index )
+        {
+            subDivMul( at( 4 * ic + 4 ), at( 4 * ic + 1 ), at( 4 * ic ), at( 4 * ic + 1 ) );
+            subDivMul( at( 4 * ic + 7 ), at( 4 * ic + 1 ), at( 4 * ic ), at( 4 * ic + 3 ) );
+
+            ++ic;
+        }
+
+        const double* pivot = at( 4 * ic );
+        if ( rank == 1 )
+        {
+            unsigned int j = op_[ iop ];
+            unsigned int s = op_[ iop + 1 ];
+
+            subDivMul( at( s ), at( j + 1 ), pivot, at( j ) );
+            subDivMul( at( s + 3 ), at( j + 1 ), pivot, at( 4 * ic + 3 ) );
+
+            iop += 3;
+        }
+        else if ( rank == 2 )
+        {
+            unsigned int j = op_[ iop ];
+            unsigned int s;
+
+            s = op_[ iop + 1 ];
+            subDivMul( at( s ), at( j + 1 ), pivot, at( j ) );
+            subDivMul( at( j + 4 ), at( j + 1 ), pivot, at( j + 2 ) );
+            subDivMul( at( s + 3 ), at( j + 1 ), pivot, at( 4 * ic + 3 ) );
+
+            s = op_[ iop + 3 ];
+            subDivMul( at( j + 5 ), at( j + 3 ), pivot, at( j ) );
+            subDivMul( at( s ), at( j + 3 ), pivot, at( j + 2 ) );
+            subDivMul( at( s + 3 ), at( j + 3 ), pivot, at( 4 * ic + 3 ) );
+
+            iop += 5;
+        }
+        else
+        {
+            unsigned int end = iop + 3 * rank * ( rank + 1 );
+            for ( ; iop < end; iop += 3 )
+                subDivMul( at( op_[ iop ] ), at( op_[ iop + 2 ] ), pivot,
+                    at( op_[ iop + 1 ] ) );
+        }
+
+        ++ic;
+    }
+
+    while ( ic < nCompt_ - 1 )
+    {
+        subDivMul( at( 4 * ic + 4 ), at( 4 * ic + 1 ), at( 4 * ic ), at( 4 * ic + 1 ) );
+        subDivMul( at( 4 * ic + 7 ), at( 4 * ic + 1 ), at( 4 * ic ), at( 4 * ic + 3 ) );
+
+        ++ic;
+    }
+}
+
+/**
+ * As HSolvePassive::backwardSubstitute, which walks operand_ and
+ * backOperand_ from the end. Here iop and ibop count down from the end.
+ */
+void HinesBatch::backwardSubstitute()
+{
+    unsigned int vmid = 4 * nCompt_ + nHJ_;
+    int ic = nCompt_ - 1;
+    unsigned int iop = op_.size();
+    unsigned int ibop = backOp_.size();
+    vector< JunctionStruct >::reverse_iterator junction;
+
+    double* vm = at( vmid + ic );
+    const double* b = at( 4 * ic + 3 );
+    const double* d = at( 4 * ic );
+    for ( unsigned int l = 0; l < LANES; ++l )
+        vm[ l ] = b[ l ] / d[ l ];
+    --ic;
+
+    for ( junction = junction_.rbegin();
+            junction != junction_.rend();
+            junction++ )
+    {
+        int index = junction->index;
+        int rank = junction->rank;
+
+        while ( ic > index )
+        {
+            backSub( at( vmid + ic ), at( 4 * ic + 3 ), at( 4 * ic + 1 ),
+                at( vmid + ic + 1 ), at( 4 * ic ) );
+            --ic;
+        }
+
+        vm = at( vmid + ic );
+        b = at( 4 * ic + 3 );
+        d = at( 4 * ic );
+        if ( rank == 1 )
+        {
+            const double* v = at( op_[ iop - 1 ] );
+            const double* j = at( op_[ iop - 3 ] );
+            for ( unsigned int l = 0; l < LANES; ++l )
+                vm[ l ] = ( b[ l ] - v[ l ] * j[ l ] ) / d[ l ];
+
+            iop -= 3;
+        }
+        else if ( rank == 2 )
+        {
+            const double* v0 = at( op_[ iop - 1 ] );
+            const double* v1 = at( op_[ iop - 3 ] );
+            const double* j0 = at( op_[ iop - 5 ] );
+            const double* j2 = at( op_[ iop - 5 ] + 2 );
+            for ( unsigned int l = 0; l < LANES; ++l )
+                vm[ l ] = ( b[ l ]
+                            - v0[ l ] * j2[ l ]
+                            - v1[ l ] * j0[ l ]
+                          ) / d[ l ];
+
+            iop -= 5;
+        }
+        else
+        {
+            for ( unsigned int l = 0; l < LANES; ++l )
+                vm[ l ] = b[ l ];
+            for ( int i = 0; i < rank; ++i )
+            {
+                const double* v = at( backOp_[ ibop - 1 ] );
+                const double* j = at( backOp_[ ibop - 2 ] );
+                for ( unsigned int l = 0; l < LANES; ++l )
+                    vm[ l ] -= v[ l ] * j[ l ];
+                ibop -= 2;
+            }
+            for ( unsigned int l = 0; l < LANES; ++l )
+                vm[ l ] /= d[ l ];
+
+            iop -= 3 * rank * ( rank + 1 );
+        }
+
+        --ic;
+    }
+
+    while ( ic >= 0 )
+    {
+        backSub( at( vmid + ic ), at( 4 * ic + 3 ), at( 4 * ic + 1 ),
+            at( vmid + ic + 1 ), at( 4 * ic ) );
+        --ic;
+    }
+}
+
+/// Copies VMid back to each cell, and brings its V to the end of the step.
+void HinesBatch::scatter()
+{
+    unsigned int vmid = 4 * nCompt_ + nHJ_;
+    for ( unsigned int l = 0; l < cell_.size(); ++l )
+    {
+        HSolvePassive& cell = *cell_[ l ];
+        const double* x = &x_[ vmid * LANES + l ];
+
+        for ( unsigned int i = 0; i < nCompt_; ++i )
+        {
+            cell.VMid_[ i ] = x[ i * LANES ];
+            cell.V_[ i ] = 2 * cell.VMid_[ i ] - cell.V_[ i ];
+        }
+    }
+}
@@ -0,0 +1,76 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**   copyright (C) 2003-2007 Upinder S. Bhalla, Niraj Dudani and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#ifndef _HINES_BATCH_H
+#define _HINES_BATCH_H
+
+/**
+ * HinesBatch solves the Hines matrices of up to LANES cells with the same
+ * tree at once. The matrices are stored interleaved, entry by entry, with
+ * one lane per cell, so each step of forward elimination and backward
+ * substitution is a loop over the lanes that the compiler can vectorize.
+ * The operations are the ones in HSolvePassive, in the same order, so each
+ * lane gets exactly the result its cell would get on its own.
+ *
+ * The operands of HinesMatrix are iterators into HS_, HJ_ and VMid_. Here
+ * they become offsets into a single entry space holding HS_, then HJ_,
+ * then VMid_, which is the same for every cell with the same tree.
+ *
+ * The batch keeps the parts of the matrices that never change. Each step
+ * it only gathers the diagonal and right hand side that the cells'
+ * updateMatrix() wrote, and scatters VMid_ and V_ back. 'moose -b hines'
+ * times this against solving the cells one by one.
+ */
+class HinesBatch
+{
+public:
+    static const unsigned int LANES = 8;
+
+    HinesBatch();
+
+    /**
+     * Describes the shape of the matrix: cells with equal signatures can
+     * go in the same batch.
+     */
+    static void signature( const HSolvePassive& cell,
+        vector< unsigned int >& sig );
+
+    /// Takes up to LANES cells, all with the same signature.
+    void setup( const vector< HSolvePassive* >& cells );
+
+    /**
+     * Does forwardEliminate() and backwardSubstitute() for all the cells,
+     * on the HS_ and HJ_ left by their updateMatrix().
+     */
+    void solve();
+
+    unsigned int size() const;
+
+private:
+    void gather();
+    void forwardEliminate();
+    void backwardSubstitute();
+    void scatter();
+
+    double* at( unsigned int entry );
+
+    /// Offset in the entry space of a pointer into the cell's arrays.
+    static unsigned int entry( const HSolvePassive& cell, const double* p );
+
+    vector< HSolvePassive* >    cell_;
+    unsigned int                nCompt_;
+    unsigned int                nHJ_;
+    vector< JunctionStruct >    junction_;
+    vector< unsigned int >      op_;        ///< Offsets for operand_
+    vector< unsigned int >      backOp_;    ///< Offsets for backOperand_
+    vector< double >            x_;         ///< HS_, HJ_, VMid_ by lane
+    vector< double >            hjCopy_;    ///< HJCopy_ by lane
+};
+
+#endif // _HINES_BATCH_H
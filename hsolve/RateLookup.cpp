@@ -8,24 +8,41 @@
 **********************************************************************/
 
 #include <vector>
+#include <cmath>
+#include <cassert>
 using namespace std;
 
 #include "RateLookup.h"
 
+const int LookupTable::LINEAR = 0;
+const int LookupTable::CUBIC = 1;
+const int LookupTable::CHEBYSHEV = 2;
+
 LookupTable::LookupTable(
-	double min, double max, unsigned int nDivs, unsigned int nSpecies )
+	double min, double max, unsigned int nDivs, unsigned int nSpecies,
+	int mode )
 {
 	min_ = min;
 	max_ = max;
-	// Number of points is 1 more than number of divisions.
-	// Then add one more since we may interpolate at the last point in the table.
-	nPts_ = nDivs + 1 + 1;
+	mode_ = mode;
+	if ( mode_ == LINEAR ) {
+		// Number of points is 1 more than number of divisions.
+		// Then add one more since we may interpolate at the last point in the table.
+		nPts_ = nDivs + 1 + 1;
+		nCoeffs_ = 1;
+	} else {
+		// A cubic needs only its own row, so the last point needs no
+		// neighbour.
+		nPts_ = nDivs + 1;
+		nCoeffs_ = 4;
+	}
 	dx_ = ( max - min ) / nDivs;
 	// Every row has 2 entries for each type of gate
 	nColumns_ = 2 * nSpecies;
+	rowSize_ = nColumns_ * nCoeffs_;
 	
 	//~ interpolate_.resize( nSpecies );
-	table_.resize( nPts_ * nColumns_ );
+	table_.resize( nPts_ * rowSize_ );
 }
 
 void LookupTable::addColumns(
@@ -35,6 +52,12 @@ void LookupTable::addColumns(
 	//~ const vector< double >& C2,
 	//~ bool interpolate )
 {
+	if ( mode_ != LINEAR ) {
+		fitColumn( 2 * species, C1 );
+		fitColumn( 2 * species + 1, C2 );
+		return;
+	}
+	
 	vector< double >::const_iterator ic1 = C1.begin();
 	vector< double >::const_iterator ic2 = C2.begin();
 	vector< double >::iterator iTable = table_.begin() + 2 * species;
@@ -53,9 +76,161 @@ void LookupTable::addColumns(
 	//~ interpolate_[ species ] = interpolate;
 }
 
+/**
+ * Value of the samples C, spaced sdx apart from min, at x. The samples are
+ * joined by straight lines, as in a linear table.
+ */
+static double sample(
+	const vector< double >& C, double min, double sdx, double x )
+{
+	double div = ( x - min ) / sdx;
+	if ( div <= 0.0 )
+		return C.front();
+	
+	unsigned int integer = ( unsigned int )( div );
+	if ( integer >= C.size() - 1 )
+		return C.back();
+	
+	double fraction = div - integer;
+	return C[ integer ] + ( C[ integer + 1 ] - C[ integer ] ) * fraction;
+}
+
+/**
+ * Coefficients, in powers of the fraction t, of the cubic through the
+ * values at the 4 Chebyshev points of [0, 1]. basis[ k ][ j ] is the
+ * coefficient of t^j in the Lagrange polynomial of point k.
+ */
+static void chebyshevBasis( double node[ 4 ], double basis[ 4 ][ 4 ] )
+{
+	for ( unsigned int k = 0; k < 4; ++k )
+		node[ k ] = 0.5 * ( 1.0 - cos( ( 2 * k + 1 ) * M_PI / 8.0 ) );
+	
+	for ( unsigned int k = 0; k < 4; ++k ) {
+		double p[ 4 ] = { 1.0, 0.0, 0.0, 0.0 };
+		double scale = 1.0;
+		unsigned int degree = 0;
+		for ( unsigned int m = 0; m < 4; ++m ) {
+			if ( m == k )
+				continue;
+			
+			// p *= ( t - node[ m ] )
+			++degree;
+			for ( unsigned int j = degree; j > 0; --j )
+				p[ j ] = p[ j - 1 ] - node[ m ] * p[ j ];
+			p[ 0 ] *= -node[ m ];
+			
+			scale *= node[ k ] - node[ m ];
+		}
+		
+		for ( unsigned int j = 0; j < 4; ++j )
+			basis[ k ][ j ] = p[ j ] / scale;
+	}
+}
+
+void LookupTable::fitColumn( unsigned int column, const vector< double >& C )
+{
+	assert( C.size() >= 2 );
+	
+	double sdx = ( max_ - min_ ) / ( C.size() - 1 );
+	unsigned int nDivs = nPts_ - 1;
+	
+	double node[ 4 ];
+	double basis[ 4 ][ 4 ];
+	if ( mode_ == CHEBYSHEV )
+		chebyshevBasis( node, basis );
+	
+	double* p = &table_[ column * nCoeffs_ ];
+	for ( unsigned int i = 0; i < nDivs; ++i, p += rowSize_ ) {
+		double x0 = min_ + i * dx_;
+		
+		if ( mode_ == CUBIC ) {
+			double x1 = x0 + dx_;
+			double y0 = sample( C, min_, sdx, x0 );
+			double y1 = sample( C, min_, sdx, x1 );
+			
+			// Slopes by central differences over the samples, one-sided at
+			// the ends, and scaled to a unit division.
+			double lo, hi;
+			lo = x0 - sdx > min_ ? x0 - sdx : min_;
+			hi = x0 + sdx < max_ ? x0 + sdx : max_;
+			double m0 = dx_ *
+				( sample( C, min_, sdx, hi ) - sample( C, min_, sdx, lo ) ) /
+				( hi - lo );
+			lo = x1 - sdx > min_ ? x1 - sdx : min_;
+			hi = x1 + sdx < max_ ? x1 + sdx : max_;
+			double m1 = dx_ *
+				( sample( C, min_, sdx, hi ) - sample( C, min_, sdx, lo ) ) /
+				( hi - lo );
+			
+			p[ 0 ] = y0;
+			p[ 1 ] = m0;
+			p[ 2 ] = 3.0 * ( y1 - y0 ) - 2.0 * m0 - m1;
+			p[ 3 ] = 2.0 * ( y0 - y1 ) + m0 + m1;
+		} else {
+			double y[ 4 ];
+			for ( unsigned int k = 0; k < 4; ++k )
+				y[ k ] = sample( C, min_, sdx, x0 + node[ k ] * dx_ );
+			
+			for ( unsigned int j = 0; j < 4; ++j ) {
+				p[ j ] = 0.0;
+				for ( unsigned int k = 0; k < 4; ++k )
+					p[ j ] += basis[ k ][ j ] * y[ k ];
+			}
+		}
+	}
+	
+	// The last row is only read at max, where the fraction is 0.
+	p[ 0 ] = C.back();
+	p[ 1 ] = p[ 2 ] = p[ 3 ] = 0.0;
+}
+
+double LookupTable::error(
+	unsigned int species,
+	const vector< double >& C1,
+	const vector< double >& C2 )
+{
+	assert( C1.size() >= 2 && C1.size() == C2.size() );
+	
+	double scale1 = 0.0;
+	double scale2 = 0.0;
+	for ( unsigned int i = 0; i < C1.size(); ++i ) {
+		if ( fabs( C1[ i ] ) > scale1 )
+			scale1 = fabs( C1[ i ] );
+		if ( fabs( C2[ i ] ) > scale2 )
+			scale2 = fabs( C2[ i ] );
+	}
+	// A column that is all zero is measured in absolute terms.
+	if ( scale1 == 0.0 )
+		scale1 = 1.0;
+	if ( scale2 == 0.0 )
+		scale2 = 1.0;
+	
+	LookupColumn col;
+	LookupRow r;
+	double c1, c2;
+	double e1 = 0.0;
+	double e2 = 0.0;
+	double sdx = ( max_ - min_ ) / ( C1.size() - 1 );
+	
+	column( species, col );
+	for ( unsigned int i = 0; i < C1.size(); ++i ) {
+		row( min_ + i * sdx, r );
+		lookup( col, r, c1, c2 );
+		
+		if ( fabs( c1 - C1[ i ] ) > e1 )
+			e1 = fabs( c1 - C1[ i ] );
+		if ( fabs( c2 - C2[ i ] ) > e2 )
+			e2 = fabs( c2 - C2[ i ] );
+	}
+	
+	e1 /= scale1;
+	e2 /= scale2;
+	return e1 > e2 ? e1 : e2;
+}
+
 void LookupTable::column( unsigned int species, LookupColumn& column )
 {
-	column.column = 2 * species;
+	column.column = 2 * species * nCoeffs_;
 	//~ column.interpolate = interpolate_[ species ];
 }
 
@@ -70,7 +245,7 @@ void LookupTable::row( double x, LookupRow& row )
 	unsigned int integer = ( unsigned int )( div );
 	
 	row.fraction = div - integer;
-	row.row = &( table_.front() ) + integer * nColumns_;
+	row.row = &( table_.front() ) + integer * rowSize_;
 }
 
 void LookupTable::lookup(
@@ -84,6 +259,13 @@ void LookupTable::lookup(
 	
 	ap = row.row + column.column;
 	
+	if ( mode_ != LINEAR ) {
+		double f = row.fraction;
+		C1 = ap[ 0 ] + f * ( ap[ 1 ] + f * ( ap[ 2 ] + f * ap[ 3 ] ) );
+		C2 = ap[ 4 ] + f * ( ap[ 5 ] + f * ( ap[ 6 ] + f * ap[ 7 ] ) );
+		return;
+	}
+	
 	//~ if ( ! column.interpolate ) {
 		//~ C1 = *ap;
 		//~ C2 = *( ap + 1 );
@@ -91,7 +273,7 @@ void LookupTable::lookup(
 		//~ return;
 	//~ }
 	
-	bp = ap + nColumns_;
+	bp = ap + rowSize_;
 	
 	a = *ap;
 	b = *bp;
@@ -101,3 +283,144 @@ void LookupTable::lookup(
 	b = *( bp + 1 );
 	C2 = a + ( b - a ) * row.fraction;
 }
+
+void LookupTable::rows( const vector< double >& x, vector< LookupRow >& row )
+{
+	row.resize( x.size() );
+	for ( unsigned int i = 0; i < x.size(); ++i )
+		this->row( x[ i ], row[ i ] );
+}
+
+void LookupTable::lookup(
+	const vector< unsigned int >& column,
+	const vector< unsigned int >& index,
+	const vector< LookupRow >& row,
+	vector< double >& C1,
+	vector< double >& C2 )
+{
+	double a, b;
+	double *ap, *bp;
+	
+	if ( mode_ != LINEAR ) {
+		double f;
+		for ( unsigned int i = 0; i < column.size(); ++i ) {
+			const LookupRow& r = row[ index[ i ] ];
+			ap = r.row + column[ i ];
+			f = r.fraction;
+			
+			C1[ i ] = ap[ 0 ] + f * ( ap[ 1 ] + f * ( ap[ 2 ] + f * ap[ 3 ] ) );
+			C2[ i ] = ap[ 4 ] + f * ( ap[ 5 ] + f * ( ap[ 6 ] + f * ap[ 7 ] ) );
+		}
+		return;
+	}
+	
+	for ( unsigned int i = 0; i < column.size(); ++i ) {
+		const LookupRow& r = row[ index[ i ] ];
+		ap = r.row + column[ i ];
+		bp = ap + rowSize_;
+		
+		a = *ap;
+		b = *bp;
+		C1[ i ] = a + ( b - a ) * r.fraction;
+		
+		a = *( ap + 1 );
+		b = *( bp + 1 );
+		C2[ i ] = a + ( b - a ) * r.fraction;
+	}
+}
+
+unsigned int LookupTable::nDivs() const
+{
+	return mode_ == LINEAR ? nPts_ - 2 : nPts_ - 1;
+}
+
+int LookupTable::mode() const
+{
+	return mode_;
+}
+
+#ifdef DO_UNIT_TESTS
+
+#include "header.h"
+#include "HinesMatrix.h"		// For ASSERT
+
+void testRateLookup()
+{
+	/*
+	 * Rates of a gate, finely sampled, as the solver reads them from the
+	 * gate's own table.
+	 */
+	double min = -0.1;
+	double max = 0.05;
+	unsigned int nSamples = 3000;
+	vector< double > A( nSamples + 1 );
+	vector< double > B( nSamples + 1 );
+	for ( unsigned int i = 0; i <= nSamples; ++i ) {
+		double v = min + i * ( max - min ) / nSamples;
+		A[ i ] = 1.0 / ( 1.0 + exp( -( v + 0.04 ) / 0.005 ) );
+		B[ i ] = 0.1 * exp( -( v + 0.065 ) / 0.02 );
+	}
+	
+	// A linear table on the samples holds them exactly.
+	LookupTable linear( min, max, nSamples, 1 );
+	linear.addColumns( 0, A, B );
+	ASSERT( linear.nDivs() == nSamples, "RateLookup" );
+	ASSERT( linear.error( 0, A, B ) < 1.0e-12, "RateLookup" );
+	
+	LookupTable small( min, max, 64, 1 );
+	vector< double > smallA( 65 );
+	vector< double > smallB( 65 );
+	for ( unsigned int i = 0; i <= 64; ++i ) {
+		smallA[ i ] = A[ i * nSamples / 64 ];
+		smallB[ i ] = B[ i * nSamples / 64 ];
+	}
+	small.addColumns( 0, smallA, smallB );
+	double linearError = small.error( 0, A, B );
+	
+	// The cubic tables are far closer with as few divisions.
+	LookupTable cubic( min, max, 64, 1, LookupTable::CUBIC );
+	cubic.addColumns( 0, A, B );
+	ASSERT( cubic.nDivs() == 64, "RateLookup" );
+	ASSERT( cubic.error( 0, A, B ) < 1.0e-4, "RateLookup" );
+	ASSERT( cubic.error( 0, A, B ) < linearError / 10.0, "RateLookup" );
+	
+	LookupTable chebyshev( min, max, 64, 1, LookupTable::CHEBYSHEV );
+	chebyshev.addColumns( 0, A, B );
+	ASSERT( chebyshev.error( 0, A, B ) < 1.0e-5, "RateLookup" );
+	
+	// Lookups at either end, and beyond, give the end values.
+	LookupColumn column;
+	LookupRow row;
+	double C1, C2;
+	chebyshev.column( 0, column );
+	
+	chebyshev.row( max + 1.0, row );
+	chebyshev.lookup( column, row, C1, C2 );
+	ASSERT( doubleEq( C1, A.back() ) && doubleEq( C2, B.back() ),
+		"RateLookup" );
+	
+	chebyshev.row( min - 1.0, row );
+	chebyshev.lookup( column, row, C1, C2 );
+	ASSERT( fabs( C1 - A.front() ) < 1.0e-5 &&
+		fabs( C2 - B.front() ) < 1.0e-5 * B.front(), "RateLookup" );
+	
+	// The batched lookup agrees with the single one.
+	vector< double > x( 3 );
+	x[ 0 ] = -0.07; x[ 1 ] = -0.04; x[ 2 ] = 0.01;
+	vector< LookupRow > rows;
+	chebyshev.rows( x, rows );
+	vector< unsigned int > columns( 3, column.column );
+	vector< unsigned int > index( 3 );
+	index[ 0 ] = 0; index[ 1 ] = 1; index[ 2 ] = 2;
+	vector< double > batchC1( 3 ), batchC2( 3 );
+	chebyshev.lookup( columns, index, rows, batchC1, batchC2 );
+	for ( unsigned int i = 0; i < 3; ++i ) {
+		chebyshev.row( x[ i ], row );
+		chebyshev.lookup( column, row, C1, C2 );
+		ASSERT( batchC1[ i ] == C1 && batchC2[ i ] == C2, "RateLookup" );
+	}
+	
+	cout << "." << flush;
+}
+
+#endif // DO_UNIT_TESTS
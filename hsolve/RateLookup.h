@@ -24,18 +24,41 @@ struct LookupColumn
 	//~ bool interpolate;
 };
 
+/**
+ * Lookup table for the rates of many species of gates over a uniform grid.
+ *
+ * A LINEAR table holds the rates at each division boundary, and
+ * interpolates linearly in between. The higher-order tables hold a cubic
+ * in the fraction for each division, so that a small table can be as
+ * accurate as a large linear one:
+ *   - CUBIC is a Hermite cubic through the rates and slopes at the ends of
+ *     the division, so the rates and their slopes are continuous.
+ *   - CHEBYSHEV interpolates the rates at the 4 Chebyshev points of the
+ *     division, which comes close to the least maximum error.
+ */
 class LookupTable
 {
 public:
+	static const int LINEAR;
+	static const int CUBIC;
+	static const int CHEBYSHEV;
+	
 	LookupTable() { ; }
 	
 	LookupTable(
 		double min,					///< min of range
 		double max,					///< max of range
 		unsigned int nDivs,			///< number of divisions (~ no. of rows)
-		unsigned int nSpecies );	///< number of species (no. of columns / 2)
+		unsigned int nSpecies,		///< number of species (no. of columns / 2)
+		int mode = LINEAR );		///< interpolation within a division
 	
-	/// Adds the columns for a given species. Columns supplied are C1 and C2
+	/**
+	 * Adds the columns for a given species. Columns supplied are C1 and C2,
+	 * sampled at even steps from min to max. A LINEAR table takes one
+	 * sample per division boundary. The others take any number of samples
+	 * (at least 2), and fit each division to them, treating them as a
+	 * linear table in their own right.
+	 */
 	void addColumns(
 		int species,
 		const vector< double >& C1,
@@ -43,6 +66,16 @@ public:
 		//~ const vector< double >& C2,
 		//~ bool interpolate );
 	
+	/**
+	 * Largest difference between the table and the given samples of C1 and
+	 * C2 for a species, taken at the samples, relative to the largest
+	 * magnitude among the samples of that column.
+	 */
+	double error(
+		unsigned int species,
+		const vector< double >& C1,
+		const vector< double >& C2 );
+	
 	void column(
 		unsigned int species,
 		LookupColumn& column );
@@ -55,14 +88,36 @@ public:
 		double x,
 		LookupRow& row );
 	
-	/// Actually performs the lookup and the linear interpolation
+	/// Actually performs the lookup and the interpolation
 	void lookup(
 		const LookupColumn& column,
 		const LookupRow& row,
 		double& C1,
 		double& C2 );
 	
+	/// Finds the row for each of the values in x.
+	void rows(
+		const vector< double >& x,
+		vector< LookupRow >& row );
+	
+	/**
+	 * Does lookup() for many gates at once. Gate i reads column[ i ] of
+	 * row[ index[ i ] ], and its results go in C1[ i ] and C2[ i ].
+	 */
+	void lookup(
+		const vector< unsigned int >& column,
+		const vector< unsigned int >& index,
+		const vector< LookupRow >& row,
+		vector< double >& C1,
+		vector< double >& C2 );
+	
+	unsigned int nDivs() const;
+	int mode() const;
+	
 private:
+	/// Fits the cubic for each division to the samples in C.
+	void fitColumn( unsigned int column, const vector< double >& C );
+	
 	//~ vector< bool >       interpolate_;
 	vector< double >     table_;		///< Flattened table
 	double               min_;			///< min of the voltage / caConc range
@@ -70,9 +125,14 @@ private:
 	unsigned int         nPts_;			///< Number of rows in the table.
 										///< Equal to nDivs + 2, so that
 										///< interpol. is safe at either end.
+										///< A cubic needs nDivs + 1.
 	double               dx_;			///< This is the smallest difference:
 										///< (max - min) / nDivs
 	unsigned int         nColumns_;		///< (# columns) = 2 * (# species)
+	int                  mode_;			///< LINEAR, CUBIC or CHEBYSHEV
+	unsigned int         nCoeffs_;		///< Entries per column in a row:
+										///< 1, or 4 for a cubic.
+	unsigned int         rowSize_;		///< nColumns_ * nCoeffs_
 };
 
 #endif // _RATE_LOOKUP_H
@@ -0,0 +1,280 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2007 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#include "header.h"
+#include "../biophysics/ChanBase.h"
+
+#include "HinesMatrix.h"
+#include "HSolveStruct.h"
+#include "HSolvePassive.h"
+#include "RateLookup.h"
+#include "HSolveActive.h"
+#include "HSolve.h"
+#include "ZombieMgBlock.h"
+
+static const double EPSILON = 1.0e-12;
+
+const Cinfo* ZombieMgBlock::initCinfo()
+{
+    ///////////////////////////////////////////////////////
+    // Dest definitions
+    ///////////////////////////////////////////////////////
+    static DestFinfo origChannel( "origChannel",
+        "",
+        new EpFunc2< ZombieMgBlock, double, double >(
+            &ZombieMgBlock::origChannel )
+    );
+
+    ///////////////////////////////////////////////////////
+    // Field definitions. Same as in MgBlock.
+    ///////////////////////////////////////////////////////
+    static ValueFinfo< ZombieMgBlock, double > KMg_A( "KMg_A",
+        "1/eta",
+        &ZombieMgBlock::setKMg_A,
+        &ZombieMgBlock::getKMg_A
+    );
+    static ValueFinfo< ZombieMgBlock, double > KMg_B( "KMg_B",
+        "1/gamma",
+        &ZombieMgBlock::setKMg_B,
+        &ZombieMgBlock::getKMg_B
+    );
+    static ValueFinfo< ZombieMgBlock, double > CMg( "CMg",
+        "[Mg] in mM",
+        &ZombieMgBlock::setCMg,
+        &ZombieMgBlock::getCMg
+    );
+    static ValueFinfo< ZombieMgBlock, double > Zk( "Zk",
+        "Charge on ion",
+        &ZombieMgBlock::setZk,
+        &ZombieMgBlock::getZk
+    );
+
+    static Finfo* zombieMgBlockFinfos[] =
+    {
+        &origChannel,   // Dest
+        &KMg_A,         // Value
+        &KMg_B,         // Value
+        &CMg,           // Value
+        &Zk,            // Value
+    };
+
+    static string doc[] =
+    {
+        "Name", "ZombieMgBlock",
+        "Author", "Upinder S. Bhalla, 2007, NCBS",
+        "Description", "ZombieMgBlock: MgBlock whose block is applied by "
+        "the HSolve, along with the SynChan that feeds it. ",
+    };
+
+    static Dinfo< ZombieMgBlock > dinfo;
+    static Cinfo zombieMgBlockCinfo(
+        "ZombieMgBlock",
+        ChanBase::initCinfo(),
+        zombieMgBlockFinfos,
+        sizeof( zombieMgBlockFinfos ) / sizeof( Finfo* ),
+        &dinfo,
+        doc,
+        sizeof( doc ) / sizeof( string )
+    );
+
+    return &zombieMgBlockCinfo;
+}
+
+static const Cinfo* zombieMgBlockCinfo = ZombieMgBlock::initCinfo();
+
+///////////////////////////////////////////////////
+// Constructor
+///////////////////////////////////////////////////
+ZombieMgBlock::ZombieMgBlock()
+    :
+    hsolve_( 0 ),
+    chan_( 0 ),
+    Gbar_( 0.0 ),
+    modulation_( 1.0 ),
+    Zk_( 0.0 )
+{ ; }
+
+///////////////////////////////////////////////////
+// Field function definitions
+///////////////////////////////////////////////////
+
+void ZombieMgBlock::vSetGbar( const Eref& e, double Gbar )
+{
+    Gbar_ = Gbar;
+}
+
+double ZombieMgBlock::vGetGbar( const Eref& e ) const
+{
+    return Gbar_;
+}
+
+void ZombieMgBlock::vSetModulation( const Eref& e, double modulation )
+{
+    modulation_ = modulation;
+}
+
+double ZombieMgBlock::vGetModulation( const Eref& e ) const
+{
+    return modulation_;
+}
+
+/// Ek follows the SynChan, as it did through origChannel.
+void ZombieMgBlock::vSetEk( const Eref& e, double Ek )
+{
+    ;   // dummy
+}
+
+double ZombieMgBlock::vGetEk( const Eref& e ) const
+{
+    return chan_->Ek_;
+}
+
+void ZombieMgBlock::vSetGk( const Eref& e, double Gk )
+{
+    chan_->Gk_ = Gk;
+}
+
+double ZombieMgBlock::vGetGk( const Eref& e ) const
+{
+    return chan_->Gk_;
+}
+
+void ZombieMgBlock::vSetIk( const Eref& e, double Ik )
+{
+    ;   // dummy
+}
+
+double ZombieMgBlock::vGetIk( const Eref& e ) const
+{
+    return chan_->Gk_ * ( chan_->Ek_ - chan_->Vm_ );
+}
+
+void ZombieMgBlock::setKMg_A( double KMg_A )
+{
+    if ( KMg_A < EPSILON )
+        cout << "Error: KMg_A=" << KMg_A << " must be > 0. Not set.\n";
+    else
+        chan_->KMg_A_ = KMg_A;
+}
+
+double ZombieMgBlock::getKMg_A() const
+{
+    return chan_->KMg_A_;
+}
+
+void ZombieMgBlock::setKMg_B( double KMg_B )
+{
+    if ( KMg_B < EPSILON )
+        cout << "Error: KMg_B=" << KMg_B << " must be > 0. Not set.\n";
+    else
+        chan_->KMg_B_ = KMg_B;
+}
+
+double ZombieMgBlock::getKMg_B() const
+{
+    return chan_->KMg_B_;
+}
+
+void ZombieMgBlock::setCMg( double CMg )
+{
+    if ( CMg < EPSILON )
+        cout << "Error: CMg = " << CMg << " must be > 0. Not set.\n";
+    else
+        chan_->CMg_ = CMg;
+}
+
+double ZombieMgBlock::getCMg() const
+{
+    return chan_->CMg_;
+}
+
+void ZombieMgBlock::setZk( double Zk )
+{
+    Zk_ = Zk;
+}
+
+double ZombieMgBlock::getZk() const
+{
+    return Zk_;
+}
+
+///////////////////////////////////////////////////
+// Dest function definitions
+///////////////////////////////////////////////////
+
+void ZombieMgBlock::vProcess( const Eref& e, ProcPtr info )
+{
+    ;
+}
+
+void ZombieMgBlock::vReinit( const Eref& e, ProcPtr info )
+{
+    Zk_ = 0.0;
+}
+
+void ZombieMgBlock::vHandleVm( double Vm )
+{
+    ;
+}
+
+void ZombieMgBlock::origChannel( const Eref& e, double Gk, double Ek )
+{
+    ;   // The solver applies the block to the SynChan directly.
+}
+
+///////////////////////////////////////////////////
+// Assign solver
+///////////////////////////////////////////////////
+
+void ZombieMgBlock::setSolver( const Eref& e, Id hsolve )
+{
+    if ( !hsolve.element()->cinfo()->isA( "HSolve" ) ) {
+        cout << "Error: ZombieMgBlock::setSolver: Object: " <<
+                hsolve.path() << " is not an HSolve. Aborted\n";
+        hsolve_ = 0;
+        chan_ = 0;
+        assert( 0 );
+        return;
+    }
+    hsolve_ = reinterpret_cast< HSolve* >( hsolve.eref().data() );
+    chan_ = hsolve_->getSynChan( e.id() );
+}
+
+void ZombieMgBlock::zombify( Element* orig, const Cinfo* zClass, Id hsolve )
+{
+    if ( orig->cinfo() == zClass )
+        return;
+    unsigned int start = orig->localDataStart();
+    unsigned int num = orig->numLocalData();
+    if ( num == 0 )
+        return;
+
+    // Parameters are Gbar, modulation, Zk. The rest are in the solver.
+    vector< double > data( num * 3 );
+    vector< double >::iterator j = data.begin();
+    for ( unsigned int i = 0; i < num; ++i ) {
+        ObjId oid( orig->id(), i + start );
+        *j = Field< double >::get( oid, "Gbar" );
+        *( j + 1 ) = Field< double >::get( oid, "modulation" );
+        *( j + 2 ) = Field< double >::get( oid, "Zk" );
+        j += 3;
+    }
+
+    orig->zombieSwap( zClass );
+    j = data.begin();
+    for ( unsigned int i = 0; i < num; ++i ) {
+        Eref er( orig, i + start );
+        ZombieMgBlock* zb = reinterpret_cast< ZombieMgBlock* >( er.data() );
+        zb->setSolver( er, hsolve );
+        zb->Gbar_ = *j;
+        zb->modulation_ = *( j + 1 );
+        zb->Zk_ = *( j + 2 );
+        j += 3;
+    }
+}
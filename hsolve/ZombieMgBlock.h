@@ -0,0 +1,78 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2007 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#ifndef _ZOMBIE_MGBLOCK_H
+#define _ZOMBIE_MGBLOCK_H
+
+/**
+ * Zombie MgBlock. It shares the solver's entry with the SynChan that feeds
+ * it: the block is applied to the SynChan's conductance by the solver, so
+ * the origChannel message is not used. Gbar, modulation and Zk take no
+ * part in the calculation, and are kept here. The fields repeat those of
+ * MgBlock, in the same order.
+ */
+class ZombieMgBlock: public virtual ChanBase
+{
+public:
+    ZombieMgBlock();
+
+    /////////////////////////////////////////////////////////////
+    // Value field access function definitions
+    /////////////////////////////////////////////////////////////
+
+    void vSetGbar( const Eref& e, double Gbar );
+    double vGetGbar( const Eref& e ) const;
+    void vSetModulation( const Eref& e, double modulation );
+    double vGetModulation( const Eref& e ) const;
+    void vSetEk( const Eref& e, double Ek );
+    double vGetEk( const Eref& e ) const;
+    void vSetGk( const Eref& e, double Gk );
+    double vGetGk( const Eref& e ) const;
+    void vSetIk( const Eref& e, double Ik );
+    double vGetIk( const Eref& e ) const;
+
+    void setKMg_A( double KMg_A );
+    double getKMg_A() const;
+    void setKMg_B( double KMg_B );
+    double getKMg_B() const;
+    void setCMg( double CMg );
+    double getCMg() const;
+    void setZk( double Zk );
+    double getZk() const;
+
+    /////////////////////////////////////////////////////////////
+    // Dest function definitions
+    /////////////////////////////////////////////////////////////
+
+    void vProcess( const Eref& e, ProcPtr p );
+    void vReinit( const Eref& e, ProcPtr p );
+    void vHandleVm( double Vm );
+    void origChannel( const Eref& e, double Gk, double Ek );
+
+    /////////////////////////////////////////////////////////////
+    void setSolver( const Eref& e, Id hsolve );
+
+    /**
+     * Swaps the MgBlock for the zombie class, carrying over the fields that
+     * the solver does not keep.
+     */
+    static void zombify( Element* orig, const Cinfo* zClass, Id hsolve );
+
+    static const Cinfo* initCinfo();
+
+private:
+    HSolve* hsolve_;
+    SynChanStruct* chan_;
+
+    double Gbar_;
+    double modulation_;
+    double Zk_;
+};
+
+#endif // _ZOMBIE_MGBLOCK_H
@@ -0,0 +1,280 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2007 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#include "header.h"
+#include "ElementValueFinfo.h"
+#include "../biophysics/ChanBase.h"
+
+#include "HinesMatrix.h"
+#include "HSolveStruct.h"
+#include "HSolvePassive.h"
+#include "RateLookup.h"
+#include "HSolveActive.h"
+#include "HSolve.h"
+#include "ZombieSynChan.h"
+#include "ZombieNMDAChan.h"
+
+static const double EPSILON = 1.0e-12;
+
+SrcFinfo1< double >* ZombieNMDAChan::ICaOut()
+{
+    static SrcFinfo1< double > ICaOut( "ICaOut",
+        "Calcium current portion of the total current carried by the NMDAR" );
+    return &ICaOut;
+}
+
+const Cinfo* ZombieNMDAChan::initCinfo()
+{
+    ///////////////////////////////////////////////////////
+    // Field definitions. Same as in NMDAChan.
+    ///////////////////////////////////////////////////////
+    static ValueFinfo< ZombieNMDAChan, double > KMg_A( "KMg_A",
+        "1/eta",
+        &ZombieNMDAChan::setKMg_A,
+        &ZombieNMDAChan::getKMg_A
+    );
+    static ValueFinfo< ZombieNMDAChan, double > KMg_B( "KMg_B",
+        "1/gamma",
+        &ZombieNMDAChan::setKMg_B,
+        &ZombieNMDAChan::getKMg_B
+    );
+    static ValueFinfo< ZombieNMDAChan, double > CMg( "CMg",
+        "[Mg] in mM",
+        &ZombieNMDAChan::setCMg,
+        &ZombieNMDAChan::getCMg
+    );
+    static ValueFinfo< ZombieNMDAChan, double > temperature( "temperature",
+        "Temperature in degrees Kelvin.",
+        &ZombieNMDAChan::setTemperature,
+        &ZombieNMDAChan::getTemperature
+    );
+    static ValueFinfo< ZombieNMDAChan, double > extCa( "extCa",
+        "External concentration of Calcium in millimolar",
+        &ZombieNMDAChan::setExtCa,
+        &ZombieNMDAChan::getExtCa
+    );
+    static ValueFinfo< ZombieNMDAChan, double > intCa( "intCa",
+        "Internal concentration of Calcium in millimolar."
+        "This is the final value used by the internal calculations, "
+        "and may also be updated by the assignIntCa message after "
+        "offset and scaling.",
+        &ZombieNMDAChan::setIntCa,
+        &ZombieNMDAChan::getIntCa
+    );
+    static ValueFinfo< ZombieNMDAChan, double > intCaScale( "intCaScale",
+        "Scale factor for internal concentration of Calcium in mM, "
+        "applied to values coming in through the assignIntCa message. ",
+        &ZombieNMDAChan::setIntCaScale,
+        &ZombieNMDAChan::getIntCaScale
+    );
+    static ValueFinfo< ZombieNMDAChan, double > intCaOffset( "intCaOffset",
+        "Offsetfor internal concentration of Calcium in mM, "
+        "applied _after_ the scaling to mM is done. ",
+        &ZombieNMDAChan::setIntCaOffset,
+        &ZombieNMDAChan::getIntCaOffset
+    );
+    static ValueFinfo< ZombieNMDAChan, double > condFraction( "condFraction",
+        "Fraction of total channel conductance that is due to the "
+        "passage of Ca ions. ",
+        &ZombieNMDAChan::setCondFraction,
+        &ZombieNMDAChan::getCondFraction
+    );
+    static ReadOnlyValueFinfo< ZombieNMDAChan, double > ICa( "ICa",
+        "Current carried by Ca ions",
+        &ZombieNMDAChan::getICa
+    );
+    static ElementValueFinfo< ChanBase, double > permeability(
+        "permeability",
+        "Permeability. Alias for Gbar. ",
+        &ChanBase::setGbar,
+        &ChanBase::getGbar
+    );
+
+    ///////////////////////////////////////////////////////
+    // MsgDest definitions
+    ///////////////////////////////////////////////////////
+    static DestFinfo assignIntCa( "assignIntCa",
+        "Assign the internal concentration of Ca. The final value "
+        "is computed as: "
+        "     intCa = assignIntCa * intCaScale + intCaOffset ",
+        new OpFunc1< ZombieNMDAChan, double >( &ZombieNMDAChan::assignIntCa )
+    );
+
+    static Finfo* zombieNMDAChanFinfos[] =
+    {
+        &KMg_A,         // Value
+        &KMg_B,         // Value
+        &CMg,           // Value
+        &temperature,   // Value
+        &extCa,         // Value
+        &intCa,         // Value
+        &intCaScale,    // Value
+        &intCaOffset,   // Value
+        &condFraction,  // Value
+        &ICa,           // ReadOnlyValue
+        &permeability,  // ElementValue
+        &assignIntCa,   // Dest
+        ICaOut(),       // Src
+    };
+
+    static string doc[] =
+    {
+        "Name", "ZombieNMDAChan",
+        "Author", "Upinder S. Bhalla, 2007, NCBS",
+        "Description", "ZombieNMDAChan: NMDAChan whose conductance, Mg "
+        "block and Ca current are computed by the HSolve. ",
+    };
+
+    static Dinfo< ZombieNMDAChan > dinfo;
+    static Cinfo zombieNMDAChanCinfo(
+        "ZombieNMDAChan",
+        ZombieSynChan::initCinfo(),
+        zombieNMDAChanFinfos,
+        sizeof( zombieNMDAChanFinfos ) / sizeof( Finfo* ),
+        &dinfo,
+        doc,
+        sizeof( doc ) / sizeof( string )
+    );
+
+    return &zombieNMDAChanCinfo;
+}
+
+static const Cinfo* zombieNMDAChanCinfo = ZombieNMDAChan::initCinfo();
+
+///////////////////////////////////////////////////
+// Constructor
+///////////////////////////////////////////////////
+ZombieNMDAChan::ZombieNMDAChan()
+{ ; }
+
+///////////////////////////////////////////////////
+// Field function definitions
+///////////////////////////////////////////////////
+
+void ZombieNMDAChan::setKMg_A( double KMg_A )
+{
+    if ( KMg_A < EPSILON )
+        cout << "Error: KMg_A=" << KMg_A << " must be > 0. Not set.\n";
+    else
+        chan_->KMg_A_ = KMg_A;
+}
+
+double ZombieNMDAChan::getKMg_A() const
+{
+    return chan_->KMg_A_;
+}
+
+void ZombieNMDAChan::setKMg_B( double KMg_B )
+{
+    if ( KMg_B < EPSILON )
+        cout << "Error: KMg_B=" << KMg_B << " must be > 0. Not set.\n";
+    else
+        chan_->KMg_B_ = KMg_B;
+}
+
+double ZombieNMDAChan::getKMg_B() const
+{
+    return chan_->KMg_B_;
+}
+
+void ZombieNMDAChan::setCMg( double CMg )
+{
+    if ( CMg < EPSILON )
+        cout << "Error: CMg = " << CMg << " must be > 0. Not set.\n";
+    else
+        chan_->CMg_ = CMg;
+}
+
+double ZombieNMDAChan::getCMg() const
+{
+    return chan_->CMg_;
+}
+
+void ZombieNMDAChan::setTemperature( double temperature )
+{
+    if ( temperature < EPSILON )
+        cout << "Error: temperature = " << temperature << " must be > 0. Not set.\n";
+    else
+        chan_->setTemperature( temperature );
+}
+
+double ZombieNMDAChan::getTemperature() const
+{
+    return chan_->temperature_;
+}
+
+void ZombieNMDAChan::setExtCa( double Cout )
+{
+    if ( Cout < EPSILON )
+        cout << "Error: Cout = " << Cout << " must be > 0. Not set.\n";
+    else
+        chan_->Cout_ = Cout;
+}
+
+double ZombieNMDAChan::getExtCa() const
+{
+    return chan_->Cout_;
+}
+
+void ZombieNMDAChan::setIntCa( double Cin )
+{
+    if ( Cin < 0.0 )
+        cout << "Error: IntCa = " << Cin << " must be > 0. Not set.\n";
+    else
+        chan_->Cin_ = Cin;
+}
+
+double ZombieNMDAChan::getIntCa() const
+{
+    return chan_->Cin_;
+}
+
+void ZombieNMDAChan::setIntCaScale( double v )
+{
+    chan_->intCaScale_ = v;
+}
+
+double ZombieNMDAChan::getIntCaScale() const
+{
+    return chan_->intCaScale_;
+}
+
+void ZombieNMDAChan::setIntCaOffset( double v )
+{
+    chan_->intCaOffset_ = v;
+}
+
+double ZombieNMDAChan::getIntCaOffset() const
+{
+    return chan_->intCaOffset_;
+}
+
+void ZombieNMDAChan::setCondFraction( double v )
+{
+    chan_->condFraction_ = v;
+}
+
+double ZombieNMDAChan::getCondFraction() const
+{
+    return chan_->condFraction_;
+}
+
+double ZombieNMDAChan::getICa() const
+{
+    return chan_->ICa_;
+}
+
+///////////////////////////////////////////////////
+// Dest function definitions
+///////////////////////////////////////////////////
+
+void ZombieNMDAChan::assignIntCa( double v )
+{
+    chan_->Cin_ = v * chan_->intCaScale_ + chan_->intCaOffset_;
+}
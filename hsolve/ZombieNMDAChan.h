@@ -0,0 +1,65 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2007 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#ifndef _ZOMBIE_NMDACHAN_H
+#define _ZOMBIE_NMDACHAN_H
+
+/**
+ * Zombie NMDAChan. The Mg block and the Ca current are computed by the
+ * solver, which also reads the internal Ca from the pool of this cell that
+ * sets it, and feeds the Ca current into the pool it goes to. The fields
+ * repeat those of NMDAChan, in the same order.
+ */
+class ZombieNMDAChan: public ZombieSynChan
+{
+public:
+    ZombieNMDAChan();
+
+    /////////////////////////////////////////////////////////////
+    // Value field access function definitions
+    /////////////////////////////////////////////////////////////
+
+    void setKMg_A( double KMg_A );
+    double getKMg_A() const;
+    void setKMg_B( double KMg_B );
+    double getKMg_B() const;
+    void setCMg( double CMg );
+    double getCMg() const;
+
+    void setTemperature( double temperature );
+    double getTemperature() const;
+    void setExtCa( double conc );
+    double getExtCa() const;
+    void setIntCa( double conc );
+    double getIntCa() const;
+    void setIntCaScale( double v );
+    double getIntCaScale() const;
+    void setIntCaOffset( double v );
+    double getIntCaOffset() const;
+    void setCondFraction( double v );
+    double getCondFraction() const;
+    double getICa() const;
+
+    /////////////////////////////////////////////////////////////
+    // Dest function definitions
+    /////////////////////////////////////////////////////////////
+
+    void assignIntCa( double v );
+
+    /**
+     * Keeps the slot of the NMDAChan's ICaOut. The solver takes over an
+     * NMDAChan only if its Ca current goes into the solver's own pools, so
+     * nothing is sent on it.
+     */
+    static SrcFinfo1< double >* ICaOut();
+
+    static const Cinfo* initCinfo();
+};
+
+#endif // _ZOMBIE_NMDACHAN_H
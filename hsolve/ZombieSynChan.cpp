@@ -0,0 +1,243 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2007 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#include "header.h"
+#include "../biophysics/ChanBase.h"
+
+#include "HinesMatrix.h"
+#include "HSolveStruct.h"
+#include "HSolvePassive.h"
+#include "RateLookup.h"
+#include "HSolveActive.h"
+#include "HSolve.h"
+#include "ZombieSynChan.h"
+
+const Cinfo* ZombieSynChan::initCinfo()
+{
+    ///////////////////////////////////////////////////////
+    // Field definitions. Same as in SynChan.
+    ///////////////////////////////////////////////////////
+    static ValueFinfo< ZombieSynChan, double > tau1( "tau1",
+        "Decay time constant for the synaptic conductance, tau1 >= tau2.",
+        &ZombieSynChan::setTau1,
+        &ZombieSynChan::getTau1
+    );
+    static ValueFinfo< ZombieSynChan, double > tau2( "tau2",
+        "Rise time constant for the synaptic conductance, tau1 >= tau2.",
+        &ZombieSynChan::setTau2,
+        &ZombieSynChan::getTau2
+    );
+    static ValueFinfo< ZombieSynChan, bool > normalizeWeights(
+        "normalizeWeights",
+        "Flag. If true, the overall conductance is normalized by the "
+        "number of individual synapses in this SynChan object.",
+        &ZombieSynChan::setNormalizeWeights,
+        &ZombieSynChan::getNormalizeWeights
+    );
+
+    ///////////////////////////////////////////////////////
+    // MsgDest definitions
+    ///////////////////////////////////////////////////////
+    static DestFinfo activation( "activation",
+        "Sometimes we want to continuously activate the channel",
+        new OpFunc1< ZombieSynChan, double >( &ZombieSynChan::activation )
+    );
+
+    static Finfo* zombieSynChanFinfos[] =
+    {
+        &tau1,              // Value
+        &tau2,              // Value
+        &normalizeWeights,  // Value
+        &activation,        // Dest
+    };
+
+    static string doc[] =
+    {
+        "Name", "ZombieSynChan",
+        "Author", "Upinder S. Bhalla, 2007, 2014, NCBS",
+        "Description", "ZombieSynChan: SynChan whose conductance is "
+        "computed by the HSolve. Activation from the SynHandlers is "
+        "added straight into the solver. ",
+    };
+
+    static Dinfo< ZombieSynChan > dinfo;
+    static Cinfo zombieSynChanCinfo(
+        "ZombieSynChan",
+        ChanBase::initCinfo(),
+        zombieSynChanFinfos,
+        sizeof( zombieSynChanFinfos ) / sizeof( Finfo* ),
+        &dinfo,
+        doc,
+        sizeof( doc ) / sizeof( string )
+    );
+
+    return &zombieSynChanCinfo;
+}
+
+static const Cinfo* zombieSynChanCinfo = ZombieSynChan::initCinfo();
+
+///////////////////////////////////////////////////
+// Constructor
+///////////////////////////////////////////////////
+ZombieSynChan::ZombieSynChan()
+    : hsolve_( 0 ), chan_( 0 )
+{ ; }
+
+///////////////////////////////////////////////////
+// Field function definitions
+///////////////////////////////////////////////////
+
+void ZombieSynChan::vSetGbar( const Eref& e, double Gbar )
+{
+    chan_->Gbar_ = Gbar;
+    chan_->normalizeGbar();
+}
+
+double ZombieSynChan::vGetGbar( const Eref& e ) const
+{
+    return chan_->Gbar_;
+}
+
+void ZombieSynChan::vSetModulation( const Eref& e, double modulation )
+{
+    chan_->modulation_ = modulation;
+}
+
+double ZombieSynChan::vGetModulation( const Eref& e ) const
+{
+    return chan_->modulation_;
+}
+
+void ZombieSynChan::vSetEk( const Eref& e, double Ek )
+{
+    chan_->Ek_ = Ek;
+}
+
+double ZombieSynChan::vGetEk( const Eref& e ) const
+{
+    return chan_->Ek_;
+}
+
+/**
+ * A SynChan behind an MgBlock has the conductance before the block. The
+ * MgBlock, and an NMDAChan, have the conductance after it.
+ */
+void ZombieSynChan::vSetGk( const Eref& e, double Gk )
+{
+    if ( chan_->block_ == Id() )
+        chan_->Gk_ = Gk;
+    else
+        chan_->synGk_ = Gk;
+}
+
+double ZombieSynChan::vGetGk( const Eref& e ) const
+{
+    if ( chan_->block_ == Id() )
+        return chan_->Gk_;
+    return chan_->synGk_;
+}
+
+void ZombieSynChan::vSetIk( const Eref& e, double Ik )
+{
+    ;   // dummy
+}
+
+double ZombieSynChan::vGetIk( const Eref& e ) const
+{
+    return vGetGk( e ) * ( chan_->Ek_ - chan_->Vm_ );
+}
+
+void ZombieSynChan::setTau1( double tau1 )
+{
+    chan_->setTau1( tau1 );
+}
+
+double ZombieSynChan::getTau1() const
+{
+    return chan_->tau1_;
+}
+
+void ZombieSynChan::setTau2( double tau2 )
+{
+    chan_->setTau2( tau2 );
+}
+
+double ZombieSynChan::getTau2() const
+{
+    return chan_->tau2_;
+}
+
+void ZombieSynChan::setNormalizeWeights( bool value )
+{
+    chan_->normalizeWeights_ = value;
+}
+
+bool ZombieSynChan::getNormalizeWeights() const
+{
+    return chan_->normalizeWeights_;
+}
+
+///////////////////////////////////////////////////
+// Dest function definitions
+///////////////////////////////////////////////////
+
+void ZombieSynChan::vProcess( const Eref& e, ProcPtr info )
+{
+    ;
+}
+
+void ZombieSynChan::vReinit( const Eref& e, ProcPtr info )
+{
+    ;
+}
+
+void ZombieSynChan::vHandleVm( double Vm )
+{
+    ;
+}
+
+void ZombieSynChan::activation( double val )
+{
+    chan_->activation_ += val;
+}
+
+///////////////////////////////////////////////////
+// Assign solver
+///////////////////////////////////////////////////
+
+void ZombieSynChan::setSolver( const Eref& e, Id hsolve )
+{
+    if ( !hsolve.element()->cinfo()->isA( "HSolve" ) ) {
+        cout << "Error: ZombieSynChan::setSolver: Object: " <<
+                hsolve.path() << " is not an HSolve. Aborted\n";
+        hsolve_ = 0;
+        chan_ = 0;
+        assert( 0 );
+        return;
+    }
+    hsolve_ = reinterpret_cast< HSolve* >( hsolve.eref().data() );
+    chan_ = hsolve_->getSynChan( e.id() );
+}
+
+void ZombieSynChan::zombify( Element* orig, const Cinfo* zClass, Id hsolve )
+{
+    if ( orig->cinfo() == zClass )
+        return;
+    unsigned int start = orig->localDataStart();
+    unsigned int num = orig->numLocalData();
+    if ( num == 0 )
+        return;
+
+    orig->zombieSwap( zClass );
+    for ( unsigned int i = 0; i < num; ++i ) {
+        Eref er( orig, i + start );
+        ZombieSynChan* zs = reinterpret_cast< ZombieSynChan* >( er.data() );
+        zs->setSolver( er, hsolve );
+    }
+}
@@ -0,0 +1,77 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2007 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#ifndef _ZOMBIE_SYNCHAN_H
+#define _ZOMBIE_SYNCHAN_H
+
+/**
+ * Zombie object that lets HSolve do its calculations, while letting the user
+ * interact with this object as if it were the original object.
+ *
+ * There is no base class shared by SynChan and ZombieSynChan, so the Cinfo
+ * repeats the fields of SynChan, in the same order, so that messages such as
+ * the activation from SynHandlers keep their slots. The zombie holds a
+ * pointer to its entry in the solver, so that the fields and activation go
+ * straight into solver memory.
+ */
+class ZombieSynChan: public virtual ChanBase
+{
+public:
+    ZombieSynChan();
+
+    /////////////////////////////////////////////////////////////
+    // Value field access function definitions
+    /////////////////////////////////////////////////////////////
+
+    void vSetGbar( const Eref& e, double Gbar );
+    double vGetGbar( const Eref& e ) const;
+    void vSetModulation( const Eref& e, double modulation );
+    double vGetModulation( const Eref& e ) const;
+    void vSetEk( const Eref& e, double Ek );
+    double vGetEk( const Eref& e ) const;
+    void vSetGk( const Eref& e, double Gk );
+    double vGetGk( const Eref& e ) const;
+    void vSetIk( const Eref& e, double Ik );
+    double vGetIk( const Eref& e ) const;
+
+    void setTau1( double tau1 );
+    double getTau1() const;
+    void setTau2( double tau2 );
+    double getTau2() const;
+    void setNormalizeWeights( bool value );
+    bool getNormalizeWeights() const;
+
+    /////////////////////////////////////////////////////////////
+    // Dest function definitions
+    /////////////////////////////////////////////////////////////
+
+    void vProcess( const Eref& e, ProcPtr p );
+    void vReinit( const Eref& e, ProcPtr p );
+    void vHandleVm( double Vm );
+
+    /// Adds to the activation in the solver.
+    void activation( double val );
+
+    /////////////////////////////////////////////////////////////
+    void setSolver( const Eref& e, Id hsolve );
+
+    /**
+     * Swaps the SynChan or NMDAChan for the zombie class, and points it to
+     * the solver. The fields have already been read in by the solver.
+     */
+    static void zombify( Element* orig, const Cinfo* zClass, Id hsolve );
+
+    static const Cinfo* initCinfo();
+
+protected:
+    HSolve* hsolve_;
+    SynChanStruct* chan_;
+};
+
+#endif // _ZOMBIE_SYNCHAN_H
@@ -21,6 +21,11 @@ using namespace std;
 extern void testHinesMatrix(); // Defined in HinesMatrix.cpp
 extern void testHSolvePassive(); // Defined in HSolvePassive.cpp
 extern void testHSolveUtils(); // Defined in HSolveUtils.cpp
+extern void testHSolvePool(); // Defined in HSolvePool.cpp
+extern void testHSolvePoolThreads(); // Defined in HSolvePool.cpp
+extern void testRateLookup(); // Defined in RateLookup.cpp
+extern void testHSolveActive(); // Defined in HSolveActive.cpp
+extern void testHSolveSynChans(); // Defined in HSolveActive.cpp
 extern void runRallpackBenchmarks();                 /* Defined in RallPacks.cpp */
 
 void testHSolve()
@@ -28,6 +33,11 @@ void testHSolve()
 	testHSolveUtils();
 	testHinesMatrix();
 	testHSolvePassive();
+	testHSolvePool();
+	testHSolvePoolThreads();
+	testRateLookup();
+	testHSolveActive();
+	testHSolveSynChans();
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,404 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2015 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+#include <typeinfo>
+#include "header.h"
+#ifdef USE_GSL
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_matrix.h>
+#include <gsl/gsl_odeiv2.h>
+#endif
+
+#include "OdeSystem.h"
+#include "VoxelPoolsBase.h"
+#include "RateKernel.h"
+#include "VoxelPools.h"
+#include "BatchedVoxelPools.h"
+#include "RateTerm.h"
+#include "FuncTerm.h"
+#include "SparseMatrix.h"
+#include "KinSparseMatrix.h"
+#include "../mesh/VoxelJunction.h"
+#include "XferInfo.h"
+#include "ZombiePoolInterface.h"
+#include "Stoich.h"
+#include "Rkf45.h"
+
+//////////////////////////////////////////////////////////////
+// Class definitions
+//////////////////////////////////////////////////////////////
+
+BatchedVoxelPools::BatchedVoxelPools()
+	: 
+		stoich_( 0 ),
+		numVoxels_( 0 ),
+		numPools_( 0 ),
+		numVarPools_( 0 ),
+		numRates_( 0 ),
+		epsAbs_( 1e-4 ),
+		epsRel_( 1e-6 ),
+		h_( 0.01 ),
+		numSteps_( 0 ),
+		numFailedSteps_( 0 ),
+		needsGather_( false )
+{;}
+
+unsigned int BatchedVoxelPools::numVoxels() const
+{
+	return numVoxels_;
+}
+
+/**
+ * Returns the whole term, or its forward or backward half if it is a
+ * BidirectionalReaction.
+ */
+static const RateTerm* halfTerm( const RateTerm* term, unsigned int half )
+{
+	if ( half == 0 )
+		return term;
+	const BidirectionalReaction* br = 
+		static_cast< const BidirectionalReaction* >( term );
+	if ( half == 1 )
+		return br->getForward();
+	return br->getBackward();
+}
+
+void BatchedVoxelPools::addMassAction( const vector< VoxelPools >& pools,
+			unsigned int rate, unsigned int half, double sign )
+{
+	vector< unsigned int > mol;
+	halfTerm( pools[0].getRateTerms()[rate], half )->getReactants( mol );
+	vector< double >* k;
+	if ( mol.size() == 0 ) {
+		zeroRate_.push_back( rate );
+		k = &zeroK_;
+	} else if ( mol.size() == 1 ) {
+		firstRate_.push_back( rate );
+		firstMol_.push_back( mol[0] );
+		k = &firstK_;
+	} else if ( mol.size() == 2 ) {
+		secondRate_.push_back( rate );
+		secondMol1_.push_back( mol[0] );
+		secondMol2_.push_back( mol[1] );
+		k = &secondK_;
+	} else {
+		nthRate_.push_back( rate );
+		nthMol_.insert( nthMol_.end(), mol.begin(), mol.end() );
+		nthStart_.push_back( nthMol_.size() );
+		k = &nthK_;
+	}
+	for ( unsigned int i = 0; i < numVoxels_; ++i )
+		k->push_back( sign * 
+			halfTerm( pools[i].getRateTerms()[rate], half )->getR1() );
+}
+
+void BatchedVoxelPools::build( const vector< VoxelPools >& pools, 
+				const Stoich* stoich, double epsAbs, double epsRel )
+{
+	double h = h_;
+	*this = BatchedVoxelPools();
+	h_ = h;
+	stoich_ = stoich;
+	epsAbs_ = epsAbs;
+	epsRel_ = epsRel;
+	numVoxels_ = pools.size();
+	if ( numVoxels_ == 0 || !stoich )
+		return;
+	numPools_ = stoich->getNumAllPools() + stoich->getNumProxyPools();
+	numVarPools_ = stoich->getNumVarPools() + stoich->getNumProxyPools();
+	numRates_ = pools[0].getRateTerms().size();
+	nthStart_.push_back( 0 );
+
+	const vector< RateTerm* >& rates = pools[0].getRateTerms();
+	for ( unsigned int i = 0; i < numRates_; ++i ) {
+		const RateTerm* term = rates[i];
+		const type_info& t = typeid( *term );
+		if ( RateKernel::isMassAction( term ) ) {
+			addMassAction( pools, i, 0, 1.0 );
+		} else if ( t == typeid( MMEnzyme1 ) ) {
+			vector< unsigned int > mol;
+			term->getReactants( mol );
+			mmRate_.push_back( i );
+			mmEnz_.push_back( mol[0] );
+			mmSub_.push_back( mol[1] );
+			for ( unsigned int j = 0; j < numVoxels_; ++j ) {
+				mmKm_.push_back( pools[j].getRateTerms()[i]->getR1() );
+				mmKcat_.push_back( pools[j].getRateTerms()[i]->getR2() );
+			}
+		} else if ( t == typeid( BidirectionalReaction ) && 
+			RateKernel::isMassAction( halfTerm( term, 1 ) ) &&
+			RateKernel::isMassAction( halfTerm( term, 2 ) ) ) {
+			addMassAction( pools, i, 1, 1.0 );
+			addMassAction( pools, i, 2, -1.0 );
+		} else {
+			otherRate_.push_back( i );
+			for ( unsigned int j = 0; j < numVoxels_; ++j )
+				otherTerm_.push_back( pools[j].getRateTerms()[i] );
+		}
+	}
+	needsGather_ = ( otherRate_.size() > 0 || stoich->getNumFuncs() > 0 );
+	for ( unsigned int j = 0; j < numVoxels_; ++j )
+		voxel_.push_back( &pools[j] );
+
+	const KinSparseMatrix& N = stoich->getStoichiometryMatrix();
+	rowStart_.push_back( 0 );
+	for ( unsigned int i = 0; i < numVarPools_; ++i ) {
+		const int* entry = 0;
+		const unsigned int* colIndex = 0;
+		unsigned int numEntries = N.getRow( i, &entry, &colIndex );
+		for ( unsigned int j = 0; j < numEntries; ++j ) {
+			colIndex_.push_back( colIndex[j] );
+			entry_.push_back( entry[j] );
+		}
+		rowStart_.push_back( colIndex_.size() );
+	}
+
+	unsigned int size = numPools_ * numVoxels_;
+	y_.resize( size );
+	yErr_.resize( size );
+	yTemp_.resize( size );
+	for ( unsigned int i = 0; i < 6; ++i )
+		k_[i].resize( size );
+	v_.resize( numRates_ * numVoxels_ );
+	s_.resize( numPools_ );
+	temp_.resize( numVoxels_ );
+}
+
+void BatchedVoxelPools::reinit( double dt )
+{
+	h_ = dt;
+	numSteps_ = 0;
+	numFailedSteps_ = 0;
+}
+
+double BatchedVoxelPools::getStepSize() const
+{
+	return h_;
+}
+
+unsigned int BatchedVoxelPools::getNumSteps() const
+{
+	return numSteps_;
+}
+
+unsigned int BatchedVoxelPools::getNumFailedSteps() const
+{
+	return numFailedSteps_;
+}
+
+//////////////////////////////////////////////////////////////
+// Rate calculations
+//////////////////////////////////////////////////////////////
+
+void BatchedVoxelPools::updateRates( double t, double* y, double* dydt )
+{
+	const unsigned int nv = numVoxels_;
+	double* v = &v_[0];
+	for ( unsigned int i = 0; i < numRates_ * nv; ++i )
+		v[i] = 0.0;
+
+	if ( needsGather_ ) {
+		// Funcs and other terms work on one voxel at a time.
+		double* s = &s_[0];
+		for ( unsigned int j = 0; j < nv; ++j ) {
+			for ( unsigned int p = 0; p < numPools_; ++p )
+				s[p] = y[ p * nv + j ];
+			if ( stoich_->getNumFuncs() > 0 ) {
+				voxel_[j]->updateFuncs( s, t );
+				for ( unsigned int p = 0; p < numPools_; ++p )
+					y[ p * nv + j ] = s[p];
+			}
+			for ( unsigned int i = 0; i < otherRate_.size(); ++i )
+				v[ otherRate_[i] * nv + j ] = (*otherTerm_[ i * nv + j ])( s );
+		}
+	}
+
+	// Each of the loops over voxels below is contiguous, and vectorizes.
+	for ( unsigned int i = 0; i < zeroRate_.size(); ++i ) {
+		double* vr = v + zeroRate_[i] * nv;
+		const double* k = &zeroK_[ i * nv ];
+		for ( unsigned int j = 0; j < nv; ++j )
+			vr[j] += k[j];
+	}
+	for ( unsigned int i = 0; i < firstRate_.size(); ++i ) {
+		double* vr = v + firstRate_[i] * nv;
+		const double* k = &firstK_[ i * nv ];
+		const double* s = y + firstMol_[i] * nv;
+		for ( unsigned int j = 0; j < nv; ++j )
+			vr[j] += k[j] * s[j];
+	}
+	for ( unsigned int i = 0; i < secondRate_.size(); ++i ) {
+		double* vr = v + secondRate_[i] * nv;
+		const double* k = &secondK_[ i * nv ];
+		const double* s1 = y + secondMol1_[i] * nv;
+		const double* s2 = y + secondMol2_[i] * nv;
+		for ( unsigned int j = 0; j < nv; ++j )
+			vr[j] += k[j] * s1[j] * s2[j];
+	}
+	for ( unsigned int i = 0; i < nthRate_.size(); ++i ) {
+		double* vr = v + nthRate_[i] * nv;
+		double* temp = &temp_[0];
+		const double* k = &nthK_[ i * nv ];
+		for ( unsigned int j = 0; j < nv; ++j )
+			temp[j] = k[j];
+		for ( unsigned int m = nthStart_[i]; m < nthStart_[i+1]; ++m ) {
+			const double* s = y + nthMol_[m] * nv;
+			for ( unsigned int j = 0; j < nv; ++j )
+				temp[j] *= s[j];
+		}
+		for ( unsigned int j = 0; j < nv; ++j )
+			vr[j] += temp[j];
+	}
+	for ( unsigned int i = 0; i < mmRate_.size(); ++i ) {
+		double* vr = v + mmRate_[i] * nv;
+		const double* km = &mmKm_[ i * nv ];
+		const double* kcat = &mmKcat_[ i * nv ];
+		const double* sub = y + mmSub_[i] * nv;
+		const double* enz = y + mmEnz_[i] * nv;
+		for ( unsigned int j = 0; j < nv; ++j )
+			vr[j] = ( kcat[j] * sub[j] * enz[j] ) / ( km[j] + sub[j] );
+	}
+
+	for ( unsigned int i = 0; i < numVarPools_; ++i ) {
+		double* dy = dydt + i * nv;
+		for ( unsigned int j = 0; j < nv; ++j )
+			dy[j] = 0.0;
+		for ( unsigned int e = rowStart_[i]; e < rowStart_[i+1]; ++e ) {
+			const double n = entry_[e];
+			const double* vr = v + colIndex_[e] * nv;
+			for ( unsigned int j = 0; j < nv; ++j )
+				dy[j] += n * vr[j];
+		}
+	}
+	for ( unsigned int i = numVarPools_ * nv; i < numPools_ * nv; ++i )
+		dydt[i] = 0.0;
+}
+
+//////////////////////////////////////////////////////////////
+// Integration
+//////////////////////////////////////////////////////////////
+
+/**
+ * Does one RKF45 step from y_ into yTemp_, and puts the error estimate
+ * into yErr_. Returns the largest error over all entries, scaled by the
+ * tolerance, using the same error criterion as the GSL drivers.
+ */
+double BatchedVoxelPools::step( double t, double h )
+{
+	const unsigned int n = y_.size();
+	const double* y = &y_[0];
+	double* yt = &yTemp_[0];
+	double* k1 = &k_[0][0];
+	double* k2 = &k_[1][0];
+	double* k3 = &k_[2][0];
+	double* k4 = &k_[3][0];
+	double* k5 = &k_[4][0];
+	double* k6 = &k_[5][0];
+
+	// Func pools are assigned in place by updateRates, so work on a copy.
+	for ( unsigned int i = 0; i < n; ++i )
+		yt[i] = y[i];
+	updateRates( t, yt, k1 );
+
+	for ( unsigned int i = 0; i < n; ++i )
+		yt[i] = y[i] + h * ah[0] * k1[i];
+	updateRates( t + ah[0] * h, yt, k2 );
+
+	for ( unsigned int i = 0; i < n; ++i )
+		yt[i] = y[i] + h * ( b3[0] * k1[i] + b3[1] * k2[i] );
+	updateRates( t + ah[1] * h, yt, k3 );
+
+	for ( unsigned int i = 0; i < n; ++i )
+		yt[i] = y[i] + h * ( b4[0] * k1[i] + b4[1] * k2[i] + 
+						b4[2] * k3[i] );
+	updateRates( t + ah[2] * h, yt, k4 );
+
+	for ( unsigned int i = 0; i < n; ++i )
+		yt[i] = y[i] + h * ( b5[0] * k1[i] + b5[1] * k2[i] + 
+						b5[2] * k3[i] + b5[3] * k4[i] );
+	updateRates( t + ah[3] * h, yt, k5 );
+
+	for ( unsigned int i = 0; i < n; ++i )
+		yt[i] = y[i] + h * ( b6[0] * k1[i] + b6[1] * k2[i] + 
+				b6[2] * k3[i] + b6[3] * k4[i] + b6[4] * k5[i] );
+	updateRates( t + ah[4] * h, yt, k6 );
+
+	double maxErr = 0.0;
+	for ( unsigned int i = 0; i < n; ++i ) {
+		yt[i] = y[i] + h * ( c1 * k1[i] + c3 * k3[i] + c4 * k4[i] + 
+						c5 * k5[i] + c6 * k6[i] );
+		yErr_[i] = h * ( ec[0] * k1[i] + ec[2] * k3[i] + ec[3] * k4[i] + 
+						ec[4] * k5[i] + ec[5] * k6[i] );
+		double scaled = fabs( yErr_[i] ) / ( epsAbs_ + epsRel_ * fabs( y[i] ) );
+		if ( maxErr < scaled )
+			maxErr = scaled;
+	}
+	return maxErr;
+}
+
+void BatchedVoxelPools::advance( vector< VoxelPools >& pools, 
+				double t0, double t1 )
+{
+	const unsigned int nv = numVoxels_;
+	if ( nv == 0 || numPools_ == 0 )
+		return;
+	assert( pools.size() == nv );
+
+	for ( unsigned int j = 0; j < nv; ++j ) {
+		const double* s = pools[j].S();
+		for ( unsigned int p = 0; p < numPools_; ++p )
+			y_[ p * nv + j ] = s[p];
+	}
+
+	double t = t0;
+	while ( t < t1 ) {
+		double h = h_;
+		bool isLast = false;
+		if ( t + h >= t1 ) {
+			h = t1 - t;
+			isLast = true;
+		}
+		double err = step( t, h );
+		if ( !( err <= 1.1 ) ) {
+			// Reject the step and shrink it. A NaN error fails the test
+			// too, and its ratio below falls back to the minimum.
+			++numFailedSteps_;
+			double r = RKF_SAFETY / pow( err, 1.0 / RKF_ORDER );
+			h_ = h * ( r > 0.2 ? r : 0.2 );
+			if ( h_ < 1e-12 * ( t1 - t0 ) ) {
+				cout << "Error: BatchedVoxelPools::advance: " <<
+					"Timestep has gotten too small at time " << t << endl;
+				break;
+			}
+			continue;
+		}
+		y_.swap( yTemp_ );
+		t = isLast ? t1 : t + h;
+		++numSteps_;
+		if ( err < 0.5 ) {
+			double r = RKF_SAFETY / pow( err, 1.0 / ( RKF_ORDER + 1.0 ) );
+			if ( r > 5.0 ) 
+				r = 5.0;
+			// The last step is cut short, so it may only grow h_.
+			if ( r > 1.0 && ( !isLast || h * r > h_ ) )
+				h_ = h * r;
+		} else if ( !isLast ) {
+			h_ = h;
+		}
+	}
+
+	// step leaves the func pools as they were, so assign them here.
+	bool hasFuncs = ( stoich_->getNumFuncs() > 0 );
+	for ( unsigned int j = 0; j < nv; ++j ) {
+		double* s = pools[j].varS();
+		for ( unsigned int p = 0; p < numPools_; ++p )
+			s[p] = y_[ p * nv + j ];
+		if ( hasFuncs )
+			pools[j].updateFuncs( s, t1 );
+	}
+}
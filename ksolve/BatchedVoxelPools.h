@@ -0,0 +1,142 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2015 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#ifndef _BATCHED_VOXEL_POOLS_H
+#define _BATCHED_VOXEL_POOLS_H
+
+class Stoich;
+class VoxelPools;
+
+/**
+ * This class integrates all the voxels of a Ksolve together, as a 
+ * single system. All voxels share the same Stoich, so the rate terms
+ * have the same structure and differ only in their (volume-scaled)
+ * rate constants.
+ *
+ * The state is stored interleaved as [pool][voxel], and the rate 
+ * constants as [term][voxel]. The rate terms are sorted by type as in
+ * the RateKernel. Each term is evaluated in a loop over voxels, which
+ * is contiguous in memory, so that the compiler can vectorize it.
+ *
+ * The integration uses the Runge-Kutta-Fehlberg (4,5) method, with a
+ * single adaptive timestep shared by all voxels. The step is controlled
+ * by the worst error over all voxels.
+ */
+class BatchedVoxelPools
+{
+	public: 
+		BatchedVoxelPools();
+
+		/**
+		 * Sets up the batch from the rate terms of each voxel. Must be
+		 * redone whenever the rate terms change.
+		 */
+		void build( const vector< VoxelPools >& pools, 
+				const Stoich* stoich, double epsAbs, double epsRel );
+
+		/// Number of voxels in the batch. Zero if not built.
+		unsigned int numVoxels() const;
+
+		/// Sets the initial timestep to use.
+		void reinit( double dt );
+
+		/**
+		 * Advances all the voxels in pools from t0 to t1. The pools
+		 * must be the same as those used to build the batch.
+		 */
+		void advance( vector< VoxelPools >& pools, double t0, double t1 );
+
+		/// Internal timestep that the next step will try.
+		double getStepSize() const;
+
+		/// Number of steps taken and rejected since reinit.
+		unsigned int getNumSteps() const;
+		unsigned int getNumFailedSteps() const;
+
+	private:
+		/// Computes dydt for all voxels from the interleaved state y.
+		void updateRates( double t, double* y, double* dydt );
+
+		/// Adds a mass-action term, with its rate const from each voxel.
+		void addMassAction( const vector< VoxelPools >& pools,
+			unsigned int rate, unsigned int half, double sign );
+
+		/// Does one RKF45 step of size h. Returns the scaled error.
+		double step( double t, double h );
+
+		const Stoich* stoich_;
+		unsigned int numVoxels_;
+		unsigned int numPools_;
+		unsigned int numVarPools_;
+		unsigned int numRates_;
+		double epsAbs_;
+		double epsRel_;
+
+		/// Current internal timestep, carried across calls to advance.
+		double h_;
+		unsigned int numSteps_;
+		unsigned int numFailedSteps_;
+
+		/// Rate term structure, shared by all voxels.
+		vector< unsigned int > zeroRate_;
+		vector< unsigned int > firstRate_;
+		vector< unsigned int > firstMol_;
+		vector< unsigned int > secondRate_;
+		vector< unsigned int > secondMol1_;
+		vector< unsigned int > secondMol2_;
+		vector< unsigned int > nthRate_;
+		vector< unsigned int > nthStart_;
+		vector< unsigned int > nthMol_;
+		vector< unsigned int > mmRate_;
+		vector< unsigned int > mmSub_;
+		vector< unsigned int > mmEnz_;
+		vector< unsigned int > otherRate_;
+
+		/// Rate constants, as [term][voxel].
+		vector< double > zeroK_;
+		vector< double > firstK_;
+		vector< double > secondK_;
+		vector< double > nthK_;
+		vector< double > mmKm_;
+		vector< double > mmKcat_;
+
+		/// Terms evaluated through the RateTerm, as [term][voxel].
+		vector< const RateTerm* > otherTerm_;
+
+		/// The voxels, whose own FuncTerms update the func pools.
+		vector< const VoxelPoolsBase* > voxel_;
+
+		/// Flattened stoichiometry matrix rows for the variable pools.
+		vector< unsigned int > rowStart_;
+		vector< unsigned int > colIndex_;
+		vector< double > entry_;
+
+		/**
+		 * True if each voxel has to be gathered into a plain vector on
+		 * every rate evaluation, to handle funcs and other terms.
+		 */
+		bool needsGather_;
+
+		/// State, stage and workspace arrays, all as [pool][voxel].
+		vector< double > y_;
+		vector< double > yErr_;
+		vector< double > yTemp_;
+		vector< double > k_[6];
+
+		/// Velocities, as [rate][voxel].
+		vector< double > v_;
+
+		/// Single voxel state for gather and scatter.
+		vector< double > s_;
+
+		/// Workspace for higher order terms, one entry per voxel.
+		vector< double > temp_;
+};
+
+#endif	// _BATCHED_VOXEL_POOLS_H
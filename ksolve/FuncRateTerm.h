@@ -145,6 +145,24 @@ class FuncReac: public FuncRate
 			// return new FuncReac( k_ / ratio, v_ );
 		}
 
+		/**
+		 * Only the substrate terms are differentiated. The dependence
+		 * of the function on its arguments is not known analytically,
+		 * so it is left out of the Jacobian.
+		 */
+		void rateDerivatives( const double* S,
+			vector< pair< unsigned int, double > >& deriv ) const
+		{
+			double f = func_( S, 0.0 );
+			for ( unsigned int i = 0; i < v_.size(); ++i ) {
+				double d = f;
+				for ( unsigned int j = 0; j < v_.size(); ++j )
+					if ( j != i )
+						d *= S[ v_[j] ];
+				deriv.push_back( pair< unsigned int, double >( v_[i], d ) );
+			}
+		}
+
 	private:
 		vector< unsigned int > v_;
 		unsigned int numSubstrates_;
@@ -23,6 +23,12 @@ class FuncTerm
 		double operator() ( const double* S, double t ) const;
 		const FuncTerm& operator=( const FuncTerm& other );
 
+		/**
+		 * Evaluates the function and puts the result into the target
+		 * entry of s. This writes the arguments into the parser, so
+		 * each voxel that may run on its own thread uses its own copy
+		 * of the FuncTerm. See VoxelPoolsBase::updateAllFuncTerms.
+		 */
 		void evalPool( double* s, double t ) const;
 
 		/**
@@ -19,9 +19,14 @@
 #include "KinSparseMatrix.h"
 #include "GssaSystem.h"
 #include "Stoich.h"
+#include "PropensityTree.h"
+#include "IndexedPriorityQueue.h"
+#include "../randnum/Philox.h"
 #include "GssaVoxelPools.h"
+#include "../basecode/WorkerPool.h"
 
 #include "Gsolve.h"
+#include "../randnum/randnum.h"
 
 const unsigned int OFFNODE = ~0;
 
@@ -105,6 +110,90 @@ const Cinfo* Gsolve::initCinfo()
 			&Gsolve::getRandInit
 		);
 
+		static ValueFinfo< Gsolve, long > seed(
+			"seed",
+			"Seed for the random number streams of the voxels. Each "
+			"voxel has its own counter-based stream, indexed by its "
+			"voxel number, which is restarted on reinit. So a given "
+			"seed gives the same results whatever the number of threads. "
+			"If zero, the default, a seed is drawn from the global "
+			"random number generator on each reinit.",
+			&Gsolve::setSeed,
+			&Gsolve::getSeed
+		);
+
+		static ValueFinfo< Gsolve, unsigned int > numThreads(
+			"numThreads",
+			"Number of threads used to advance the voxels of this Gsolve "
+			"on each timestep. The voxels are split into contiguous "
+			"chunks, one per thread. As each voxel has its own random "
+			"number stream, results are identical to the single-threaded "
+			"calculation. Default is 1.",
+			&Gsolve::setNumThreads,
+			&Gsolve::getNumThreads
+		);
+
+		static ValueFinfo< Gsolve, string > method(
+			"method",
+			"Stochastic simulation algorithm. Options are: \n"
+			"direct: Gillespie direct method. Draws two random numbers "
+			"per event and picks the reaction using 'selectionMethod'. "
+			"Default.\n"
+			"nextReaction: Gibson-Bruck next-reaction method. Keeps a "
+			"putative firing time for each reaction in an indexed "
+			"priority queue, and after each event only updates the "
+			"reactions that depend on the one that fired. Draws one "
+			"random number per event. Good for models where most "
+			"reactions are slow and a few are fast.\n"
+			"tauLeap: Adaptive tau-leaping, with the step selection of "
+			"Cao, Gillespie and Petzold 2006. Many reactions fire in "
+			"each leap as Poisson draws. Approximate, with accuracy set "
+			"by 'tauLeapEpsilon'. Reverts to exact SSA when the "
+			"leap would be short.\n"
+			"hybrid: Reactions that only change pools with more than "
+			"'hybridThreshold' molecules are integrated as ODEs, and "
+			"the rest are exact SSA. Pools of high copy number are then "
+			"no longer integral.",
+			&Gsolve::setMethod,
+			&Gsolve::getMethod
+		);
+
+		static ValueFinfo< Gsolve, double > tauLeapEpsilon(
+			"tauLeapEpsilon",
+			"Error control for the tauLeap and hybrid methods. The "
+			"tau-leap is chosen so that no propensity is expected to "
+			"change by more than this fraction, and the deterministic "
+			"part of the hybrid changes no pool by more than this "
+			"fraction per step. Default 0.03.",
+			&Gsolve::setTauLeapEpsilon,
+			&Gsolve::getTauLeapEpsilon
+		);
+
+		static ValueFinfo< Gsolve, double > hybridThreshold(
+			"hybridThreshold",
+			"Number of molecules above which a pool is treated as "
+			"continuous by the hybrid method. A reaction is integrated "
+			"deterministically if all the pools it changes are above "
+			"this. Default 1000.",
+			&Gsolve::setHybridThreshold,
+			&Gsolve::getHybridThreshold
+		);
+
+		static ValueFinfo< Gsolve, string > selectionMethod(
+			"selectionMethod",
+			"Engine used to pick the next reaction to fire. "
+			"Options are: \n"
+			"linear: Scan the cumulative sum of propensities. Cost is "
+			"linear in the number of reactions. Default.\n"
+			"tree: Search a binary sum tree of propensities, which is "
+			"updated incrementally as reactions fire. Cost is "
+			"logarithmic in the number of reactions, so this is much "
+			"faster for large models. Picks the same reactions as "
+			"'linear' for the same random numbers, apart from roundoff.",
+			&Gsolve::setSelectionMethod,
+			&Gsolve::getSelectionMethod
+		);
+
 		///////////////////////////////////////////////////////
 		// DestFinfo definitions
 		///////////////////////////////////////////////////////
@@ -179,6 +268,12 @@ const Cinfo* Gsolve::initCinfo()
 		&xCompt,			// SharedFinfo
 		// Here we put new fields that were not there in the Ksolve. 
 		&useRandInit,		// Value
+		&selectionMethod,	// Value
+		&method,			// Value
+		&tauLeapEpsilon,	// Value
+		&seed,				// Value
+		&numThreads,		// Value
+		&hybridThreshold,	// Value
 	};
 	
 	static Dinfo< Gsolve > dinfo;
@@ -204,7 +299,9 @@ Gsolve::Gsolve()
 		pools_( 1 ),
 		startVoxel_( 0 ),
 		dsolve_(),
-		dsolvePtr_( 0 )
+		dsolvePtr_( 0 ),
+		seed_( 0 ),
+		numThreads_( 1 )
 {;}
 
 Gsolve::~Gsolve()
@@ -226,6 +323,7 @@ void Gsolve::setCompartment( Id compt )
 		vector< double > vols = 
 			Field< vector< double > >::get( compt, "voxelVolume" );
 		if ( vols.size() > 0 ) {
+			unshareState();
 			pools_.resize( vols.size() );
 			for ( unsigned int i = 0; i < vols.size(); ++i ) {
 				pools_[i].setVolume( vols[i] );
@@ -267,6 +365,7 @@ void Gsolve::setNumAllVoxels( unsigned int numVoxels )
 	if ( numVoxels == 0 ) {
 		return;
 	}
+	unshareState();
 	pools_.resize( numVoxels );
 	sys_.isReady = false;
 }
@@ -275,7 +374,8 @@ vector< double > Gsolve::getNvec( unsigned int voxel) const
 {
 	static vector< double > dummy;
 	if ( voxel < pools_.size() ) {
-		return const_cast< GssaVoxelPools* >( &( pools_[ voxel ]) )->Svec();
+		const double* s = pools_[ voxel ].S();
+		return vector< double >( s, s + pools_[ voxel ].size() );
 	}
 	return dummy;
 }
@@ -309,32 +409,154 @@ void Gsolve::setRandInit( bool val )
 	sys_.useRandInit = val;
 }
 
+string Gsolve::getMethod() const
+{
+	switch ( sys_.method ) {
+		case GssaNextReaction:
+			return "nextReaction";
+		case GssaTauLeap:
+			return "tauLeap";
+		case GssaHybrid:
+			return "hybrid";
+		default:
+			return "direct";
+	}
+}
+
+void Gsolve::setMethod( string method )
+{
+	if ( method == "direct" || method == "gillespie" ) {
+		sys_.method = GssaDirect;
+	} else if ( method == "nextReaction" || method == "gibsonBruck" ) {
+		sys_.method = GssaNextReaction;
+	} else if ( method == "tauLeap" ) {
+		sys_.method = GssaTauLeap;
+	} else if ( method == "hybrid" ) {
+		sys_.method = GssaHybrid;
+	} else {
+		cout << "Warning: Gsolve::setMethod: '" << method <<
+			"' not known, using direct.\n";
+		sys_.method = GssaDirect;
+	}
+	if ( sys_.isReady ) {
+		for ( vector< GssaVoxelPools >::iterator 
+				i = pools_.begin(); i != pools_.end(); ++i )
+			i->refreshAtot( &sys_ );
+	}
+}
+
+long Gsolve::getSeed() const
+{
+	return seed_;
+}
+
+void Gsolve::setSeed( long seed )
+{
+	seed_ = seed;
+}
+
+unsigned int Gsolve::getNumThreads() const
+{
+	return numThreads_;
+}
+
+void Gsolve::setNumThreads( unsigned int num )
+{
+	if ( num == 0 )
+		numThreads_ = 1;
+	else
+		numThreads_ = num;
+	if ( numThreads_ == 1 )
+		workers_.stop();
+}
+
+double Gsolve::getTauLeapEpsilon() const
+{
+	return sys_.tauLeapEpsilon;
+}
+
+void Gsolve::setTauLeapEpsilon( double eps )
+{
+	if ( eps > 0.0 && eps < 1.0 )
+		sys_.tauLeapEpsilon = eps;
+	else
+		cout << "Warning: Gsolve::setTauLeapEpsilon: " << eps <<
+			" must be between 0 and 1. Not changed.\n";
+}
+
+double Gsolve::getHybridThreshold() const
+{
+	return sys_.hybridThreshold;
+}
+
+void Gsolve::setHybridThreshold( double n )
+{
+	if ( n >= 1.0 )
+		sys_.hybridThreshold = n;
+	else
+		cout << "Warning: Gsolve::setHybridThreshold: " << n <<
+			" must be at least 1. Not changed.\n";
+}
+
+string Gsolve::getSelectionMethod() const
+{
+	if ( sys_.useSelectionTree )
+		return "tree";
+	return "linear";
+}
+
+void Gsolve::setSelectionMethod( string method )
+{
+	if ( method == "linear" ) {
+		sys_.useSelectionTree = false;
+	} else if ( method == "tree" ) {
+		sys_.useSelectionTree = true;
+	} else {
+		cout << "Warning: Gsolve::setSelectionMethod: '" << method <<
+			"' not known, using linear.\n";
+		sys_.useSelectionTree = false;
+	}
+	if ( sys_.isReady ) {
+		for ( vector< GssaVoxelPools >::iterator 
+				i = pools_.begin(); i != pools_.end(); ++i )
+			i->refreshAtot( &sys_ );
+	}
+}
+
 //////////////////////////////////////////////////////////////
 // Process operations.
 //////////////////////////////////////////////////////////////
+/// Advances the voxels in the range [begin, end). Used by each thread.
+static void advancePools( vector< GssaVoxelPools >* pools, 
+		unsigned int begin, unsigned int end, ProcPtr p, 
+		const GssaSystem* sys )
+{
+	for ( unsigned int i = begin; i < end; ++i )
+		(*pools)[i].advance( p, sys );
+}
+
 void Gsolve::process( const Eref& e, ProcPtr p )
 {
 	// cout << stoichPtr_ << "	dsolve = " <<	dsolvePtr_ << endl;
 	if ( !stoichPtr_ )
 		return;
-	// First, handle incoming diffusion values. Note potential for
-	// issues with roundoff if diffusion is not integral.
+	// First, a Dsolve sharing our state store has already diffused it in
+	// place. Here we need to convert to integers, just in case. With
+	// the Dsolve 'binomial' method they are already integral and this
+	// changes nothing, but the 'implicit' method leaves fractions.
+	// The propensities, and the firing times of the next-reaction
+	// method, are out of date for the new n, so they are redone too.
+	// Otherwise a voxel that was stuck at atot = 0 never picks up the
+	// molecules that diffuse into it.
 	if ( dsolvePtr_ ) {
-		vector< double > dvalues( 4 );
-		dvalues[0] = 0;
-		dvalues[1] = getNumLocalVoxels();
-		dvalues[2] = 0;
-		dvalues[3] = stoichPtr_->getNumVarPools();
-		dsolvePtr_->getBlock( dvalues );
-		// Here we need to convert to integers, just in case. Normally
-		// one would use a stochastic (integral) diffusion method with 
-		// the GSSA, but in mixed models it may be more complicated.
-		vector< double >::iterator i = dvalues.begin() + 4;
-		for ( ; i != dvalues.end(); ++i ) {
-		//	cout << *i << "	" << round( *i ) << "		";
-			*i = round( *i );
+		unsigned int numVarPools = stoichPtr_->getNumVarPools();
+		for ( vector< GssaVoxelPools >::iterator 
+				i = pools_.begin(); i != pools_.end(); ++i ) {
+			double* s = i->varS();
+			for ( unsigned int j = 0; j < numVarPools; ++j )
+				s[j] = round( s[j] );
+			i->refreshAtot( &sys_ );
 		}
-		setBlock( dvalues );
 	}
 	// Second, take the arrived xCompt reac values and update S with them.
 	// Here the roundoff issues are handled by the GssaVoxelPools functions
@@ -355,20 +577,24 @@ void Gsolve::process( const Eref& e, ProcPtr p )
 	}
 
 	// Fourth, update the mol #s
-	for ( vector< GssaVoxelPools >::iterator 
-					i = pools_.begin(); i != pools_.end(); ++i ) {
-		i->advance( p, &sys_ );
-	}
-
-	// Finally, assemble and send the integrated values off for the Dsolve.
-	if ( dsolvePtr_ ) {
-		vector< double > kvalues( 4 );
-		kvalues[0] = 0;
-		kvalues[1] = getNumLocalVoxels();
-		kvalues[2] = 0;
-		kvalues[3] = stoichPtr_->getNumVarPools();
-		getBlock( kvalues );
-		dsolvePtr_->setBlock( kvalues );
+	unsigned int numVoxels = pools_.size();
+	unsigned int numThreads = numThreads_;
+	if ( numThreads > numVoxels )
+		numThreads = numVoxels;
+	if ( numThreads <= 1 ) {
+		advancePools( &pools_, 0, numVoxels, p, &sys_ );
+	} else {
+		// Split voxels into contiguous chunks, one per thread. The
+		// calling thread handles the last chunk.
+		unsigned int chunk = ( numVoxels + numThreads - 1 ) / numThreads;
+		unsigned int numChunks = ( numVoxels + chunk - 1 ) / chunk;
+		vector< GssaVoxelPools >* pools = &pools_;
+		const GssaSystem* sys = &sys_;
+		workers_.run( numChunks, [=]( unsigned int i ) {
+			unsigned int end = ( i + 1 ) * chunk;
+			advancePools( pools, i * chunk, 
+							end < numVoxels ? end : numVoxels, p, sys );
+		} );
 	}
 }
 
@@ -378,6 +604,9 @@ void Gsolve::reinit( const Eref& e, ProcPtr p )
 		return;
 	if ( !sys_.isReady )
 		rebuildGssaSystem();
+	seedVoxels();
+	if ( dsolvePtr_ )
+		dsolvePtr_->setSharedState( e.id() );
 	// First reinit concs.
 	for ( vector< GssaVoxelPools >::iterator 
 					i = pools_.begin(); i != pools_.end(); ++i ) {
@@ -430,6 +659,7 @@ void Gsolve::initProc( const Eref& e, ProcPtr p )
 
 void Gsolve::initReinit( const Eref& e, ProcPtr p )
 {
+	seedVoxels();
 	for ( unsigned int i = 0 ; i < pools_.size(); ++i ) {
 		pools_[i].reinit( &sys_ );
 	}
@@ -450,6 +680,20 @@ void Gsolve::initReinit( const Eref& e, ProcPtr p )
 // Solver setup
 //////////////////////////////////////////////////////////////
 
+/**
+ * Restarts the random number stream of each voxel, with the voxel index
+ * as the stream index.
+ */
+void Gsolve::seedVoxels()
+{
+	uint64_t seed = seed_;
+	if ( seed_ == 0 ) // Draw from the global generator, so mtseed applies.
+		seed = ( static_cast< uint64_t >( genrand_int32() ) << 32 ) | 
+				genrand_int32();
+	for ( unsigned int i = 0; i < pools_.size(); ++i )
+		pools_[i].setRandomStream( seed, startVoxel_ + i );
+}
+
 void Gsolve::rebuildGssaSystem()
 {
 	stoichPtr_->convertRatesToStochasticForm();
@@ -464,6 +708,7 @@ void Gsolve::rebuildGssaSystem()
 	fillMmEnzDep();
 	fillMathDep();
 	makeReacDepsUnique();
+	fillReactantOrders();
 	for ( vector< GssaVoxelPools >::iterator 
 					i = pools_.begin(); i != pools_.end(); ++i ) {
 		i->setNumReac( stoichPtr_->getNumRates() );
@@ -473,6 +718,38 @@ void Gsolve::rebuildGssaSystem()
 	sys_.isReady = true;
 }
 
+/**
+ * Fill in the highest order of reaction in which each pool is a 
+ * substrate, and how many of its molecules that reaction consumes.
+ * Used for tau-leap step selection.
+ */
+void Gsolve::fillReactantOrders()
+{
+	unsigned int numPools = 
+		stoichPtr_->getNumVarPools() + stoichPtr_->getNumProxyPools();
+	sys_.highestOrder.assign( numPools, 0 );
+	sys_.highestOrderMult.assign( numPools, 0 );
+	const vector< RateTerm* >& rates = stoichPtr_->getRateTerms();
+	for ( unsigned int i = 0; i < rates.size(); ++i ) {
+		vector< unsigned int > molIndex;
+		unsigned int numSub = rates[i]->getReactants( molIndex );
+		for ( unsigned int j = 0; j < numSub; ++j ) {
+			unsigned int pool = molIndex[j];
+			if ( pool >= numPools )
+				continue;
+			unsigned int mult = count( molIndex.begin(), 
+				molIndex.begin() + numSub, pool );
+			if ( numSub > sys_.highestOrder[ pool ] ) {
+				sys_.highestOrder[ pool ] = numSub;
+				sys_.highestOrderMult[ pool ] = mult;
+			} else if ( numSub == sys_.highestOrder[ pool ] && 
+					mult > sys_.highestOrderMult[ pool ] ) {
+				sys_.highestOrderMult[ pool ] = mult;
+			}
+		}
+	}
+}
+
 /**
  * Fill in dependency list for all MMEnzs on reactions.
  * The dependencies of MMenz products are already in the system,
@@ -534,10 +811,6 @@ void Gsolve::fillMathDep()
 		for ( unsigned int j = 0; j < molIndex.size(); ++j )
 			funcMap[ molIndex[j] ].push_back( i );
 	}
-	// The output of each func is a mol indexed as 
-	// numVarMols + numBufMols + i
-	unsigned int funcOffset = 
-			stoichPtr_->getNumVarPools() + stoichPtr_->getNumProxyPools() + stoichPtr_->getNumBufPools();
 	unsigned int numRates = stoichPtr_->getNumRates();
 	sys_.dependentMathExpn.resize( numRates );
 	vector< unsigned int > indices;
@@ -554,14 +827,15 @@ void Gsolve::fillMathDep()
 			vector< unsigned int >& funcs = funcMap[ molIndex ];
 			dep.insert( dep.end(), funcs.begin(), funcs.end() );
 			for ( unsigned int k = 0; k < funcs.size(); ++k ) {
-				unsigned int outputMol = funcs[k] + funcOffset;
+				unsigned int outputMol = 
+						stoichPtr_->funcs( funcs[k] )->getTarget();
 				// Insert reac deps here. Columns are reactions.
 				vector< int > e; // Entries: we don't need.
 				vector< unsigned int > c; // Column index: the reactions.
 				stoichPtr_->getStoichiometryMatrix().
 						getRow( outputMol, e, c );
 				// Each of the reacs (col entries) depend on this func.
-				vector< unsigned int > rdep = sys_.dependency[i];
+				vector< unsigned int >& rdep = sys_.dependency[i];
 				rdep.insert( rdep.end(), c.begin(), c.end() );
 			}
 		}
@@ -619,6 +893,9 @@ unsigned int Gsolve::getVoxelIndex( const Eref& e ) const
 
 void Gsolve::setDsolve( Id dsolve )
 {
+	// The old Dsolve, if still around, must go back to its own copy.
+	if ( dsolvePtr_ && dsolve_.element() )
+		dsolvePtr_->setSharedState( Id() );
 	if ( dsolve == Id () ) {
 		dsolvePtr_ = 0;
 		dsolve_ = Id();
@@ -64,8 +64,10 @@ class Gsolve: public ZombiePoolInterface
 		// Solver setup functions
 		//////////////////////////////////////////////////////////////////
 		void rebuildGssaSystem();
+		void seedVoxels();
 		void fillMmEnzDep();
 		void fillMathDep();
+		void fillReactantOrders();
 		void insertMathDepReacs( unsigned int mathDepIndex,
 			unsigned int firedReac );
 		void makeReacDepsUnique();
@@ -110,6 +112,31 @@ class Gsolve: public ZombiePoolInterface
 		/// Flag: set true if randomized round to integers is to be done.
 		void setRandInit( bool val );
 
+		/// Returns the algorithm: direct, nextReaction, tauLeap or hybrid.
+		string getMethod() const;
+		/// Assigns the stochastic simulation algorithm.
+		void setMethod( string method );
+
+		/// Seed for the per-voxel random streams. 0 means pick one.
+		long getSeed() const;
+		void setSeed( long seed );
+
+		/// Number of threads used in process. 1 means serial.
+		unsigned int getNumThreads() const;
+		void setNumThreads( unsigned int num );
+
+		/// Error control parameter for tau-leaping and hybrid methods.
+		double getTauLeapEpsilon() const;
+		void setTauLeapEpsilon( double eps );
+		/// Copy number above which the hybrid method uses ODEs.
+		double getHybridThreshold() const;
+		void setHybridThreshold( double n );
+
+		/// Returns the reaction selection engine, 'linear' or 'tree'.
+		string getSelectionMethod() const;
+		/// Assigns the reaction selection engine.
+		void setSelectionMethod( string method );
+
 		//////////////////////////////////////////////////////////////////
 		static SrcFinfo2< Id, vector< double > >* xComptOut();
 		static const Cinfo* initCinfo();
@@ -137,6 +164,15 @@ class Gsolve: public ZombiePoolInterface
 
 		/// Pointer to diffusion solver
 		ZombiePoolInterface* dsolvePtr_;
+
+		/// Seed for the voxel random streams. 0 means draw one on reinit.
+		long seed_;
+
+		/// Number of threads to use in process. 1 means serial.
+		unsigned int numThreads_;
+
+		/// Threads that advance the voxels, kept between ticks.
+		WorkerPool workers_;
 };
 
 #endif	// _GSOLVE_H
@@ -15,12 +15,22 @@
  * GSSA calculations.
  */
 
+/**
+ * Algorithm used to advance the GSSA. GssaDirect is the Gillespie direct
+ * method, GssaNextReaction is the Gibson-Bruck next-reaction method,
+ * GssaTauLeap is adaptive tau-leaping, and GssaHybrid integrates 
+ * high-copy-number reactions deterministically and the rest by SSA.
+ */
+enum GssaMethod { GssaDirect, GssaNextReaction, GssaTauLeap, GssaHybrid };
+
 class Stoich;
 class GssaSystem
 {
 	public: 
 		GssaSystem()
-			: stoich( 0 ), useRandInit( true ), isReady( false )
+			: stoich( 0 ), useRandInit( true ), useSelectionTree( false ),
+			method( GssaDirect ), tauLeapEpsilon( 0.03 ),
+			hybridThreshold( 1000.0 ), isReady( false )
 		{;}
 		vector< vector< unsigned int > > dependency;
 		vector< vector< unsigned int > > dependentMathExpn;
@@ -43,6 +53,52 @@ class GssaSystem
 		 */
 		bool useRandInit;
 
+		/**
+		 * Flag: True when reactions are picked using a PropensityTree,
+		 * in O(log R) time, rather than a linear scan over the
+		 * propensities. Both pick the same reaction for the same random
+		 * number, apart from roundoff.
+		 */
+		bool useSelectionTree;
+
+		/**
+		 * Algorithm used to advance each voxel, see GssaMethod. The
+		 * direct and next-reaction methods are exact stochastic
+		 * simulations; tau-leaping and the hybrid method approximate.
+		 * The next-reaction method keeps a putative firing time for
+		 * each reaction in an IndexedPriorityQueue, and after each 
+		 * event only updates the reactions in the dependency list of
+		 * the one that fired. When a Dsolve or cross-compartment 
+		 * transfer changes n between steps, all propensities are
+		 * recomputed but only the changed ones get new firing times.
+		 */
+		GssaMethod method;
+
+		/**
+		 * Error control parameter for tau-leaping, as per Cao, Gillespie
+		 * and Petzold (J Chem Phys 124:044109, 2006). The leap is chosen
+		 * so that no propensity is expected to change by more than this
+		 * fraction. Also used as the relative change per step of the 
+		 * deterministic part of the hybrid method.
+		 */
+		double tauLeapEpsilon;
+
+		/**
+		 * In the hybrid method, a reaction is integrated
+		 * deterministically if all the pools it changes have at least
+		 * this many molecules.
+		 */
+		double hybridThreshold;
+
+		/**
+		 * Highest order of any reaction in which each pool is a
+		 * substrate, and the number of molecules of the pool that 
+		 * reaction consumes. Zero order if the pool is not a substrate.
+		 * Used to select the leap in tau-leaping. 
+		 */
+		vector< unsigned int > highestOrder;
+		vector< unsigned int > highestOrderMult;
+
 		/**
 		 * Flag: True when all initialization is done.
 		 */
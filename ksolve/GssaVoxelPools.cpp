@@ -6,6 +6,7 @@
 ** GNU Lesser General Public License version 2.1
 ** See the file COPYING.LIB for the full notice.
 **********************************************************************/
+#include <limits>
 #include "header.h"
 #include "RateTerm.h"
 #include "FuncTerm.h"
@@ -17,8 +18,10 @@
 #include "ZombiePoolInterface.h"
 #include "Stoich.h"
 #include "GssaSystem.h"
+#include "PropensityTree.h"
+#include "IndexedPriorityQueue.h"
+#include "../randnum/Philox.h"
 #include "GssaVoxelPools.h"
-#include "../randnum/randnum.h"
 
 /**
  * The SAFETY_FACTOR Protects against the total propensity exceeding
@@ -37,6 +40,19 @@
  */
 const double SAFETY_FACTOR = 1.0 + 1.0e-9;
 
+/**
+ * In tau-leaping, a reaction is critical if it can fire fewer than this
+ * many times before exhausting a substrate. Critical reactions fire at
+ * most once per leap, so they cannot drive mol #s negative. The same
+ * number of expected events is the smallest leap worth taking.
+ */
+const double NUM_CRITICAL_FIRINGS = 10.0;
+
+/**
+ * Number of direct SSA events done when a tau-leap would be too short.
+ */
+const unsigned int NUM_SSA_STEPS = 100;
+
 //////////////////////////////////////////////////////////////
 // Class definitions
 //////////////////////////////////////////////////////////////
@@ -45,7 +61,8 @@ GssaVoxelPools::GssaVoxelPools()
 	: 
 			VoxelPoolsBase(),
 			t_( 0.0 ),
-			atot_( 0.0 )
+			atot_( 0.0 ),
+			slowHazard_( 0.0 )
 {;}
 
 GssaVoxelPools::~GssaVoxelPools()
@@ -64,15 +81,25 @@ void GssaVoxelPools::updateDependentMathExpn(
 	const vector< unsigned int >& deps = g->dependentMathExpn[ rindex ];
 	for( vector< unsigned int >::const_iterator 
 			i = deps.begin(); i != deps.end(); ++i ) {
-			// Future fix: Need to get current time in here.
-			g->stoich->funcs( *i )->evalPool( varS(), 0.0 );
-		// varS()[ *i + offset] = g->stoich->funcs( *i )->operator()( S(), t_);
+		// Uses this voxel's own copy of the FuncTerm, as the one in the
+		// Stoich is shared by voxels on other threads.
+		assert( *i < funcs_.size() && funcs_[ *i ] );
+		funcs_[ *i ]->evalPool( varS(), t_ );
 	}
 }
 
 void GssaVoxelPools::updateDependentRates( 
 	const vector< unsigned int >& deps, const Stoich* stoich )
 {
+	if ( tree_.size() > 0 ) {
+		for ( vector< unsigned int >::const_iterator
+				i = deps.begin(); i != deps.end(); ++i ) {
+			v_[ *i ] = getReacVelocity( *i, S() );
+			tree_.update( *i, v_[ *i ] );
+		}
+		atot_ = tree_.total();
+		return;
+	}
 	for ( vector< unsigned int >::const_iterator
 			i = deps.begin(); i != deps.end(); ++i ) {
 		atot_ -= v_[ *i ];
@@ -84,7 +111,9 @@ void GssaVoxelPools::updateDependentRates(
 unsigned int GssaVoxelPools::pickReac() const
 {
 	// double r =  gsl_rng_uniform( rng ) * atot_;
-	double r = mtrand() * atot_;
+	double r = rng_.uniform() * atot_;
+	if ( tree_.size() > 0 )
+		return tree_.pick( r );
 	double sum = 0.0;
 
 	// This is an inefficient way to do it. Can easily get to 
@@ -92,7 +121,8 @@ unsigned int GssaVoxelPools::pickReac() const
 	// subsidiary tables. Too many levels causes slow-down because
 	// of overhead in managing the tree. 
 	// Slepoy, Thompson and Plimpton 2008
-	// report a linear time version.
+	// report a linear time version. The PropensityTree used when 
+	// GssaSystem::useSelectionTree is set does it in log time.
 	for ( vector< double >::const_iterator 
 			i = v_.begin(); i != v_.end(); ++i ) {
 		if ( r < ( sum += *i ) )
@@ -105,16 +135,55 @@ void GssaVoxelPools::setNumReac( unsigned int n )
 {
 	v_.clear();
 	v_.resize( n, 0.0 );
+	tree_.clear();
+	queue_.clear();
 }
 
 /**
  * Cleans out all reac rates and recalculates atot. Needed whenever a
  * mol conc changes, or if there is a roundoff error.
  * Returns true if OK, returns false if it is in a stuck state and atot<=0
+ * For the next-reaction method, once the queue is built only the
+ * reactions whose propensity has changed get new firing times, so the
+ * cost of a refresh after diffusion is one propensity per reaction plus
+ * a queue update per changed one.
  */
 bool GssaVoxelPools::refreshAtot( const GssaSystem* g )
 {
+	if ( g->method == GssaNextReaction && queue_.size() == v_.size() &&
+					v_.size() > 0 ) {
+		tree_.clear();
+		atot_ = 0;
+		for ( unsigned int i = 0; i < v_.size(); ++i ) {
+			double aOld = v_[i];
+			double aNew = v_[i] = getReacVelocity( i, S() );
+			atot_ += aNew;
+			if ( aNew != aOld )
+				queue_.update( i, rescaledTime( i, aOld, aNew ) );
+		}
+		return ( atot_ > 0.0 );
+	}
 	updateReacVelocities( g, S(), v_ );
+	if ( g->method == GssaNextReaction ) {
+		// No queue yet, so draw fresh firing times for all reactions.
+		tree_.clear();
+		vector< double > times( v_.size() );
+		atot_ = 0;
+		for ( unsigned int i = 0; i < v_.size(); ++i ) {
+			atot_ += v_[i];
+			times[i] = putativeTime( v_[i] );
+		}
+		queue_.build( times );
+		return ( atot_ > 0.0 );
+	}
+	queue_.clear();
+	if ( g->useSelectionTree ) {
+		// The tree keeps an exact sum, so no safety factor is needed.
+		tree_.build( v_ );
+		atot_ = tree_.total();
+		return ( atot_ > 0.0 );
+	}
+	tree_.clear();
 	atot_ = 0;
 	for ( vector< double >::const_iterator 
 			i = v_.begin(); i != v_.end(); ++i )
@@ -129,11 +198,30 @@ bool GssaVoxelPools::refreshAtot( const GssaSystem* g )
 
 void GssaVoxelPools::advance( const ProcInfo* p, const GssaSystem* g )
 {
-	double nextt = p->currTime;
-	while ( t_ < nextt ) {
+	switch ( g->method ) {
+		case GssaNextReaction:
+			advanceNextReaction( p, g );
+			break;
+		case GssaTauLeap:
+			advanceTauLeap( p, g );
+			break;
+		case GssaHybrid:
+			advanceHybrid( p, g );
+			break;
+		default:
+			fireDirect( g, p->currTime, ~0U );
+			break;
+	}
+}
+
+unsigned int GssaVoxelPools::fireDirect( const GssaSystem* g, double nextt,
+				unsigned int maxEvents )
+{
+	unsigned int numEvents = 0;
+	while ( t_ < nextt && numEvents < maxEvents ) {
 		if ( atot_ <= 0.0 ) { // reac system is stuck, will not advance.
 			t_ = nextt;
-			return;
+			return numEvents;
 		}
 		unsigned int rindex = pickReac();
 		assert( g->stoich->getNumRates() == v_.size() );
@@ -142,7 +230,7 @@ void GssaVoxelPools::advance( const ProcInfo* p, const GssaSystem* g )
 			// Recalculate atot to avoid, and redo.
 			if ( !refreshAtot( g ) ) { // Stuck state.
 				t_ = nextt;
-				return;
+				return numEvents;
 			}
 			// We had a roundoff error, fixed it, but now need to be sure
 			// we only fire a reaction where this is permissible.
@@ -155,22 +243,399 @@ void GssaVoxelPools::advance( const ProcInfo* p, const GssaSystem* g )
 			assert( rindex < v_.size() );
 		}
 
-		g->transposeN.fireReac( rindex, Svec() );
-		double r = mtrand();
+		g->transposeN.fireReac( rindex, varS() );
+		double r = rng_.uniform();
 		while ( r <= 0.0 ) {
-			r = mtrand();
+			r = rng_.uniform();
 		}
 		t_ -= ( 1.0 / atot_ ) * log( r );
-		g->stoich->updateFuncs( varS(), t_ );
+		updateFuncs( varS(), t_ );
 		updateDependentMathExpn( g, rindex );
 		updateDependentRates( g->dependency[ rindex ], g->stoich );
+		++numEvents;
+	}
+	return numEvents;
+}
+
+double GssaVoxelPools::putativeTime( double a ) const
+{
+	if ( a <= 0.0 )
+		return numeric_limits< double >::infinity();
+	double r = rng_.uniform();
+	while ( r <= 0.0 ) {
+		r = rng_.uniform();
+	}
+	return t_ - log( r ) / a;
+}
+
+double GssaVoxelPools::rescaledTime( unsigned int r, 
+				double aOld, double aNew ) const
+{
+	double tau = queue_.time( r );
+	if ( aOld > 0.0 && aNew > 0.0 && tau < 
+					numeric_limits< double >::infinity() )
+		return t_ + ( aOld / aNew ) * ( tau - t_ );
+	return putativeTime( aNew );
+}
+
+void GssaVoxelPools::updateNextReactionTimes( 
+	const vector< unsigned int >& deps, unsigned int fired )
+{
+	for ( vector< unsigned int >::const_iterator
+			i = deps.begin(); i != deps.end(); ++i ) {
+		double aOld = v_[ *i ];
+		double aNew = v_[ *i ] = getReacVelocity( *i, S() );
+		atot_ += aNew - aOld;
+		if ( *i != fired )
+			queue_.update( *i, rescaledTime( *i, aOld, aNew ) );
+	}
+	queue_.update( fired, putativeTime( v_[ fired ] ) );
+}
+
+void GssaVoxelPools::advanceNextReaction( 
+				const ProcInfo* p, const GssaSystem* g )
+{
+	double nextt = p->currTime;
+	if ( queue_.size() != v_.size() ) // Switched method since reinit.
+		refreshAtot( g );
+	while ( queue_.size() > 0 && queue_.topTime() <= nextt ) {
+		unsigned int rindex = queue_.top();
+		t_ = queue_.topTime();
+		g->transposeN.fireReac( rindex, varS() );
+		updateFuncs( varS(), t_ );
+		updateDependentMathExpn( g, rindex );
+		updateNextReactionTimes( g->dependency[ rindex ], rindex );
+	}
+	// The pending firing times remain valid past nextt, so the queue
+	// carries over to the next timestep. If anything else changes the
+	// n in between, such as a Dsolve, refreshAtot rescales them.
+	t_ = nextt;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// Tau-leaping and hybrid methods
+/////////////////////////////////////////////////////////////////////////
+
+/**
+ * Draws a Poisson distributed number of firings with the given mean.
+ * Uses Knuth's product of uniforms for small means, and the transformed
+ * rejection method PTRS of Hormann (Insurance Math Econ 12:39, 1993)
+ * for large ones, so the cost does not grow with the mean.
+ */
+static double poissonSample( double mean, Philox& rng )
+{
+	if ( mean <= 0.0 )
+		return 0.0;
+	if ( mean < 10.0 ) {
+		double limit = exp( -mean );
+		double prod = rng.uniform();
+		double k = 0.0;
+		while ( prod > limit ) {
+			prod *= rng.uniform();
+			k += 1.0;
+		}
+		return k;
+	}
+	double sqrtMean = sqrt( mean );
+	double logMean = log( mean );
+	double b = 0.931 + 2.53 * sqrtMean;
+	double a = -0.059 + 0.02483 * b;
+	double invAlpha = 1.1239 + 1.1328 / ( b - 3.4 );
+	double vr = 0.9277 - 3.6224 / ( b - 2.0 );
+	while ( true ) {
+		double u = rng.uniform() - 0.5;
+		double v = rng.uniform();
+		double us = 0.5 - fabs( u );
+		double k = floor( ( 2.0 * a / us + b ) * u + mean + 0.43 );
+		if ( us >= 0.07 && v <= vr )
+			return k;
+		if ( k < 0.0 || ( us < 0.013 && v > us ) )
+			continue;
+		if ( log( v ) + log( invAlpha ) - log( a / ( us * us ) + b ) <= 
+				-mean + k * logMean - lgamma( k + 1.0 ) )
+			return k;
+	}
+}
+
+/**
+ * The factor g_i of Cao, Gillespie and Petzold 2006, which relates the
+ * relative change in a substrate pool to the relative change in the
+ * propensity of the highest order reaction that consumes it.
+ */
+static double reactantOrderFactor( unsigned int order, unsigned int mult,
+				double x )
+{
+	if ( order <= 1 )
+		return 1.0;
+	if ( order == 2 ) {
+		if ( mult >= 2 && x > 1.0 )
+			return 2.0 + 1.0 / ( x - 1.0 );
+		return 2.0;
+	}
+	if ( order == 3 ) {
+		if ( mult == 2 && x > 1.0 )
+			return 1.5 * ( 2.0 + 1.0 / ( x - 1.0 ) );
+		if ( mult >= 3 && x > 2.0 )
+			return 3.0 + 1.0 / ( x - 1.0 ) + 2.0 / ( x - 2.0 );
+		return 3.0;
+	}
+	return order;
+}
+
+double GssaVoxelPools::maxFirings( const GssaSystem* g, unsigned int r,
+				unsigned int numPools ) const
+{
+	const int* entry;
+	const unsigned int* colIndex;
+	unsigned int n = g->transposeN.getRow( r, &entry, &colIndex );
+	const double* s = S();
+	double ret = numeric_limits< double >::infinity();
+	for ( unsigned int k = 0; k < n; ++k ) {
+		if ( colIndex[k] < numPools && entry[k] < 0 ) {
+			double x = floor( s[ colIndex[k] ] / -entry[k] );
+			if ( ret > x )
+				ret = x;
+		}
+	}
+	return ret;
+}
+
+double GssaVoxelPools::tauLeapStep( const GssaSystem* g, 
+				unsigned int numPools )
+{
+	mu_.assign( numPools, 0.0 );
+	sigma_.assign( numPools, 0.0 );
+	for ( unsigned int r = 0; r < v_.size(); ++r ) {
+		if ( isCritical_[r] || v_[r] <= 0.0 )
+			continue;
+		const int* entry;
+		const unsigned int* colIndex;
+		unsigned int n = g->transposeN.getRow( r, &entry, &colIndex );
+		for ( unsigned int k = 0; k < n; ++k ) {
+			if ( colIndex[k] < numPools ) {
+				mu_[ colIndex[k] ] += entry[k] * v_[r];
+				sigma_[ colIndex[k] ] += entry[k] * entry[k] * v_[r];
+			}
+		}
+	}
+	const double* s = S();
+	double tau = numeric_limits< double >::infinity();
+	for ( unsigned int i = 0; i < numPools && i < g->highestOrder.size(); 
+					++i ) {
+		if ( g->highestOrder[i] == 0 ) // Not a substrate of anything.
+			continue;
+		double gi = reactantOrderFactor( g->highestOrder[i], 
+						g->highestOrderMult[i], s[i] );
+		double bound = g->tauLeapEpsilon * s[i] / gi;
+		if ( bound < 1.0 )
+			bound = 1.0;
+		if ( mu_[i] != 0.0 && tau > bound / fabs( mu_[i] ) )
+			tau = bound / fabs( mu_[i] );
+		if ( sigma_[i] > 0.0 && tau > bound * bound / sigma_[i] )
+			tau = bound * bound / sigma_[i];
+	}
+	return tau;
+}
+
+void GssaVoxelPools::advanceTauLeap( const ProcInfo* p, const GssaSystem* g )
+{
+	double nextt = p->currTime;
+	unsigned int numPools = 
+		g->stoich->getNumVarPools() + g->stoich->getNumProxyPools();
+	while ( t_ < nextt ) {
+		updateReacVelocities( g, S(), v_ );
+		double a0 = 0.0;
+		double a0c = 0.0;
+		isCritical_.assign( v_.size(), false );
+		for ( unsigned int r = 0; r < v_.size(); ++r ) {
+			a0 += v_[r];
+			if ( v_[r] > 0.0 && 
+				maxFirings( g, r, numPools ) < NUM_CRITICAL_FIRINGS ) {
+				isCritical_[r] = true;
+				a0c += v_[r];
+			}
+		}
+		if ( a0 <= 0.0 ) { // Stuck state.
+			t_ = nextt;
+			return;
+		}
+		double tau1 = tauLeapStep( g, numPools );
+		if ( tau1 * a0 < NUM_CRITICAL_FIRINGS ) {
+			// Leap would cover only a few events, so do them exactly.
+			refreshAtot( g );
+			fireDirect( g, nextt, NUM_SSA_STEPS );
+			continue;
+		}
+		backup_.assign( S(), S() + size() );
+		while ( true ) {
+			double tau2 = numeric_limits< double >::infinity();
+			if ( a0c > 0.0 ) {
+				double r = rng_.uniform();
+				while ( r <= 0.0 )
+					r = rng_.uniform();
+				tau2 = -log( r ) / a0c;
+			}
+			double tau = ( tau1 < tau2 ) ? tau1 : tau2;
+			bool fireCritical = ( tau2 <= tau1 );
+			if ( t_ + tau > nextt ) {
+				tau = nextt - t_;
+				fireCritical = false;
+			}
+			for ( unsigned int r = 0; r < v_.size(); ++r ) {
+				if ( !isCritical_[r] ) {
+					double k = poissonSample( v_[r] * tau, rng_ );
+					if ( k > 0.0 )
+						g->transposeN.fireReac( r, varS(), k );
+				}
+			}
+			if ( fireCritical ) { // Exactly one critical reaction fires.
+				double x = rng_.uniform() * a0c;
+				unsigned int last = v_.size();
+				for ( unsigned int r = 0; r < v_.size(); ++r ) {
+					if ( isCritical_[r] ) {
+						last = r;
+						if ( x < v_[r] )
+							break;
+						x -= v_[r];
+					}
+				}
+				g->transposeN.fireReac( last, varS(), 1.0 );
+			}
+			bool isNegative = false;
+			const double* s = S();
+			for ( unsigned int i = 0; i < numPools; ++i )
+				isNegative |= ( s[i] < 0.0 );
+			if ( !isNegative ) {
+				t_ += tau;
+				break;
+			}
+			// Leap overshot, undo it and try half as far.
+			copy( backup_.begin(), backup_.end(), varS() );
+			tau1 *= 0.5;
+		}
+		updateFuncs( varS(), t_ );
+	}
+}
+
+void GssaVoxelPools::partitionReacs( const GssaSystem* g,
+				unsigned int numPools )
+{
+	const double* s = S();
+	isFast_.assign( v_.size(), false );
+	for ( unsigned int r = 0; r < v_.size(); ++r ) {
+		const int* entry;
+		const unsigned int* colIndex;
+		unsigned int n = g->transposeN.getRow( r, &entry, &colIndex );
+		bool isFast = false;
+		for ( unsigned int k = 0; k < n; ++k ) {
+			if ( colIndex[k] >= numPools )
+				continue;
+			isFast = ( s[ colIndex[k] ] >= g->hybridThreshold );
+			if ( !isFast )
+				break;
+		}
+		isFast_[r] = isFast;
+	}
+}
+
+double GssaVoxelPools::fastRates( const GssaSystem* g, 
+				unsigned int numPools )
+{
+	double aSlow = 0.0;
+	dxdt_.assign( numPools, 0.0 );
+	for ( unsigned int r = 0; r < v_.size(); ++r ) {
+		if ( !isFast_[r] ) {
+			aSlow += v_[r];
+			continue;
+		}
+		const int* entry;
+		const unsigned int* colIndex;
+		unsigned int n = g->transposeN.getRow( r, &entry, &colIndex );
+		for ( unsigned int k = 0; k < n; ++k ) {
+			if ( colIndex[k] < numPools )
+				dxdt_[ colIndex[k] ] += entry[k] * v_[r];
+		}
+	}
+	return aSlow;
+}
+
+void GssaVoxelPools::advanceHybrid( const ProcInfo* p, const GssaSystem* g )
+{
+	double nextt = p->currTime;
+	unsigned int numPools = 
+		g->stoich->getNumVarPools() + g->stoich->getNumProxyPools();
+	double* s = varS();
+	while ( t_ < nextt ) {
+		// Copy numbers may have crossed the threshold since last step.
+		partitionReacs( g, numPools );
+		if ( slowHazard_ <= 0.0 ) {
+			double r = rng_.uniform();
+			while ( r <= 0.0 )
+				r = rng_.uniform();
+			slowHazard_ = -log( r );
+		}
+		// Pick the step so that no fast pool changes by more than
+		// tauLeapEpsilon of its value.
+		updateReacVelocities( g, S(), v_ );
+		fastRates( g, numPools );
+		double h = nextt - t_;
+		for ( unsigned int i = 0; i < numPools; ++i ) {
+			double limit = g->tauLeapEpsilon * ( s[i] > 1.0 ? s[i] : 1.0 );
+			if ( fabs( dxdt_[i] ) * h > limit )
+				h = limit / fabs( dxdt_[i] );
+		}
+		// Explicit midpoint step for the fast reactions. The slow
+		// propensity is integrated by the midpoint rule along with it.
+		backup_.assign( s, s + size() );
+		for ( unsigned int i = 0; i < numPools; ++i )
+			s[i] += 0.5 * h * dxdt_[i];
+		updateFuncs( varS(), t_ + 0.5 * h );
+		updateReacVelocities( g, S(), v_ );
+		double aSlow = fastRates( g, numPools );
+		double dHazard = aSlow * h;
+		bool fireSlow = ( dHazard >= slowHazard_ );
+		if ( fireSlow ) // Slow event is within this step, stop there.
+			h *= slowHazard_ / dHazard;
+		for ( unsigned int i = 0; i < numPools; ++i ) {
+			s[i] = backup_[i] + h * dxdt_[i];
+			if ( s[i] < 0.0 )
+				s[i] = 0.0;
+		}
+		t_ += h;
+		updateFuncs( varS(), t_ );
+		if ( !fireSlow ) {
+			slowHazard_ -= dHazard;
+			continue;
+		}
+		// Fire one slow reaction, chosen by its propensity now.
+		slowHazard_ = 0.0;
+		updateReacVelocities( g, S(), v_ );
+		double aSlowNow = 0.0;
+		for ( unsigned int r = 0; r < v_.size(); ++r )
+			if ( !isFast_[r] )
+				aSlowNow += v_[r];
+		if ( aSlowNow > 0.0 ) {
+			double x = rng_.uniform() * aSlowNow;
+			unsigned int last = v_.size();
+			for ( unsigned int r = 0; r < v_.size(); ++r ) {
+				if ( !isFast_[r] && v_[r] > 0.0 ) {
+					last = r;
+					if ( x < v_[r] )
+						break;
+					x -= v_[r];
+				}
+			}
+			g->transposeN.fireReac( last, s );
+			updateFuncs( varS(), t_ );
+			updateDependentMathExpn( g, last );
+		}
 	}
 }
 
 void GssaVoxelPools::reinit( const GssaSystem* g )
 {
 	VoxelPoolsBase::reinit(); // Assigns S = Sinit;
-	g->stoich->updateFuncs( varS(), 0 );
+	updateFuncs( varS(), 0 );
 
 	unsigned int numVarPools = g->stoich->getNumVarPools();
 	double* n = varS();
@@ -181,7 +646,7 @@ void GssaVoxelPools::reinit( const GssaSystem* g )
 			double base = floor( n[i] );
 			double frac = n[i] - base;
 			// if ( gsl_rng_uniform( rng ) > frac )
-			if ( mtrand() > frac )
+			if ( rng_.uniform() > frac )
 				n[i] = base;
 			else
 				n[i] = base + 1.0;
@@ -192,6 +657,8 @@ void GssaVoxelPools::reinit( const GssaSystem* g )
 		}
 	}
 	t_ = 0.0;
+	slowHazard_ = 0.0;
+	queue_.clear(); // Its times are from the last run.
 	refreshAtot( g );
 }
 
@@ -212,6 +679,7 @@ void GssaVoxelPools::updateAllRateTerms( const vector< RateTerm* >& rates,
 		rates_[i] = rates[i]->copyWithVolScaling( getVolume(), 
 						getXreacScaleSubstrates(i - numCoreRates),
 						getXreacScaleProducts(i - numCoreRates ) );
+	updateAllFuncTerms();
 }
 
 void GssaVoxelPools::updateRateTerms( const vector< RateTerm* >& rates,
@@ -259,6 +727,11 @@ double GssaVoxelPools::getReacVelocity(
 	return rates_[r]->operator()( s );
 }
 
+void GssaVoxelPools::setRandomStream( uint64_t seed, uint64_t stream )
+{
+	rng_.setSeed( seed, stream );
+}
+
 void GssaVoxelPools::setStoich( const Stoich* stoichPtr )
 {
 	stoichPtr_ = stoichPtr;
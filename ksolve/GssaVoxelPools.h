@@ -31,6 +31,54 @@ class GssaVoxelPools: public VoxelPoolsBase
 
 		void advance( const ProcInfo* p, const GssaSystem* g );
 
+		/**
+		 * Advances the voxel to p->currTime using the Gibson-Bruck 
+		 * next-reaction method.
+		 */
+		void advanceNextReaction( const ProcInfo* p, const GssaSystem* g );
+
+		/**
+		 * Recomputes the propensities of the reactions in deps after
+		 * reaction 'fired' has occurred at time t_, and rescales their
+		 * putative firing times as per Gibson and Bruck. The fired 
+		 * reaction gets a fresh firing time.
+		 */
+		void updateNextReactionTimes( 
+			const vector< unsigned int >& deps, unsigned int fired );
+
+		/**
+		 * Draws a putative firing time after t_ for a reaction with
+		 * propensity a. Returns infinity if a is not positive.
+		 */
+		double putativeTime( double a ) const;
+
+		/**
+		 * Returns the firing time of reaction r, whose propensity has
+		 * gone from aOld to aNew at t_: the time left is scaled by
+		 * aOld / aNew, or drawn afresh if either is zero.
+		 */
+		double rescaledTime( unsigned int r, double aOld, double aNew ) 
+				const;
+
+		/**
+		 * Advances the voxel to p->currTime by adaptive tau-leaping,
+		 * using the step selection of Cao, Gillespie and Petzold 2006 
+		 * and their treatment of critical reactions to avoid negative
+		 * mol #s. Falls back to direct SSA when the leap would be 
+		 * shorter than a few SSA events.
+		 */
+		void advanceTauLeap( const ProcInfo* p, const GssaSystem* g );
+
+		/**
+		 * Advances the voxel to p->currTime by the hybrid method.
+		 * Reactions that only change pools with more than 
+		 * g->hybridThreshold molecules are integrated as ODEs with the
+		 * explicit midpoint method. The rest fire as exact SSA events,
+		 * timed by integrating their total propensity along the
+		 * deterministic trajectory.
+		 */
+		void advanceHybrid( const ProcInfo* p, const GssaSystem* g );
+
 		/**
  		* Cleans out all reac rates and recalculates atot. Needed whenever a
  		* mol conc changes, or if there is a roundoff error. Returns true
@@ -78,7 +126,48 @@ class GssaVoxelPools: public VoxelPoolsBase
 
 		void setStoich( const Stoich* stoichPtr );
 
+		/**
+		 * Restarts the random number stream of this voxel. Voxels with
+		 * the same seed and different stream indices draw independent
+		 * sequences, so results do not depend on the order or thread
+		 * in which voxels are advanced.
+		 */
+		void setRandomStream( uint64_t seed, uint64_t stream );
+
 	private:
+		/**
+		 * Fires reactions by the direct method until t_ reaches nextt
+		 * or maxEvents have fired. Returns the number fired.
+		 */
+		unsigned int fireDirect( const GssaSystem* g, double nextt,
+						unsigned int maxEvents );
+
+		/**
+		 * Number of times reaction r can fire before one of the pools
+		 * it consumes runs out.
+		 */
+		double maxFirings( const GssaSystem* g, unsigned int r, 
+						unsigned int numPools ) const;
+
+		/**
+		 * Largest leap for the non-critical reactions, from the 
+		 * means and variances of the change in each substrate pool.
+		 */
+		double tauLeapStep( const GssaSystem* g, unsigned int numPools );
+
+		/**
+		 * Marks as fast in isFast_ every reaction whose pools all 
+		 * have at least g->hybridThreshold molecules.
+		 */
+		void partitionReacs( const GssaSystem* g, unsigned int numPools );
+
+		/**
+		 * Computes the rate of change of pools due to the fast
+		 * reactions into dxdt_, and returns the total propensity of the
+		 * slow reactions. Uses the current velocities in v_.
+		 */
+		double fastRates( const GssaSystem* g, unsigned int numPools );
+
 		/// Time at which next event will occur.
 		double t_; 
 
@@ -92,8 +181,43 @@ class GssaVoxelPools: public VoxelPoolsBase
 		 * recalculated on each step.
 		 */
 		vector< double > v_; 
-		// Possibly we should put independent RNGS, so save one here.
-		
+
+		/**
+		 * Sum tree over v_, used to pick reactions in log time.
+		 * Empty unless the GssaSystem asks for tree selection.
+		 */
+		PropensityTree tree_;
+
+		/**
+		 * Putative firing times of all reactions, used by the
+		 * next-reaction method. Empty for the direct method.
+		 */
+		IndexedPriorityQueue queue_;
+
+		/// Flags critical reactions during a tau-leap.
+		vector< bool > isCritical_;
+
+		/// Flags reactions integrated deterministically by the hybrid.
+		vector< bool > isFast_;
+
+		/// Scratch: expected change and variance per pool in tau-leap.
+		vector< double > mu_;
+		vector< double > sigma_;
+
+		/// Scratch: rate of change of pools due to fast reactions.
+		vector< double > dxdt_;
+
+		/// Scratch: mol #s at the start of a leap or hybrid step.
+		vector< double > backup_;
+
+		/**
+		 * Hybrid method: integrated propensity of the slow reactions
+		 * still to elapse before the next slow event.
+		 */
+		double slowHazard_;
+
+		/// Random number stream private to this voxel.
+		mutable Philox rng_;
 };
 
 #endif	// _GSSA_VOXEL_POOLS_H
@@ -0,0 +1,107 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2015 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+#include <vector>
+#include <cassert>
+using namespace std;
+#include "IndexedPriorityQueue.h"
+
+IndexedPriorityQueue::IndexedPriorityQueue()
+{;}
+
+void IndexedPriorityQueue::build( const vector< double >& times )
+{
+	time_ = times;
+	heap_.resize( times.size() );
+	pos_.resize( times.size() );
+	for ( unsigned int i = 0; i < times.size(); ++i ) {
+		heap_[i] = i;
+		pos_[i] = i;
+	}
+	for ( unsigned int k = heap_.size() / 2; k > 0; --k )
+		siftDown( k - 1 );
+}
+
+void IndexedPriorityQueue::clear()
+{
+	time_.clear();
+	heap_.clear();
+	pos_.clear();
+}
+
+unsigned int IndexedPriorityQueue::size() const
+{
+	return heap_.size();
+}
+
+unsigned int IndexedPriorityQueue::top() const
+{
+	assert( heap_.size() > 0 );
+	return heap_[0];
+}
+
+double IndexedPriorityQueue::topTime() const
+{
+	assert( heap_.size() > 0 );
+	return time_[ heap_[0] ];
+}
+
+double IndexedPriorityQueue::time( unsigned int i ) const
+{
+	assert( i < time_.size() );
+	return time_[i];
+}
+
+void IndexedPriorityQueue::update( unsigned int i, double t )
+{
+	assert( i < time_.size() );
+	double old = time_[i];
+	time_[i] = t;
+	if ( t < old )
+		siftUp( pos_[i] );
+	else if ( t > old )
+		siftDown( pos_[i] );
+}
+
+void IndexedPriorityQueue::siftUp( unsigned int k )
+{
+	while ( k > 0 ) {
+		unsigned int parent = ( k - 1 ) / 2;
+		if ( !( time_[ heap_[k] ] < time_[ heap_[parent] ] ) )
+			break;
+		swapNodes( k, parent );
+		k = parent;
+	}
+}
+
+void IndexedPriorityQueue::siftDown( unsigned int k )
+{
+	unsigned int n = heap_.size();
+	while ( true ) {
+		unsigned int smallest = k;
+		unsigned int left = 2 * k + 1;
+		unsigned int right = left + 1;
+		if ( left < n && time_[ heap_[left] ] < time_[ heap_[smallest] ] )
+			smallest = left;
+		if ( right < n && time_[ heap_[right] ] < time_[ heap_[smallest] ] )
+			smallest = right;
+		if ( smallest == k )
+			break;
+		swapNodes( k, smallest );
+		k = smallest;
+	}
+}
+
+void IndexedPriorityQueue::swapNodes( unsigned int j, unsigned int k )
+{
+	unsigned int temp = heap_[j];
+	heap_[j] = heap_[k];
+	heap_[k] = temp;
+	pos_[ heap_[j] ] = j;
+	pos_[ heap_[k] ] = k;
+}
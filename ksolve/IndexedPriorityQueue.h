@@ -0,0 +1,69 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2015 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#ifndef _INDEXED_PRIORITY_QUEUE_H
+#define _INDEXED_PRIORITY_QUEUE_H
+
+/**
+ * Indexed priority queue of reaction firing times, as used in the
+ * next-reaction method of Gibson and Bruck (J Phys Chem A 104:1876, 2000).
+ * 
+ * This is a binary min-heap of reaction indices keyed on their putative
+ * firing times, together with the position of each reaction in the heap.
+ * The earliest reaction is found in constant time, and the time of any
+ * reaction can be changed in O(log R) time. Reactions that cannot fire
+ * have an infinite time, and sink to the bottom of the heap.
+ */
+class IndexedPriorityQueue
+{
+	public: 
+		IndexedPriorityQueue();
+
+		/// Builds the queue from the firing times of all reactions.
+		void build( const vector< double >& times );
+
+		/// Empties the queue.
+		void clear();
+
+		/// Number of reactions in the queue.
+		unsigned int size() const;
+
+		/// Index of the reaction with the earliest firing time.
+		unsigned int top() const;
+
+		/// Earliest firing time.
+		double topTime() const;
+
+		/// Firing time of reaction i.
+		double time( unsigned int i ) const;
+
+		/// Assigns a new firing time to reaction i, and reorders the heap.
+		void update( unsigned int i, double t );
+
+	private:
+		/// Moves the entry at heap position k up until in order.
+		void siftUp( unsigned int k );
+
+		/// Moves the entry at heap position k down until in order.
+		void siftDown( unsigned int k );
+
+		/// Exchanges the entries at heap positions j and k.
+		void swapNodes( unsigned int j, unsigned int k );
+
+		/// Firing time of each reaction, indexed by reaction.
+		vector< double > time_;
+
+		/// Heap of reaction indices, heap_[0] is the earliest.
+		vector< unsigned int > heap_;
+
+		/// Position of each reaction in heap_, indexed by reaction.
+		vector< unsigned int > pos_;
+};
+
+#endif	// _INDEXED_PRIORITY_QUEUE_H
@@ -104,10 +104,10 @@ void KinSparseMatrix::getGillespieDependence(
  * This too operates on the transposed matrix, because we need to get all
  * the molecules for a given reac: a column in the original N matrix.
  */
-void KinSparseMatrix::fireReac( unsigned int reacIndex, vector< double >& S ) 
+void KinSparseMatrix::fireReac( unsigned int reacIndex, double* S ) 
 	const
 {
-	assert( ncolumns_ == S.size() && reacIndex < nrows_ );
+	assert( reacIndex < nrows_ );
 	unsigned int rowBeginIndex = rowStart_[ reacIndex ];
 	// vector< int >::const_iterator rowEnd = N_.begin() + rowStart_[ reacIndex + 1];
 	vector< int >::const_iterator rowBegin = 
@@ -123,6 +123,22 @@ void KinSparseMatrix::fireReac( unsigned int reacIndex, vector< double >& S )
 	}
 }
 
+void KinSparseMatrix::fireReac( unsigned int reacIndex, double* S,
+	double n ) const
+{
+	assert( reacIndex < nrows_ );
+	unsigned int rowBeginIndex = rowStart_[ reacIndex ];
+	vector< int >::const_iterator rowBegin = 
+		N_.begin() + rowBeginIndex;
+	vector< int >::const_iterator rowEnd = 
+		N_.begin() + rowTruncated_[ reacIndex ];
+	vector< unsigned int >::const_iterator molIndex = 
+		colIndex_.begin() + rowBeginIndex;
+
+	for ( vector< int >::const_iterator i = rowBegin; i != rowEnd; ++i )
+		S[ *molIndex++ ] += n * *i;
+}
+
 /**
  * This function generates a new internal list of rowEnds, such that
  * they are all less than the maxColumnIndex.
@@ -49,7 +49,15 @@ class KinSparseMatrix: public SparseMatrix< int >
          * Fires a stochastic reaction: It undergoes a single transition
          * This operation updates the mol concs due to the reacn.
          */
-        void fireReac( unsigned int reacIndex, vector< double >& S ) const;
+        void fireReac( unsigned int reacIndex, double* S ) const;
+
+	    /** 
+         * Fires a stochastic reaction n times, as done in a tau-leap.
+         * Unlike the single transition, this may drive mol #s negative,
+         * so the caller must check and reject the leap if it does.
+         */
+        void fireReac( unsigned int reacIndex, double* S,
+						double n ) const;
     
         /** 
         * This function generates a new internal list of rowEnds, such
@@ -15,7 +15,10 @@
 
 #include "OdeSystem.h"
 #include "VoxelPoolsBase.h"
+#include "RateKernel.h"
 #include "VoxelPools.h"
+#include "BatchedVoxelPools.h"
+#include "../basecode/WorkerPool.h"
 #include "../mesh/VoxelJunction.h"
 #include "XferInfo.h"
 #include "ZombiePoolInterface.h"
@@ -30,6 +33,7 @@
 #include "../mesh/MeshEntry.h"
 #include "../mesh/Boundary.h"
 #include "../mesh/ChemCompt.h"
+#include "../scheduling/Clock.h"
 #include "Ksolve.h"
 
 const unsigned int OFFNODE = ~0;
@@ -58,13 +62,26 @@ const Cinfo* Ksolve::initCinfo()
 		
 		static ValueFinfo< Ksolve, string > method (
 			"method",
-			"Integration method, using GSL. So far only explict. Options are:"
+			"Integration method, using GSL. Options are:"
 			"rk5: The default Runge-Kutta-Fehlberg 5th order adaptive dt method"
 			"gsl: alias for the above"
 			"rk4: The Runge-Kutta 4th order fixed dt method"
 			"rk2: The Runge-Kutta 2,3 embedded fixed dt method"
 			"rkck: The Runge-Kutta Cash-Karp (4,5) method"
-			"rk8: The Runge-Kutta Prince-Dormand (8,9) method" ,
+			"rk8: The Runge-Kutta Prince-Dormand (8,9) method"
+			"bdf: Implicit variable-order BDF method for stiff systems. "
+			"Uses the analytic Jacobian from the stoichiometry matrix."
+			"batched: Runge-Kutta-Fehlberg method applied to all voxels "
+			"together, with a single shared adaptive dt. Faster when "
+			"there are many voxels with similar dynamics. "
+			"The following are built in and do not need GSL: "
+			"ee: Exponential Euler, with a fixed step of the clock dt. "
+			"Fast, but only first order accurate. "
+			"rk4fixed: The Runge-Kutta 4th order method, with a fixed "
+			"step of the clock dt. "
+			"rkf45: The Runge-Kutta-Fehlberg (4,5) method with "
+			"adaptive dt. Without GSL, this is used in place of rk5, "
+			"rk2, rkck, rk8 and bdf, and rk4fixed in place of rk4." ,
 			&Ksolve::setMethod,
 			&Ksolve::getMethod
 		);
@@ -83,6 +100,119 @@ const Cinfo* Ksolve::initCinfo()
 			&Ksolve::getEpsRel
 		);
 		
+		static ValueFinfo< Ksolve, unsigned int > numThreads (
+			"numThreads",
+			"Number of threads used to advance the voxels of this Ksolve "
+			"on each timestep. The voxels are split into contiguous "
+			"chunks, one per thread. Results are identical to the "
+			"single-threaded calculation. Default is 1.",
+			&Ksolve::setNumThreads,
+			&Ksolve::getNumThreads
+		);
+		
+		static ValueFinfo< Ksolve, unsigned int > maxSkipTicks (
+			"maxSkipTicks",
+			"Maximum number of clock ticks in a row that the Ksolve may "
+			"skip. A tick is skipped when the step size chosen by the "
+			"integrator is longer than the time since the last advance, "
+			"and the next advance then covers all the skipped ticks. "
+			"The pool n are held between advances, but the last tick of "
+			"a run is never skipped. This saves much time "
+			"when the chemistry is quiet. Not done when there is a "
+			"Dsolve or cross-compartment reactions, since those need "
+			"every tick. Default 0, which never skips.",
+			&Ksolve::setMaxSkipTicks,
+			&Ksolve::getMaxSkipTicks
+		);
+
+		static ReadOnlyValueFinfo< Ksolve, unsigned int > numSkippedTicks (
+			"numSkippedTicks",
+			"Number of clock ticks skipped since reinit. See maxSkipTicks.",
+			&Ksolve::getNumSkippedTicks
+		);
+
+		static ReadOnlyValueFinfo< Ksolve, vector< double > > stepSize (
+			"stepSize",
+			"Step size that the integrator of each voxel will try next, "
+			"as chosen by its error control.",
+			&Ksolve::getStepSize
+		);
+
+		static ReadOnlyValueFinfo< Ksolve, vector< unsigned int > > 
+				numSteps (
+			"numSteps",
+			"Number of integration steps taken by each voxel since "
+			"reinit, not counting rejected steps.",
+			&Ksolve::getNumSteps
+		);
+
+		static ReadOnlyValueFinfo< Ksolve, vector< unsigned int > > 
+				numFailedSteps (
+			"numFailedSteps",
+			"Number of integration steps of each voxel that were "
+			"rejected by the error control since reinit.",
+			&Ksolve::getNumFailedSteps
+		);
+
+		static ValueFinfo< Ksolve, vector< double > > ensembleParams (
+			"ensembleParams",
+			"Parameter matrix for running many variants of the model at "
+			"once. Each row is one instance, and holds R1 and R2 of "
+			"each rate term of the Stoich in turn, in the same units as "
+			"the Stoich. For a Reac these are Kf and Kb, for an MMenz "
+			"Km and kcat. Assigning it turns the voxels of the Ksolve "
+			"into as many independent copies of the first voxel as "
+			"there are rows. Must be done after the stoich path is set, "
+			"and cannot be used with a Dsolve or cross-compartment "
+			"reactions. The instances are advanced in parallel by the "
+			"numThreads or the batched method.",
+			&Ksolve::setEnsembleParams,
+			&Ksolve::getEnsembleParams
+		);
+
+		static ReadOnlyValueFinfo< Ksolve, vector< double > > ensembleN (
+			"ensembleN",
+			"n of all the pools in all the voxels or instances, as "
+			"one block laid out as [instance][pool].",
+			&Ksolve::getEnsembleN
+		);
+
+		static ValueFinfo< Ksolve, vector< unsigned int > > 
+				sensitivityParams (
+			"sensitivityParams",
+			"Rate parameters for which to compute forward sensitivities "
+			"dn/dp of all the pools, numbered as the columns of "
+			"ensembleParams: 2 * i for R1 and 2 * i + 1 for R2 of rate "
+			"term i of the Stoich. The sensitivities are integrated "
+			"along with the state, so one run gives them all. They "
+			"take one trapezoidal step, with a dense linear solve, per "
+			"step of the integrator, up to 100 a tick, so are meant "
+			"for models of modest size. Applied on reinit. "
+			"Not done by the batched method. Empty turns them off.",
+			&Ksolve::setSensitivityParams,
+			&Ksolve::getSensitivityParams
+		);
+
+		static ReadOnlyLookupValueFinfo< 
+				Ksolve, unsigned int, vector< double > > sensitivity (
+			"sensitivity",
+			"dn/dp for the sensitivityParams entry given by the index. "
+			"Holds the latest sample, or with a sensitivityInterval "
+			"the time series of samples since reinit. Laid out as "
+			"[sample][voxel][pool]. p is in the units of the Stoich "
+			"rates.",
+			&Ksolve::getSensitivity
+		);
+
+		static ValueFinfo< Ksolve, unsigned int > sensitivityInterval (
+			"sensitivityInterval",
+			"Number of ticks between the samples of sensitivity that are "
+			"kept. Default 0, which keeps only the latest sample, so "
+			"that long runs do not fill up memory.",
+			&Ksolve::setSensitivityInterval,
+			&Ksolve::getSensitivityInterval
+		);
+
 		static ValueFinfo< Ksolve, Id > compartment(
 			"compartment",
 			"Compartment in which the Ksolve reaction system lives.",
@@ -196,6 +326,17 @@ const Cinfo* Ksolve::initCinfo()
 		&method,			// Value
 		&epsAbs,			// Value
 		&epsRel,			// Value
+		&numThreads,		// Value
+		&maxSkipTicks,		// Value
+		&ensembleParams,	// Value
+		&ensembleN,			// ReadOnlyValue
+		&sensitivityParams,	// Value
+		&sensitivity,		// ReadOnlyLookupValue
+		&sensitivityInterval,	// Value
+		&numSkippedTicks,	// ReadOnlyValue
+		&stepSize,			// ReadOnlyValue
+		&numSteps,			// ReadOnlyValue
+		&numFailedSteps,	// ReadOnlyValue
 		&compartment,		// Value
 		&numLocalVoxels,	// ReadOnlyValue
 		&nVec,				// LookupValue
@@ -232,6 +373,12 @@ Ksolve::Ksolve()
 		method_( "rk5" ),
 		epsAbs_( 1e-4 ),
 		epsRel_( 1e-6 ),
+		numThreads_( 1 ),
+		maxSkipTicks_( 0 ),
+		numSkippedTicks_( 0 ),
+		ticksSkipped_( 0 ),
+		sensInterval_( 0 ),
+		sensTicks_( 0 ),
 		pools_( 1 ),
 		startVoxel_( 0 ),
 		dsolve_(),
@@ -255,13 +402,28 @@ void Ksolve::setMethod( string method )
 	if ( method == "rk5" || method == "gsl" ) {
 		method_ = "rk5";
 	} else if ( method == "rk4"  || method == "rk2" || 
-					method == "rk8" || method == "rkck" ) {
+					method == "rk8" || method == "rkck" ||
+					method == "bdf" || method == "batched" ||
+					VoxelPools::isBuiltinMethod( method ) ) {
 		method_ = method;
 	} else {
 		cout << "Warning: Ksolve::setMethod: '" << method << 
 				"' not known, using rk5\n";
 		method_ = "rk5";
 	}
+	// The voxels have to be set up again for the new method. That resets
+	// S to Sinit, so carry the current state across the rebuild.
+	if ( isBuilt_ && stoichPtr_ ) {
+		vector< vector< double > > saved( pools_.size() );
+		for ( unsigned int i = 0; i < pools_.size(); ++i )
+			saved[i].assign( pools_[i].S(), 
+							pools_[i].S() + pools_[i].size() );
+		isBuilt_ = false;
+		setStoich( stoich_ );
+		for ( unsigned int i = 0; i < pools_.size(); ++i )
+			copy( saved[i].begin(), saved[i].end(), pools_[i].varS() );
+	}
+	buildBatch();
 }
 
 double Ksolve::getEpsAbs() const
@@ -293,11 +455,203 @@ void Ksolve::setEpsRel( double epsRel )
 	}
 }
 
+unsigned int Ksolve::getNumThreads() const
+{
+	return numThreads_;
+}
+
+void Ksolve::setNumThreads( unsigned int num )
+{
+	if ( num == 0 )
+		numThreads_ = 1;
+	else
+		numThreads_ = num;
+	if ( numThreads_ == 1 )
+		workers_.stop();
+}
+
+unsigned int Ksolve::getMaxSkipTicks() const
+{
+	return maxSkipTicks_;
+}
+
+void Ksolve::setMaxSkipTicks( unsigned int num )
+{
+	maxSkipTicks_ = num;
+}
+
+unsigned int Ksolve::getNumSkippedTicks() const
+{
+	return numSkippedTicks_;
+}
+
+vector< double > Ksolve::getStepSize() const
+{
+	vector< double > ret( pools_.size() );
+	for ( unsigned int i = 0; i < pools_.size(); ++i )
+		ret[i] = ( method_ == "batched" ) ? 
+				batch_.getStepSize() : pools_[i].getStepSize();
+	return ret;
+}
+
+vector< unsigned int > Ksolve::getNumSteps() const
+{
+	vector< unsigned int > ret( pools_.size() );
+	for ( unsigned int i = 0; i < pools_.size(); ++i )
+		ret[i] = ( method_ == "batched" ) ? 
+				batch_.getNumSteps() : pools_[i].getNumSteps();
+	return ret;
+}
+
+vector< unsigned int > Ksolve::getNumFailedSteps() const
+{
+	vector< unsigned int > ret( pools_.size() );
+	for ( unsigned int i = 0; i < pools_.size(); ++i )
+		ret[i] = ( method_ == "batched" ) ? 
+				batch_.getNumFailedSteps() : pools_[i].getNumFailedSteps();
+	return ret;
+}
+
+void Ksolve::setEnsembleParams( vector< double > params )
+{
+	if ( !isBuilt_ || !stoichPtr_ ) {
+		cout << "Warning: Ksolve::setEnsembleParams: the stoich path "
+				"must be set first\n";
+		return;
+	}
+	if ( dsolvePtr_ || !xfer_.empty() ) {
+		cout << "Warning: Ksolve::setEnsembleParams: not possible with "
+				"diffusion or cross-compartment reactions\n";
+		return;
+	}
+	unsigned int numParams = 2 * stoichPtr_->getNumRates();
+	if ( numParams == 0 || params.size() == 0 || 
+					params.size() % numParams != 0 ) {
+		cout << "Warning: Ksolve::setEnsembleParams: size " << 
+			params.size() << " is not a multiple of " << numParams << endl;
+		return;
+	}
+	unsigned int num = params.size() / numParams;
+	if ( num != pools_.size() )
+		setEnsembleSize( num );
+	for ( unsigned int i = 0; i < num; ++i ) {
+		vector< double > p( params.begin() + i * numParams, 
+						params.begin() + ( i + 1 ) * numParams );
+		pools_[i].setRateParams( stoichPtr_->getRateTerms(),
+						stoichPtr_->getNumCoreRates(), p );
+	}
+	buildBatch();
+}
+
+vector< double > Ksolve::getEnsembleParams() const
+{
+	vector< double > ret;
+	if ( !stoichPtr_ )
+		return ret;
+	for ( unsigned int i = 0; i < pools_.size(); ++i ) {
+		vector< double > p = 
+			pools_[i].getRateParams( stoichPtr_->getRateTerms() );
+		ret.insert( ret.end(), p.begin(), p.end() );
+	}
+	return ret;
+}
+
+/**
+ * Replaces the voxels with num copies of the first one. VoxelPools own
+ * their rate terms and integrator, so they are made afresh rather than
+ * copied.
+ */
+void Ksolve::setEnsembleSize( unsigned int num )
+{
+	unshareState();
+	double vol = pools_[0].getVolume();
+	vector< double > sinit( pools_[0].Sinit(), 
+					pools_[0].Sinit() + pools_[0].size() );
+	vector< double > s( pools_[0].S(), pools_[0].S() + pools_[0].size() );
+	pools_.clear();
+	pools_.resize( num );
+	for ( unsigned int i = 0; i < num; ++i ) {
+		pools_[i].resizeArrays( sinit.size() );
+		pools_[i].setVolume( vol );
+		pools_[i].resetXreacScale( 
+			stoichPtr_->getNumRates() - stoichPtr_->getNumCoreRates() );
+	}
+	isBuilt_ = false;
+	setStoich( stoich_ ); // Sets up the integrators again.
+	for ( unsigned int i = 0; i < num; ++i ) {
+		copy( sinit.begin(), sinit.end(), pools_[i].varSinit() );
+		copy( s.begin(), s.end(), pools_[i].varS() );
+		pools_[i].updateAllRateTerms( stoichPtr_->getRateTerms(),
+						   stoichPtr_->getNumCoreRates() );
+	}
+	buildBatch();
+}
+
+vector< double > Ksolve::getEnsembleN() const
+{
+	vector< double > ret;
+	for ( unsigned int i = 0; i < pools_.size(); ++i )
+		ret.insert( ret.end(), pools_[i].S(), 
+						pools_[i].S() + pools_[i].size() );
+	return ret;
+}
+
+void Ksolve::setSensitivityParams( vector< unsigned int > params )
+{
+	if ( stoichPtr_ ) {
+		unsigned int numParams = 2 * stoichPtr_->getNumRates();
+		for ( unsigned int i = 0; i < params.size(); ++i ) {
+			if ( params[i] >= numParams ) {
+				cout << "Warning: Ksolve::setSensitivityParams: " <<
+					params[i] << " is out of range 0 to " << 
+					numParams << endl;
+				return;
+			}
+		}
+	}
+	sensParams_ = params;
+}
+
+vector< unsigned int > Ksolve::getSensitivityParams() const
+{
+	return sensParams_;
+}
+
+unsigned int Ksolve::getSensitivityInterval() const
+{
+	return sensInterval_;
+}
+
+void Ksolve::setSensitivityInterval( unsigned int ticks )
+{
+	sensInterval_ = ticks;
+}
+
+vector< double > Ksolve::getSensitivity( unsigned int i ) const
+{
+	if ( i < sensHistory_.size() )
+		return sensHistory_[i];
+	return vector< double >();
+}
+
 Id Ksolve::getStoich() const
 {
 	return stoich_;
 }
 
+#ifndef USE_GSL
+/// Without GSL, each method is done by the nearest built-in one.
+void innerSetMethod( OdeSystem& ode, const string& method )
+{
+	if ( VoxelPools::isBuiltinMethod( method ) )
+		ode.method = method;
+	else if ( method == "rk4" )
+		ode.method = "rk4fixed";
+	else
+		ode.method = "rkf45";
+}
+#endif
+
 #ifdef USE_GSL
 void innerSetMethod( OdeSystem& ode, const string& method )
 {
@@ -312,12 +666,28 @@ void innerSetMethod( OdeSystem& ode, const string& method )
 		ode.gslStep = gsl_odeiv2_step_rkck;
 	} else if ( method == "rk8" ) {
 		ode.gslStep = gsl_odeiv2_step_rk8pd;
+	} else if ( method == "bdf" ) {
+		ode.gslStep = gsl_odeiv2_step_msbdf;
 	} else {
 		ode.gslStep = gsl_odeiv2_step_rkf45;
 	}
 }
 #endif
 
+void Ksolve::buildBatch()
+{
+	if ( method_ != "batched" || !stoichPtr_ )
+		return;
+	for ( unsigned int i = 0; i < pools_.size(); ++i ) {
+		if ( pools_[i].getRateTerms().size() != stoichPtr_->getNumRates() ) {
+			batch_.build( vector< VoxelPools >(), stoichPtr_, 
+							epsAbs_, epsRel_ );
+			return;
+		}
+	}
+	batch_.build( pools_, stoichPtr_, epsAbs_, epsRel_ );
+}
+
 void Ksolve::setStoich( Id stoich )
 {
 	assert( stoich.element()->cinfo()->isA( "Stoich" ) );
@@ -329,22 +699,25 @@ void Ksolve::setStoich( Id stoich )
 		ode.epsRel = epsRel_;
 		// ode.initStepSize = getEstimatedDt();
 		ode.initStepSize = 0.01; // This will be overridden at reinit.
-#ifdef USE_GSL
-		ode.gslSys.dimension = stoichPtr_->getNumAllPools() + stoichPtr_->getNumProxyPools();
-		if ( ode.gslSys.dimension == 0 )
+		unsigned int dimension = stoichPtr_->getNumAllPools() + 
+				stoichPtr_->getNumProxyPools();
+		if ( dimension == 0 )
 			return; // No pools, so don't bother.
 		innerSetMethod( ode, method_ );
+#ifdef USE_GSL
+		ode.gslSys.dimension = dimension;
 		ode.gslSys.function = &VoxelPools::gslFunc;
-   		ode.gslSys.jacobian = 0;
-		innerSetMethod( ode, method_ );
+   		ode.gslSys.jacobian = &VoxelPools::gslJacobian;
+#endif
 		unsigned int numVoxels = pools_.size();
 		for ( unsigned int i = 0 ; i < numVoxels; ++i ) {
+#ifdef USE_GSL
    			ode.gslSys.params = &pools_[i];
+#endif
 			pools_[i].setStoich( stoichPtr_, &ode );
 			// pools_[i].setIntDt( ode.initStepSize ); // We're setting it up anyway
 		}
 		isBuilt_ = true;
-#endif
 	}
 }
 
@@ -355,6 +728,9 @@ Id Ksolve::getDsolve() const
 
 void Ksolve::setDsolve( Id dsolve )
 {
+	// The old Dsolve, if still around, must go back to its own copy.
+	if ( dsolvePtr_ && dsolve_.element() )
+		dsolvePtr_->setSharedState( Id() );
 	if ( dsolve == Id () ) {
 		dsolvePtr_ = 0;
 		dsolve_ = Id();
@@ -385,14 +761,17 @@ void Ksolve::setNumAllVoxels( unsigned int numVoxels )
 	if ( numVoxels == 0 ) {
 		return;
 	}
+	unshareState();
 	pools_.resize( numVoxels );
+	buildBatch();
 }
 
 vector< double > Ksolve::getNvec( unsigned int voxel) const
 {
 	static vector< double > dummy;
 	if ( voxel < pools_.size() ) {
-		return const_cast< VoxelPools* >( &( pools_[ voxel ] ) )->Svec();
+		const double* s = pools_[ voxel ].S();
+		return vector< double >( s, s + pools_[ voxel ].size() );
 	}
 	return dummy;
 }
@@ -435,33 +814,63 @@ double Ksolve::getEstimatedDt() const
 //////////////////////////////////////////////////////////////
 // Process operations.
 //////////////////////////////////////////////////////////////
+
+/// Advances the voxels in the range [begin, end). Used by each thread.
+static void advancePools( vector< VoxelPools >* pools, 
+				unsigned int begin, unsigned int end, ProcPtr p )
+{
+	for ( unsigned int i = begin; i < end; ++i )
+		(*pools)[i].advance( p );
+}
+
+/**
+ * A tick can be skipped if the shortest step that any voxel will try
+ * is longer than the time to the end of this tick since the last
+ * advance, and it is not the last tick of the run. Other solvers that
+ * read or change our pools every tick rule this out.
+ */
+bool Ksolve::skipTick( ProcPtr p )
+{
+	if ( ticksSkipped_ >= maxSkipTicks_ || !xfer_.empty() || dsolvePtr_ ||
+					!sensHistory_.empty() )
+		return false;
+	double h = 0.0;
+	if ( method_ == "batched" ) {
+		h = batch_.getStepSize();
+	} else if ( pools_.size() > 0 ) {
+		h = pools_[0].getStepSize();
+		for ( unsigned int i = 1; i < pools_.size(); ++i )
+			if ( h > pools_[i].getStepSize() )
+				h = pools_[i].getStepSize();
+	}
+	if ( ( ticksSkipped_ + 1 ) * p->dt >= h )
+		return false;
+	// The last tick of a run catches up, so the pools are current when
+	// the run ends.
+	static Id clockId( 1 );
+	const Clock* clock = 
+		reinterpret_cast< const Clock* >( clockId.eref().data() );
+	if ( p->currTime + 0.5 * p->dt >= clock->getRunTime() )
+		return false;
+	++ticksSkipped_;
+	++numSkippedTicks_;
+	return true;
+}
+
 void Ksolve::process( const Eref& e, ProcPtr p )
 {
 	if ( isBuilt_ == false )
 		return;
-	// First, handle incoming diffusion values, update S with those.
-	if ( dsolvePtr_ ) {
-		vector< double > dvalues( 4 );
-		dvalues[0] = 0;
-		dvalues[1] = getNumLocalVoxels();
-		dvalues[2] = 0;
-		dvalues[3] = stoichPtr_->getNumVarPools();
-		dsolvePtr_->getBlock( dvalues );
-		
-		/*
-		vector< double >::iterator i = dvalues.begin() + 4;
-		for ( ; i != dvalues.end(); ++i )
-			cout << *i << "	" << round( *i ) << endl;
-		getBlock( kvalues );
-		vector< double >::iterator d = dvalues.begin() + 4;
-		for ( vector< double >::iterator 
-				k = kvalues.begin() + 4; k != kvalues.end(); ++k )
-				*k++ = ( *k + *d )/2.0
-		setBlock( kvalues );
-		*/
-		setBlock( dvalues );
-	}
-	// Second, take the arrived xCompt reac values and update S with them.
+	if ( skipTick( p ) )
+		return;
+	// This advance covers any ticks skipped before it.
+	ProcInfo span = *p;
+	span.dt = ( ticksSkipped_ + 1 ) * p->dt;
+	ticksSkipped_ = 0;
+	p = &span;
+	// Diffusion needs no transfer here: a Dsolve shares our state store
+	// and works on it in place. See stateBlock.
+	// First, take the arrived xCompt reac values and update S with them.
 	for ( unsigned int i = 0; i < xfer_.size(); ++i ) {
 		const XferInfo& xf = xfer_[i];
 		// cout << xfer_.size() << "	" << xf.xferVoxel.size() << endl;
@@ -470,7 +879,7 @@ void Ksolve::process( const Eref& e, ProcPtr p )
 					xf.xferPoolIdx, xf.values, xf.lastValues, j );
 		}
 	}
-	// Third, record the current value of pools as the reference for the
+	// Second, record the current value of pools as the reference for the
 	// next cycle.
 	for ( unsigned int i = 0; i < xfer_.size(); ++i ) {
 		XferInfo& xf = xfer_[i];
@@ -479,33 +888,71 @@ void Ksolve::process( const Eref& e, ProcPtr p )
 		}
 	}
 
-	// Fourth, do the numerical integration for all reactions.
-	for ( vector< VoxelPools >::iterator 
-				i = pools_.begin(); i != pools_.end(); ++i ) {
-		i->advance( p );
+	// Third, do the numerical integration for all reactions.
+	unsigned int numVoxels = pools_.size();
+	unsigned int numThreads = numThreads_;
+	if ( numThreads > numVoxels )
+		numThreads = numVoxels;
+	if ( method_ == "batched" ) {
+		if ( batch_.numVoxels() != numVoxels )
+			buildBatch();
+		batch_.advance( pools_, p->currTime - p->dt, p->currTime );
+	} else if ( numThreads <= 1 ) {
+		advancePools( &pools_, 0, numVoxels, p );
+	} else {
+		// Split voxels into contiguous chunks, one per thread. The
+		// calling thread handles the last chunk.
+		unsigned int chunk = ( numVoxels + numThreads - 1 ) / numThreads;
+		unsigned int numChunks = ( numVoxels + chunk - 1 ) / chunk;
+		vector< VoxelPools >* pools = &pools_;
+		workers_.run( numChunks, [=]( unsigned int i ) {
+			unsigned int end = ( i + 1 ) * chunk;
+			advancePools( pools, i * chunk, 
+							end < numVoxels ? end : numVoxels, p );
+		} );
 	}
-	// Finally, assemble and send the integrated values off for the Dsolve.
-	if ( dsolvePtr_ ) {
-		vector< double > kvalues( 4 );
-		kvalues[0] = 0;
-		kvalues[1] = getNumLocalVoxels();
-		kvalues[2] = 0;
-		kvalues[3] = stoichPtr_->getNumVarPools();
-		getBlock( kvalues );
-		dsolvePtr_->setBlock( kvalues );
+
+	// Last, record the sensitivities.
+	++sensTicks_;
+	if ( sensInterval_ > 0 && sensTicks_ % sensInterval_ != 0 )
+		return;
+	for ( unsigned int j = 0; j < sensHistory_.size(); ++j ) {
+		if ( sensInterval_ == 0 )
+			sensHistory_[j].clear();
+		for ( unsigned int i = 0; i < numVoxels; ++i ) {
+			const vector< double >& s = pools_[i].getSensitivity();
+			unsigned int dim = s.size() / sensHistory_.size();
+			sensHistory_[j].insert( sensHistory_[j].end(), 
+				s.begin() + j * dim, s.begin() + ( j + 1 ) * dim );
+		}
 	}
 }
 
 void Ksolve::reinit( const Eref& e, ProcPtr p )
 {
 	assert( stoichPtr_ );
+	numSkippedTicks_ = 0;
+	ticksSkipped_ = 0;
+	sensTicks_ = 0;
+	sensHistory_.clear();
+	if ( method_ != "batched" )
+		sensHistory_.resize( sensParams_.size() );
 	if ( isBuilt_ ) {
-		for ( unsigned int i = 0 ; i < pools_.size(); ++i )
+		for ( unsigned int i = 0 ; i < pools_.size(); ++i ) {
+			pools_[i].setSensitivityParams( 
+				method_ == "batched" ? vector< unsigned int >() : sensParams_ );
 			pools_[i].reinit( p->dt );
+		}
+		if ( method_ == "batched" ) {
+			buildBatch();
+			batch_.reinit( p->dt );
+		}
 	} else {
 		cout << "Warning:Ksolve::reinit: Reaction system not initialized\n";
 		return;
 	}
+	if ( dsolvePtr_ )
+		dsolvePtr_->setSharedState( e.id() );
 	for ( unsigned int i = 0; i < xfer_.size(); ++i ) {
 		const XferInfo& xf = xfer_[i];
 		for ( unsigned int j = 0; j < xf.xferVoxel.size(); ++j ) {
@@ -582,6 +1029,7 @@ void Ksolve::updateRateTerms( unsigned int index )
 			pools_[i].updateRateTerms( stoichPtr_->getRateTerms(),
 							stoichPtr_->getNumCoreRates(), index );
 	}
+	buildBatch();
 }
 
 
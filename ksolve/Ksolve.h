@@ -33,6 +33,60 @@ class Ksolve: public ZombiePoolInterface
 		double getEpsRel() const;
 		void setEpsRel( double val );
 
+		/**
+		 * Assigns number of threads used to advance the voxels. The
+		 * voxels are split into contiguous chunks, one per thread. 
+		 * Results are identical to the single-threaded case since each
+		 * voxel is integrated independently.
+		 */
+		unsigned int getNumThreads() const;
+		void setNumThreads( unsigned int num );
+
+		/**
+		 * Maximum number of clock ticks in a row that may be skipped 
+		 * while the integrator's own step is longer than the ticks.
+		 * 0 means every tick is done.
+		 */
+		unsigned int getMaxSkipTicks() const;
+		void setMaxSkipTicks( unsigned int num );
+		unsigned int getNumSkippedTicks() const;
+
+		/// Per-voxel statistics of the integrator steps.
+		vector< double > getStepSize() const;
+		vector< unsigned int > getNumSteps() const;
+		vector< unsigned int > getNumFailedSteps() const;
+
+		/**
+		 * Parameter matrix of an ensemble of model instances, one row
+		 * of rate term R1 and R2 per voxel. Assigning it turns the 
+		 * voxels into independent copies of the first one.
+		 */
+		void setEnsembleParams( vector< double > params );
+		vector< double > getEnsembleParams() const;
+
+		/// n of all pools of all voxels, as [voxel][pool].
+		vector< double > getEnsembleN() const;
+
+		/**
+		 * Rate parameters for forward sensitivities, numbered as the 
+		 * columns of ensembleParams. 
+		 */
+		void setSensitivityParams( vector< unsigned int > params );
+		vector< unsigned int > getSensitivityParams() const;
+
+		/**
+		 * Ticks between kept samples of the sensitivities. 0 keeps
+		 * only the latest.
+		 */
+		void setSensitivityInterval( unsigned int ticks );
+		unsigned int getSensitivityInterval() const;
+
+		/**
+		 * Samples of dn/dp for the i-th sensitivity parameter, as
+		 * [sample][voxel][pool].
+		 */
+		vector< double > getSensitivity( unsigned int i ) const;
+
 		/// Assigns Stoich object to Ksolve.
 		Id getStoich() const;
 		void setStoich( Id stoich ); /// Inherited from ZombiePoolInterface.
@@ -141,9 +195,49 @@ class Ksolve: public ZombiePoolInterface
 		static SrcFinfo2< Id, vector< double > >* xComptOut();
 		static const Cinfo* initCinfo();
 	private:
+		/// Replaces the voxels with num copies of the first one.
+		void setEnsembleSize( unsigned int num );
+
+		/// Returns true if this tick can be left to the next advance.
+		bool skipTick( ProcPtr p );
+
+		/**
+		 * Rebuilds batch_ from pools_ if the method is 'batched'.
+		 * Empties it if the voxels do not all have their rate terms yet.
+		 */
+		void buildBatch();
+
 		string method_;
 		double epsAbs_;
 		double epsRel_;
+
+		/// Number of threads to use in process. 1 means serial.
+		unsigned int numThreads_;
+
+		/// Threads that advance the voxels, kept between ticks.
+		WorkerPool workers_;
+
+		/// Most ticks in a row that process may skip.
+		unsigned int maxSkipTicks_;
+
+		/// Ticks skipped since reinit.
+		unsigned int numSkippedTicks_;
+
+		/// Ticks skipped since the last advance.
+		unsigned int ticksSkipped_;
+
+		/// Rate parameters for forward sensitivities.
+		vector< unsigned int > sensParams_;
+
+		/// Ticks between kept samples of the sensitivities.
+		unsigned int sensInterval_;
+
+		/// Ticks since reinit, for sensInterval_.
+		unsigned int sensTicks_;
+
+		/// Samples of the sensitivities to each of sensParams_.
+		vector< vector< double > > sensHistory_;
+
 		/**
 		 * Each VoxelPools entry handles all the pools in a single voxel.
 		 * Each entry knows how to update itself in order to complete 
@@ -153,6 +247,12 @@ class Ksolve: public ZombiePoolInterface
 		 */
 		vector< VoxelPools > pools_;
 
+		/**
+		 * Used by the 'batched' method to integrate all the voxels
+		 * together in lock-step.
+		 */
+		BatchedVoxelPools batch_;
+
 		/// First voxel indexed on the current node.
 		unsigned int startVoxel_;
 
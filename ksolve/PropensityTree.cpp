@@ -0,0 +1,75 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2015 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+#include <vector>
+#include <cassert>
+using namespace std;
+#include "PropensityTree.h"
+
+PropensityTree::PropensityTree()
+	: numLeaves_( 0 ), base_( 0 )
+{;}
+
+void PropensityTree::build( const vector< double >& v )
+{
+	numLeaves_ = v.size();
+	base_ = 1;
+	while ( base_ < numLeaves_ )
+		base_ *= 2;
+	node_.assign( 2 * base_, 0.0 );
+	for ( unsigned int i = 0; i < numLeaves_; ++i )
+		node_[ base_ + i ] = v[i];
+	for ( unsigned int i = base_ - 1; i > 0; --i )
+		node_[i] = node_[ 2 * i ] + node_[ 2 * i + 1 ];
+}
+
+void PropensityTree::clear()
+{
+	numLeaves_ = 0;
+	base_ = 0;
+	node_.clear();
+}
+
+unsigned int PropensityTree::size() const
+{
+	return numLeaves_;
+}
+
+void PropensityTree::update( unsigned int i, double v )
+{
+	assert( i < numLeaves_ );
+	unsigned int k = base_ + i;
+	node_[k] = v;
+	for ( k /= 2; k > 0; k /= 2 )
+		node_[k] = node_[ 2 * k ] + node_[ 2 * k + 1 ];
+}
+
+double PropensityTree::total() const
+{
+	if ( numLeaves_ == 0 )
+		return 0.0;
+	return node_[1];
+}
+
+unsigned int PropensityTree::pick( double r ) const
+{
+	if ( numLeaves_ == 0 )
+		return 0;
+	unsigned int k = 1;
+	while ( k < base_ ) {
+		k *= 2;
+		if ( r >= node_[k] ) {
+			r -= node_[k];
+			++k;
+		}
+	}
+	unsigned int i = k - base_;
+	if ( i >= numLeaves_ || node_[k] <= 0.0 )
+		return numLeaves_;
+	return i;
+}
@@ -0,0 +1,64 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2015 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#ifndef _PROPENSITY_TREE_H
+#define _PROPENSITY_TREE_H
+
+/**
+ * The PropensityTree is a complete binary sum tree over the reaction
+ * propensities of a GSSA voxel. Each leaf holds one propensity and each
+ * internal node holds the sum of its two children, so the root is the
+ * total propensity atot.
+ *
+ * Changing one propensity costs O(log R), as does picking a reaction
+ * from a uniform random number in [0, atot). The leaves are in reaction
+ * order, so for the same random number the tree picks the same reaction
+ * as a linear scan over the cumulative sum. Internal nodes are
+ * recomputed from their children rather than incremented, so the
+ * total does not drift with roundoff.
+ */
+class PropensityTree
+{
+	public: 
+		PropensityTree();
+
+		/// Builds the tree from the propensities v.
+		void build( const vector< double >& v );
+
+		/// Empties the tree.
+		void clear();
+
+		/// Number of leaves, that is, reactions.
+		unsigned int size() const;
+
+		/// Assigns the propensity of reaction i and updates its parents.
+		void update( unsigned int i, double v );
+
+		/// Total propensity, the sum of all leaves.
+		double total() const;
+
+		/**
+		 * Returns the index of the reaction in whose cumulative interval
+		 * r falls, with 0 <= r < total(). Returns size() if roundoff
+		 * brings the search to a leaf with zero propensity.
+		 */
+		unsigned int pick( double r ) const;
+
+	private:
+		/// Number of reactions.
+		unsigned int numLeaves_;
+
+		/// Power of two >= numLeaves_. Leaf i is at node_[ base_ + i ].
+		unsigned int base_;
+
+		/// Tree nodes, node_[1] is the root. node_[0] is unused.
+		vector< double > node_;
+};
+
+#endif	// _PROPENSITY_TREE_H
@@ -0,0 +1,274 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2015 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#include <typeinfo>
+#include "header.h"
+#include "RateTerm.h"
+#include "SparseMatrix.h"
+#include "KinSparseMatrix.h"
+#include "RateKernel.h"
+
+RateKernel::RateKernel()
+	: numRates_( 0 ),
+		nthStart_( 1, 0 ),
+		rowStart_( 1, 0 )
+{;}
+
+unsigned int RateKernel::numRates() const
+{
+	return numRates_;
+}
+
+/**
+ * The exact type is checked because subclasses like Flux or StochNOrder
+ * compute something else.
+ */
+bool RateKernel::isMassAction( const RateTerm* term )
+{
+	const type_info& t = typeid( *term );
+	return ( t == typeid( ZeroOrder ) || t == typeid( FirstOrder ) ||
+		t == typeid( SecondOrder ) || t == typeid( NOrder ) );
+}
+
+void RateKernel::addMassAction( const RateTerm* term, unsigned int rate,
+				double sign )
+{
+	vector< unsigned int > mol;
+	term->getReactants( mol );
+	double k = sign * term->getR1();
+	if ( mol.size() == 0 ) {
+		zeroRate_.push_back( rate );
+		zeroK_.push_back( k );
+	} else if ( mol.size() == 1 ) {
+		firstRate_.push_back( rate );
+		firstMol_.push_back( mol[0] );
+		firstK_.push_back( k );
+	} else if ( mol.size() == 2 ) {
+		secondRate_.push_back( rate );
+		secondMol1_.push_back( mol[0] );
+		secondMol2_.push_back( mol[1] );
+		secondK_.push_back( k );
+	} else {
+		nthRate_.push_back( rate );
+		nthMol_.insert( nthMol_.end(), mol.begin(), mol.end() );
+		nthStart_.push_back( nthMol_.size() );
+		nthK_.push_back( k );
+	}
+}
+
+void RateKernel::build( const vector< RateTerm* >& rates, 
+				const KinSparseMatrix& N, unsigned int numVarPools )
+{
+	*this = RateKernel();
+	numRates_ = rates.size();
+	for ( unsigned int i = 0; i < rates.size(); ++i ) {
+		const RateTerm* term = rates[i];
+		const type_info& t = typeid( *term );
+		if ( isMassAction( term ) ) {
+			addMassAction( term, i, 1.0 );
+		} else if ( t == typeid( MMEnzyme1 ) ) {
+			vector< unsigned int > mol;
+			term->getReactants( mol );
+			mmRate_.push_back( i );
+			mmEnz_.push_back( mol[0] );
+			mmSub_.push_back( mol[1] );
+			mmKm_.push_back( term->getR1() );
+			mmKcat_.push_back( term->getR2() );
+		} else if ( t == typeid( BidirectionalReaction ) &&
+			isMassAction( static_cast< const BidirectionalReaction* >( 
+							term )->getForward() ) &&
+			isMassAction( static_cast< const BidirectionalReaction* >( 
+							term )->getBackward() ) ) {
+			// The backward half is subtracted by negating its rate.
+			const BidirectionalReaction* br = 
+				static_cast< const BidirectionalReaction* >( term );
+			addMassAction( br->getForward(), i, 1.0 );
+			addMassAction( br->getBackward(), i, -1.0 );
+		} else {
+			otherRate_.push_back( i );
+			otherTerm_.push_back( term );
+		}
+	}
+
+	for ( unsigned int i = 0; i < numVarPools; ++i ) {
+		const int* entry = 0;
+		const unsigned int* colIndex = 0;
+		unsigned int numEntries = N.getRow( i, &entry, &colIndex );
+		for ( unsigned int j = 0; j < numEntries; ++j ) {
+			colIndex_.push_back( colIndex[j] );
+			entry_.push_back( entry[j] );
+		}
+		rowStart_.push_back( colIndex_.size() );
+	}
+	v_.assign( numRates_, 0.0 );
+	vb_.assign( numRates_, 0.0 );
+}
+
+void RateKernel::velocities( const double* s, double* v ) const
+{
+	for ( unsigned int i = 0; i < numRates_; ++i )
+		v[i] = 0.0;
+
+	unsigned int n = zeroRate_.size();
+	for ( unsigned int i = 0; i < n; ++i )
+		v[ zeroRate_[i] ] += zeroK_[i];
+
+	n = firstRate_.size();
+	for ( unsigned int i = 0; i < n; ++i )
+		v[ firstRate_[i] ] += firstK_[i] * s[ firstMol_[i] ];
+
+	n = secondRate_.size();
+	for ( unsigned int i = 0; i < n; ++i )
+		v[ secondRate_[i] ] += 
+			secondK_[i] * s[ secondMol1_[i] ] * s[ secondMol2_[i] ];
+
+	n = nthRate_.size();
+	for ( unsigned int i = 0; i < n; ++i ) {
+		double ret = nthK_[i];
+		for ( unsigned int j = nthStart_[i]; j < nthStart_[i+1]; ++j )
+			ret *= s[ nthMol_[j] ];
+		v[ nthRate_[i] ] += ret;
+	}
+
+	n = mmRate_.size();
+	for ( unsigned int i = 0; i < n; ++i ) {
+		double sub = s[ mmSub_[i] ];
+		v[ mmRate_[i] ] = ( mmKcat_[i] * sub * s[ mmEnz_[i] ] ) / 
+				( mmKm_[i] + sub );
+	}
+
+	n = otherRate_.size();
+	for ( unsigned int i = 0; i < n; ++i )
+		v[ otherRate_[i] ] = (*otherTerm_[i])( s );
+}
+
+void RateKernel::updateRates( const double* s, double* yprime, 
+				unsigned int numPools ) const
+{
+	double* v = numRates_ > 0 ? &v_[0] : 0;
+	velocities( s, v );
+	unsigned int numRows = rowStart_.size() - 1;
+	assert( numRows <= numPools );
+	for ( unsigned int i = 0; i < numRows; ++i ) {
+		double ret = 0.0;
+		for ( unsigned int j = rowStart_[i]; j < rowStart_[i+1]; ++j )
+			ret += entry_[j] * v[ colIndex_[j] ];
+		yprime[i] = ret;
+	}
+	for ( unsigned int i = numRows; i < numPools; ++i )
+		yprime[i] = 0.0;
+}
+
+void RateKernel::splitVelocities( const double* s, double* vf, 
+				double* vb ) const
+{
+	for ( unsigned int i = 0; i < numRates_; ++i ) {
+		vf[i] = 0.0;
+		vb[i] = 0.0;
+	}
+
+	// The backward halves of reactions have negative rate constants.
+	unsigned int n = zeroRate_.size();
+	for ( unsigned int i = 0; i < n; ++i ) {
+		double x = zeroK_[i];
+		if ( x >= 0.0 )
+			vf[ zeroRate_[i] ] += x;
+		else
+			vb[ zeroRate_[i] ] -= x;
+	}
+
+	n = firstRate_.size();
+	for ( unsigned int i = 0; i < n; ++i ) {
+		double x = firstK_[i] * s[ firstMol_[i] ];
+		if ( firstK_[i] >= 0.0 )
+			vf[ firstRate_[i] ] += x;
+		else
+			vb[ firstRate_[i] ] -= x;
+	}
+
+	n = secondRate_.size();
+	for ( unsigned int i = 0; i < n; ++i ) {
+		double x = secondK_[i] * s[ secondMol1_[i] ] * s[ secondMol2_[i] ];
+		if ( secondK_[i] >= 0.0 )
+			vf[ secondRate_[i] ] += x;
+		else
+			vb[ secondRate_[i] ] -= x;
+	}
+
+	n = nthRate_.size();
+	for ( unsigned int i = 0; i < n; ++i ) {
+		double x = nthK_[i];
+		for ( unsigned int j = nthStart_[i]; j < nthStart_[i+1]; ++j )
+			x *= s[ nthMol_[j] ];
+		if ( nthK_[i] >= 0.0 )
+			vf[ nthRate_[i] ] += x;
+		else
+			vb[ nthRate_[i] ] -= x;
+	}
+
+	n = mmRate_.size();
+	for ( unsigned int i = 0; i < n; ++i ) {
+		double sub = s[ mmSub_[i] ];
+		vf[ mmRate_[i] ] = ( mmKcat_[i] * sub * s[ mmEnz_[i] ] ) / 
+				( mmKm_[i] + sub );
+	}
+
+	// A reversible term that is not mass action is still evaluated one
+	// half at a time. Anything else only has a net velocity.
+	n = otherRate_.size();
+	for ( unsigned int i = 0; i < n; ++i ) {
+		const RateTerm* term = otherTerm_[i];
+		unsigned int r = otherRate_[i];
+		if ( typeid( *term ) == typeid( BidirectionalReaction ) ) {
+			const BidirectionalReaction* br = 
+				static_cast< const BidirectionalReaction* >( term );
+			vf[r] = (*br->getForward())( s );
+			vb[r] = (*br->getBackward())( s );
+		} else {
+			double x = (*term)( s );
+			if ( x >= 0.0 )
+				vf[r] = x;
+			else
+				vb[r] = -x;
+		}
+	}
+}
+
+void RateKernel::updateProdLoss( const double* s, double* prod, 
+				double* loss, unsigned int numPools ) const
+{
+	double* vf = numRates_ > 0 ? &v_[0] : 0;
+	double* vb = numRates_ > 0 ? &vb_[0] : 0;
+	splitVelocities( s, vf, vb );
+	unsigned int numRows = rowStart_.size() - 1;
+	assert( numRows <= numPools );
+	for ( unsigned int i = 0; i < numRows; ++i ) {
+		double p = 0.0;
+		double l = 0.0;
+		for ( unsigned int j = rowStart_[i]; j < rowStart_[i+1]; ++j ) {
+			// The forward flux of a reaction goes one way and the
+			// backward flux the other, whatever the net velocity.
+			double e = entry_[j];
+			unsigned int r = colIndex_[j];
+			if ( e > 0.0 ) {
+				p += e * vf[r];
+				l += e * vb[r];
+			} else {
+				l -= e * vf[r];
+				p -= e * vb[r];
+			}
+		}
+		prod[i] = p;
+		loss[i] = l;
+	}
+	for ( unsigned int i = numRows; i < numPools; ++i ) {
+		prod[i] = 0.0;
+		loss[i] = 0.0;
+	}
+}
@@ -0,0 +1,142 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2015 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#ifndef _RATE_KERNEL_H
+#define _RATE_KERNEL_H
+
+class RateTerm;
+class KinSparseMatrix;
+
+/**
+ * The RateKernel is a flattened form of the rate terms and stoichiometry
+ * matrix of a single voxel, used to evaluate the ODE right-hand side
+ * without virtual calls or memory allocation.
+ *
+ * At build time each RateTerm is sorted by type into structure-of-arrays
+ * batches. Mass-action terms (ZeroOrder, FirstOrder, SecondOrder, NOrder,
+ * and the two halves of a BidirectionalReaction) go into batches by
+ * order, with the backward halves stored with a negated rate constant.
+ * MMEnzyme1 terms have their own batch. Anything else is kept as a 
+ * RateTerm pointer and evaluated through the virtual function.
+ *
+ * The stoichiometry matrix is copied into flat row arrays with double
+ * entries, so the rate of change of each pool is a plain dot product.
+ *
+ * The arithmetic is done in the same order as the RateTerm operators
+ * and KinSparseMatrix::computeRowRate, so results are bit-identical.
+ */
+class RateKernel
+{
+	public: 
+		RateKernel();
+
+		/**
+		 * Builds the kernel from the rate terms and stoichiometry matrix.
+		 * Only the first numVarPools rows of N are used, the rest
+		 * of the pools are buffered and have zero rate of change.
+		 * The RateTerms must outlive the kernel, as some are held as
+		 * pointers.
+		 */
+		void build( const vector< RateTerm* >& rates, 
+				const KinSparseMatrix& N, unsigned int numVarPools );
+
+		/**
+		 * True if the term is a plain mass-action term: ZeroOrder,
+		 * FirstOrder, SecondOrder or NOrder. 
+		 */
+		static bool isMassAction( const RateTerm* term );
+
+		/// Number of rate terms the kernel was built for.
+		unsigned int numRates() const;
+
+		/// Computes the reaction velocities v from the mol #s s.
+		void velocities( const double* s, double* v ) const;
+
+		/**
+		 * Computes yprime, the rate of change of all numPools pools, 
+		 * from the mol #s s. Uses an internal scratch vector for the 
+		 * velocities, so one kernel must not be used from two threads at
+		 * once.
+		 */
+		void updateRates( const double* s, double* yprime, 
+						unsigned int numPools ) const;
+
+		/**
+		 * Computes the production and loss rates of all numPools pools
+		 * separately, so that yprime = prod - loss. Used by the
+		 * exponential Euler method. The forward and backward fluxes of
+		 * a reversible reaction go to different sides, so a pool that
+		 * is consumed and made by the same reaction has both. Shares
+		 * the scratch vector with updateRates.
+		 */
+		void updateProdLoss( const double* s, double* prod, double* loss,
+						unsigned int numPools ) const;
+
+	private:
+		/**
+		 * Computes the forward velocities vf and backward velocities
+		 * vb separately, both non-negative, so that v = vf - vb.
+		 */
+		void splitVelocities( const double* s, double* vf, 
+						double* vb ) const;
+
+		/// Puts a mass-action term into the batch for its order.
+		void addMassAction( const RateTerm* term, unsigned int rate,
+						double sign );
+
+		unsigned int numRates_;
+
+		/// Zero order terms: v[rate] += k
+		vector< unsigned int > zeroRate_;
+		vector< double > zeroK_;
+
+		/// First order terms: v[rate] += k * s[mol]
+		vector< unsigned int > firstRate_;
+		vector< unsigned int > firstMol_;
+		vector< double > firstK_;
+
+		/// Second order terms: v[rate] += k * s[mol1] * s[mol2]
+		vector< unsigned int > secondRate_;
+		vector< unsigned int > secondMol1_;
+		vector< unsigned int > secondMol2_;
+		vector< double > secondK_;
+
+		/** 
+		 * Higher order terms: v[rate] += k * product of s[mol] for the
+		 * mols from nthStart_[i] to nthStart_[i+1].
+		 */
+		vector< unsigned int > nthRate_;
+		vector< unsigned int > nthStart_;
+		vector< unsigned int > nthMol_;
+		vector< double > nthK_;
+
+		/// MMEnzyme1 terms: v[rate] = kcat * s[sub] * s[enz] / (Km + s[sub])
+		vector< unsigned int > mmRate_;
+		vector< unsigned int > mmSub_;
+		vector< unsigned int > mmEnz_;
+		vector< double > mmKm_;
+		vector< double > mmKcat_;
+
+		/// All other terms are evaluated through the RateTerm.
+		vector< unsigned int > otherRate_;
+		vector< const RateTerm* > otherTerm_;
+
+		/// Flattened stoichiometry matrix rows for the variable pools.
+		vector< unsigned int > rowStart_;
+		vector< unsigned int > colIndex_;
+		vector< double > entry_;
+
+		/// Scratch space for the velocities.
+		mutable vector< double > v_;
+
+		/// Scratch space for the backward velocities in updateProdLoss.
+		mutable vector< double > vb_;
+};
+
+#endif	// _RATE_KERNEL_H
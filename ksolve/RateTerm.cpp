@@ -43,3 +43,60 @@ double StochNOrder::operator() ( const double* S ) const {
 	}
 	return ret;
 }
+
+void StochNOrder::paramDerivatives( const double* S,
+			double& dR1, double& dR2 ) const
+{
+	// Same as the rate, with k = 1.
+	dR1 = 1.0;
+	unsigned int lasty = 0;
+	double y = 0.0;
+	for ( vector< unsigned int >::const_iterator 
+			i = v_.begin(); i != v_.end(); i++) {
+		if ( lasty == *i )
+			y -= 1.0;
+		else
+			y = S[ *i ];
+		dR1 *= y;
+		lasty = *i;
+	}
+	dR2 = 0.0;
+}
+
+/**
+ * The rate is k * product over distinct substrates of the falling
+ * factorial y(y-1)...(y-m+1), where m is the multiplicity of that
+ * substrate. The derivative with respect to each substrate is the
+ * derivative of its own factor times all the other factors.
+ */
+void StochNOrder::rateDerivatives( const double* S,
+			vector< pair< unsigned int, double > >& deriv ) const
+{
+	// v_ is sorted, so repeated substrates are consecutive.
+	vector< unsigned int > mol;
+	vector< double > factor;
+	vector< double > dfactor;
+	for ( unsigned int i = 0; i < v_.size(); ) {
+		unsigned int m = 1;
+		while ( i + m < v_.size() && v_[i + m] == v_[i] )
+			++m;
+		double y = S[ v_[i] ];
+		double f = 1.0;
+		double df = 0.0;
+		for ( unsigned int k = 0; k < m; ++k ) {
+			df = df * ( y - k ) + f; // Product rule, built up term by term.
+			f *= y - k;
+		}
+		mol.push_back( v_[i] );
+		factor.push_back( f );
+		dfactor.push_back( df );
+		i += m;
+	}
+	for ( unsigned int i = 0; i < mol.size(); ++i ) {
+		double d = k_ * dfactor[i];
+		for ( unsigned int j = 0; j < mol.size(); ++j )
+			if ( j != i )
+				d *= factor[j];
+		deriv.push_back( pair< unsigned int, double >( mol[i], d ) );
+	}
+}
@@ -74,6 +74,24 @@ class RateTerm
 		 */
 		virtual RateTerm* copyWithVolScaling( 
 				double vol, double sub, double prd ) const = 0;
+
+		/**
+		 * Appends to deriv the partial derivatives of the rate with
+		 * respect to each of the molecules in S that it depends on,
+		 * as pairs of ( molIndex, dRate/dS[molIndex] ). A molecule may
+		 * appear more than once, in which case the entries add up.
+		 * Used to build the analytic Jacobian for implicit methods.
+		 */
+		virtual void rateDerivatives( const double* S,
+			vector< pair< unsigned int, double > >& deriv ) const = 0;
+
+		/**
+		 * Computes the partial derivatives of the rate with respect to
+		 * R1 and R2, as returned by getR1 and getR2, at S. 
+		 * Used for forward sensitivity analysis.
+		 */
+		virtual void paramDerivatives( const double* S,
+			double& dR1, double& dR2 ) const = 0;
 };
 
 // Base class MMEnzme for the purposes of setting rates
@@ -165,6 +183,24 @@ class MMEnzyme1: public MMEnzymeBase
 			return new MMEnzyme1( ratio * Km_, kcat_, enz_, sub_);
 		}
 
+		void rateDerivatives( const double* S,
+			vector< pair< unsigned int, double > >& deriv ) const
+		{
+			double denom = Km_ + S[ sub_ ];
+			deriv.push_back( pair< unsigned int, double >( 
+				enz_, kcat_ * S[ sub_ ] / denom ) );
+			deriv.push_back( pair< unsigned int, double >( 
+				sub_, kcat_ * S[ enz_ ] * Km_ / ( denom * denom ) ) );
+		}
+
+		void paramDerivatives( const double* S,
+			double& dR1, double& dR2 ) const
+		{
+			double denom = Km_ + S[ sub_ ];
+			dR2 = S[ sub_ ] * S[ enz_ ] / denom;
+			dR1 = -kcat_ * dR2 / denom;
+		}
+
 	private:
 		unsigned int sub_;
 };
@@ -198,6 +234,30 @@ class MMEnzyme: public MMEnzymeBase
 			double ratio = sub * vol * NA;
 			return new MMEnzyme( ratio * Km_, kcat_, enz_, substrates_ );
 		}
+
+		void rateDerivatives( const double* S,
+			vector< pair< unsigned int, double > >& deriv ) const
+		{
+			// Chain rule through the substrate product term.
+			double sub = (*substrates_)( S );
+			double denom = Km_ + sub;
+			unsigned int start = deriv.size();
+			substrates_->rateDerivatives( S, deriv );
+			double scale = kcat_ * S[ enz_ ] * Km_ / ( denom * denom );
+			for ( unsigned int i = start; i < deriv.size(); ++i )
+				deriv[i].second *= scale;
+			deriv.push_back( pair< unsigned int, double >( 
+				enz_, kcat_ * sub / denom ) );
+		}
+
+		void paramDerivatives( const double* S,
+			double& dR1, double& dR2 ) const
+		{
+			double sub = (*substrates_)( S );
+			double denom = Km_ + sub;
+			dR2 = sub * S[ enz_ ] / denom;
+			dR1 = -kcat_ * dR2 / denom;
+		}
 	private:
 		RateTerm* substrates_;
 };
@@ -248,6 +308,18 @@ class ExternReac: public RateTerm
 			return new ExternReac();
 		}
 
+		void rateDerivatives( const double* S,
+			vector< pair< unsigned int, double > >& deriv ) const
+		{
+			; // Rate is zero, nothing to add.
+		}
+
+		void paramDerivatives( const double* S,
+			double& dR1, double& dR2 ) const
+		{
+			dR1 = dR2 = 0.0; // Rate does not depend on R1 or R2.
+		}
+
 	private:
 };
 
@@ -307,6 +379,23 @@ class ZeroOrder: public RateTerm
 		{
 			return new ZeroOrder( k_ );
 		}
+
+		void rateDerivatives( const double* S,
+			vector< pair< unsigned int, double > >& deriv ) const
+		{
+			; // Constant rate, nothing to add.
+		}
+
+		/**
+		 * The mass action terms are all k_ times a product of their
+		 * reactants, so dR1 is that product.
+		 */
+		void paramDerivatives( const double* S,
+			double& dR1, double& dR2 ) const
+		{
+			dR1 = 1.0;
+			dR2 = 0.0;
+		}
 	protected:
 		double k_;
 };
@@ -346,6 +435,19 @@ class Flux: public ZeroOrder
 			return new Flux( k_, y_ );
 		}
 
+		void rateDerivatives( const double* S,
+			vector< pair< unsigned int, double > >& deriv ) const
+		{
+			deriv.push_back( pair< unsigned int, double >( y_, k_ ) );
+		}
+
+		void paramDerivatives( const double* S,
+			double& dR1, double& dR2 ) const
+		{
+			dR1 = S[ y_ ];
+			dR2 = 0.0;
+		}
+
 	private:
 		unsigned int y_;
 };
@@ -380,6 +482,19 @@ class FirstOrder: public ZeroOrder
 			return new FirstOrder( k_ / sub, y_ );
 		}
 
+		void rateDerivatives( const double* S,
+			vector< pair< unsigned int, double > >& deriv ) const
+		{
+			deriv.push_back( pair< unsigned int, double >( y_, k_ ) );
+		}
+
+		void paramDerivatives( const double* S,
+			double& dR1, double& dR2 ) const
+		{
+			dR1 = S[ y_ ];
+			dR2 = 0.0;
+		}
+
 	private:
 		unsigned int y_;
 };
@@ -419,6 +534,22 @@ class SecondOrder: public ZeroOrder
 			return new SecondOrder( k_ / ratio, y1_, y2_ );
 		}
 
+		void rateDerivatives( const double* S,
+			vector< pair< unsigned int, double > >& deriv ) const
+		{
+			deriv.push_back( pair< unsigned int, double >( 
+				y1_, k_ * S[ y2_ ] ) );
+			deriv.push_back( pair< unsigned int, double >( 
+				y2_, k_ * S[ y1_ ] ) );
+		}
+
+		void paramDerivatives( const double* S,
+			double& dR1, double& dR2 ) const
+		{
+			dR1 = S[ y1_ ] * S[ y2_ ];
+			dR2 = 0.0;
+		}
+
 	private:
 		unsigned int y1_;
 		unsigned int y2_;
@@ -465,6 +596,20 @@ class StochSecondOrderSingleSubstrate: public ZeroOrder
 			return new StochSecondOrderSingleSubstrate( k_ / ratio, y_ );
 		}
 
+		void rateDerivatives( const double* S,
+			vector< pair< unsigned int, double > >& deriv ) const
+		{
+			deriv.push_back( pair< unsigned int, double >( 
+				y_, k_ * ( 2.0 * S[ y_ ] - 1.0 ) ) );
+		}
+
+		void paramDerivatives( const double* S,
+			double& dR1, double& dR2 ) const
+		{
+			dR1 = ( S[ y_ ] - 1 ) * S[ y_ ];
+			dR2 = 0.0;
+		}
+
 	private:
 		const unsigned int y_;
 };
@@ -508,6 +653,27 @@ class NOrder: public ZeroOrder
 			return new NOrder( k_ / ratio, v_ );
 		}
 
+		void rateDerivatives( const double* S,
+			vector< pair< unsigned int, double > >& deriv ) const
+		{
+			for ( unsigned int i = 0; i < v_.size(); ++i ) {
+				double d = k_;
+				for ( unsigned int j = 0; j < v_.size(); ++j )
+					if ( j != i )
+						d *= S[ v_[j] ];
+				deriv.push_back( pair< unsigned int, double >( v_[i], d ) );
+			}
+		}
+
+		void paramDerivatives( const double* S,
+			double& dR1, double& dR2 ) const
+		{
+			dR1 = 1.0;
+			for ( unsigned int i = 0; i < v_.size(); ++i )
+				dR1 *= S[ v_[i] ];
+			dR2 = 0.0;
+		}
+
 	protected:
 		vector< unsigned int > v_;
 };
@@ -533,6 +699,12 @@ class StochNOrder: public NOrder
 			double ratio = sub * pow( vol * NA, (int)( v_.size() ) -1);
 			return new StochNOrder( k_ / ratio, v_ );
 		}
+
+		void rateDerivatives( const double* S,
+			vector< pair< unsigned int, double > >& deriv ) const;
+
+		void paramDerivatives( const double* S,
+			double& dR1, double& dR2 ) const;
 };
 
 extern class ZeroOrder* 
@@ -579,6 +751,14 @@ class BidirectionalReaction: public RateTerm
 			return backward_->getR1();
 		}
 
+		const ZeroOrder* getForward() const {
+			return forward_;
+		}
+
+		const ZeroOrder* getBackward() const {
+			return backward_;
+		}
+
 		unsigned int getReactants( vector< unsigned int >& molIndex ) const{
 			forward_->getReactants( molIndex );
 			unsigned int ret = molIndex.size();
@@ -604,6 +784,25 @@ class BidirectionalReaction: public RateTerm
 			return new BidirectionalReaction( f, b );
 		}
 
+		void rateDerivatives( const double* S,
+			vector< pair< unsigned int, double > >& deriv ) const
+		{
+			forward_->rateDerivatives( S, deriv );
+			unsigned int start = deriv.size();
+			backward_->rateDerivatives( S, deriv );
+			for ( unsigned int i = start; i < deriv.size(); ++i )
+				deriv[i].second = -deriv[i].second;
+		}
+
+		void paramDerivatives( const double* S,
+			double& dR1, double& dR2 ) const
+		{
+			double unused;
+			forward_->paramDerivatives( S, dR1, unused );
+			backward_->paramDerivatives( S, dR2, unused );
+			dR2 = -dR2;
+		}
+
 	private:
 		ZeroOrder* forward_;
 		ZeroOrder* backward_;
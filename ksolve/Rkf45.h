@@ -0,0 +1,38 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2015 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#ifndef _RKF45_H
+#define _RKF45_H
+
+/**
+ * Runge-Kutta-Fehlberg (4,5) coefficients, shared by the built-in
+ * integrators of VoxelPools and BatchedVoxelPools.
+ */
+static const double ah[] = { 1.0/4.0, 3.0/8.0, 12.0/13.0, 1.0, 1.0/2.0 };
+static const double b3[] = { 3.0/32.0, 9.0/32.0 };
+static const double b4[] = { 1932.0/2197.0, -7200.0/2197.0, 7296.0/2197.0 };
+static const double b5[] = { 
+	439.0/216.0, -8.0, 3680.0/513.0, -845.0/4104.0 };
+static const double b6[] = { 
+	-8.0/27.0, 2.0, -3544.0/2565.0, 1859.0/4104.0, -11.0/40.0 };
+// Fifth order solution.
+static const double c1 = 16.0/135.0;
+static const double c3 = 6656.0/12825.0;
+static const double c4 = 28561.0/56430.0;
+static const double c5 = -9.0/50.0;
+static const double c6 = 2.0/55.0;
+// Difference between the fifth and fourth order solutions.
+static const double ec[] = { 1.0/360.0, 0.0, -128.0/4275.0, 
+	-2197.0/75240.0, 1.0/50.0, 2.0/55.0 };
+
+/// Step size control of the RKF45 methods.
+static const double RKF_SAFETY = 0.9;
+static const double RKF_ORDER = 5.0;
+
+#endif	// _RKF45_H
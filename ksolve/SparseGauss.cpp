@@ -0,0 +1,154 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2015 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#include <math.h>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <cassert>
+using namespace std;
+#include "SparseGauss.h"
+
+static const unsigned int NONE = ~0U;
+
+SparseGauss::SparseGauss()
+	: numCols_( 0 ), numPivotCols_( 0 ), tiny_( 0.0 )
+{;}
+
+void SparseGauss::reset( unsigned int numCols, unsigned int numPivotCols,
+				double tiny )
+{
+	assert( numPivotCols <= numCols );
+	numCols_ = numCols;
+	numPivotCols_ = numPivotCols;
+	tiny_ = tiny;
+	pivotCol_.clear();
+	pivotVal_.clear();
+	pivotRow_.clear();
+	colPivot_.assign( numCols, NONE );
+	rowPivot_.clear();
+	mult_.clear();
+	work_.assign( numCols, 0.0 );
+	touched_.assign( numCols, false );
+}
+
+bool SparseGauss::addRow( vector< pair< unsigned int, double > >& row )
+{
+	// Pivots must be used in the order they were made, as each has
+	// zeros in the columns of all the ones before it.
+	priority_queue< unsigned int, vector< unsigned int >,
+			greater< unsigned int > > pending;
+	vector< unsigned int > nz;
+	for ( unsigned int i = 0; i < row.size(); ++i ) {
+		unsigned int c = row[i].first;
+		assert( c < numCols_ );
+		if ( !touched_[c] ) {
+			touched_[c] = true;
+			nz.push_back( c );
+			if ( colPivot_[c] != NONE )
+				pending.push( colPivot_[c] );
+		}
+		work_[c] += row[i].second;
+	}
+
+	vector< pair< unsigned int, double > > mult;
+	while ( !pending.empty() ) {
+		unsigned int k = pending.top();
+		pending.pop();
+		unsigned int c = pivotCol_[k];
+		double x = work_[c];
+		work_[c] = 0.0;
+		if ( fabs( x ) <= tiny_ )
+			continue;
+		double f = x / pivotVal_[k];
+		mult.push_back( pair< unsigned int, double >( k, f ) );
+		const vector< pair< unsigned int, double > >& p = pivotRow_[k];
+		for ( unsigned int i = 0; i < p.size(); ++i ) {
+			unsigned int j = p[i].first;
+			if ( !touched_[j] ) {
+				touched_[j] = true;
+				nz.push_back( j );
+				if ( colPivot_[j] != NONE )
+					pending.push( colPivot_[j] );
+			}
+			work_[j] -= f * p[i].second;
+		}
+	}
+
+	// Gather what is left, and clean up the scratch row.
+	sort( nz.begin(), nz.end() );
+	row.clear();
+	unsigned int best = NONE;
+	double bestVal = 0.0;
+	for ( unsigned int i = 0; i < nz.size(); ++i ) {
+		unsigned int c = nz[i];
+		double x = work_[c];
+		work_[c] = 0.0;
+		touched_[c] = false;
+		if ( fabs( x ) <= tiny_ )
+			continue;
+		if ( c < numPivotCols_ && fabs( x ) > bestVal ) {
+			best = c;
+			bestVal = fabs( x );
+		}
+		row.push_back( pair< unsigned int, double >( c, x ) );
+	}
+	mult_.push_back( mult );
+
+	if ( best == NONE ) {
+		rowPivot_.push_back( NONE );
+		return false;
+	}
+	unsigned int k = pivotCol_.size();
+	rowPivot_.push_back( k );
+	colPivot_[ best ] = k;
+	pivotCol_.push_back( best );
+	pivotRow_.push_back( vector< pair< unsigned int, double > >() );
+	for ( unsigned int i = 0; i < row.size(); ++i ) {
+		if ( row[i].first == best )
+			pivotVal_.push_back( row[i].second );
+		else
+			pivotRow_[k].push_back( row[i] );
+	}
+	return true;
+}
+
+unsigned int SparseGauss::rank() const
+{
+	return pivotCol_.size();
+}
+
+void SparseGauss::solve( const vector< double >& b, vector< double >& x )
+		const
+{
+	assert( b.size() == rowPivot_.size() );
+	// Forward: y = L^-1 b, one entry per pivot.
+	vector< double > y( pivotCol_.size(), 0.0 );
+	for ( unsigned int r = 0; r < rowPivot_.size(); ++r ) {
+		unsigned int k = rowPivot_[r];
+		if ( k == NONE )
+			continue;
+		double sum = b[r];
+		const vector< pair< unsigned int, double > >& m = mult_[r];
+		for ( unsigned int i = 0; i < m.size(); ++i )
+			sum -= m[i].second * y[ m[i].first ];
+		y[k] = sum;
+	}
+	// Backward: each pivot row only has entries in the columns of later
+	// pivots, or of no pivot.
+	x.assign( numCols_, 0.0 );
+	for ( unsigned int k = pivotCol_.size(); k > 0; --k ) {
+		const vector< pair< unsigned int, double > >& p = pivotRow_[k-1];
+		double sum = y[k-1];
+		for ( unsigned int i = 0; i < p.size(); ++i )
+			sum -= p[i].second * x[ p[i].first ];
+		x[ pivotCol_[k-1] ] = sum / pivotVal_[k-1];
+	}
+}
@@ -0,0 +1,89 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2015 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#ifndef _SPARSE_GAUSS_H
+#define _SPARSE_GAUSS_H
+
+/**
+ * SparseGauss does Gaussian elimination on sparse rows, added one at a
+ * time. Each new row is reduced by all the pivot rows so far, in the
+ * order they were made. If anything is left, its largest entry becomes
+ * a new pivot, so the pivot rows form an LU factorization with row
+ * order fixed and columns chosen by partial pivoting. Only entries that
+ * are nonzero or filled in are touched, so the cost follows the
+ * number of nonzeros rather than the matrix size.
+ *
+ * Only the first numPivotCols columns may be pivots. The others just go
+ * along, so that with rows [N I] the rows that reduce to nothing in N
+ * give the conservation laws in the I part.
+ */
+class SparseGauss
+{
+	public:
+		SparseGauss();
+
+		/**
+		 * Starts afresh on rows of numCols columns, of which the first
+		 * numPivotCols can be pivots. Entries that end up no bigger
+		 * than tiny are dropped.
+		 */
+		void reset( unsigned int numCols, unsigned int numPivotCols,
+						double tiny );
+
+		/**
+		 * Reduces row by the pivot rows so far. If there is anything
+		 * left in the pivot columns, it makes a new pivot and returns
+		 * true. Otherwise it returns false and row holds what is left,
+		 * all in the other columns, sorted by column.
+		 */
+		bool addRow( vector< pair< unsigned int, double > >& row );
+
+		/// Number of pivots so far.
+		unsigned int rank() const;
+
+		/**
+		 * Solves A x = b, where the rows of A are the ones added, and
+		 * b has one entry for each of them. x has an entry for each
+		 * column. Rows that gave no pivot are ignored, and the columns
+		 * that were never a pivot are zero in x.
+		 */
+		void solve( const vector< double >& b, vector< double >& x ) const;
+
+	private:
+		unsigned int numCols_;
+		unsigned int numPivotCols_;
+		double tiny_;
+
+		/// Column of each pivot, in the order they were made.
+		vector< unsigned int > pivotCol_;
+
+		/// Value at each pivot.
+		vector< double > pivotVal_;
+
+		/// Rest of each pivot row, without the pivot itself.
+		vector< vector< pair< unsigned int, double > > > pivotRow_;
+
+		/// Pivot number of each column, or ~0 if none.
+		vector< unsigned int > colPivot_;
+
+		/// Pivot made by each added row, or ~0 if none.
+		vector< unsigned int > rowPivot_;
+
+		/**
+		 * Multipliers used on each added row, as pairs of
+		 * ( pivot number, factor ). These are the rows of L.
+		 */
+		vector< vector< pair< unsigned int, double > > > mult_;
+
+		/// Dense scratch row for addRow, kept zero between calls.
+		vector< double > work_;
+		vector< bool > touched_;
+};
+
+#endif	// _SPARSE_GAUSS_H
@@ -9,16 +9,19 @@
 
 /**
  * This program works out a steady-state value for a reaction system.
- * It uses GSL heavily, and isn't even compiled if the flag isn't set.
- * It finds the ss value closest to the initial conditions.
+ * The dense method uses GSL heavily, and does nothing if the flag isn't
+ * set. The sparse method needs no GSL, and scales to large networks.
+ * Both find the ss value closest to the initial conditions.
  *
  * If you want to find multiple stable states, it is best to do this
  * in Python as it gives a lot of flexibility in working out how to
  * find steady states.
- * Likewise, if you want to carry out a dose-response calculation.
+ * Dose-response curves and hysteresis loops can be done here, by scan
+ * and continuation on the sparse path. settleAll does every voxel.
  */
 
 #include "header.h"
+#include "../basecode/WorkerPool.h"
 #include "SparseMatrix.h"
 #include "KinSparseMatrix.h"
 #include "RateTerm.h"
@@ -29,6 +32,7 @@
 #include "ZombiePoolInterface.h"
 #include "Stoich.h"
 #include "../randnum/randnum.h"
+#include <cfloat>
 
 #ifdef USE_GSL
 #include <gsl/gsl_errno.h>
@@ -45,11 +49,13 @@
 
 #include "VoxelPoolsBase.h"
 #include "OdeSystem.h"
+#include "RateKernel.h"
 #include "VoxelPools.h"
+#include "SparseGauss.h"
 #include "SteadyState.h"
 
-int ss_func( const gsl_vector* x, void* params, gsl_vector* f );
 #ifdef USE_GSL
+int ss_func( const gsl_vector* x, void* params, gsl_vector* f );
 int myGaussianDecomp( gsl_matrix* U );
 #endif
 
@@ -147,6 +153,23 @@ const Cinfo* SteadyState::initCinfo()
 			&SteadyState::setConvergenceCriterion,
 			&SteadyState::getConvergenceCriterion
 		);
+		static ValueFinfo< SteadyState, string > method( 
+			"method", 
+			"Solution method. "
+			"'dense': GSL root finders on dense matrices, with "
+			"finite difference Jacobians. Default if built with GSL. "
+			"'sparse': conservation laws by sparse elimination, then "
+			"Newton iterations using the analytic Jacobian of the rate "
+			"terms and a sparse LU factorization. If Newton fails, it "
+			"falls back to pseudo-transient continuation, which follows "
+			"the time course in ever longer implicit steps. The cost "
+			"follows the number of reactions, so it suits large "
+			"networks, and it does not need GSL. The eigenvalues are "
+			"found by GSL when it is present, and otherwise by QR "
+			"iteration on the analytic Jacobian.",
+			&SteadyState::setMethod,
+			&SteadyState::getMethod
+		);
 		static ReadOnlyValueFinfo< SteadyState, unsigned int > numVarPools(
 			"numVarPools", 
 			"Number of variable molecules in reaction system.",
@@ -200,6 +223,54 @@ const Cinfo* SteadyState::initCinfo()
 			"Eigenvalues computed for steady state",
 			&SteadyState::getEigenvalue
 		);
+		static ValueFinfo< SteadyState, unsigned int > numThreads( 
+			"numThreads", 
+			"Number of threads used by settleAll and scan. Default 1.",
+			&SteadyState::setNumThreads,
+			&SteadyState::getNumThreads
+		);
+		static ValueFinfo< SteadyState, vector< unsigned int > > scanTotals(
+			"scanTotals", 
+			"Indices of the totals assigned by each row of scanGrid.",
+			&SteadyState::setScanTotals,
+			&SteadyState::getScanTotals
+		);
+		static ValueFinfo< SteadyState, vector< unsigned int > > scanParams(
+			"scanParams", 
+			"Rate parameters assigned by each row of scanGrid, numbered "
+			"as the columns of Ksolve::ensembleParams: 2 * i for R1 "
+			"and 2 * i + 1 for R2 of rate term i of the Stoich.",
+			&SteadyState::setScanParams,
+			&SteadyState::getScanParams
+		);
+		static ValueFinfo< SteadyState, vector< double > > scanGrid( 
+			"scanGrid", 
+			"Points for scan and continuation, one row per point. Each "
+			"row holds the values of the scanTotals and then of the "
+			"scanParams. Everything else is as in voxel 0.",
+			&SteadyState::setScanGrid,
+			&SteadyState::getScanGrid
+		);
+		static ReadOnlyValueFinfo< SteadyState, vector< double > > scanN( 
+			"scanN", 
+			"n of all pools at the steady state found for each voxel or "
+			"point by the last settleAll, scan or continuation. Laid out "
+			"as [point][pool].",
+			&SteadyState::getScanN
+		);
+		static ReadOnlyValueFinfo< SteadyState, vector< unsigned int > > 
+				scanStatus( 
+			"scanStatus", 
+			"solutionStatus of each voxel or point of the last batch.",
+			&SteadyState::getScanStatus
+		);
+		static ReadOnlyValueFinfo< SteadyState, vector< unsigned int > > 
+				scanStateType( 
+			"scanStateType", 
+			"stateType of each voxel or point of the last batch. Only "
+			"meaningful where scanStatus is 0.",
+			&SteadyState::getScanStateType
+		);
 		///////////////////////////////////////////////////////
 		// MsgDest definitions
 		///////////////////////////////////////////////////////
@@ -231,6 +302,35 @@ const Cinfo* SteadyState::initCinfo()
 			new EpFunc0< SteadyState >( 
 					&SteadyState::randomizeInitialCondition )
 		);
+		static DestFinfo settleAll( "settleAll", 
+			"Finds the steady state of every voxel of the ksolve, each "
+			"from its current n, with its own volume and rate "
+			"parameters. The voxels are done in parallel on numThreads "
+			"threads. Solutions are put back in the voxels, and the "
+			"results are in scanN, scanStatus and scanStateType. "
+			"Needs the sparse method.",
+			new OpFunc0< SteadyState >( &SteadyState::settleAll )
+		);
+		static DestFinfo scan( "scan", 
+			"Finds a steady state for each point of scanGrid, starting "
+			"from the n of voxel 0. The points are done in parallel on "
+			"numThreads threads. Results are in scanN, scanStatus and "
+			"scanStateType. Needs the sparse method.",
+			new OpFunc0< SteadyState >( &SteadyState::scan )
+		);
+		static DestFinfo continuation( "continuation", 
+			"Natural parameter continuation: settles voxel 0, then goes "
+			"through the points of scanGrid in turn, each starting from "
+			"the solution at the one before. If Newton fails, it tries "
+			"smaller steps toward the point. So it follows one branch "
+			"of solutions. Where the branch ends, it follows the time "
+			"course at the point by pseudo-transient continuation, and "
+			"so jumps to the branch the system would go to. A grid that "
+			"goes up and then down again shows any hysteresis. Results "
+			"are in scanN, scanStatus and scanStateType. Needs the "
+			"sparse method.",
+			new OpFunc0< SteadyState >( &SteadyState::continuation )
+		);
 		///////////////////////////////////////////////////////
 		// Shared definitions
 		///////////////////////////////////////////////////////
@@ -243,6 +343,7 @@ const Cinfo* SteadyState::initCinfo()
 			&status,				// ReadOnlyValue
 			&maxIter,				// Value
 			&convergenceCriterion,	// ReadOnlyValue
+			&method,				// Value
 			&numVarPools,			// ReadOnlyValue
 			&rank,					// ReadOnlyValue
 			&stateType,				// ReadOnlyValue
@@ -251,11 +352,21 @@ const Cinfo* SteadyState::initCinfo()
 			&solutionStatus,		// ReadOnlyValue
 			&total,					// LookupValue
 			&eigenvalues,			// ReadOnlyLookupValue
+			&numThreads,			// Value
+			&scanTotals,			// Value
+			&scanParams,			// Value
+			&scanGrid,				// Value
+			&scanN,					// ReadOnlyValue
+			&scanStatus,			// ReadOnlyValue
+			&scanStateType,			// ReadOnlyValue
 			&setupMatrix,			// DestFinfo
 			&settle,				// DestFinfo
 			&resettle,				// DestFinfo
 			&showMatrices,			// DestFinfo
 			&randomInit,			// DestFinfo
+			&settleAll,				// DestFinfo
+			&scan,					// DestFinfo
+			&continuation,			// DestFinfo
 
 
 	};
@@ -273,6 +384,8 @@ const Cinfo* SteadyState::initCinfo()
 		"the solution, as a way to help classify the fixed points. "
 		"Note that the method finds unstable as well as stable fixed "
 		"points.\n "
+		"For large reaction networks use the sparse method instead, "
+		"which uses sparse matrices throughout.\n "
 		"The SteadyState class also provides a utility function "
 	    "*randomInit()*	to "
 		"randomly initialize the concentrations, within the constraints "
@@ -324,6 +437,11 @@ SteadyState::SteadyState()
 		isInitialized_( 0 ),
 		isSetup_( 0 ),
 		convergenceCriterion_( 1e-7 ),
+#ifdef USE_GSL
+		method_( "dense" ),
+#else
+		method_( "sparse" ),
+#endif
 #ifdef USE_GSL
 		LU_( 0 ),
 		Nr_( 0 ),
@@ -338,7 +456,8 @@ SteadyState::SteadyState()
 		nPosEigenvalues_( 0 ),
 		stateType_( 0 ),
 		solutionStatus_( 0 ),
-		numFailed_( 0 )
+		numFailed_( 0 ),
+		numThreads_( 1 )
 {
 	;
 }
@@ -444,6 +563,72 @@ double SteadyState::getConvergenceCriterion() const {
 	return convergenceCriterion_;
 }
 
+string SteadyState::getMethod() const {
+	return method_;
+}
+
+void SteadyState::setMethod( string method ) {
+#ifdef USE_GSL
+	if ( method != "dense" && method != "sparse" ) {
+#else
+	if ( method != "sparse" ) {
+#endif
+		cout << "Warning: SteadyState::setMethod: '" << method <<
+			"' not available, using '" << method_ << "'\n";
+		return;
+	}
+	if ( method != method_ ) {
+		method_ = method;
+		isSetup_ = 0;
+		if ( isInitialized_ )
+			setupSSmatrix();
+	}
+}
+
+unsigned int SteadyState::getNumThreads() const {
+	return numThreads_;
+}
+
+void SteadyState::setNumThreads( unsigned int num ) {
+	numThreads_ = ( num > 0 ) ? num : 1;
+}
+
+vector< unsigned int > SteadyState::getScanTotals() const {
+	return scanTotals_;
+}
+
+void SteadyState::setScanTotals( vector< unsigned int > v ) {
+	scanTotals_ = v;
+}
+
+vector< unsigned int > SteadyState::getScanParams() const {
+	return scanParams_;
+}
+
+void SteadyState::setScanParams( vector< unsigned int > v ) {
+	scanParams_ = v;
+}
+
+vector< double > SteadyState::getScanGrid() const {
+	return scanGrid_;
+}
+
+void SteadyState::setScanGrid( vector< double > v ) {
+	scanGrid_ = v;
+}
+
+vector< double > SteadyState::getScanN() const {
+	return scanN_;
+}
+
+vector< unsigned int > SteadyState::getScanStatus() const {
+	return scanStatus_;
+}
+
+vector< unsigned int > SteadyState::getScanStateType() const {
+	return scanStateType_;
+}
+
 double SteadyState::getTotal( const unsigned int i ) const
 {
 	if ( i < total_.size() )
@@ -529,6 +714,16 @@ void SteadyState::showMatrices()
 	for ( int i = 0; i < numConsv; ++i )
 		cout << total_[i] << "	";
 	cout << endl;
+	if ( method_ == "sparse" ) {
+		cout << "gamma:\n";
+		for ( unsigned int i = 0; i < sparseGamma_.size(); ++i ) {
+			for ( unsigned int j = 0; j < sparseGamma_[i].size(); ++j )
+				cout << "	" << sparseGamma_[i][j].first << ":" <<
+					sparseGamma_[i][j].second;
+			cout << endl;
+		}
+		return;
+	}
 #ifdef USE_GSL
 	print_gsl_mat( gamma_, "gamma" );
 	print_gsl_mat( Nr_, "Nr" );
@@ -538,6 +733,10 @@ void SteadyState::showMatrices()
 
 void SteadyState::setupSSmatrix()
 {
+	if ( method_ == "sparse" ) {
+		setupSparseMatrix();
+		return;
+	}
 #ifdef USE_GSL
 	if ( numVarPools_ == 0 || nReacs_ == 0 )
 		return;
@@ -645,6 +844,243 @@ static double invop( double x )
 	return 0.0;
 }
 
+#ifndef USE_GSL
+///////////////////////////////////////////////////
+// Eigenvalues of a small dense real matrix, for classify without GSL.
+// Balancing, reduction to Hessenberg form by elimination, and the
+// shifted QR iteration of EISPACK hqr. The matrix is row-major in a,
+// 1-based through A(), and is destroyed.
+///////////////////////////////////////////////////
+
+#define A( i, j ) a[ ( (i) - 1 ) * n + (j) - 1 ]
+
+static void balanceMatrix( vector< double >& a, int n )
+{
+	const double radix = 2.0;
+	bool done = false;
+	while ( !done ) {
+		done = true;
+		for ( int i = 1; i <= n; ++i ) {
+			double c = 0.0;
+			double r = 0.0;
+			for ( int j = 1; j <= n; ++j ) {
+				if ( j != i ) {
+					c += fabs( A( j, i ) );
+					r += fabs( A( i, j ) );
+				}
+			}
+			if ( c == 0.0 || r == 0.0 )
+				continue;
+			double g = r / radix;
+			double f = 1.0;
+			double s = c + r;
+			while ( c < g ) {
+				f *= radix;
+				c *= radix * radix;
+			}
+			g = r * radix;
+			while ( c > g ) {
+				f /= radix;
+				c /= radix * radix;
+			}
+			if ( ( c + r ) / f < 0.95 * s ) {
+				done = false;
+				for ( int j = 1; j <= n; ++j )
+					A( i, j ) /= f;
+				for ( int j = 1; j <= n; ++j )
+					A( j, i ) *= f;
+			}
+		}
+	}
+}
+
+static void reduceToHessenberg( vector< double >& a, int n )
+{
+	for ( int m = 2; m < n; ++m ) {
+		double x = 0.0;
+		int i = m;
+		for ( int j = m; j <= n; ++j ) {
+			if ( fabs( A( j, m - 1 ) ) > fabs( x ) ) {
+				x = A( j, m - 1 );
+				i = j;
+			}
+		}
+		if ( i != m ) {
+			for ( int j = m - 1; j <= n; ++j )
+				swap( A( i, j ), A( m, j ) );
+			for ( int j = 1; j <= n; ++j )
+				swap( A( j, i ), A( j, m ) );
+		}
+		if ( x == 0.0 )
+			continue;
+		for ( i = m + 1; i <= n; ++i ) {
+			double y = A( i, m - 1 );
+			if ( y == 0.0 )
+				continue;
+			y /= x;
+			A( i, m - 1 ) = 0.0;
+			for ( int j = m; j <= n; ++j )
+				A( i, j ) -= y * A( m, j );
+			for ( int j = 1; j <= n; ++j )
+				A( j, m ) += y * A( j, i );
+		}
+	}
+}
+
+/**
+ * Puts the real parts of the eigenvalues of the n x n matrix a into re.
+ * Returns false if the QR iteration does not converge.
+ */
+static bool realEigenvalues( vector< double >& a, int n, 
+				vector< double >& re )
+{
+	re.assign( n, 0.0 );
+	balanceMatrix( a, n );
+	reduceToHessenberg( a, n );
+	double anorm = 0.0;
+	for ( int i = 1; i <= n; ++i )
+		for ( int j = max( i - 1, 1 ); j <= n; ++j )
+			anorm += fabs( A( i, j ) );
+
+	int nn = n;
+	double t = 0.0; // Accumulated exceptional shifts.
+	double p = 0.0, q = 0.0, r = 0.0, s, w, x, y, z;
+	while ( nn >= 1 ) {
+		int its = 0;
+		int l;
+		do {
+			// Look for a small subdiagonal element to split at.
+			for ( l = nn; l >= 2; --l ) {
+				s = fabs( A( l - 1, l - 1 ) ) + fabs( A( l, l ) );
+				if ( s == 0.0 )
+					s = anorm;
+				if ( fabs( A( l, l - 1 ) ) <= DBL_EPSILON * s ) {
+					A( l, l - 1 ) = 0.0;
+					break;
+				}
+			}
+			x = A( nn, nn );
+			if ( l == nn ) { // One root found.
+				re[ nn - 1 ] = x + t;
+				--nn;
+				continue;
+			}
+			y = A( nn - 1, nn - 1 );
+			w = A( nn, nn - 1 ) * A( nn - 1, nn );
+			if ( l == nn - 1 ) { // Two roots found.
+				p = 0.5 * ( y - x );
+				q = p * p + w;
+				z = sqrt( fabs( q ) );
+				x += t;
+				if ( q >= 0.0 ) { // Real pair.
+					z = p + ( p >= 0.0 ? z : -z );
+					re[ nn - 2 ] = re[ nn - 1 ] = x + z;
+					if ( z != 0.0 )
+						re[ nn - 1 ] = x - w / z;
+				} else { // Complex pair.
+					re[ nn - 2 ] = re[ nn - 1 ] = x + p;
+				}
+				nn -= 2;
+				continue;
+			}
+			if ( its == 30 )
+				return false;
+			if ( its == 10 || its == 20 ) { // Exceptional shift.
+				t += x;
+				for ( int i = 1; i <= nn; ++i )
+					A( i, i ) -= x;
+				s = fabs( A( nn, nn - 1 ) ) + fabs( A( nn - 1, nn - 2 ) );
+				y = x = 0.75 * s;
+				w = -0.4375 * s * s;
+			}
+			++its;
+			// Form the double shift, and look for two consecutive small
+			// subdiagonal elements.
+			int m;
+			for ( m = nn - 2; m >= l; --m ) {
+				z = A( m, m );
+				r = x - z;
+				s = y - z;
+				p = ( r * s - w ) / A( m + 1, m ) + A( m, m + 1 );
+				q = A( m + 1, m + 1 ) - z - r - s;
+				r = A( m + 2, m + 1 );
+				s = fabs( p ) + fabs( q ) + fabs( r );
+				p /= s;
+				q /= s;
+				r /= s;
+				if ( m == l )
+					break;
+				double u = fabs( A( m, m - 1 ) ) * ( fabs( q ) + fabs( r ) );
+				double v = fabs( p ) * ( fabs( A( m - 1, m - 1 ) ) + 
+						fabs( z ) + fabs( A( m + 1, m + 1 ) ) );
+				if ( u <= DBL_EPSILON * v )
+					break;
+			}
+			for ( int i = m + 2; i <= nn; ++i ) {
+				A( i, i - 2 ) = 0.0;
+				if ( i != m + 2 )
+					A( i, i - 3 ) = 0.0;
+			}
+			// Double shift QR step on rows l to nn, columns m to nn.
+			for ( int k = m; k <= nn - 1; ++k ) {
+				if ( k != m ) {
+					p = A( k, k - 1 );
+					q = A( k + 1, k - 1 );
+					r = 0.0;
+					if ( k != nn - 1 )
+						r = A( k + 2, k - 1 );
+					x = fabs( p ) + fabs( q ) + fabs( r );
+					if ( x != 0.0 ) {
+						p /= x;
+						q /= x;
+						r /= x;
+					}
+				}
+				s = sqrt( p * p + q * q + r * r );
+				if ( p < 0.0 )
+					s = -s;
+				if ( s == 0.0 )
+					continue;
+				if ( k == m ) {
+					if ( l != m )
+						A( k, k - 1 ) = -A( k, k - 1 );
+				} else {
+					A( k, k - 1 ) = -s * x;
+				}
+				p += s;
+				x = p / s;
+				y = q / s;
+				z = r / s;
+				q /= p;
+				r /= p;
+				for ( int j = k; j <= nn; ++j ) {
+					p = A( k, j ) + q * A( k + 1, j );
+					if ( k != nn - 1 ) {
+						p += r * A( k + 2, j );
+						A( k + 2, j ) -= p * z;
+					}
+					A( k + 1, j ) -= p * y;
+					A( k, j ) -= p * x;
+				}
+				int mmin = min( nn, k + 3 );
+				for ( int i = l; i <= mmin; ++i ) {
+					p = x * A( i, k ) + y * A( i, k + 1 );
+					if ( k != nn - 1 ) {
+						p += z * A( i, k + 2 );
+						A( i, k + 2 ) -= p * r;
+					}
+					A( i, k + 1 ) -= p * q;
+					A( i, k ) -= p;
+				}
+			}
+		} while ( l < nn - 1 );
+	}
+	return true;
+}
+
+#undef A
+#endif
+
 
 /**
  * This does the iteration, using the specified method.
@@ -683,13 +1119,45 @@ int iterate( const gsl_multiroot_fsolver_type* st, struct reac_info *ri,
 }
 #endif
 
+/**
+ * The stateType for nNeg negative and nPos positive eigenvalues, when
+ * rank of them are expected to be nonzero.
+ */
+static unsigned int stateTypeOf( unsigned int nNeg, unsigned int nPos,
+				unsigned int rank )
+{
+	if ( nNeg == rank ) 
+		return 0; // Stable
+	if ( nPos == rank ) // Never see it.
+		return 1; // Unstable
+	if ( nPos == 1 )
+		return 2; // Saddle
+	if ( nPos >= 2 )
+		return 3; // putative oscillatory
+	if ( nNeg == ( rank - 1 ) && nPos == 0 )
+		return 4; // one zero or unclassified eigenvalue. Messy.
+	return 5; // Other
+}
+
 void SteadyState::classifyState( const double* T )
+{
+	Stoich* s = reinterpret_cast< Stoich* >( stoich_.eref().data() );
+	vector< double > nVec = LookupField< unsigned int, vector< double > >::get(
+		s->getKsolve(), "nVec", 0 );
+	unsigned int type = classify( pool_, nVec, eigenvalues_, 
+					nNegEigenvalues_, nPosEigenvalues_ );
+	if ( type == ~0U )
+		solutionStatus_ = 2; // Steady state OK, eig failed
+	else
+		stateType_ = type;
+}
+
+unsigned int SteadyState::classify( const VoxelPools& pool, 
+		vector< double > nVec, vector< double >& eigenvalues, 
+		unsigned int& nNeg, unsigned int& nPos ) const
 {
 #ifdef USE_GSL
 	// unsigned int nConsv = numVarPools_ - rank_;
-	gsl_matrix* J = gsl_matrix_calloc ( numVarPools_, numVarPools_ );
-	// double* yprime = new double[ numVarPools_ ];
-	// vector< double > yprime( numVarPools_, 0.0 );
 	// Generate an approximation to the Jacobean by generating small
 	// increments to each of the molecules in the steady state, one 
 	// at a time, and putting the resultant rate vector into a column
@@ -699,33 +1167,28 @@ void SteadyState::classifyState( const double* T )
 	// I used the totals from consv rules earlier, but that can have 
 	// negative values.
 	double tot = 0.0;
-	Stoich* s = reinterpret_cast< Stoich* >( stoich_.eref().data() );
-	vector< double > nVec = LookupField< unsigned int, vector< double > >::get(
-		s->getKsolve(), "nVec", 0 );
 	for ( unsigned int i = 0; i < numVarPools_; ++i ) {
 		tot += nVec[i];
 	}
 	tot *= DELTA;
+	if ( isNaN( tot ) ) {
+		cout << "Warning: SteadyState::classifyState: tot=nan\n";
+		return ~0U;
+	}
 	
+	gsl_matrix* J = gsl_matrix_calloc ( numVarPools_, numVarPools_ );
 	vector< double > yprime( nVec.size(), 0.0 );
 	// Fill up Jacobian
 	for ( unsigned int i = 0; i < numVarPools_; ++i ) {
 		double orig = nVec[i];
 		if ( isNaN( orig ) ) {
 			cout << "Warning: SteadyState::classifyState: orig=nan\n";
-			solutionStatus_ = 2; // Steady state OK, eig failed
-			gsl_matrix_free ( J );
-			return;
-		}
-		if ( isNaN( tot ) ) {
-			cout << "Warning: SteadyState::classifyState: tot=nan\n";
-			solutionStatus_ = 2; // Steady state OK, eig failed
 			gsl_matrix_free ( J );
-			return;
+			return ~0U;
 		}
 		nVec[i] = orig + tot;
 
-		pool_.updateRates( &nVec[0], &yprime[0] );
+		pool.updateRates( &nVec[0], &yprime[0] );
 		nVec[i] = orig;
 
 		// Assign the rates for each mol.
@@ -739,45 +1202,90 @@ void SteadyState::classifyState( const double* T )
 	gsl_eigen_nonsymm_workspace* workspace =
 		gsl_eigen_nonsymm_alloc( numVarPools_ );
 	int status = gsl_eigen_nonsymm( J, vec, workspace );
-	eigenvalues_.clear();
-	eigenvalues_.resize( numVarPools_, 0.0 );
+	eigenvalues.clear();
+	eigenvalues.resize( numVarPools_, 0.0 );
+	unsigned int stateType = ~0U;
 	if ( status != GSL_SUCCESS ) {
 		cout << "Warning: SteadyState::classifyState failed to find eigenvalues. Status = " <<
 			status << endl;
-		solutionStatus_ = 2; // Steady state OK, eig classification failed
 	} else { // Eigenvalues are ready. Classify state.
-		nNegEigenvalues_ = 0;
-		nPosEigenvalues_ = 0;
+		nNeg = 0;
+		nPos = 0;
 		for ( unsigned int i = 0; i < numVarPools_; ++i ) {
 			gsl_complex z = gsl_vector_complex_get( vec, i );
 			double r = GSL_REAL( z );
-			nNegEigenvalues_ += ( r < -EPSILON );
-			nPosEigenvalues_ += ( r > EPSILON );
-			eigenvalues_[i] = r;
+			nNeg += ( r < -EPSILON );
+			nPos += ( r > EPSILON );
+			eigenvalues[i] = r;
 			// We have a problem here because numVarPools_ usually > rank
 			// This means we have several zero eigenvalues.
 		}
 
-		if ( nNegEigenvalues_ == rank_ ) 
-			stateType_ = 0; // Stable
-		else if ( nPosEigenvalues_ == rank_ ) // Never see it.
-			stateType_ = 1; // Unstable
-		else  if (nPosEigenvalues_ == 1)
-			stateType_ = 2; // Saddle
-		else if ( nPosEigenvalues_ >= 2 )
-			stateType_ = 3; // putative oscillatory
-		else if ( nNegEigenvalues_ == ( rank_ - 1) && nPosEigenvalues_ == 0 )
-			stateType_ = 4; // one zero or unclassified eigenvalue. Messy.
-		else
-			stateType_ = 5; // Other
+		stateType = stateTypeOf( nNeg, nPos, rank_ );
 	}
 
 	gsl_vector_complex_free( vec );
 	gsl_matrix_free ( J );
 	gsl_eigen_nonsymm_free( workspace );
+	return stateType;
+#else
+	// No GSL: the Jacobian comes from the analytic rate derivatives on
+	// the sparse stoichiometry, and the eigenvalues from realEigenvalues.
+	for ( unsigned int i = 0; i < numVarPools_; ++i ) {
+		if ( isNaN( nVec[i] ) ) {
+			cout << "Warning: SteadyState::classifyState: orig=nan\n";
+			return ~0U;
+		}
+	}
+	vector< double > J;
+	jacobian( pool, nVec, J );
+	if ( !realEigenvalues( J, numVarPools_, eigenvalues ) ) {
+		cout << "Warning: SteadyState::classifyState failed to find "
+				"eigenvalues: QR iteration did not converge\n";
+		eigenvalues.assign( numVarPools_, 0.0 );
+		return ~0U;
+	}
+	nNeg = 0;
+	nPos = 0;
+	for ( unsigned int i = 0; i < numVarPools_; ++i ) {
+		nNeg += ( eigenvalues[i] < -EPSILON );
+		nPos += ( eigenvalues[i] > EPSILON );
+	}
+	return stateTypeOf( nNeg, nPos, rank_ );
 #endif
 }
 
+void SteadyState::jacobian( const VoxelPools& pool, 
+		const vector< double >& n, vector< double >& J ) const
+{
+	Stoich* s = reinterpret_cast< Stoich* >( stoich_.eref().data() );
+	const KinSparseMatrix& N = s->getStoichiometryMatrix();
+	const vector< RateTerm* >& rates = pool.getRateTerms();
+	vector< pair< unsigned int, double > > deriv;
+	vector< unsigned int > derivStart( rates.size() + 1, 0 );
+	for ( unsigned int r = 0; r < rates.size(); ++r ) {
+		derivStart[r] = deriv.size();
+		rates[r]->rateDerivatives( &n[0], deriv );
+	}
+	derivStart[ rates.size() ] = deriv.size();
+
+	J.assign( numVarPools_ * numVarPools_, 0.0 );
+	for ( unsigned int i = 0; i < numVarPools_; ++i ) {
+		const int* entry = 0;
+		const unsigned int* colIndex = 0;
+		unsigned int numEntries = N.getRow( i, &entry, &colIndex );
+		double* row = &J[ i * numVarPools_ ];
+		for ( unsigned int e = 0; e < numEntries; ++e ) {
+			unsigned int r = colIndex[e];
+			for ( unsigned int q = derivStart[r]; q < derivStart[r+1]; ++q ){
+				unsigned int j = deriv[q].first;
+				if ( j < numVarPools_ ) // Skip buffered.
+					row[j] += entry[e] * deriv[q].second;
+			}
+		}
+	}
+}
+
 static bool isSolutionPositive( const vector< double >& x )
 {
 	for ( vector< double >::const_iterator 
@@ -796,13 +1304,17 @@ static bool isSolutionPositive( const vector< double >& x )
  */
 void SteadyState::settle( bool forceSetup )
 {
-#ifdef USE_GSL
-	gsl_set_error_handler_off();
-	
 	if ( !isInitialized_ ) {
 		cout << "Error: SteadyState object has not been initialized. No calculations done\n";
 		return;
 	}
+	if ( method_ == "sparse" ) {
+		settleSparse( forceSetup );
+		return;
+	}
+#ifdef USE_GSL
+	gsl_set_error_handler_off();
+	
 	if ( forceSetup || isSetup_ == 0 ) {
 		setupSSmatrix();
 	}
@@ -870,6 +1382,555 @@ void SteadyState::settle( bool forceSetup )
 #endif
 }
 
+///////////////////////////////////////////////////
+// The sparse path. Nothing here is dense in the number of pools or
+// reactions, and none of it needs GSL.
+///////////////////////////////////////////////////
+
+void SteadyState::setupSparseMatrix()
+{
+	isSetup_ = 0;
+	indepPools_.clear();
+	sparseGamma_.clear();
+	rank_ = 0;
+	if ( numVarPools_ == 0 || nReacs_ == 0 )
+		return;
+	Stoich* s = reinterpret_cast< Stoich* >( stoich_.eref().data() );
+	const KinSparseMatrix& N = s->getStoichiometryMatrix();
+
+	// Rows that reduce to nothing in N give a conservation law, in
+	// the columns past nReacs_.
+	SparseGauss g;
+	g.reset( nReacs_ + numVarPools_, nReacs_, EPSILON );
+	for ( unsigned int i = 0; i < numVarPools_; ++i ) {
+		const int* entry = 0;
+		const unsigned int* colIndex = 0;
+		unsigned int numEntries = N.getRow( i, &entry, &colIndex );
+		vector< pair< unsigned int, double > > row;
+		for ( unsigned int j = 0; j < numEntries; ++j )
+			row.push_back( pair< unsigned int, double >( 
+									colIndex[j], entry[j] ) );
+		row.push_back( pair< unsigned int, double >( nReacs_ + i, 1.0 ) );
+		if ( g.addRow( row ) ) {
+			indepPools_.push_back( i );
+		} else {
+			for ( unsigned int j = 0; j < row.size(); ++j )
+				row[j].first -= nReacs_;
+			sparseGamma_.push_back( row );
+		}
+	}
+	rank_ = indepPools_.size();
+
+	Id ksolve = Field< Id >::get( stoich_, "ksolve" );
+	vector< double > nVec = 
+			LookupField< unsigned int, vector< double > >::get(
+			ksolve,"nVec", 0 );
+	if ( nVec.size() < numVarPools_ ) {
+		cout << "Error: SteadyState::setupSparseMatrix(): unable to get"
+				"pool numbers from ksolve.\n";
+		return;
+	}
+	total_.assign( sparseGamma_.size(), 0.0 );
+	for ( unsigned int i = 0; i < sparseGamma_.size(); ++i )
+		for ( unsigned int j = 0; j < sparseGamma_[i].size(); ++j )
+			total_[i] += sparseGamma_[i][j].second * 
+					nVec[ sparseGamma_[i][j].first ];
+	isSetup_ = 1;
+}
+
+double SteadyState::sparseResidual( const VoxelPools& pool,
+		const vector< double >& total, const vector< double >& n,
+		vector< double >& f ) const
+{
+	Stoich* s = reinterpret_cast< Stoich* >( stoich_.eref().data() );
+	const KinSparseMatrix& N = s->getStoichiometryMatrix();
+	vector< double > v;
+	pool.updateReacVelocities( &n[0], v );
+	f.resize( numVarPools_ );
+	double sum = 0.0;
+	for ( unsigned int k = 0; k < indepPools_.size(); ++k ) {
+		f[k] = N.computeRowRate( indepPools_[k], v );
+		sum += fabs( f[k] );
+	}
+	for ( unsigned int k = 0; k < sparseGamma_.size(); ++k ) {
+		double t = -total[k];
+		for ( unsigned int j = 0; j < sparseGamma_[k].size(); ++j )
+			t += sparseGamma_[k][j].second * n[ sparseGamma_[k][j].first ];
+		f[ rank_ + k ] = t;
+		sum += fabs( t );
+	}
+	return sum;
+}
+
+bool SteadyState::sparseFactor( const VoxelPools& pool, 
+		const vector< double >& n, double sigma, SparseGauss& lu ) const
+{
+	Stoich* s = reinterpret_cast< Stoich* >( stoich_.eref().data() );
+	const KinSparseMatrix& N = s->getStoichiometryMatrix();
+	const vector< RateTerm* >& rates = pool.getRateTerms();
+	vector< pair< unsigned int, double > > deriv;
+	vector< unsigned int > derivStart( rates.size() + 1, 0 );
+	for ( unsigned int r = 0; r < rates.size(); ++r ) {
+		derivStart[r] = deriv.size();
+		rates[r]->rateDerivatives( &n[0], deriv );
+	}
+	derivStart[ rates.size() ] = deriv.size();
+
+	lu.reset( numVarPools_, numVarPools_, 0.0 );
+	vector< double > acc( numVarPools_, 0.0 );
+	vector< bool > used( numVarPools_, false );
+	vector< unsigned int > cols;
+	vector< pair< unsigned int, double > > row;
+	// Rate rows: sigma I - J, where J = N dv/dn.
+	for ( unsigned int k = 0; k < indepPools_.size(); ++k ) {
+		unsigned int i = indepPools_[k];
+		const int* entry = 0;
+		const unsigned int* colIndex = 0;
+		unsigned int numEntries = N.getRow( i, &entry, &colIndex );
+		cols.clear();
+		for ( unsigned int e = 0; e < numEntries; ++e ) {
+			unsigned int r = colIndex[e];
+			for ( unsigned int q = derivStart[r]; q < derivStart[r+1]; ++q ){
+				unsigned int j = deriv[q].first;
+				if ( j >= numVarPools_ ) // Buffered.
+					continue;
+				if ( !used[j] ) {
+					used[j] = true;
+					cols.push_back( j );
+				}
+				acc[j] -= entry[e] * deriv[q].second;
+			}
+		}
+		row.clear();
+		if ( sigma != 0.0 )
+			row.push_back( pair< unsigned int, double >( i, sigma ) );
+		for ( unsigned int c = 0; c < cols.size(); ++c ) {
+			row.push_back( pair< unsigned int, double >( 
+									cols[c], acc[ cols[c] ] ) );
+			acc[ cols[c] ] = 0.0;
+			used[ cols[c] ] = false;
+		}
+		if ( !lu.addRow( row ) )
+			return false;
+	}
+	// Conservation rows: gamma.
+	for ( unsigned int k = 0; k < sparseGamma_.size(); ++k ) {
+		row = sparseGamma_[k];
+		if ( !lu.addRow( row ) )
+			return false;
+	}
+	return true;
+}
+
+bool SteadyState::iterateSparse( const VoxelPools& pool, 
+		const vector< double >& total, vector< double >& n, bool ptc,
+		unsigned int& nIter ) const
+{
+	vector< double > f;
+	vector< double > b( numVarPools_ );
+	vector< double > dx;
+	vector< double > trial;
+	SparseGauss lu;
+	double res = sparseResidual( pool, total, n, f );
+	// Pseudo time step, grown as the residual falls, in the manner of
+	// Kelley and Keyes (SIAM J Numer Anal 35:508, 1998).
+	double dt = 1e-3;
+	unsigned int limit = ptc ? 10 * maxIter_ : maxIter_;
+	for ( nIter = 0; nIter < limit && res >= convergenceCriterion_; 
+					++nIter ) {
+		if ( isNaN( res ) || isInfinity( res ) )
+			return false;
+		if ( !sparseFactor( pool, n, ptc ? 1.0 / dt : 0.0, lu ) ) {
+			if ( !ptc )
+				return false;
+			dt *= 0.1;
+			continue;
+		}
+		for ( unsigned int k = 0; k < numVarPools_; ++k )
+			b[k] = ( k < rank_ ) ? f[k] : -f[k];
+		lu.solve( b, dx );
+
+		// Newton halves the step until the residual falls. Either
+		// way, pools do not go below zero.
+		double lambda = 1.0;
+		double newRes = res;
+		while ( true ) {
+			trial = n;
+			for ( unsigned int i = 0; i < numVarPools_; ++i ) {
+				trial[i] = n[i] + lambda * dx[i];
+				if ( trial[i] < 0.0 )
+					trial[i] = 0.0;
+			}
+			newRes = sparseResidual( pool, total, trial, f );
+			if ( ptc || newRes < res || lambda < 1e-4 )
+				break;
+			lambda *= 0.5;
+		}
+		if ( !ptc && !( newRes < res ) )
+			return false;
+		if ( ptc && newRes > 0.0 ) {
+			// Always grow it a bit, or it stalls where the residual
+			// does not fall, as past the end of a branch of solutions.
+			double grow = res / newRes;
+			dt *= ( grow > 1.5 ) ? grow : 1.5;
+			if ( dt > 1e12 )
+				dt = 1e12;
+		}
+		n.swap( trial );
+		res = newRes;
+	}
+	return res < convergenceCriterion_;
+}
+
+bool SteadyState::solveSparse( const VoxelPools& pool, 
+		const vector< double >& total, vector< double >& n, bool ptc,
+		unsigned int& nIter, string& status ) const
+{
+	vector< double > start = n;
+	status = "success";
+	if ( iterateSparse( pool, total, n, false, nIter ) )
+		return true;
+	if ( ptc ) {
+		n = start;
+		status = "success by pseudo-transient continuation";
+		if ( iterateSparse( pool, total, n, true, nIter ) )
+			return true;
+	}
+	n = start;
+	status = "failed to converge";
+	return false;
+}
+
+void SteadyState::settleSparse( bool forceSetup )
+{
+	if ( forceSetup || isSetup_ == 0 )
+		setupSparseMatrix();
+	if ( isSetup_ == 0 )
+		return;
+
+	Id ksolve = Field< Id >::get( stoich_, "ksolve" );
+	vector< double > nVec = 
+			LookupField< unsigned int, vector< double > >::get(
+			ksolve,"nVec", 0 );
+	if ( reassignTotal_ ) { // The user has defined new conservation values.
+		reassignTotal_ = 0;
+	} else {
+		for ( unsigned int i = 0; i < sparseGamma_.size(); ++i ) {
+			total_[i] = 0.0;
+			for ( unsigned int j = 0; j < sparseGamma_[i].size(); ++j )
+				total_[i] += sparseGamma_[i][j].second * 
+						nVec[ sparseGamma_[i][j].first ];
+		}
+	}
+
+	vector< double > repair = nVec;
+	bool ok = solveSparse( pool_, total_, nVec, true, nIter_, status_ );
+	if ( ok ) {
+		solutionStatus_ = 0; // Good solution
+		LookupField< unsigned int, vector< double > >::set(
+			ksolve,"nVec", 0, nVec );
+		classifyState( total_.empty() ? 0 : &total_[0] );
+	} else {
+		cout << "Warning: SteadyState iteration failed, status = " <<
+			status_ << ", nIter = " << nIter_ << endl;
+		solutionStatus_ = 1; // Steady state failed.
+		LookupField< unsigned int, vector< double > >::set(
+			ksolve,"nVec", 0, repair );
+	}
+}
+
+///////////////////////////////////////////////////
+// Batches of steady states, on the sparse path.
+///////////////////////////////////////////////////
+
+bool SteadyState::startBatch( const char* func )
+{
+	if ( !isInitialized_ ) {
+		cout << "Error: SteadyState::" << func << 
+				": not initialized. No calculations done\n";
+		return false;
+	}
+	if ( method_ != "sparse" ) {
+		cout << "Warning: SteadyState::" << func << 
+				": needs the sparse method\n";
+		return false;
+	}
+	if ( isSetup_ == 0 )
+		setupSparseMatrix();
+	return isSetup_ != 0;
+}
+
+bool SteadyState::checkGrid( const char* func ) const
+{
+	unsigned int width = scanTotals_.size() + scanParams_.size();
+	if ( width == 0 || scanGrid_.size() == 0 || 
+					scanGrid_.size() % width != 0 ) {
+		cout << "Warning: SteadyState::" << func << ": scanGrid size " <<
+			scanGrid_.size() << " is not a multiple of " << width << endl;
+		return false;
+	}
+	for ( unsigned int i = 0; i < scanTotals_.size(); ++i ) {
+		if ( scanTotals_[i] >= total_.size() ) {
+			cout << "Warning: SteadyState::" << func << ": total " <<
+				scanTotals_[i] << " out of range " << total_.size() << endl;
+			return false;
+		}
+	}
+	for ( unsigned int i = 0; i < scanParams_.size(); ++i ) {
+		if ( scanParams_[i] >= 2 * nReacs_ ) {
+			cout << "Warning: SteadyState::" << func << ": param " <<
+				scanParams_[i] << " out of range " << 2 * nReacs_ << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+vector< double > SteadyState::baseParams() const
+{
+	Stoich* s = reinterpret_cast< Stoich* >( stoich_.eref().data() );
+	Id ksolve = s->getKsolve();
+	if ( ksolve.element()->cinfo()->isA( "Ksolve" ) ) {
+		vector< double > p = 
+			Field< vector< double > >::get( ksolve, "ensembleParams" );
+		if ( p.size() >= 2 * nReacs_ )
+			return vector< double >( p.begin(), p.begin() + 2 * nReacs_ );
+	}
+	return pool_.getRateParams( s->getRateTerms() );
+}
+
+vector< double > SteadyState::totalsOf( const vector< double >& n ) const
+{
+	vector< double > ret( sparseGamma_.size(), 0.0 );
+	for ( unsigned int i = 0; i < sparseGamma_.size(); ++i )
+		for ( unsigned int j = 0; j < sparseGamma_[i].size(); ++j )
+			ret[i] += sparseGamma_[i][j].second * 
+					n[ sparseGamma_[i][j].first ];
+	return ret;
+}
+
+void SteadyState::gridPoint( const vector< double >& from, unsigned int i,
+		double frac, vector< double >& total, vector< double >& params )
+		const
+{
+	unsigned int width = scanTotals_.size() + scanParams_.size();
+	const double* row = &scanGrid_[ i * width ];
+	for ( unsigned int j = 0; j < width; ++j ) {
+		double x = from[j] + frac * ( row[j] - from[j] );
+		if ( j < scanTotals_.size() )
+			total[ scanTotals_[j] ] = x;
+		else
+			params[ scanParams_[ j - scanTotals_.size() ] ] = x;
+	}
+}
+
+void SteadyState::setupPool( VoxelPools& pool, double vol, 
+				const vector< double >& params ) const
+{
+	Stoich* s = reinterpret_cast< Stoich* >( stoich_.eref().data() );
+	pool.setVolume( vol );
+	pool.setStoich( s, 0 );
+	pool.setRateParams( s->getRateTerms(), s->getNumCoreRates(), params );
+}
+
+void SteadyState::settleRange( unsigned int begin, unsigned int end )
+{
+	unsigned int stride = scanN_.size() / scanStatus_.size();
+	for ( unsigned int i = begin; i < end; ++i ) {
+		vector< double > n( scanN_.begin() + i * stride, 
+						scanN_.begin() + ( i + 1 ) * stride );
+		unsigned int nIter = 0;
+		string status;
+		if ( !solveSparse( batchPools_[i], batchTotal_[i], n, true,
+								nIter, status ) ) {
+			scanStatus_[i] = 1;
+			continue;
+		}
+		copy( n.begin(), n.end(), scanN_.begin() + i * stride );
+		vector< double > eig;
+		unsigned int nNeg = 0;
+		unsigned int nPos = 0;
+		unsigned int type = classify( batchPools_[i], n, eig, nNeg, nPos );
+		scanStatus_[i] = ( type == ~0U ) ? 2 : 0;
+		if ( type != ~0U )
+			scanStateType_[i] = type;
+	}
+}
+
+void SteadyState::settleBatch()
+{
+	unsigned int num = scanStatus_.size();
+	unsigned int numThreads = ( numThreads_ < num ) ? numThreads_ : num;
+	if ( numThreads <= 1 ) {
+		settleRange( 0, num );
+	} else {
+		// As in Ksolve::process, the calling thread does the last chunk.
+		unsigned int chunk = ( num + numThreads - 1 ) / numThreads;
+		unsigned int numChunks = ( num + chunk - 1 ) / chunk;
+		workers_.run( numChunks, [=]( unsigned int i ) {
+			unsigned int end = ( i + 1 ) * chunk;
+			settleRange( i * chunk, end < num ? end : num );
+		} );
+	}
+	batchPools_.clear();
+	batchTotal_.clear();
+}
+
+void SteadyState::settleAll()
+{
+	if ( !startBatch( "settleAll" ) )
+		return;
+	Stoich* s = reinterpret_cast< Stoich* >( stoich_.eref().data() );
+	Id ksolve = s->getKsolve();
+	ZombiePoolInterface* zpi = 
+			reinterpret_cast< ZombiePoolInterface* >( ksolve.eref().data() );
+	unsigned int num = zpi->getNumLocalVoxels();
+	vector< double > params;
+	if ( ksolve.element()->cinfo()->isA( "Ksolve" ) )
+		params = Field< vector< double > >::get( ksolve, "ensembleParams" );
+	unsigned int numParams = 2 * nReacs_;
+
+	scanN_.clear();
+	scanStatus_.assign( num, 1 );
+	scanStateType_.assign( num, 5 );
+	batchPools_.clear();
+	batchPools_.resize( num );
+	batchTotal_.resize( num );
+	for ( unsigned int i = 0; i < num; ++i ) {
+		vector< double > n = LookupField< unsigned int, vector< double > >::
+				get( ksolve, "nVec", i );
+		scanN_.insert( scanN_.end(), n.begin(), n.end() );
+		batchTotal_[i] = totalsOf( n );
+		vector< double > p;
+		if ( params.size() >= ( i + 1 ) * numParams )
+			p.assign( params.begin() + i * numParams, 
+					params.begin() + ( i + 1 ) * numParams );
+		setupPool( batchPools_[i], zpi->volume( i ), p );
+	}
+	settleBatch();
+
+	unsigned int stride = scanN_.size() / num;
+	for ( unsigned int i = 0; i < num; ++i ) {
+		if ( scanStatus_[i] == 1 )
+			continue;
+		vector< double > n( scanN_.begin() + i * stride,
+						scanN_.begin() + ( i + 1 ) * stride );
+		LookupField< unsigned int, vector< double > >::set( 
+						ksolve, "nVec", i, n );
+	}
+}
+
+void SteadyState::scan()
+{
+	if ( !startBatch( "scan" ) || !checkGrid( "scan" ) )
+		return;
+	Id ksolve = Field< Id >::get( stoich_, "ksolve" );
+	vector< double > n0 = LookupField< unsigned int, vector< double > >::
+			get( ksolve, "nVec", 0 );
+	vector< double > total0 = reassignTotal_ ? total_ : totalsOf( n0 );
+	vector< double > params0 = baseParams();
+	unsigned int width = scanTotals_.size() + scanParams_.size();
+	unsigned int num = scanGrid_.size() / width;
+
+	scanN_.clear();
+	scanStatus_.assign( num, 1 );
+	scanStateType_.assign( num, 5 );
+	batchPools_.clear();
+	batchPools_.resize( num );
+	batchTotal_.assign( num, total0 );
+	for ( unsigned int i = 0; i < num; ++i ) {
+		scanN_.insert( scanN_.end(), n0.begin(), n0.end() );
+		vector< double > params = params0;
+		gridPoint( vector< double >( width, 0.0 ), i, 1.0, 
+						batchTotal_[i], params );
+		setupPool( batchPools_[i], pool_.getVolume(), params );
+	}
+	settleBatch();
+}
+
+void SteadyState::continuation()
+{
+	if ( !startBatch( "continuation" ) || !checkGrid( "continuation" ) )
+		return;
+	Id ksolve = Field< Id >::get( stoich_, "ksolve" );
+	vector< double > n = LookupField< unsigned int, vector< double > >::
+			get( ksolve, "nVec", 0 );
+	vector< double > total0 = reassignTotal_ ? total_ : totalsOf( n );
+	vector< double > params0 = baseParams();
+	unsigned int width = scanTotals_.size() + scanParams_.size();
+	unsigned int num = scanGrid_.size() / width;
+
+	scanN_.clear();
+	scanStatus_.assign( num, 1 );
+	scanStateType_.assign( num, 5 );
+
+	// The values at the last point solved, starting from voxel 0.
+	vector< double > from( width );
+	for ( unsigned int j = 0; j < width; ++j )
+		from[j] = ( j < scanTotals_.size() ) ? total0[ scanTotals_[j] ] :
+				params0[ scanParams_[ j - scanTotals_.size() ] ];
+
+	VoxelPools pool;
+	setupPool( pool, pool_.getVolume(), params0 );
+	unsigned int nIter = 0;
+	string status;
+	if ( !solveSparse( pool, total0, n, true, nIter, status ) ) {
+		cout << "Warning: SteadyState::continuation: could not settle "
+				"the starting point\n";
+		scanN_.assign( num * n.size(), 0.0 );
+		return;
+	}
+
+	vector< double > total = total0;
+	vector< double > params = params0;
+	for ( unsigned int i = 0; i < num; ++i ) {
+		// Go toward point i in steps, halving them on failure and
+		// doubling them on success.
+		double done = 0.0;
+		double step = 1.0;
+		while ( done < 1.0 && step >= 1.0 / 64.0 ) {
+			double frac = ( done + step < 1.0 ) ? done + step : 1.0;
+			gridPoint( from, i, frac, total, params );
+			setupPool( pool, pool_.getVolume(), params );
+			vector< double > trial = n;
+			if ( iterateSparse( pool, total, trial, false, nIter ) ) {
+				n.swap( trial );
+				done = frac;
+				step = ( step < 0.5 ) ? step * 2.0 : 1.0;
+			} else {
+				step *= 0.5;
+			}
+		}
+		if ( done < 1.0 ) {
+			// Past the end of the branch. Follow the time course at the
+			// point to the branch that the system would go to.
+			gridPoint( from, i, 1.0, total, params );
+			setupPool( pool, pool_.getVolume(), params );
+			vector< double > trial = n;
+			if ( iterateSparse( pool, total, trial, true, nIter ) ) {
+				n.swap( trial );
+				done = 1.0;
+			}
+		}
+		scanN_.insert( scanN_.end(), n.begin(), n.end() );
+		if ( done < 1.0 ) {
+			// Stay where we got to, for the next point.
+			for ( unsigned int j = 0; j < width; ++j )
+				from[j] += done * ( scanGrid_[ i * width + j ] - from[j] );
+			continue;
+		}
+		from.assign( scanGrid_.begin() + i * width, 
+						scanGrid_.begin() + ( i + 1 ) * width );
+		vector< double > eig;
+		unsigned int nNeg = 0;
+		unsigned int nPos = 0;
+		unsigned int type = classify( pool, n, eig, nNeg, nPos );
+		scanStatus_[i] = ( type == ~0U ) ? 2 : 0;
+		if ( type != ~0U )
+			scanStateType_[i] = type;
+	}
+}
+
 // Long section here of functions using GSL
 #ifdef USE_GSL
 int ss_func( const gsl_vector* x, void* params, gsl_vector* f )
@@ -1029,6 +2090,11 @@ static bool checkAboveZero( const vector< double >& y )
  */
 void SteadyState::randomizeInitialCondition( const Eref& me )
 {
+	if ( method_ == "sparse" ) {
+		cout << "Warning: SteadyState::randomizeInitialCondition: "
+				"needs the dense method\n";
+		return;
+	}
 #ifdef USE_GSL
 	Id ksolve = Field< Id >::get( stoich_, "ksolve" );
 	vector< double > nVec = 
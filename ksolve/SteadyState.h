@@ -34,6 +34,8 @@ class SteadyState
 		string getStatus() const;
 		double getConvergenceCriterion() const;
 		void setConvergenceCriterion( double value );
+		string getMethod() const;
+		void setMethod( string method );
 		double getTotal( const unsigned int i ) const;
 		void setTotal( const unsigned int i, double val );
 		double getEigenvalue( const unsigned int i ) const;
@@ -42,6 +44,17 @@ class SteadyState
 		unsigned int getNnegEigenvalues() const;
 		unsigned int getNposEigenvalues() const;
 		unsigned int getSolutionStatus() const;
+		unsigned int getNumThreads() const;
+		void setNumThreads( unsigned int num );
+		vector< unsigned int > getScanTotals() const;
+		void setScanTotals( vector< unsigned int > v );
+		vector< unsigned int > getScanParams() const;
+		void setScanParams( vector< unsigned int > v );
+		vector< double > getScanGrid() const;
+		void setScanGrid( vector< double > v );
+		vector< double > getScanN() const;
+		vector< unsigned int > getScanStatus() const;
+		vector< unsigned int > getScanStateType() const;
 
 		///////////////////////////////////////////////////
 		// Msg Dest function definitions
@@ -53,6 +66,18 @@ class SteadyState
 		void showMatricesFunc();
 		void showMatrices();
 		void randomizeInitialCondition( const Eref& e);
+
+		/// Settles every voxel of the ksolve, in parallel.
+		void settleAll();
+
+		/// Settles every point of scanGrid independently, in parallel.
+		void scan();
+
+		/**
+		 * Goes through the points of scanGrid in turn, each starting
+		 * from the solution at the one before.
+		 */
+		void continuation();
 		static void assignY( double* S );
 		// static void randomInitFunc();
 		// void randomInit();
@@ -87,6 +112,106 @@ class SteadyState
 
 	private:
 		void setupSSmatrix();
+
+		///////////////////////////////////////////////////
+		// The sparse path.
+		///////////////////////////////////////////////////
+		/**
+		 * Finds the conservation laws by sparse elimination on the
+		 * rows of the stoichiometry matrix, as [N I].
+		 */
+		void setupSparseMatrix();
+
+		/// Settles using the sparse path.
+		void settleSparse( bool forceSetup );
+
+		/*
+		 * The functions below work on the rates of the given pool and
+		 * the given totals, and change nothing else, so that many
+		 * steady states can be found at once on different threads.
+		 */
+
+		/**
+		 * Fills in f, the rates of the independent pools followed by
+		 * gamma.n - total. Returns the sum of |f|.
+		 */
+		double sparseResidual( const VoxelPools& pool,
+				const vector< double >& total, const vector< double >& n,
+				vector< double >& f ) const;
+
+		/**
+		 * Factors the matrix of the Newton step, with sigma added to
+		 * the diagonal of the rate rows for pseudo-transient 
+		 * continuation. Returns false if it is singular.
+		 */
+		bool sparseFactor( const VoxelPools& pool, 
+				const vector< double >& n, double sigma, 
+				SparseGauss& lu ) const;
+
+		/**
+		 * Iterates to the steady state from n. Plain damped Newton if
+		 * ptc is false, otherwise pseudo-transient continuation.
+		 * Returns true on convergence.
+		 */
+		bool iterateSparse( const VoxelPools& pool, 
+				const vector< double >& total, vector< double >& n, 
+				bool ptc, unsigned int& nIter ) const;
+
+		/**
+		 * Newton from n, then pseudo-transient continuation if that 
+		 * fails and ptc is true. Leaves n as it was on failure.
+		 */
+		bool solveSparse( const VoxelPools& pool, 
+				const vector< double >& total, vector< double >& n, 
+				bool ptc, unsigned int& nIter, string& status ) const;
+
+		///////////////////////////////////////////////////
+		// Batches of steady states.
+		///////////////////////////////////////////////////
+		/// Checks the batch can be done, and sets up the sparse path.
+		bool startBatch( const char* func );
+
+		/// Checks scanTotals, scanParams and scanGrid against each other.
+		bool checkGrid( const char* func ) const;
+
+		/// Rate parameters of voxel 0, numbered as Ksolve ensembleParams.
+		vector< double > baseParams() const;
+
+		/// Totals of the conservation laws for n.
+		vector< double > totalsOf( const vector< double >& n ) const;
+
+		/**
+		 * Puts the values of grid row i, or a point a fraction frac of
+		 * the way to it from the row 'from', into total and params.
+		 */
+		void gridPoint( const vector< double >& from, unsigned int i, 
+				double frac, vector< double >& total, 
+				vector< double >& params ) const;
+
+		/// Sets up pool with the given volume and rate parameters.
+		void setupPool( VoxelPools& pool, double vol, 
+				const vector< double >& params ) const;
+
+		/// Settles the batch points from begin to end.
+		void settleRange( unsigned int begin, unsigned int end );
+
+		/// Settles all the batch points, on numThreads_ threads.
+		void settleBatch();
+
+		/**
+		 * Finds the eigenvalues of the Jacobian of pool at nVec, and
+		 * returns the stateType. Returns ~0U if they could not be found.
+		 */
+		unsigned int classify( const VoxelPools& pool, 
+				vector< double > nVec, vector< double >& eigenvalues,
+				unsigned int& nNeg, unsigned int& nPos ) const;
+
+		/**
+		 * Fills J with the Jacobian N dv/dn of pool at n, over the
+		 * variable pools. It is dense and row-major.
+		 */
+		void jacobian( const VoxelPools& pool, const vector< double >& n,
+				vector< double >& J ) const;
 		
 		///////////////////////////////////////////////////
 		// Internal fields.
@@ -99,6 +224,9 @@ class SteadyState
 		bool isSetup_;
 		double convergenceCriterion_;
 
+		/// "dense" for the GSL root finders, "sparse" otherwise.
+		string method_;
+
 #ifdef USE_GSL
 		gsl_matrix* LU_;
 		gsl_matrix* Nr_;
@@ -109,6 +237,13 @@ class SteadyState
 		unsigned int nReacs_;
 		unsigned int rank_;
 
+		/**
+		 * Sparse path: the pools whose rate equations are independent,
+		 * and the conservation laws, one sparse row each.
+		 */
+		vector< unsigned int > indepPools_;
+		vector< vector< pair< unsigned int, double > > > sparseGamma_;
+
 		vector< double > total_;
 		bool reassignTotal_;
 		unsigned int nNegEigenvalues_;
@@ -118,6 +253,32 @@ class SteadyState
 		unsigned int solutionStatus_;
 		unsigned int numFailed_;
 		VoxelPools pool_;
+
+		/// Number of threads for settleAll and scan.
+		unsigned int numThreads_;
+
+		/// Threads that settle the batch, kept between batches.
+		WorkerPool workers_;
+
+		/**
+		 * Which totals and rate parameters each row of scanGrid_
+		 * assigns, in that order.
+		 */
+		vector< unsigned int > scanTotals_;
+		vector< unsigned int > scanParams_;
+		vector< double > scanGrid_;
+
+		/**
+		 * Results of the last batch, one row per voxel or grid point.
+		 * scanN_ is laid out as [point][pool].
+		 */
+		vector< double > scanN_;
+		vector< unsigned int > scanStatus_;
+		vector< unsigned int > scanStateType_;
+
+		/// Rates and totals of each point while a batch is done.
+		vector< VoxelPools > batchPools_;
+		vector< vector< double > > batchTotal_;
 };
 
 extern const Cinfo* initSteadyStateCinfo();
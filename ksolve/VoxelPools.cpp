@@ -6,6 +6,7 @@
 ** GNU Lesser General Public License version 2.1
 ** See the file COPYING.LIB for the full notice.
 **********************************************************************/
+#include <limits>
 #include "header.h"
 #ifdef USE_GSL
 #include <gsl/gsl_errno.h>
@@ -15,6 +16,7 @@
 
 #include "OdeSystem.h"
 #include "VoxelPoolsBase.h"
+#include "RateKernel.h"
 #include "VoxelPools.h"
 #include "RateTerm.h"
 #include "FuncTerm.h"
@@ -24,12 +26,21 @@
 #include "XferInfo.h"
 #include "ZombiePoolInterface.h"
 #include "Stoich.h"
+#include "Rkf45.h"
 
 //////////////////////////////////////////////////////////////
 // Class definitions
 //////////////////////////////////////////////////////////////
 
 VoxelPools::VoxelPools()
+	:
+		method_( "rk5" ),
+		h_( 0.01 ),
+		epsAbs_( 1e-6 ),
+		epsRel_( 1e-6 ),
+		numSteps_( 0 ),
+		numFailedSteps_( 0 ),
+		isSensSingular_( false )
 {
 #ifdef USE_GSL
 		driver_ = 0;
@@ -52,6 +63,12 @@ VoxelPools::~VoxelPools()
 void VoxelPools::reinit( double dt )
 {
 	VoxelPoolsBase::reinit();
+	buildKernel();
+	h_ = dt;
+	numSteps_ = 0;
+	numFailedSteps_ = 0;
+	sens_.assign( sensParams_.size() * dimension(), 0.0 );
+	isSensSingular_ = false;
 #ifdef USE_GSL
 	if ( !driver_ )
 		return;
@@ -63,45 +80,121 @@ void VoxelPools::reinit( double dt )
 void VoxelPools::setStoich( Stoich* s, const OdeSystem* ode )
 {
 	stoichPtr_ = s;
+	if ( ode ) {
+		method_ = ode->method;
+		h_ = ode->initStepSize;
+		epsAbs_ = ode->epsAbs;
+		epsRel_ = ode->epsRel;
+		unsigned int dim = dimension();
+		yTemp_.resize( dim );
+		for ( unsigned int i = 0; i < 6; ++i )
+			k_[i].resize( dim );
+	}
 #ifdef USE_GSL
 	if ( ode ) {
 		sys_ = ode->gslSys;
 		if ( driver_ )
 			gsl_odeiv2_driver_free( driver_ );
-		driver_ = gsl_odeiv2_driver_alloc_y_new( 
-			&sys_, ode->gslStep, ode->initStepSize, 
-			ode->epsAbs, ode->epsRel );
+		driver_ = 0;
+		if ( !isBuiltinMethod( method_ ) )
+			driver_ = gsl_odeiv2_driver_alloc_y_new( 
+				&sys_, ode->gslStep, ode->initStepSize, 
+				ode->epsAbs, ode->epsRel );
 	}
 #endif
 	VoxelPoolsBase::reinit();
 }
 
+bool VoxelPools::isBuiltinMethod( const string& method )
+{
+	return ( method == "ee" || method == "rk4fixed" || method == "rkf45" );
+}
+
 void VoxelPools::advance( const ProcInfo* p )
 {
-#ifdef USE_GSL
-	double t = p->currTime - p->dt;
-	int status = gsl_odeiv2_driver_apply( driver_, &t, p->currTime, varS());
-	if ( status != GSL_SUCCESS ) {
-		cout << "Error: VoxelPools::advance: GSL integration error at time "
-			 << t << "\n";
-		cout << "Error info: " << status << ", " << 
-				gsl_strerror( status ) << endl;
-		if ( status == GSL_EMAXITER ) 
-			cout << "Max number of steps exceeded\n";
-		else if ( status == GSL_ENOPROG ) 
-			cout << "Timestep has gotten too small\n";
-		else if ( status == GSL_EBADFUNC ) 
-			cout << "Internal error\n";
-		assert( 0 );
+	double t0 = p->currTime - p->dt;
+	if ( sensParams_.empty() ) {
+		advanceState( t0, p->currTime );
+		return;
 	}
+	// The sensitivities take one trapezoidal step per call, so break
+	// the tick up into steps of the size the integrator is using.
+	unsigned int numSub = 1;
+	double h = getStepSize();
+	if ( h > 0.0 && h < p->dt )
+		numSub = static_cast< unsigned int >( ceil( p->dt / h ) );
+	for ( unsigned int i = 0; i < numSub; ++i ) {
+		double t1 = t0 + ( p->currTime - t0 ) / ( numSub - i );
+		sensY0_.assign( S(), S() + dimension() );
+		advanceState( t0, t1 );
+		advanceSensitivity( t0, t1 );
+		t0 = t1;
+	}
+}
+
+void VoxelPools::advanceState( double t0, double t1 )
+{
+	if ( method_ == "ee" ) {
+		advanceExpEuler( t0, t1 );
+	} else if ( method_ == "rk4fixed" ) {
+		advanceRk4( t0, t1 );
+	} else if ( method_ == "rkf45" ) {
+		advanceRkf45( t0, t1 );
+	} else {
+#ifdef USE_GSL
+		double t = t0;
+		int status = gsl_odeiv2_driver_apply( driver_, &t, t1, varS() );
+		if ( status != GSL_SUCCESS ) {
+			cout << "Error: VoxelPools::advance: GSL integration error "
+				"at time " << t << "\n";
+			cout << "Error info: " << status << ", " << 
+					gsl_strerror( status ) << endl;
+			if ( status == GSL_EMAXITER ) 
+				cout << "Max number of steps exceeded\n";
+			else if ( status == GSL_ENOPROG ) 
+				cout << "Timestep has gotten too small\n";
+			else if ( status == GSL_EBADFUNC ) 
+				cout << "Internal error\n";
+			assert( 0 );
+		}
 #endif
+	}
 }
 
 void VoxelPools::setInitDt( double dt )
 {
+	h_ = dt;
 #ifdef USE_GSL
-	gsl_odeiv2_driver_reset_hstart( driver_, dt );
+	if ( driver_ )
+		gsl_odeiv2_driver_reset_hstart( driver_, dt );
+#endif
+}
+
+double VoxelPools::getStepSize() const
+{
+#ifdef USE_GSL
+	if ( driver_ )
+		return fabs( driver_->h );
+#endif
+	return isBuiltinMethod( method_ ) ? h_ : 0.0;
+}
+
+unsigned int VoxelPools::getNumSteps() const
+{
+#ifdef USE_GSL
+	if ( driver_ ) // The count includes the rejected tries.
+		return driver_->e->count - driver_->e->failed_steps;
+#endif
+	return numSteps_;
+}
+
+unsigned int VoxelPools::getNumFailedSteps() const
+{
+#ifdef USE_GSL
+	if ( driver_ )
+		return driver_->e->failed_steps;
 #endif
+	return numFailedSteps_;
 }
 
 // static func. This is the function that goes into the Gsl solver.
@@ -122,7 +215,7 @@ int VoxelPools::gslFunc( double t, const double* y, double *dydt,
 		*b++ = *sinit++;
 		*/
 
-	vp->stoichPtr_->updateFuncs( q, t );
+	vp->updateFuncs( q, t );
 	vp->updateRates( y, dydt );
 #ifdef USE_GSL
 	return GSL_SUCCESS;
@@ -130,6 +223,201 @@ int VoxelPools::gslFunc( double t, const double* y, double *dydt,
 	return 0;
 #endif
 }
+// static func. Jacobian for the implicit Gsl solvers.
+int VoxelPools::gslJacobian( double t, const double* y, double* dfdy,
+						double* dfdt, void* params )
+{
+	VoxelPools* vp = reinterpret_cast< VoxelPools* >( params );
+	double* q = const_cast< double* >( y ); // Assign the func portion.
+	vp->updateFuncs( q, t );
+	unsigned int dim = vp->stoichPtr_->getNumAllPools() + 
+			vp->stoichPtr_->getNumProxyPools();
+	vp->updateJacobian( y, dfdy, dim );
+	for ( unsigned int i = 0; i < dim; ++i )
+		dfdt[i] = 0.0;
+#ifdef USE_GSL
+	return GSL_SUCCESS;
+#else
+	return 0;
+#endif
+}
+///////////////////////////////////////////////////////////////////////
+// Built-in integrators. These work on S in place, with workspace
+// allocated in setStoich, and call the rate kernel directly.
+///////////////////////////////////////////////////////////////////////
+
+unsigned int VoxelPools::dimension() const
+{
+	return stoichPtr_->getNumAllPools() + stoichPtr_->getNumProxyPools();
+}
+
+void VoxelPools::evalRates( double t, double* y, double* dydt )
+{
+	updateFuncs( y, t );
+	kernel_.updateRates( y, dydt, dimension() );
+}
+
+unsigned int VoxelPools::numFixedSteps( double dt ) const
+{
+	if ( h_ <= 0.0 )
+		return 1;
+	// Allow for roundoff, so that dt == h_ is one step.
+	unsigned int n = ceil( dt / h_ - 1e-6 );
+	return ( n > 0 ) ? n : 1;
+}
+
+void VoxelPools::advanceExpEuler( double t0, double t1 )
+{
+	static const double EPSILON = 1e-15;
+	unsigned int dim = dimension();
+	double* y = varS();
+	double* prod = &k_[0][0];
+	double* loss = &k_[1][0];
+	unsigned int n = numFixedSteps( t1 - t0 );
+	double h = ( t1 - t0 ) / n;
+	for ( unsigned int step = 0; step < n; ++step ) {
+		updateFuncs( y, t0 + step * h );
+		kernel_.updateProdLoss( y, prod, loss, dim );
+		for ( unsigned int i = 0; i < dim; ++i ) {
+			if ( loss[i] > 0.0 && y[i] > EPSILON ) {
+				double b = loss[i] / y[i];
+				double e = exp( -b * h );
+				y[i] = y[i] * e + ( prod[i] / b ) * ( 1.0 - e );
+			} else {
+				y[i] += ( prod[i] - loss[i] ) * h;
+				if ( y[i] < 0.0 )
+					y[i] = 0.0;
+			}
+		}
+		++numSteps_;
+	}
+}
+
+void VoxelPools::advanceRk4( double t0, double t1 )
+{
+	unsigned int dim = dimension();
+	double* y = varS();
+	double* yt = &yTemp_[0];
+	double* k1 = &k_[0][0];
+	double* k2 = &k_[1][0];
+	double* k3 = &k_[2][0];
+	double* k4 = &k_[3][0];
+	unsigned int n = numFixedSteps( t1 - t0 );
+	double h = ( t1 - t0 ) / n;
+	for ( unsigned int step = 0; step < n; ++step ) {
+		double t = t0 + step * h;
+		evalRates( t, y, k1 );
+		for ( unsigned int i = 0; i < dim; ++i )
+			yt[i] = y[i] + 0.5 * h * k1[i];
+		evalRates( t + 0.5 * h, yt, k2 );
+		for ( unsigned int i = 0; i < dim; ++i )
+			yt[i] = y[i] + 0.5 * h * k2[i];
+		evalRates( t + 0.5 * h, yt, k3 );
+		for ( unsigned int i = 0; i < dim; ++i )
+			yt[i] = y[i] + h * k3[i];
+		evalRates( t + h, yt, k4 );
+		for ( unsigned int i = 0; i < dim; ++i )
+			y[i] += h * ( k1[i] + 2.0 * ( k2[i] + k3[i] ) + k4[i] ) / 6.0;
+		++numSteps_;
+	}
+	// Leave the func pools consistent with the final state.
+	updateFuncs( y, t1 );
+}
+
+double VoxelPools::rkf45Step( double t, double h )
+{
+	unsigned int dim = dimension();
+	double* y = varS();
+	double* yt = &yTemp_[0];
+	double* k1 = &k_[0][0];
+	double* k2 = &k_[1][0];
+	double* k3 = &k_[2][0];
+	double* k4 = &k_[3][0];
+	double* k5 = &k_[4][0];
+	double* k6 = &k_[5][0];
+
+	evalRates( t, y, k1 );
+	for ( unsigned int i = 0; i < dim; ++i )
+		yt[i] = y[i] + h * ah[0] * k1[i];
+	evalRates( t + ah[0] * h, yt, k2 );
+	for ( unsigned int i = 0; i < dim; ++i )
+		yt[i] = y[i] + h * ( b3[0] * k1[i] + b3[1] * k2[i] );
+	evalRates( t + ah[1] * h, yt, k3 );
+	for ( unsigned int i = 0; i < dim; ++i )
+		yt[i] = y[i] + h * ( b4[0] * k1[i] + b4[1] * k2[i] + 
+						b4[2] * k3[i] );
+	evalRates( t + ah[2] * h, yt, k4 );
+	for ( unsigned int i = 0; i < dim; ++i )
+		yt[i] = y[i] + h * ( b5[0] * k1[i] + b5[1] * k2[i] + 
+						b5[2] * k3[i] + b5[3] * k4[i] );
+	evalRates( t + ah[3] * h, yt, k5 );
+	for ( unsigned int i = 0; i < dim; ++i )
+		yt[i] = y[i] + h * ( b6[0] * k1[i] + b6[1] * k2[i] + 
+				b6[2] * k3[i] + b6[3] * k4[i] + b6[4] * k5[i] );
+	evalRates( t + ah[4] * h, yt, k6 );
+
+	double maxErr = 0.0;
+	for ( unsigned int i = 0; i < dim; ++i ) {
+		yt[i] = y[i] + h * ( c1 * k1[i] + c3 * k3[i] + c4 * k4[i] + 
+						c5 * k5[i] + c6 * k6[i] );
+		double err = h * ( ec[0] * k1[i] + ec[2] * k3[i] + ec[3] * k4[i] + 
+						ec[4] * k5[i] + ec[5] * k6[i] );
+		double scaled = fabs( err ) / ( epsAbs_ + epsRel_ * fabs( y[i] ) );
+		if ( maxErr < scaled )
+			maxErr = scaled;
+	}
+	return maxErr;
+}
+
+/**
+ * Same step control as BatchedVoxelPools::advance, but each voxel has
+ * its own h_.
+ */
+void VoxelPools::advanceRkf45( double t0, double t1 )
+{
+	unsigned int dim = dimension();
+	double* y = varS();
+	double t = t0;
+	while ( t < t1 ) {
+		double h = h_;
+		bool isLast = false;
+		if ( t + h >= t1 ) {
+			h = t1 - t;
+			isLast = true;
+		}
+		double err = rkf45Step( t, h );
+		if ( err > 1.1 ) {
+			// Reject the step and shrink it.
+			++numFailedSteps_;
+			double r = RKF_SAFETY / pow( err, 1.0 / RKF_ORDER );
+			h_ = h * ( r > 0.2 ? r : 0.2 );
+			if ( h_ < 1e-12 * ( t1 - t0 ) ) {
+				cout << "Error: VoxelPools::advanceRkf45: " <<
+					"Timestep has gotten too small at time " << t << endl;
+				break;
+			}
+			continue;
+		}
+		for ( unsigned int i = 0; i < dim; ++i )
+			y[i] = yTemp_[i];
+		t = isLast ? t1 : t + h;
+		++numSteps_;
+		if ( err < 0.5 ) {
+			double r = RKF_SAFETY / pow( err, 1.0 / ( RKF_ORDER + 1.0 ) );
+			if ( r > 5.0 ) 
+				r = 5.0;
+			// A last step is cut short to end on the tick, so it may
+			// only grow the step. This lets quiet voxels take steps
+			// longer than a tick, which Ksolve::skipTick relies on.
+			if ( r > 1.0 && ( !isLast || h * r > h_ ) )
+				h_ = h * r;
+		} else if ( !isLast ) {
+			h_ = h;
+		}
+	}
+	updateFuncs( y, t1 );
+}
+
 ///////////////////////////////////////////////////////////////////////
 // Here are the internal reaction rate calculation functions
 ///////////////////////////////////////////////////////////////////////
@@ -142,13 +430,10 @@ void VoxelPools::updateAllRateTerms( const vector< RateTerm* >& rates,
 		delete( rates_[i] );
 
 	rates_.resize( rates.size() );
-	for ( unsigned int i = 0; i < numCoreRates; ++i )
-		rates_[i] = rates[i]->copyWithVolScaling( getVolume(), 1, 1 );
-	for ( unsigned int i = numCoreRates; i < rates.size(); ++i ) {
-		rates_[i] = rates[i]->copyWithVolScaling(  getVolume(), 
-				getXreacScaleSubstrates(i - numCoreRates),
-				getXreacScaleProducts(i - numCoreRates ) );
-	}
+	for ( unsigned int i = 0; i < rates.size(); ++i )
+		rates_[i] = copyRateTerm( rates, numCoreRates, i );
+	updateAllFuncTerms();
+	buildKernel();
 }
 
 void VoxelPools::updateRateTerms( const vector< RateTerm* >& rates,
@@ -159,41 +444,278 @@ void VoxelPools::updateRateTerms( const vector< RateTerm* >& rates,
  	if ( index >= rates_.size() )
 		return;
 	delete( rates_[index] );
-	if ( index >= numCoreRates )
-		rates_[index] = rates[index]->copyWithVolScaling(
-				getVolume(), 
-				getXreacScaleSubstrates(index - numCoreRates),
-				getXreacScaleProducts(index - numCoreRates ) );
-	else
-		rates_[index] = rates[index]->copyWithVolScaling(  
-				getVolume(), 1.0, 1.0 );
+	rates_[index] = copyRateTerm( rates, numCoreRates, index );
+	buildKernel();
+}
+
+RateTerm* VoxelPools::copyRateTerm( const vector< RateTerm* >& rates,
+			unsigned int numCoreRates, unsigned int index ) const
+{
+	double sub = 1.0;
+	double prd = 1.0;
+	if ( index >= numCoreRates ) {
+		sub = getXreacScaleSubstrates( index - numCoreRates );
+		prd = getXreacScaleProducts( index - numCoreRates );
+	}
+	RateTerm* ref = rates[index];
+	if ( 2 * index + 1 >= rateParams_.size() )
+		return ref->copyWithVolScaling( getVolume(), sub, prd );
+	// The override goes onto a copy, leaving the Stoich's term alone.
+	// A volume of 1 / NA leaves the copy unscaled, so the override is
+	// then scaled the same way as the reference values.
+	RateTerm* temp = ref->copyWithVolScaling( 1.0 / NA, 1.0, 1.0 );
+	temp->setRates( rateParams_[ 2 * index ], rateParams_[ 2 * index + 1 ] );
+	RateTerm* ret = temp->copyWithVolScaling( getVolume(), sub, prd );
+	delete temp;
+	return ret;
+}
+
+void VoxelPools::setRateParams( const vector< RateTerm* >& rates,
+			unsigned int numCoreRates, const vector< double >& params )
+{
+	rateParams_ = params;
+	updateAllRateTerms( rates, numCoreRates );
+}
+
+vector< double > VoxelPools::getRateParams( 
+				const vector< RateTerm* >& rates ) const
+{
+	if ( rateParams_.size() == 2 * rates.size() )
+		return rateParams_;
+	vector< double > ret( 2 * rates.size() );
+	for ( unsigned int i = 0; i < rates.size(); ++i ) {
+		ret[ 2 * i ] = rates[i]->getR1();
+		ret[ 2 * i + 1 ] = rates[i]->getR2();
+	}
+	return ret;
+}
+
+void VoxelPools::rateTermsChanged()
+{
+	buildKernel();
+}
+
+void VoxelPools::buildKernel()
+{
+	if ( !stoichPtr_ )
+		return;
+	kernel_.build( rates_, stoichPtr_->getStoichiometryMatrix(),
+		stoichPtr_->getNumVarPools() + stoichPtr_->getNumProxyPools() );
+	buildSensitivityTerms();
 }
 
 void VoxelPools::updateRates( const double* s, double* yprime ) const
+{
+	assert( kernel_.numRates() == rates_.size() );
+	kernel_.updateRates( s, yprime, 
+		stoichPtr_->getNumAllPools() + stoichPtr_->getNumProxyPools() );
+}
+
+/**
+ * The Jacobian is J = N.dv/ds. We first gather the nonzero entries of 
+ * dv/ds for each rate term, then go along each row of N and scatter 
+ * them into the row of J.
+ */
+void VoxelPools::updateJacobian( const double* s, double* dfdy, 
+				unsigned int dim ) const
 {
 	const KinSparseMatrix& N = stoichPtr_->getStoichiometryMatrix();
-	vector< double > v( N.nColumns(), 0.0 );
-	vector< double >::iterator j = v.begin();
-	// totVar should include proxyPools only if this voxel uses them
+	assert( N.nColumns() == rates_.size() );
 	unsigned int totVar = stoichPtr_->getNumVarPools() + 
 			stoichPtr_->getNumProxyPools();
-	// totVar should include proxyPools if this voxel does not use them
-	unsigned int totInvar = stoichPtr_->getNumBufPools();
-	assert( N.nColumns() == 0 || 
-			N.nRows() == 
-			stoichPtr_->getNumAllPools() + stoichPtr_->getNumProxyPools() );
-	assert( N.nColumns() == rates_.size() );
+	assert( totVar <= dim );
 
-	for ( vector< RateTerm* >::const_iterator
-		i = rates_.begin(); i != rates_.end(); i++) {
-		*j++ = (**i)( s );
-		assert( !std::isnan( *( j-1 ) ) );
+	vector< pair< unsigned int, double > > deriv;
+	vector< unsigned int > derivStart( rates_.size() + 1, 0 );
+	for ( unsigned int i = 0; i < rates_.size(); ++i ) {
+		derivStart[i] = deriv.size();
+		rates_[i]->rateDerivatives( s, deriv );
+	}
+	derivStart[ rates_.size() ] = deriv.size();
+
+	for ( unsigned int i = 0; i < dim * dim; ++i )
+		dfdy[i] = 0.0;
+
+	for ( unsigned int i = 0; i < totVar; ++i ) {
+		const int* entry = 0;
+		const unsigned int* colIndex = 0;
+		unsigned int numEntries = N.getRow( i, &entry, &colIndex );
+		double* row = dfdy + i * dim;
+		for ( unsigned int j = 0; j < numEntries; ++j ) {
+			unsigned int r = colIndex[j];
+			for ( unsigned int k = derivStart[r]; k < derivStart[r+1]; ++k ){
+				assert( deriv[k].first < dim );
+				row[ deriv[k].first ] += entry[j] * deriv[k].second;
+			}
+		}
 	}
+	// Rows for buffered pools stay zero, matching updateRates.
+}
+
+///////////////////////////////////////////////////////////////////////
+// Forward sensitivities. Each s_j = dn/dp_j obeys
+// ds_j/dt = J s_j + df/dp_j, with J the Jacobian of the rates. 
+///////////////////////////////////////////////////////////////////////
 
-	for (unsigned int i = 0; i < totVar; ++i)
-		*yprime++ = N.computeRowRate( i , v );
-	for (unsigned int i = 0; i < totInvar ; ++i)
-		*yprime++ = 0.0;
+void VoxelPools::setSensitivityParams( const vector< unsigned int >& params )
+{
+	sensParams_ = params;
+	buildSensitivityTerms();
+	if ( stoichPtr_ )
+		sens_.assign( sensParams_.size() * dimension(), 0.0 );
+}
+
+const vector< double >& VoxelPools::getSensitivity() const
+{
+	return sens_;
+}
+
+void VoxelPools::buildSensitivityTerms()
+{
+	sensScale_.clear();
+	sensStoich_.clear();
+	if ( sensParams_.empty() || !stoichPtr_ )
+		return;
+	const vector< RateTerm* >& rates = stoichPtr_->getRateTerms();
+	if ( rates.size() != rates_.size() ) // Not set up yet.
+		return;
+	unsigned int numCore = stoichPtr_->getNumCoreRates();
+	const KinSparseMatrix& N = stoichPtr_->getStoichiometryMatrix();
+	unsigned int totVar = stoichPtr_->getNumVarPools() + 
+			stoichPtr_->getNumProxyPools();
+
+	// The volume scaling of R1 and R2 is linear in the parameter, so
+	// the scale is read off a copy with the parameter set to 1.
+	vector< double > params = getRateParams( rates );
+	vector< double > saved = rateParams_;
+	sensStoich_.resize( sensParams_.size() );
+	for ( unsigned int j = 0; j < sensParams_.size(); ++j ) {
+		unsigned int q = sensParams_[j];
+		assert( q < params.size() );
+		unsigned int r = q / 2;
+		rateParams_ = params;
+		rateParams_[q] = 1.0;
+		RateTerm* unit = copyRateTerm( rates, numCore, r );
+		sensScale_.push_back( ( q % 2 == 0 ) ? unit->getR1() : unit->getR2() );
+		delete unit;
+		for ( unsigned int i = 0; i < totVar; ++i ) {
+			int n = N.get( i, r );
+			if ( n != 0 )
+				sensStoich_[j].push_back( 
+						pair< unsigned int, int >( i, n ) );
+		}
+	}
+	rateParams_ = saved;
+}
+
+void VoxelPools::paramDerivative( const double* s, unsigned int j,
+				double* dfdp ) const
+{
+	unsigned int q = sensParams_[j];
+	double dR1;
+	double dR2;
+	rates_[ q / 2 ]->paramDerivatives( s, dR1, dR2 );
+	double dv = ( ( q % 2 == 0 ) ? dR1 : dR2 ) * sensScale_[j];
+	const vector< pair< unsigned int, int > >& col = sensStoich_[j];
+	for ( unsigned int i = 0; i < col.size(); ++i )
+		dfdp[ col[i].first ] += col[i].second * dv;
+}
+
+/**
+ * LU factorization of the dense n * n row-major matrix a in place, with
+ * partial pivoting. Returns false if a is singular.
+ */
+static bool luFactor( double* a, unsigned int n, unsigned int* pivot )
+{
+	for ( unsigned int k = 0; k < n; ++k ) {
+		unsigned int p = k;
+		for ( unsigned int i = k + 1; i < n; ++i )
+			if ( fabs( a[ i * n + k ] ) > fabs( a[ p * n + k ] ) )
+				p = i;
+		pivot[k] = p;
+		if ( a[ p * n + k ] == 0.0 )
+			return false;
+		if ( p != k )
+			for ( unsigned int j = 0; j < n; ++j )
+				swap( a[ k * n + j ], a[ p * n + j ] );
+		for ( unsigned int i = k + 1; i < n; ++i ) {
+			double f = a[ i * n + k ] /= a[ k * n + k ];
+			if ( f == 0.0 )
+				continue;
+			for ( unsigned int j = k + 1; j < n; ++j )
+				a[ i * n + j ] -= f * a[ k * n + j ];
+		}
+	}
+	return true;
+}
+
+/// Solves a x = b in place in b, using the factors from luFactor.
+static void luSolve( const double* a, unsigned int n, 
+				const unsigned int* pivot, double* b )
+{
+	for ( unsigned int k = 0; k < n; ++k ) {
+		swap( b[k], b[ pivot[k] ] );
+		for ( unsigned int i = k + 1; i < n; ++i )
+			b[i] -= a[ i * n + k ] * b[k];
+	}
+	for ( unsigned int k = n; k > 0; --k ) {
+		unsigned int i = k - 1;
+		for ( unsigned int j = i + 1; j < n; ++j )
+			b[i] -= a[ i * n + j ] * b[j];
+		b[i] /= a[ i * n + i ];
+	}
+}
+
+void VoxelPools::advanceSensitivity( double t0, double t1 )
+{
+	double h = t1 - t0;
+	if ( h <= 0.0 || sensScale_.size() != sensParams_.size() )
+		return;
+	unsigned int dim = dimension();
+	unsigned int num = sensParams_.size();
+	const double* y0 = &sensY0_[0];
+	const double* y1 = S();
+	sensJac_.resize( dim * dim );
+	sensRhs_.assign( dim * num, 0.0 );
+	sensPivot_.resize( dim );
+
+	// Right hand side: s + h/2 ( J(y0) s + df/dp(y0) + df/dp(y1) )
+	updateJacobian( y0, &sensJac_[0], dim );
+	for ( unsigned int j = 0; j < num; ++j ) {
+		double* rhs = &sensRhs_[ j * dim ];
+		const double* s = &sens_[ j * dim ];
+		paramDerivative( y0, j, rhs );
+		paramDerivative( y1, j, rhs );
+		for ( unsigned int i = 0; i < dim; ++i ) {
+			const double* row = &sensJac_[ i * dim ];
+			double js = 0.0;
+			for ( unsigned int k = 0; k < dim; ++k )
+				js += row[k] * s[k];
+			rhs[i] = s[i] + 0.5 * h * ( js + rhs[i] );
+		}
+	}
+
+	// Left hand side: ( I - h/2 J(y1) ) s'
+	updateJacobian( y1, &sensJac_[0], dim );
+	for ( unsigned int i = 0; i < dim * dim; ++i )
+		sensJac_[i] *= -0.5 * h;
+	for ( unsigned int i = 0; i < dim; ++i )
+		sensJac_[ i * dim + i ] += 1.0;
+	if ( luFactor( &sensJac_[0], dim, &sensPivot_[0] ) ) {
+		for ( unsigned int j = 0; j < num; ++j )
+			luSolve( &sensJac_[0], dim, &sensPivot_[0], 
+							&sensRhs_[ j * dim ] );
+	} else {
+		// The sensitivities are undefined from here on.
+		if ( !isSensSingular_ )
+			cout << "Warning: VoxelPools::advanceSensitivity: singular "
+				"matrix at time " << t1 << ", sensitivities are NaN "
+				"until reinit\n";
+		isSensSingular_ = true;
+		sensRhs_.assign( sensRhs_.size(), 
+						numeric_limits< double >::quiet_NaN() );
+	}
+	sens_.swap( sensRhs_ );
 }
 
 /**
@@ -218,6 +740,11 @@ void VoxelPools::updateReacVelocities(
 	}
 }
 
+const vector< RateTerm* >& VoxelPools::getRateTerms() const
+{
+	return rates_;
+}
+
 /// For debugging: Print contents of voxel pool
 void VoxelPools::print() const
 {
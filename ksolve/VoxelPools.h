@@ -33,16 +33,43 @@ class VoxelPools: public VoxelPoolsBase
 		 */
 		void setStoich( Stoich* stoich, const OdeSystem* ode );
 
-		/// Do the numerical integration. Advance the simulation.
+		/**
+		 * Do the numerical integration. Advance the simulation.
+		 * The built-in methods ee, rk4fixed and rkf45 are done here
+		 * directly on S, the others by the GSL driver.
+		 */
 		void advance( const ProcInfo* p );
 
+		/// True if the method is one of the built-in integrators.
+		static bool isBuiltinMethod( const string& method );
+
 		/// Set initial timestep to use by the solver.
 		void setInitDt( double dt );
 
+		/**
+		 * Step size that the solver will try next, as chosen by its
+		 * error control. 0 if there is no solver.
+		 */
+		double getStepSize() const;
+
+		/// Number of steps taken since reinit, not counting rejects.
+		unsigned int getNumSteps() const;
+
+		/// Number of steps rejected by the error control since reinit.
+		unsigned int getNumFailedSteps() const;
+
 		/// This is the function which evaluates the rates.
 		static int gslFunc( double t, const double* y, double *dydt, 
 						void* params );
 
+		/**
+		 * This evaluates the Jacobian, for use by the implicit
+		 * methods. dfdy is a dense row-major matrix of size
+		 * dimension * dimension, and dfdt is zero.
+		 */
+		static int gslJacobian( double t, const double* y, double* dfdy,
+						double* dfdt, void* params );
+
 		//////////////////////////////////////////////////////////////////
 		// Rate manipulation and calculation functions
 		//////////////////////////////////////////////////////////////////
@@ -67,6 +94,15 @@ class VoxelPools: public VoxelPoolsBase
 		 */
 		void updateRates( const double* s, double* yprime ) const;
 
+		/**
+		 * Computes the Jacobian d(yprime)/ds into the dense row-major
+		 * array dfdy, of size dim * dim. It is assembled analytically 
+		 * from the stoichiometry matrix and the derivatives of each 
+		 * RateTerm, so no extra rate evaluations are needed.
+		 */
+		void updateJacobian( const double* s, double* dfdy, 
+						unsigned int dim ) const;
+
 		/**
 		 * updateReacVelocities computes the velocity *v* of each reaction
 		 * from the vector *s* of pool #s.
@@ -76,14 +112,160 @@ class VoxelPools: public VoxelPoolsBase
 		void updateReacVelocities( 
 						const double* s, vector< double >& v ) const;
 
+		/**
+		 * Overrides R1 and R2 of the rate terms of this voxel, so that
+		 * each voxel can have its own parameters. params holds R1 and
+		 * R2 of each rate term in turn, in the units of the reference
+		 * rates. Empty to go back to the reference values.
+		 */
+		void setRateParams( const vector< RateTerm* >& rates,
+			unsigned int numCoreRates, const vector< double >& params );
+
+		/// Returns R1 and R2 of each rate term, as for setRateParams.
+		vector< double > getRateParams( 
+						const vector< RateTerm* >& rates ) const;
+
+		/**
+		 * Sets up forward sensitivities of all pools to the listed rate
+		 * parameters, numbered 2 * rate + 0 for R1 and 2 * rate + 1
+		 * for R2 of each rate term of the Stoich. They are zero at
+		 * reinit and are advanced along with S. Empty turns them off.
+		 */
+		void setSensitivityParams( const vector< unsigned int >& params );
+
+		/**
+		 * Returns dn/dp of all the pools for each sensitivity parameter
+		 * in turn, laid out as [param][pool]. p is in the units of the
+		 * Stoich rates.
+		 */
+		const vector< double >& getSensitivity() const;
+
+		/// Returns the volume-scaled rate terms of this voxel.
+		const vector< RateTerm* >& getRateTerms() const;
+
 		/**
 		 * Changes cross rate terms to zero if there is no junction
 		void filterCrossRateTerms( const vector< pair< Id, Id > >& vec );
 		 */
 
+		/// Rebuilds the kernel after filterCrossRateTerms.
+		void rateTermsChanged();
+
 		/// Used for debugging.
 		void print() const;
 	private:
+		/// Rebuilds kernel_ following any change in the rates_ vector.
+		void buildKernel();
+
+		/**
+		 * Returns a volume-scaled copy of rates[index], using the 
+		 * override in rateParams_ if there is one.
+		 */
+		RateTerm* copyRateTerm( const vector< RateTerm* >& rates,
+			unsigned int numCoreRates, unsigned int index ) const;
+
+		/// Number of state variables seen by the integrators.
+		unsigned int dimension() const;
+
+		/// Assigns func pools in y and evaluates dydt at time t.
+		void evalRates( double t, double* y, double* dydt );
+
+		/// Advances S from t0 to t1 by the selected method.
+		void advanceState( double t0, double t1 );
+
+		/**
+		 * Exponential Euler: each pool relaxes exponentially toward
+		 * prod / ( loss / y ) over each step of h_. Only first order
+		 * accurate, and pools linked by reactions much faster than h_
+		 * can overshoot each other from step to step.
+		 */
+		void advanceExpEuler( double t0, double t1 );
+
+		/// Classical Runge-Kutta, with steps of h_ or a bit less.
+		void advanceRk4( double t0, double t1 );
+
+		/// Runge-Kutta-Fehlberg (4,5) with error control on h_.
+		void advanceRkf45( double t0, double t1 );
+
+		/// One RKF45 step from S into yTemp_. Returns the scaled error.
+		double rkf45Step( double t, double h );
+
+		/// Number of equal steps, none longer than h_, spanning dt.
+		unsigned int numFixedSteps( double dt ) const;
+
+		/**
+		 * Finds the volume scaling from each sensitivity parameter to
+		 * the R1 or R2 of this voxel's rate term, and the stoichiometry
+		 * of that rate term. Done whenever rates_ changes.
+		 */
+		void buildSensitivityTerms();
+
+		/**
+		 * Computes df/dp for sensitivity parameter j at s, from the
+		 * analytic RateTerm::paramDerivatives.
+		 */
+		void paramDerivative( const double* s, unsigned int j, 
+						double* dfdp ) const;
+
+		/**
+		 * Advances sens_ from t0 to t1, with S going from sensY0_ to
+		 * its present value. Uses the trapezoidal rule with the 
+		 * Jacobian at both ends, which is stable for stiff systems.
+		 * This is a single step with no error control of its own, so 
+		 * advance calls it once per step of the integrator, and its
+		 * accuracy follows from epsAbs and epsRel only through that 
+		 * step size. If the matrix is singular, warns and sets sens_
+		 * to NaN.
+		 */
+		void advanceSensitivity( double t0, double t1 );
+
+		/**
+		 * Flattened form of rates_ and the stoichiometry matrix, used
+		 * by updateRates.
+		 */
+		RateKernel kernel_;
+
+		/// Overrides of R1 and R2 of each rate term. Usually empty.
+		vector< double > rateParams_;
+
+		/// Integration method, as in OdeSystem.
+		string method_;
+
+		/// Step size of the built-in methods.
+		double h_;
+
+		/// Error tolerances of the rkf45 method.
+		double epsAbs_;
+		double epsRel_;
+
+		/// Steps taken and rejected by the built-in methods since reinit.
+		unsigned int numSteps_;
+		unsigned int numFailedSteps_;
+
+		/// Sensitivity parameters, as in setSensitivityParams.
+		vector< unsigned int > sensParams_;
+
+		/// d(R1 or R2 of this voxel) / dp for each sensitivity parameter.
+		vector< double > sensScale_;
+
+		/// Stoichiometry of the rate term of each parameter.
+		vector< vector< pair< unsigned int, int > > > sensStoich_;
+
+		/// Sensitivities dn/dp, as [param][pool].
+		vector< double > sens_;
+
+		/// Workspace for advanceSensitivity.
+		vector< double > sensY0_;
+		vector< double > sensJac_;
+		vector< double > sensRhs_;
+		vector< unsigned int > sensPivot_;
+
+		/// Set once the sensitivity matrix has been singular.
+		bool isSensSingular_;
+
+		/// Workspace for the built-in methods, sized in setStoich.
+		vector< double > yTemp_;
+		vector< double > k_[6];
 #ifdef USE_GSL
 		gsl_odeiv2_driver* driver_;
 		gsl_odeiv2_system sys_;
@@ -26,12 +26,16 @@ VoxelPoolsBase::VoxelPoolsBase()
 	: 
 		stoichPtr_( 0 ),
 		S_(1),
+		sharedS_( 0 ),
 		Sinit_(1),
 		volume_(1.0)
 {;}
 
 VoxelPoolsBase::~VoxelPoolsBase()
-{}
+{
+	for ( unsigned int i = 0; i < funcs_.size(); ++i )
+		delete funcs_[i];
+}
 
 //////////////////////////////////////////////////////////////
 // Array ops
@@ -39,13 +43,59 @@ VoxelPoolsBase::~VoxelPoolsBase()
 /// Using the computed array sizes, now allocate space for them.
 void VoxelPoolsBase::resizeArrays( unsigned int totNumPools )
 {
+	if ( totNumPools != S_.size() ) // The shared slot no longer fits.
+		shareS( 0 );
 	S_.resize( totNumPools, 0.0 );
 	Sinit_.resize( totNumPools, 0.0);
 }
 
 void VoxelPoolsBase::reinit()
 {
-	S_ = Sinit_;
+	copy( Sinit_.begin(), Sinit_.end(), varS() );
+}
+
+void VoxelPoolsBase::shareS( double* s )
+{
+	if ( s == sharedS_ )
+		return;
+	if ( sharedS_ )
+		copy( sharedS_, sharedS_ + S_.size(), S_.begin() );
+	sharedS_ = s;
+	if ( sharedS_ )
+		copy( S_.begin(), S_.end(), sharedS_ );
+}
+
+bool VoxelPoolsBase::isSharedS() const
+{
+	return sharedS_ != 0;
+}
+
+void VoxelPoolsBase::updateAllFuncTerms()
+{
+	for ( unsigned int i = 0; i < funcs_.size(); ++i )
+		delete funcs_[i];
+	funcs_.clear();
+	if ( !stoichPtr_ )
+		return;
+	// Entries stay at the same index as in the Stoich, including the
+	// empty ones, so that funcs_[i] is this voxel's copy of funcs( i ).
+	funcs_.resize( stoichPtr_->getNumFuncs(), 0 );
+	for ( unsigned int i = 0; i < funcs_.size(); ++i ) {
+		const FuncTerm* f = stoichPtr_->funcs( i );
+		if ( f ) {
+			FuncTerm* ft = new FuncTerm();
+			*ft = *f; // Points the copied parser at the new arguments.
+			funcs_[i] = ft;
+		}
+	}
+}
+
+void VoxelPoolsBase::updateFuncs( double* s, double t ) const
+{
+	for ( vector< FuncTerm* >::const_iterator i = funcs_.begin();
+					i != funcs_.end(); ++i )
+		if ( *i )
+			(*i)->evalPool( s, t );
 }
 
 //////////////////////////////////////////////////////////////
@@ -53,17 +103,12 @@ void VoxelPoolsBase::reinit()
 //////////////////////////////////////////////////////////////
 const double* VoxelPoolsBase::S() const
 {
-	return &S_[0];
-}
-
-vector< double >& VoxelPoolsBase::Svec()
-{
-	return S_;
+	return sharedS_ ? sharedS_ : &S_[0];
 }
 
 double* VoxelPoolsBase::varS()
 {
-	return &S_[0];
+	return sharedS_ ? sharedS_ : &S_[0];
 }
 
 const double* VoxelPoolsBase::Sinit() const
@@ -99,8 +144,9 @@ void VoxelPoolsBase::setVolumeAndDependencies( double vol )
 					i = Sinit_.begin(); i != Sinit_.end(); ++i )
 		*i *= ratio;
 
-	for ( vector< double >::iterator i = S_.begin(); i != S_.end(); ++i )
-		*i *= ratio;
+	double* s = varS();
+	for ( unsigned int i = 0; i < S_.size(); ++i )
+		s[i] *= ratio;
 
 	// I would like to update the xReacScaleSubstreates and Products here,
 	// but I don't know the order of their reactions. So leave it to
@@ -113,14 +159,12 @@ void VoxelPoolsBase::setVolumeAndDependencies( double vol )
 
 void VoxelPoolsBase::setN( unsigned int i, double v )
 {
-	S_[i] = v;
-	if ( S_[i] < 0.0 ) 
-		S_[i] = 0.0;
+	varS()[i] = ( v < 0.0 ) ? 0.0 : v;
 }
 
 double VoxelPoolsBase::getN( unsigned int i ) const
 {
-	return S_[i];
+	return S()[i];
 }
 
 void VoxelPoolsBase::setNinit( unsigned int i, double v )
@@ -157,9 +201,10 @@ void VoxelPoolsBase::xferIn(
 	unsigned int offset = voxelIndex * poolIndex.size();
 	vector< double >::const_iterator i = values.begin() + offset;
 	vector< double >::const_iterator j = lastValues.begin() + offset;
+	double* s = varS();
 	for ( vector< unsigned int >::const_iterator 
 			k = poolIndex.begin(); k != poolIndex.end(); ++k ) {
-		S_[*k] += *i++ - *j++;
+		s[*k] += *i++ - *j++;
 	}
 }
 
@@ -171,10 +216,11 @@ void VoxelPoolsBase::xferInOnlyProxies(
 {
 	unsigned int offset = voxelIndex * poolIndex.size();
 	vector< double >::const_iterator i = values.begin() + offset;
+	double* s = varS();
 	for ( vector< unsigned int >::const_iterator 
 			k = poolIndex.begin(); k != poolIndex.end(); ++k ) {
 		if ( *k >= S_.size() - numProxyPools ) {
-			Sinit_[*k] = S_[*k] += *i;
+			Sinit_[*k] = s[*k] += *i;
 		}
 		i++;
 	}
@@ -187,9 +233,10 @@ void VoxelPoolsBase::xferOut(
 {
 	unsigned int offset = voxelIndex * poolIndex.size();
 	vector< double >::iterator i = values.begin() + offset;
+	const double* s = S();
 	for ( vector< unsigned int >::const_iterator 
 			k = poolIndex.begin(); k != poolIndex.end(); ++k ) {
-		*i++ = S_[*k];
+		*i++ = s[*k];
 	}
 }
 
@@ -314,8 +361,12 @@ void VoxelPoolsBase::filterCrossRateTerms(
 			}
 		}
 	}
+	rateTermsChanged();
 }
 
+void VoxelPoolsBase::rateTermsChanged()
+{;}
+
 ////////////////////////////////////////////////////////////////////////
 void VoxelPoolsBase::print() const
 {
@@ -19,6 +19,7 @@
  * located on other compartments.
  */
 class RateTerm;
+class FuncTerm;
 class Stoich;
 class VoxelPoolsBase
 {
@@ -43,9 +44,6 @@ class VoxelPoolsBase
 		 */
 		const double* S() const;
 
-		/// Returns a handle to the mol # vector.
-		vector< double >& Svec();
-
 		/**
 		 * Returns the array of doubles of current mol #s at the specified
 		 * mesh index. Dangerous, allows one to modify the values.
@@ -64,6 +62,17 @@ class VoxelPoolsBase
 		 */
 		double* varSinit();
 
+		/**
+		 * Moves S into s, a slot of size() entries in a store shared 
+		 * with the other voxels of the solver, and works on it there 
+		 * from now on. s = 0 copies S back into the voxel's own array.
+		 * See ZombiePoolInterface::stateBlock.
+		 */
+		void shareS( double* s );
+
+		/// True when S lives in a shared store.
+		bool isSharedS() const;
+
 		/**
 		 * Assigns S = Sinit and sets up initial dt. 
 		 */
@@ -112,6 +121,13 @@ class VoxelPoolsBase
 		 */
 		void filterCrossRateTerms( const vector< Id >& offSolverReacs, const vector< pair< Id, Id > >& offSolverReacCompts );
 
+		/**
+		 * Called after entries of rates_ have been replaced in place,
+		 * so that derived classes can rebuild anything they made from
+		 * the rate terms. Does nothing here.
+		 */
+		virtual void rateTermsChanged();
+
 		//////////////////////////////////////////////////////////////////
 		// Functions to handle cross-compartment reactions.
 		//////////////////////////////////////////////////////////////////
@@ -194,12 +210,24 @@ class VoxelPoolsBase
 		 */
 		double getXreacScaleProducts( unsigned int i ) const;
 
+		/**
+		 * Replaces the FuncTerms of this voxel with copies of those in
+		 * the Stoich. Like the rates_, each voxel has its own, so that
+		 * voxels can be advanced on different threads. funcs_[i] is the
+		 * copy of Stoich::funcs( i ), and is zero where that is.
+		 */
+		void updateAllFuncTerms();
+
+		/// Evaluates the FuncTerms of this voxel on s, at time t.
+		void updateFuncs( double* s, double t ) const;
+
 		/// Debugging utility
 		void print() const;
 
 	protected:
 		const Stoich* stoichPtr_;
 		vector< RateTerm* > rates_;
+		vector< FuncTerm* > funcs_;
 
 	private:
 		/**
@@ -219,6 +247,12 @@ class VoxelPoolsBase
 		 */
 		vector< double > S_;
 
+		/**
+		 * When set, S lives here in the shared store, and S_ only keeps
+		 * the allocation for when the voxel stops sharing.
+		 */
+		double* sharedS_;
+
 		/**
 		 * Sinit_ specifies initial conditions at t = 0. Whenever the reac
 		 * system is rebuilt or reinited, all S_ values become set to Sinit.
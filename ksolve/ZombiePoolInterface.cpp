@@ -31,9 +31,47 @@
 
 ZombiePoolInterface::ZombiePoolInterface()
 		: stoich_(), compartment_(),
-		isBuilt_( false )
+		isBuilt_( false ),
+		stateStride_( 0 )
 {;}
 
+//////////////////////////////////////////////////////////////////////////
+// Shared state store.
+//////////////////////////////////////////////////////////////////////////
+double* ZombiePoolInterface::stateBlock( unsigned int& stride )
+{
+	unsigned int numVoxels = getNumLocalVoxels();
+	stride = ( numVoxels > 0 ) ? pools( 0 )->size() : 0;
+	if ( state_.size() != numVoxels * stride )
+		unshareState(); // The voxels have changed since it was built.
+	if ( stride == 0 )
+		return 0;
+	if ( state_.empty() ) {
+		state_.resize( numVoxels * stride );
+		stateStride_ = stride;
+		for ( unsigned int i = 0; i < numVoxels; ++i ) {
+			assert( pools( i )->size() == stride );
+			pools( i )->shareS( &state_[ i * stride ] );
+		}
+	}
+	return &state_[0];
+}
+
+void ZombiePoolInterface::unshareState()
+{
+	if ( state_.empty() )
+		return;
+	for ( unsigned int i = 0; i < getNumLocalVoxels(); ++i ) {
+		VoxelPoolsBase* vp = pools( i );
+		// Only voxels still in their slot take their state back.
+		if ( i * stateStride_ < state_.size() && 
+						vp->S() == &state_[ i * stateStride_ ] )
+			vp->shareS( 0 );
+	}
+	state_.clear();
+	stateStride_ = 0;
+}
+
 //////////////////////////////////////////////////////////////////////////
 // cross-compartment reaction stuff.
 //////////////////////////////////////////////////////////////////////////
@@ -286,6 +324,11 @@ void ZombiePoolInterface::matchJunctionVols( vector< double >& vols, Id otherCom
 	}
 }
 
+unsigned int ZombiePoolInterface::getNumXfer() const
+{
+	return xfer_.size();
+}
+
 /**
  * This function builds cross-solver reaction volume scaling. 
  */
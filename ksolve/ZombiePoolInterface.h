@@ -40,7 +40,21 @@ class ZombiePoolInterface
 		/// Used only in Dsolves, so here I put in a dummy.
 		virtual void setMotorConst( const Eref& e, double val )
 		{;}
+		/**
+		 * Tells a Dsolve to diffuse the pool state of the given reac
+		 * solver in place, instead of keeping its own copy and trading
+		 * blocks with it every step. The Dsolve works on the store
+		 * returned by the reac solver's stateBlock. 
+		 * Id() turns sharing off.
+		 * Used only in Dsolves, so here I put in a dummy.
+		 */
+		virtual void setSharedState( Id owner )
+		{;}
 
+		/// Advances the solver by p->dt. Lets a ReacDiff drive solvers.
+		virtual void process( const Eref& e, ProcPtr p ) = 0;
+		/// Reinitializes the solver.
+		virtual void reinit( const Eref& e, ProcPtr p ) = 0;
 		/// Specifies number of pools (species) handled by system.
 		virtual void setNumPools( unsigned int num ) = 0;
 		/// gets number of pools (species) handled by system.
@@ -134,6 +148,22 @@ class ZombiePoolInterface
 			Id otherComptId );
 		void matchJunctionVols( vector< double >& vols, Id otherComptId )
 				const;
+		/// Number of other solvers with which this exchanges molecules.
+		unsigned int getNumXfer() const;
+
+		/**
+		 * Returns the shared state store of a reac solver: one array
+		 * holding the S of every local voxel, laid out as
+		 * state[ voxel * stride + pool ]. Entries 0 to numVarPools-1 of
+		 * each voxel hold n for the pools in Stoich order, which is also
+		 * the pool order of the Dsolve, and voxel numbering is the same
+		 * in both. The voxels integrate in their slots of the store, so
+		 * the Dsolve reads and writes it in place.
+		 * The store is built, and the voxels moved into it, on the first
+		 * call after the voxels have changed. Returns 0 if there are no
+		 * voxels or pools.
+		 */
+		double* stateBlock( unsigned int& stride );
 		
 		//////////////////////////////////////////////////////////////
 	protected:
@@ -154,6 +184,20 @@ class ZombiePoolInterface
 
 		/// Flag: True when solver setup has been completed.
 		bool isBuilt_;
+
+		/**
+		 * Moves the voxels back to their own S arrays and empties the
+		 * store. Must be called before the voxels are resized or made
+		 * afresh, while the store still holds their state.
+		 */
+		void unshareState();
+
+	private:
+		/// The shared state store, see stateBlock.
+		vector< double > state_;
+
+		/// Number of entries per voxel in state_.
+		unsigned int stateStride_;
 };
 
 #endif	// _ZOMBIE_POOL_INTERFACE_H
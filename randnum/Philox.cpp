@@ -0,0 +1,130 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2015 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#include "Philox.h"
+
+static const uint32_t PHILOX_M0 = 0xD2511F53;
+static const uint32_t PHILOX_M1 = 0xCD9E8D57;
+static const uint32_t PHILOX_W0 = 0x9E3779B9; // Golden ratio
+static const uint32_t PHILOX_W1 = 0xBB67AE85; // sqrt( 3 ) - 1
+
+Philox::Philox()
+{
+	setSeed( 0, 0 );
+}
+
+Philox::Philox( uint64_t seed, uint64_t stream )
+{
+	setSeed( seed, stream );
+}
+
+void Philox::setSeed( uint64_t seed, uint64_t stream )
+{
+	key_[0] = static_cast< uint32_t >( seed );
+	key_[1] = static_cast< uint32_t >( seed >> 32 );
+	counter_[0] = 0;
+	counter_[1] = 0;
+	counter_[2] = static_cast< uint32_t >( stream );
+	counter_[3] = static_cast< uint32_t >( stream >> 32 );
+	index_ = 4;
+}
+
+void Philox::generate()
+{
+	uint32_t c0 = counter_[0];
+	uint32_t c1 = counter_[1];
+	uint32_t c2 = counter_[2];
+	uint32_t c3 = counter_[3];
+	uint32_t k0 = key_[0];
+	uint32_t k1 = key_[1];
+	for ( unsigned int round = 0; round < 10; ++round ) {
+		uint64_t p0 = static_cast< uint64_t >( PHILOX_M0 ) * c0;
+		uint64_t p1 = static_cast< uint64_t >( PHILOX_M1 ) * c2;
+		uint32_t hi0 = static_cast< uint32_t >( p0 >> 32 );
+		uint32_t lo0 = static_cast< uint32_t >( p0 );
+		uint32_t hi1 = static_cast< uint32_t >( p1 >> 32 );
+		uint32_t lo1 = static_cast< uint32_t >( p1 );
+		c0 = hi1 ^ c1 ^ k0;
+		c1 = lo1;
+		c2 = hi0 ^ c3 ^ k1;
+		c3 = lo0;
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+	buffer_[0] = c0;
+	buffer_[1] = c1;
+	buffer_[2] = c2;
+	buffer_[3] = c3;
+	// Step the 64-bit block number.
+	if ( ++counter_[0] == 0 )
+		++counter_[1];
+	index_ = 0;
+}
+
+uint32_t Philox::next()
+{
+	if ( index_ >= 4 )
+		generate();
+	return buffer_[ index_++ ];
+}
+
+double Philox::uniform()
+{
+	return next() * ( 1.0 / 4294967296.0 ); // divided by 2^32, as mtrand
+}
+
+#ifdef DO_UNIT_TESTS
+#include <cassert>
+#include <iostream>
+using namespace std;
+
+/**
+ * Checks the Philox4x32-10 known-answer vectors from Random123, which
+ * set the key and the whole counter, and that the 64-bit block number
+ * carries into its upper word.
+ */
+void testPhilox()
+{
+	static const uint32_t kat[3][10] = {
+		{ 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+			0x00000000, 0x00000000,
+			0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 },
+		{ 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+			0xffffffff, 0xffffffff,
+			0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd },
+		{ 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344,
+			0xa4093822, 0x299f31d0,
+			0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 }
+	};
+	Philox rng;
+	for ( unsigned int i = 0; i < 3; ++i ) {
+		for ( unsigned int j = 0; j < 4; ++j )
+			rng.counter_[j] = kat[i][j];
+		rng.key_[0] = kat[i][4];
+		rng.key_[1] = kat[i][5];
+		rng.index_ = 4;
+		for ( unsigned int j = 0; j < 4; ++j )
+			assert( rng.next() == kat[i][ 6 + j ] );
+		if ( i == 1 ) { // The block number wraps, leaving the stream.
+			assert( rng.counter_[0] == 0 && rng.counter_[1] == 0 );
+			assert( rng.counter_[2] == 0xffffffff );
+		}
+	}
+	assert( rng.counter_[0] == 0x243f6a89 );
+	// The low word of the block number carries into the high word.
+	rng.counter_[0] = 0xffffffff;
+	rng.next();
+	assert( rng.counter_[0] == 0 && rng.counter_[1] == 0x85a308d4 );
+
+	// Seed 0 and stream 0 start on the first vector.
+	rng.setSeed( 0, 0 );
+	assert( rng.next() == kat[0][6] );
+	cout << "." << flush;
+}
+#endif
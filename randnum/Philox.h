@@ -0,0 +1,62 @@
+/**********************************************************************
+** This program is part of 'MOOSE', the
+** Messaging Object Oriented Simulation Environment.
+**           Copyright (C) 2003-2015 Upinder S. Bhalla. and NCBS
+** It is made available under the terms of the
+** GNU Lesser General Public License version 2.1
+** See the file COPYING.LIB for the full notice.
+**********************************************************************/
+
+#ifndef _PHILOX_H
+#define _PHILOX_H
+
+#include <stdint.h>
+
+/**
+ * Counter-based random number generator Philox4x32-10, from Salmon,
+ * Moraes, Dror and Shaw, "Parallel random numbers: as easy as 1, 2, 3",
+ * SC11 (2011).
+ *
+ * Each number is a pure function of a key and a counter, so there is no
+ * hidden global state as in mtrand(). The key is the seed, and the upper
+ * half of the counter is a stream index. Objects that each own a Philox
+ * with the same seed and distinct stream indices get independent
+ * sequences, which do not depend on the order in which the objects are
+ * advanced or on which thread advances them.
+ */
+class Philox
+{
+	friend void testPhilox();
+	public:
+		Philox();
+		Philox( uint64_t seed, uint64_t stream );
+
+		/// Restarts the generator on the given seed and stream.
+		void setSeed( uint64_t seed, uint64_t stream );
+
+		/// Returns the next 32-bit random integer.
+		uint32_t next();
+
+		/// Returns a random number on [0, 1), with 32-bit resolution.
+		double uniform();
+
+	private:
+		/// Applies the ten Philox rounds to counter_, into buffer_.
+		void generate();
+
+		uint32_t key_[2];
+
+		/**
+		 * counter_[0,1] is the block number within the stream, 
+		 * counter_[2,3] is the stream index.
+		 */
+		uint32_t counter_[4];
+
+		/// Four outputs from the last block.
+		uint32_t buffer_[4];
+
+		/// Next unused entry in buffer_. 4 means the buffer is used up.
+		unsigned int index_;
+};
+
+#endif // _PHILOX_H
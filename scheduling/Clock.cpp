@@ -379,6 +379,7 @@ const Cinfo* Clock::initCinfo()
 		"	SymCompartment			4		50e-6\n"
 		"	SpikeGen			5		50e-6\n"
 		"	HSolve				6		50e-6\n"
+		"	HSolvePool			6		50e-6\n"
 		"	SpikeStats			7		50e-6\n"
 		"	Table				8		0.1e-3\n"
 		"	TimeTable			8		0.1e-3\n"
@@ -401,6 +402,7 @@ const Cinfo* Clock::initCinfo()
 		"	Ksolve	(init)			15		0.1\n"
 		"	Gsolve				16		0.1\n"
 		"	Ksolve				16		0.1\n"
+		"	ReacDiff			16		0.1\n"
 		"	Stats				17		0.1\n"
 
 		"	Table2				18		1\n"
@@ -801,6 +803,7 @@ void Clock::buildDefaultTick()
 	defaultTick_["SymCompartment"] = 4; // Uses 'init'
 	defaultTick_["SpikeGen"] = 5;
 	defaultTick_["HSolve"] = 6;
+	defaultTick_["HSolvePool"] = 6;
 	defaultTick_["SpikeStats"] = 7;
 	defaultTick_["Table"] = 8;
 	defaultTick_["TimeTable"] = 8;
@@ -827,6 +830,7 @@ void Clock::buildDefaultTick()
 	defaultTick_["ReacBase"] = 14;
 	defaultTick_["Gsolve"] = 16; // Note this uses an 'init' at t-1
 	defaultTick_["Ksolve"] = 16; // Note this uses an 'init' at t-1
+	defaultTick_["ReacDiff"] = 16;
 	defaultTick_["Stats"] = 17;
 
 	defaultTick_["Table2"] = 18;